@@ -0,0 +1,170 @@
+/* MIT License
+
+Copyright (c) 2023 Yijia Zhang
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+
+
+ * Command line front end of the dvfs log index (loganalyze.c).
+ * Use "make" to compile. Usage:
+ *   ./loganalyze [-g gpu list] [-w windows] dvfs.out ...
+ * Without -w, each log is summarized over its whole time span. With -w, each line "start,end" of the file (- for stdin),
+ * with times as "Y-M-D h:m:s", is a window, e.g. the start and end of a benchmark run. Lines starting with # are skipped.
+ * For each log, window and GPU, a csv line "log,start,end,gpu,samples,util,memutil,power(W),freq(MHz),energy(J)" is printed.
+ * -g restricts the GPUs, comma-separated (default all). The time to index each log is printed to stderr.
+ */
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include "loganalyze.h"
+
+#define MAXGPU 64
+#define MAXWINDOW 1000000
+
+static double nowSec()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static bool parseTime(const char* s, long long* sec)
+{
+    int y, mo, d, h, mi, se;
+    if (sscanf(s, "%d-%d-%d %d:%d:%d", &y, &mo, &d, &h, &mi, &se) != 6)
+        return false;
+    *sec = logIndexTime(y, mo, d, h, mi, se);
+    return true;
+}
+
+static void formatTime(long long sec, char* buf, size_t size)
+{
+    time_t t = (time_t)sec;
+    struct tm tm;
+    gmtime_r(&t, &tm);// the index encodes the calendar time of the log as if it were UTC.
+    strftime(buf, size, "%Y-%m-%d %H:%M:%S", &tm);
+}
+
+static void printWindow(const char* log, const logIndex* index, long long start, long long end, const bool* gpuOn)
+{
+    char startStr[32], endStr[32];
+    logWindow w;
+    int g;
+    formatTime(start, startStr, sizeof(startStr));
+    formatTime(end, endStr, sizeof(endStr));
+    for (g = 0; g < logIndexGpus(index); g++)
+    {
+        if (!gpuOn[g])
+            continue;
+        logIndexQuery(index, start, end, g, &w);
+        printf("%s,%s,%s,%d,%ld,%.2f,%.2f,%.1f,%.f,%.1f\n", log, startStr, endStr, g, w.samples, w.util, w.memUtil, w.power,
+            w.freq, w.energy);
+    }
+}
+
+int main(int argc, char* argv[])
+{
+    bool gpuOn[MAXGPU];
+    long long (*windows)[2] = NULL;
+    long numWindows = 0;
+    const char* windowFile = NULL;
+    char line[256];
+    int opt, g, i;
+    long k;
+
+    for (g = 0; g < MAXGPU; g++)
+        gpuOn[g] = true;
+    while ((opt = getopt(argc, argv, "g:w:")) != -1)
+    {
+        if (opt == 'g')
+        {
+            char* s = strtok(optarg, ",");
+            for (g = 0; g < MAXGPU; g++)
+                gpuOn[g] = false;
+            for (; s != NULL; s = strtok(NULL, ","))
+            {
+                g = atoi(s);
+                if (g >= 0 && g < MAXGPU)
+                    gpuOn[g] = true;
+            }
+        }
+        else if (opt == 'w')
+            windowFile = optarg;
+        else
+        {
+            fprintf(stderr, "Usage: %s [-g gpu list] [-w windows] dvfs.out ...\n", argv[0]);
+            return 1;
+        }
+    }
+    if (optind >= argc)
+    {
+        fprintf(stderr, "Usage: %s [-g gpu list] [-w windows] dvfs.out ...\n", argv[0]);
+        return 1;
+    }
+
+    if (windowFile != NULL)
+    {
+        FILE* f = strcmp(windowFile, "-") == 0 ? stdin : fopen(windowFile, "r");
+        if (f == NULL)
+        {
+            fprintf(stderr, "Cannot open %s: %s\n", windowFile, strerror(errno));
+            return 1;
+        }
+        windows = malloc(MAXWINDOW * sizeof(*windows));
+        while (windows != NULL && numWindows < MAXWINDOW && fgets(line, sizeof(line), f) != NULL)
+        {
+            char* comma = strchr(line, ',');
+            if (line[0] == '#' || comma == NULL)
+                continue;
+            if (!parseTime(line, &windows[numWindows][0]) || !parseTime(comma + 1, &windows[numWindows][1]))
+            {
+                fprintf(stderr, "Skipped window: %s", line);
+                continue;
+            }
+            numWindows++;
+        }
+        if (f != stdin)
+            fclose(f);
+    }
+
+    printf("log,start,end,gpu,samples,util,memutil,power(W),freq(MHz),energy(J)\n");
+    for (i = optind; i < argc; i++)
+    {
+        double t0 = nowSec();
+        logIndex* index = logIndexOpen(argv[i]);
+        if (index == NULL)
+        {
+            fprintf(stderr, "Cannot index %s: %s\n", argv[i], strerror(errno));
+            continue;
+        }
+        fprintf(stderr, "%s: %ld samples of %d GPUs indexed in %.3f s.\n", argv[i], logIndexSamples(index), logIndexGpus(index),
+            nowSec() - t0);
+        if (windowFile == NULL)
+            printWindow(argv[i], index, logIndexFirst(index), logIndexLast(index), gpuOn);
+        for (k = 0; k < numWindows; k++)
+            printWindow(argv[i], index, windows[k][0], windows[k][1], gpuOn);
+        logIndexClose(index);
+    }
+    free(windows);
+    return 0;
+}
@@ -0,0 +1,418 @@
+/* MIT License
+
+Copyright (c) 2023 Yijia Zhang
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+
+
+ * Indexed analysis of dvfs logs, see loganalyze.h.
+ * A sample line of dvfs.c is "Y-M-D h:m:s, " followed by "util, memutil, power, freq, setFreq, " of each GPU and the loop
+ * duration in microseconds. The index keeps one row per second of the log: the loops up to that second, and for each GPU the
+ * running sums of util, mem util, power and frequency up to that second, and of the energy.
+ * The energy integrates the power of each loop over its duration, as postprocessing.windowEnergy() does on a trace. The
+ * log only stamps whole seconds, so the loops of one second share it in proportion to their recorded duration, but at
+ * least evenly (the recorded duration excludes the wait for the next loop). The power of the last loop holds until the next
+ * sample: a second without samples gets a row without loops, whose energy is that power times 1 s. Over a gap of more than
+ * MAXHOLD seconds, the daemon is taken as stopped and nothing is counted.
+ * Sums of integers stay exact in doubles up to 2^53, i.e. far beyond a year of logs.
+ * The rows must be in time order. A line whose second is earlier than the previous one (e.g. after a clock step) counts
+ * toward the previous second.
+ */
+#include <errno.h>
+#include <fcntl.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "loganalyze.h"
+
+#define MAXGPU 64
+#define GPUFIELDS 5// util, memutil, power, freq, setFreq in the log.
+#define MAXHOLD 60// seconds a power sample holds across a gap in the log.
+
+enum logColumn {COL_UTIL = 0, COL_MEMUTIL, COL_POWER, COL_FREQ, COL_ENERGY, NUMCOLS};
+
+struct logIndex_st
+{
+    int numGpus;
+    long rows, cap;
+    long long* secs;// second of each row.
+    double* loops;// running count of loops, rows+1 entries, loops[0] = 0.
+    double* cum[MAXGPU * NUMCOLS];// running sums, rows+1 entries each.
+};
+
+struct rowLoops // the loops of the last row, for its energy. Loop k is dur[k] and the power of each GPU at power[k*numGpus].
+{
+    long n, cap;
+    double* dur;// seconds.
+    double* power;// W.
+};
+
+long long logIndexTime(int year, int mon, int day, int hour, int min, int sec)
+{
+    // days from 1970-01-01 of the proleptic Gregorian calendar.
+    long long y = year - (mon <= 2);
+    long long era = (y >= 0 ? y : y - 399) / 400;
+    long long yoe = y - era * 400;
+    long long doy = (153 * (mon + (mon > 2 ? -3 : 9)) + 2) / 5 + day - 1;
+    long long doe = yoe * 365 + yoe / 4 - yoe / 100 + doy;
+    long long days = era * 146097 + doe - 719468;
+    return days * 86400 + hour * 3600 + min * 60 + sec;
+}
+
+static bool parseInt(const char** p, const char* end, long* value)
+{
+    const char* s = *p;
+    bool neg = false;
+    long v = 0;
+    if (s < end && *s == '-')
+    {
+        neg = true;
+        s++;
+    }
+    if (s >= end || *s < '0' || *s > '9')
+        return false;
+    while (s < end && *s >= '0' && *s <= '9')
+        v = v * 10 + (*s++ - '0');
+    *value = neg ? -v : v;
+    *p = s;
+    return true;
+}
+
+static bool expect(const char** p, const char* end, char c)
+{
+    if (*p >= end || **p != c)
+        return false;
+    (*p)++;
+    return true;
+}
+
+// Parse one sample line into its second and fields. Return the number of fields, or -1 if it is not a sample line.
+static int parseLine(const char* s, const char* end, long long* sec, long* fields)
+{
+    long t[6];
+    int n = 0;
+    if (!(parseInt(&s, end, &t[0]) && expect(&s, end, '-') && parseInt(&s, end, &t[1]) && expect(&s, end, '-')
+        && parseInt(&s, end, &t[2]) && expect(&s, end, ' ') && parseInt(&s, end, &t[3]) && expect(&s, end, ':')
+        && parseInt(&s, end, &t[4]) && expect(&s, end, ':') && parseInt(&s, end, &t[5])))
+        return -1;
+    if (t[0] < 2000 || t[1] < 1 || t[1] > 12)
+        return -1;
+    while (s < end)
+    {
+        if (!(expect(&s, end, ',') && expect(&s, end, ' ')))
+            return -1;
+        if (n >= MAXGPU * GPUFIELDS + 1 || !parseInt(&s, end, &fields[n]))
+            return -1;
+        n++;
+    }
+    *sec = logIndexTime(t[0], t[1], t[2], t[3], t[4], t[5]);
+    return n;
+}
+
+static bool grow(logIndex* index)
+{
+    long cap = index->cap == 0 ? 4096 : index->cap * 2;
+    long long* secs = realloc(index->secs, cap * sizeof(long long));
+    double* loops;
+    int c;
+    if (secs == NULL)
+        return false;
+    index->secs = secs;
+    if ((loops = realloc(index->loops, (cap + 1) * sizeof(double))) == NULL)
+        return false;
+    index->loops = loops;
+    for (c = 0; c < index->numGpus * NUMCOLS; c++)
+    {
+        double* cum = realloc(index->cum[c], (cap + 1) * sizeof(double));
+        if (cum == NULL)
+            return false;
+        index->cum[c] = cum;
+    }
+    index->cap = cap;
+    return true;
+}
+
+// Append a new row for second sec, starting from the running sums of the last row.
+static bool newRow(logIndex* index, long long sec)
+{
+    long r = index->rows;
+    int c;
+    if (r == index->cap && !grow(index))
+        return false;
+    index->secs[r] = sec;
+    index->loops[r + 1] = index->loops[r];
+    for (c = 0; c < index->numGpus * NUMCOLS; c++)
+        index->cum[c][r + 1] = index->cum[c][r];
+    index->rows = r + 1;
+    return true;
+}
+
+static bool addLoop(struct rowLoops* row, int numGpus, const long* fields)
+{
+    long cap = row->cap == 0 ? 64 : row->cap * 2;
+    double* grown;
+    int g;
+    if (row->n == row->cap)
+    {
+        if ((grown = realloc(row->dur, cap * sizeof(double))) == NULL)
+            return false;
+        row->dur = grown;
+        if ((grown = realloc(row->power, cap * numGpus * sizeof(double))) == NULL)
+            return false;
+        row->power = grown;
+        row->cap = cap;
+    }
+    row->dur[row->n] = fields[numGpus * GPUFIELDS] / 1e6;
+    for (g = 0; g < numGpus; g++)
+        row->power[row->n * numGpus + g] = fields[g * GPUFIELDS + 2] / 1000.0;
+    row->n += 1;
+    return true;
+}
+
+// The energy of a second is only known once all its loops are in: each loop counts for its recorded duration, at least
+// 1/n s with n loops in the second, scaled so that the loops fill the second.
+static void closeRow(logIndex* index, const struct rowLoops* row)
+{
+    long r = index->rows, k;
+    double weight, weightSum = 0, energy;
+    int g;
+    for (k = 0; k < row->n; k++)
+        weightSum += row->dur[k] > 1.0 / row->n ? row->dur[k] : 1.0 / row->n;
+    for (g = 0; g < index->numGpus; g++)
+    {
+        energy = 0;
+        for (k = 0; k < row->n; k++)
+        {
+            weight = row->dur[k] > 1.0 / row->n ? row->dur[k] : 1.0 / row->n;
+            energy += row->power[k * index->numGpus + g] * weight / weightSum;
+        }
+        index->cum[g * NUMCOLS + COL_ENERGY][r] = index->cum[g * NUMCOLS + COL_ENERGY][r - 1] + energy;
+    }
+}
+
+// Rows without loops for the seconds after the last row up to sec, where the power of the last loop holds.
+static bool holdRows(logIndex* index, const struct rowLoops* row, long long sec)
+{
+    long long s;
+    int g;
+    if (sec - index->secs[index->rows - 1] > MAXHOLD + 1 || row->n == 0)
+        return true;
+    for (s = index->secs[index->rows - 1] + 1; s < sec; s++)
+    {
+        if (!newRow(index, s))
+            return false;
+        for (g = 0; g < index->numGpus; g++)
+            index->cum[g * NUMCOLS + COL_ENERGY][index->rows] += row->power[(row->n - 1) * index->numGpus + g];
+    }
+    return true;
+}
+
+logIndex* logIndexOpen(const char* path)
+{
+    logIndex* index;
+    struct stat st;
+    const char *data, *p, *end;
+    long fields[MAXGPU * GPUFIELDS + 1];
+    struct rowLoops row = {0, 0, NULL, NULL};
+    long long sec;
+    int fd, n, g, err = 0;
+
+    if ((fd = open(path, O_RDONLY)) < 0)
+        return NULL;
+    if (fstat(fd, &st) != 0)
+    {
+        err = errno;
+        close(fd);
+        errno = err;
+        return NULL;
+    }
+    if ((index = calloc(1, sizeof(logIndex))) == NULL)
+    {
+        close(fd);
+        errno = ENOMEM;
+        return NULL;
+    }
+    if ((index->loops = malloc(sizeof(double))) == NULL)
+        err = ENOMEM;
+    else
+        index->loops[0] = 0;
+    if (err != 0 || st.st_size == 0)
+    {
+        close(fd);
+        if (err != 0)
+        {
+            logIndexClose(index);
+            errno = err;
+            return NULL;
+        }
+        return index;
+    }
+    data = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    err = errno;
+    close(fd);
+    if (data == MAP_FAILED)
+    {
+        logIndexClose(index);
+        errno = err;
+        return NULL;
+    }
+    madvise((void*)data, st.st_size, MADV_SEQUENTIAL);
+    err = 0;
+
+    for (p = data, end = data + st.st_size; p < end;)
+    {
+        const char* eol = memchr(p, '\n', end - p);
+        const char* lineEnd = eol != NULL ? eol : end;
+        n = parseLine(p, lineEnd, &sec, fields);
+        p = eol != NULL ? eol + 1 : end;
+        if (n <= 1 || (n - 1) % GPUFIELDS != 0)
+            continue;
+        if (index->numGpus == 0)
+        {
+            index->numGpus = (n - 1) / GPUFIELDS;
+            for (g = 0; g < index->numGpus * NUMCOLS; g++)
+            {
+                if ((index->cum[g] = malloc(sizeof(double))) == NULL)
+                {
+                    err = ENOMEM;
+                    break;
+                }
+                index->cum[g][0] = 0;
+            }
+            if (err != 0)
+                break;
+        }
+        else if ((n - 1) / GPUFIELDS != index->numGpus)
+            continue;// a sample line broken by a message of dvfs.c.
+
+        if (index->rows == 0 || sec > index->secs[index->rows - 1])
+        {
+            if (index->rows > 0)
+                closeRow(index, &row);
+            if ((index->rows > 0 && !holdRows(index, &row, sec)) || !newRow(index, sec))
+            {
+                err = ENOMEM;
+                break;
+            }
+            row.n = 0;
+        }
+        if (!addLoop(&row, index->numGpus, fields))
+        {
+            err = ENOMEM;
+            break;
+        }
+        index->loops[index->rows] += 1;
+        for (g = 0; g < index->numGpus; g++)
+        {
+            double** cum = &index->cum[g * NUMCOLS];
+            long* f = &fields[g * GPUFIELDS];
+            cum[COL_UTIL][index->rows] += f[0];
+            cum[COL_MEMUTIL][index->rows] += f[1];
+            cum[COL_POWER][index->rows] += f[2];
+            cum[COL_FREQ][index->rows] += f[3];
+        }
+    }
+    if (err == 0 && index->rows > 0)
+        closeRow(index, &row);
+    free(row.dur);
+    free(row.power);
+    munmap((void*)data, st.st_size);
+    if (err != 0)
+    {
+        logIndexClose(index);
+        errno = err;
+        return NULL;
+    }
+    return index;
+}
+
+void logIndexClose(logIndex* index)
+{
+    int c;
+    if (index == NULL)
+        return;
+    for (c = 0; c < MAXGPU * NUMCOLS; c++)
+        free(index->cum[c]);
+    free(index->secs);
+    free(index->loops);
+    free(index);
+}
+
+int logIndexGpus(const logIndex* index)
+{
+    return index->numGpus;
+}
+
+long logIndexSamples(const logIndex* index)
+{
+    return (long)index->loops[index->rows];
+}
+
+long long logIndexFirst(const logIndex* index)
+{
+    return index->rows > 0 ? index->secs[0] : 0;
+}
+
+long long logIndexLast(const logIndex* index)
+{
+    return index->rows > 0 ? index->secs[index->rows - 1] : 0;
+}
+
+// The first row whose second is greater than sec (strict) or not less than sec.
+static long searchRow(const logIndex* index, long long sec, bool strict)
+{
+    long lo = 0, hi = index->rows;
+    while (lo < hi)
+    {
+        long mid = lo + (hi - lo) / 2;
+        if (strict ? index->secs[mid] <= sec : index->secs[mid] < sec)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    return lo;
+}
+
+long logIndexQuery(const logIndex* index, long long start, long long end, int gpu, logWindow* out)
+{
+    long lo, hi;
+    double n;
+    double* const* cum;
+    if (gpu < 0 || gpu >= index->numGpus)
+        return -1;
+    memset(out, 0, sizeof(logWindow));
+    lo = searchRow(index, start, false);
+    hi = searchRow(index, end, true);
+    if (hi <= lo)
+        return 0;
+    n = index->loops[hi] - index->loops[lo];
+    cum = &index->cum[gpu * NUMCOLS];
+    out->samples = (long)n;
+    out->energy = cum[COL_ENERGY][hi] - cum[COL_ENERGY][lo];
+    if (n == 0)
+        return 0;// only seconds without samples, which still have energy.
+    out->util = (cum[COL_UTIL][hi] - cum[COL_UTIL][lo]) / n;
+    out->memUtil = (cum[COL_MEMUTIL][hi] - cum[COL_MEMUTIL][lo]) / n;
+    out->power = (cum[COL_POWER][hi] - cum[COL_POWER][lo]) / n / 1000;
+    out->freq = (cum[COL_FREQ][hi] - cum[COL_FREQ][lo]) / n;
+    return out->samples;
+}
@@ -0,0 +1,56 @@
+/* MIT License
+
+Copyright (c) 2023 Yijia Zhang
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+
+
+ * Indexed analysis of dvfs logs (output/dvfs_*.out).
+ * logIndexOpen() maps the log once and parses it in a single pass into per-second prefix sums of util, mem util, power,
+ * frequency and energy of each GPU. A query over a time window is then two binary searches and a few subtractions.
+ * Times are the log's second-resolution local time, encoded as seconds since 1970-01-01 of that calendar time (no time zone),
+ * see logIndexTime(). A window [start, end] includes both ends, the same as postprocessing.getGpuPowerEffici_dataframe().
+ */
+#ifndef LOGANALYZE_H
+#define LOGANALYZE_H
+
+typedef struct logIndex_st logIndex;
+
+typedef struct logWindow_st
+{
+    long samples;// loops in the window. The means below are over these loops.
+    double util, memUtil;// percent.
+    double power;// W.
+    double freq;// MHz.
+    double energy;// J, the power of each loop times its duration, see loganalyze.c. Includes the seconds without samples.
+} logWindow;
+
+// Return NULL and set errno on failure. Lines other than samples (headers, messages) are skipped.
+logIndex* logIndexOpen(const char* path);
+void logIndexClose(logIndex* index);
+int logIndexGpus(const logIndex* index);
+long logIndexSamples(const logIndex* index);
+long long logIndexFirst(const logIndex* index);
+long long logIndexLast(const logIndex* index);
+// Seconds of a calendar time, as used by the index.
+long long logIndexTime(int year, int mon, int day, int hour, int min, int sec);
+// Fill out for GPU gpu over [start, end]. Return the loops in the window, 0 if none, -1 if gpu is out of range.
+long logIndexQuery(const logIndex* index, long long start, long long end, int gpu, logWindow* out);
+
+#endif
@@ -0,0 +1,588 @@
+/* MIT License
+
+Copyright (c) 2023 Yijia Zhang
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+
+
+ * Assure model of GEEPAFS. The fold-line regression of the probing records and the frequency bounds derived from it.
+ * Shared by the daemon dvfs.c and the offline tools, so they run exactly the same policy code.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include "assure.h"
+
+// ("v100-maxq" is V100 GPU with TDP 163 W; "v100-300w" is V100 GPU with TDP 300 W; "a100-insp" is A100 GPU with TDP 400 W.)
+const assureMachine assureMachines[] = {
+    {"v100-maxq", 855, 855, 1440, 810, 175, 4, {855, 1050, 1245, 1440}},
+    {"v100-300w", 952, 952, 1530, 877, 187, 4, {952, 1147, 1335, 1530}},
+    {"a100-insp", 1110, 1110, 1410, 1593, 81, 4, {1110, 1215, 1320, 1410}}};
+const int assureNumMachines = sizeof(assureMachines) / sizeof(assureMachines[0]);
+
+const assureMachine* assureFindMachine(const char* name) // look up the constants of a machine by its name.
+{
+    int i;
+    for (i = 0; i < assureNumMachines; i++)
+    {
+        if (strcmp(name, assureMachines[i].name) == 0)
+            return &assureMachines[i];
+    }
+    return NULL;
+}
+
+double parseThres(const char* arg) // parse a performance constraint like "p90", "90" or "0.9". Return -1 if invalid.
+{
+    char* end;
+    double thres;
+    if (arg[0] == 'p')
+        arg += 1;
+    thres = strtod(arg, &end);
+    if (end == arg || *end != '\0')
+        return -1;
+    if (thres > 1)
+        thres /= 100;// given in percentage.
+    if (thres <= 0 || thres > 1)
+        return -1;
+    return thres;
+}
+
+double max(double a, double b)
+{
+    if (a >= b)
+        return a;
+    else
+        return b;
+}
+
+double min(double a, double b)
+{
+    if (a >= b)
+        return b;
+    else
+        return a;
+}
+
+void linearRegression(int num, double* X, double* Y, double* slope, double* intercept, double* regErr) // linear regression.
+{
+    int k;
+    double sumx=0, sumxsq=0, sumy=0, sumxy=0, sumysq=0, div, xd, yd, a, b;
+    for (k=0; k<num; k++)
+    {
+        xd = X[k];
+        yd = Y[k];
+        sumx += xd;
+        sumxsq += xd*xd;
+        sumy += yd;
+        sumxy += xd*yd;
+        sumysq += yd*yd;
+    }
+    div = num*sumxsq - sumx*sumx;
+    a = (num*sumxy-sumx*sumy) / div;
+    b = (sumy*sumxsq-sumx*sumxy) / div;
+    *slope = a;
+    *intercept = b;
+    *regErr = sumysq + a*a*sumxsq + num*b*b - 2*a*sumxy - 2*b*sumy + 2*a*b*sumx;
+}
+
+void foldlineRegression(int xc, int num1, double* X1, double* Y1, int num2, double* X2, double* Y2, double* slope1, double* intercept1, double* slope2, double* intercept2, double* regErr) // Fold-line regression with the assumption that the fold-point's x position is at xc.
+{
+    int i, j;
+    double err=0, a1, b1, a2, b2, H, c11, c12, c13, c14, c21, c22, c23, c24, c31, c32, c33, c34, n;
+    double sum1_x=0, sum1_y=0, sum2_x=0, sum2_y=0, sum2_xsq=0, sum2_xy=0, sum1_xsq=0, sum1_xy=0;
+    n = num1 + num2;
+    for (i=0; i<num1; i++)
+    {
+        sum1_x += X1[i];
+        sum1_y += Y1[i];
+        sum1_xsq += X1[i]*X1[i];
+        sum1_xy += X1[i]*Y1[i];
+    }
+    for (j=0; j<num2; j++)
+    {
+        sum2_x += X2[j];
+        sum2_y += Y2[j];
+        sum2_xsq += X2[j]*X2[j];
+        sum2_xy += X2[j]*Y2[j];
+    }
+
+    c11 = sum1_xsq + num2*xc*xc;
+    c12 = xc*sum2_x - num2*xc*xc;
+    c13 = sum1_x + xc*num2;
+    c14 = - sum1_xy - sum2_y*xc;
+    c21 = xc*sum2_x - num2*xc*xc;
+    c22 = sum2_xsq - 2*xc*sum2_x + num2*xc*xc;
+    c23 = sum2_x - num2*xc;
+    c24 = - sum2_xy + xc*sum2_y;
+    c31 = sum1_x + num2*xc;
+    c32 = sum2_x - num2*xc;
+    c33 = n;
+    c34 = - sum1_y - sum2_y;
+
+    H = c11*c22*c33 + c12*c23*c31 + c21*c32*c13 - c13*c22*c31 - c12*c21*c33 - c11*c23*c32;
+    if (H == 0)
+    {
+        a1 = -1; b1 = -2; a2 = -3; b2 = -4; err = 12345678;
+    }
+    else
+    {
+        a1 = -(c14*c22*c33 + c12*c23*c34 + c13*c24*c32 - c13*c22*c34 - c12*c24*c33 - c23*c32*c14) / H;
+        a2 = -(c11*c24*c33 + c21*c34*c13 + c14*c23*c31 - c13*c31*c24 - c11*c23*c34 - c33*c14*c21) / H;
+        b1 = -(c11*c22*c34 + c21*c32*c14 + c12*c24*c31 - c22*c14*c31 - c12*c21*c34 - c11*c32*c24) / H;
+        b2 = xc*(a1-a2) + b1;
+        for (i=0; i<num1; i++)
+        {
+            err += (a1*X1[i] + b1 - Y1[i])*(a1*X1[i] + b1 - Y1[i]);
+        }
+        for (j=0; j<num2; j++)
+        {
+            err += (a2*X2[j] + b2 - Y2[j])*(a2*X2[j] + b2 - Y2[j]);
+        }
+    }
+    *slope1 = a1;
+    *intercept1 = b1;
+    *slope2 = a2;
+    *intercept2 = b2;
+    *regErr = err;
+}
+
+double utilFreqCap(double freq, double gutil, double perfThres, double maxFreq) // calculate the freq cap according to the gpu util and gpu freq.
+{
+    return freq / ((1-perfThres)*(freq/maxFreq+100/max(1,gutil)-1) + freq/maxFreq);// max(1,) is used to avoid division by 0.
+}
+
+void getAvailableFreqs(const char* machine, int* availableFreqs, int numAvailableFreqs) // get all available frequency values.
+{
+    // Run "nvidia-smi -q -d SUPPORTED_CLOCKS" to get available frequencies and update this function if needed.
+    if (strcmp(machine, "v100-maxq") == 0)
+    {
+        int idx = 1;
+        int freq = 135;
+        bool seven = true;
+        availableFreqs[0] = freq;
+        while (freq <= 1440)
+        {
+            if (seven)
+            {
+                freq += 7;
+                seven = false;
+            }
+            else
+            {
+                freq += 8;
+                seven = true;
+            }
+            if (freq <= 1440)
+            {
+                availableFreqs[idx] = freq;
+                idx += 1;
+            }
+        }
+    }
+    else if (strcmp(machine, "v100-300w") == 0)
+    {
+        int idx = 1;
+        int freq = 135;
+        bool seven = true;
+        availableFreqs[0] = freq;
+        while (freq <= 1530)
+        {
+            if (seven)
+            {
+                freq += 7;
+                seven = false;
+            }
+            else
+            {
+                freq += 8;
+                seven = true;
+            }
+            if (freq <= 1530)
+            {
+                availableFreqs[idx] = freq;
+                idx += 1;
+            }
+        }
+    }
+    else if (strcmp(machine, "a100-insp") == 0)
+    {
+	    int idx = 1;
+	    int freq = 210;
+	    availableFreqs[0] = freq;
+	    while (freq <= 1410)
+	    {
+	        freq += 15;
+	        if (freq <= 1410)
+	        {
+		    availableFreqs[idx] = freq;
+		    idx += 1;
+	        }
+	    }
+    }
+}
+
+bool assureModelFit(unsigned int dev, int numProbFreq, int numProbRep, int* probFreqs, double* gmemUtil, double* gPower, double perfThres, unsigned int maxFreq, unsigned int freqAvgEff, bool useRegression, double regErrThres, bool verbose, double* work, double* freqBound, double* freqEff) // fit the Assure model of one GPU from its probing records.
+{
+    // gmemUtil and gPower hold the numProbFreq*numProbRep probing records in the probing order.
+    // work should hold at least 6*numProbFreq*numProbRep + 4*numProbFreq doubles.
+    // Output: freqBound is the frequency bounded by the performance constraint perfThres, freqEff is the most power efficient frequency.
+    // Return false if the fitted model is discarded because of a large regression error.
+    const int numProbRec = numProbFreq * numProbRep;
+    double* const x = work;
+    double* const y = x + numProbRec;
+    double* const x1 = y + numProbRec;
+    double* const y1 = x1 + numProbRec;
+    double* const x2 = y1 + numProbRec;
+    double* const y2 = x2 + numProbRec;
+    double* const avg_gmemUtils = y2 + numProbRec;// record the average gmemUtil for each probing frequency.
+    double* const avg_gPowers = avg_gmemUtils + numProbFreq;// record the average gPower for each probing frequency.
+    double* const modelPerf = avg_gPowers + numProbFreq;// record model-estimated performance.
+    double* const powerEffici = modelPerf + numProbFreq;// record power efficiency.
+    unsigned int turn, turn_Opt, ifreq;
+    int j, reminder, mostEfficiFreq, max_gmem_freq, idx1, idx2;
+    double slope_Opt, slope1, slope2, slope1_Opt, slope2_Opt, intercept_Opt, intercept1, intercept2, intercept1_Opt, intercept2_Opt, sumy, regErr, regErr1, regErr2, regErrMin, freq_perfBound, freq_cross, mostEffici, criticalPerf, max_gmem;
+    bool optimalFound, skipmodel = false;
+
+    // Calculate avg_gmemUtils and avg_gPowers.
+    // construct the x, y input for the single linear model.
+    // Numbers should be converted into double.
+    sumy = 0;
+    for (j = 0; j < numProbFreq; j++)
+    {
+        avg_gmemUtils[j] = 0;
+        avg_gPowers[j] = 0;
+    }
+    for (j = 0; j < numProbRec; j++)
+    {
+        reminder = j % (2*numProbFreq);
+        y[j] = gmemUtil[j];
+        sumy += y[j];
+        if (reminder < numProbFreq)
+        {
+            x[j] = (double)probFreqs[reminder];
+            avg_gmemUtils[reminder] += y[j] / (double)numProbRep;
+            avg_gPowers[reminder] += gPower[j] / (double)numProbRep;
+        }
+        else
+        {
+            x[j] = (double)probFreqs[2*numProbFreq-1-reminder];
+            avg_gmemUtils[2*numProbFreq-1-reminder] += y[j] / (double)numProbRep;
+            avg_gPowers[2*numProbFreq-1-reminder] += gPower[j] / (double)numProbRep;
+        }
+    }
+
+    // Fit the model with fold-line regression.
+    if (useRegression)
+    {
+        // optimize frequency when all the gmem util is nonzero.
+        if (sumy > 0)
+        {
+            // print avg_gmemUtils.
+            if (verbose)
+            {
+                printf("Device %u: avg mem util at each frequency:", dev);
+                for (j = 0; j < numProbFreq; j++)
+                    printf("\t%.2lf", avg_gmemUtils[j]);// from low to high frequency.
+                printf("\n");
+                printf("Device %u: avg device power at each frequency:", dev);
+                for (j = 0; j < numProbFreq; j++)
+                    printf("\t%.2lf", avg_gPowers[j]);
+                printf("\n");
+            }
+            optimalFound = false;
+
+            // Build the performance and power efficiency model to optimize frequency.
+            if (!optimalFound)
+            {
+                // fit the points with a single linear model.
+                linearRegression(numProbRec, x, y, &slope_Opt, &intercept_Opt, &regErr);
+                regErrMin = regErr;
+                turn_Opt = 0;
+                if (verbose)
+                {
+                    printf("Device %u: turn=non, slope=%lf, intercept=%lf, regErr=%lf\n", dev, slope_Opt, intercept_Opt, regErr);
+                }
+                // Partition the points and fit the points with two linear models connected by a turning point.
+                for (turn = 2; turn <= numProbFreq - 2; turn++)// "turn" marks how many points are in the 1st model.
+                {
+                    // Partition the points to fit two linear models.
+                    // *1 for lower frequency, and *2 for higher frequency.
+                    idx1 = 0; idx2 = 0;
+                    for (j = 0; j < numProbRec; j++)
+                    {
+                        reminder = j % (2*numProbFreq);
+                        if (reminder < numProbFreq)
+                            ifreq = reminder;
+                        else
+                            ifreq = 2*numProbFreq-1-reminder;
+                        if (ifreq < turn)
+                        {
+                            x1[idx1] = (double)probFreqs[ifreq];// lower frequency.
+                            y1[idx1] = gmemUtil[j];
+                            idx1 += 1;
+                        }
+                        else
+                        {
+                            x2[idx2] = (double)probFreqs[ifreq];// higher frequency.
+                            y2[idx2] = gmemUtil[j];
+                            idx2 += 1;
+                        }
+                    }
+                    linearRegression(turn*numProbRep, x1, y1, &slope1, &intercept1, &regErr1);
+                    linearRegression((numProbFreq-turn)*numProbRep, x2, y2, &slope2, &intercept2, &regErr2);
+
+                    if (slope2 != slope1)
+                        freq_cross = (intercept1-intercept2) / (slope2-slope1);
+                    else
+                        freq_cross = -1;
+                    if (freq_cross >= probFreqs[turn-1] && freq_cross <= probFreqs[turn])
+                    {
+                        // this fold-line is valid.
+                        regErr = regErr1 + regErr2;
+                    }
+                    else
+                    {
+                        // re-fit the fold-line and let the cross to happen at probFreqs[turn-1].
+                        foldlineRegression(probFreqs[turn-1], turn*numProbRep, x1, y1, (numProbFreq-turn)*numProbRep, x2, y2, &slope1, &intercept1, &slope2, &intercept2, &regErr);
+                    }
+
+                    if (verbose)
+                        printf("Device %u: turn=%u, slope1=%lf, intercept1=%lf, slope2=%lf, intercept2=%lf, regErr=%lf. ", dev, turn, slope1, intercept1, slope2, intercept2, regErr);
+
+                    if (slope1 <= slope2)// theoretically impossible case, abandon this partition.
+                    {
+                        if (verbose)
+                            printf("slope1 <= slope2, abandon this partition.\n");
+                    }
+                    else
+                    {
+                        if (regErr < regErrMin)// update this as the optimal model.
+                        {
+                            turn_Opt = turn;
+                            regErrMin = regErr;
+                            slope1_Opt = slope1; intercept1_Opt = intercept1;
+                            slope2_Opt = slope2; intercept2_Opt = intercept2;
+                            if (verbose)
+                                printf("Better model found.\n");
+                        }
+                        else
+                        {
+                            if (verbose)
+                                printf("Larger reg err, not used.\n");
+                        }
+                    }
+                }// end for turn position.
+
+                // if regression error too large, do not use regression model. Set freq by util.
+                if (regErrMin > numProbRec * regErrThres)
+                {
+                    if (verbose)
+                        printf("All regression err too large, discard model.\n");
+                    skipmodel = true;
+                    // set a high frequency for assurance.
+                    *freqBound = (double)maxFreq;// will be bounded by freqCap later.
+                    *freqEff = (double)freqAvgEff;
+                }
+                else
+                    skipmodel = false;
+
+                if (!skipmodel)
+                {
+                    // Estimate power efficiency only at the probed frequencies.
+                    if (turn_Opt == 0)
+                    {
+                        for (j = 0; j < numProbFreq; j++)
+                        {
+                            if (slope_Opt > 0)// assume performance correlates to gmemutil.
+                                modelPerf[j] = slope_Opt*(double)probFreqs[j]+intercept_Opt;
+                            else // assume the lowest frequency's performance is maximal.
+                                modelPerf[j] = slope_Opt*(double)probFreqs[0]+intercept_Opt;
+                        }
+                    }
+                    else // fold-line model.
+                    {
+                        // slope1_Opt for lower frequency, and slope2_Opt for higher.
+                        if (slope1_Opt > 0 && slope2_Opt > 0)
+                        {
+                            for (j = 0; j < numProbFreq; j++)
+                            {
+                                if (j >= turn_Opt)
+                                {
+                                    // model for higher frequency.
+                                    modelPerf[j] = slope2_Opt*(double)probFreqs[j]+intercept2_Opt;
+                                }
+                                else
+                                {
+                                    // model for lower frequency.
+                                    modelPerf[j] = slope1_Opt*(double)probFreqs[j]+intercept1_Opt;
+                                }
+                            }
+                        }
+                        else if (slope2_Opt <= 0 && slope1_Opt > 0)// maximum is in the middle.
+                        {
+                            for (j = 0; j < numProbFreq; j++)
+                            {
+                                if (j < turn_Opt)
+                                {
+                                    // model for lower frequency.
+                                    modelPerf[j] = slope1_Opt*(double)probFreqs[j]+intercept1_Opt;
+                                }
+                                else
+                                {
+                                    // use the estimated performance at cross.
+                                    freq_cross = (intercept1_Opt-intercept2_Opt) / (slope2_Opt-slope1_Opt);
+                                    modelPerf[j] = (slope2_Opt*intercept1_Opt-slope1_Opt*intercept2_Opt) / (slope2_Opt-slope1_Opt);
+                                }
+                            }
+                        }
+                        else // slope1_Opt <= 0.
+                        {
+                            for (j = 0; j < numProbFreq; j++)
+                            {
+                                // estimate performance using the lowest frequency.
+                                modelPerf[j] = slope1_Opt*(double)probFreqs[0]+intercept1_Opt;
+                            }
+                        }
+                    }//end if model with turing point.
+
+                    // calculate the power efficiency.
+                    for (j = 0; j < numProbFreq; j++)
+                    {
+                        powerEffici[j] = modelPerf[j] / avg_gPowers[j];
+                    }
+                    if (verbose)
+                    {
+                        printf("Device %u: modeled performance:", dev);
+                        for (j = 0; j < numProbFreq; j++)
+                            printf("\t%lf", modelPerf[j]);// print from low to high frequency.
+                        printf("\n");
+                        printf("Device %u: power efficiency:", dev);
+                        for (j = 0; j < numProbFreq; j++)
+                            printf("\t%lf", powerEffici[j]);// print from low to high frequency.
+                        printf("\n");
+                    }
+
+                    // find the most power efficient frequency.
+                    mostEffici = powerEffici[0];
+                    mostEfficiFreq = probFreqs[0];
+                    for (j = 1; j < numProbFreq; j++)
+                    {
+                        if (powerEffici[j] > mostEffici)
+                        {
+                            mostEffici = powerEffici[j];
+                            mostEfficiFreq = probFreqs[j];
+                        }
+                    }
+                    *freqEff = (double)mostEfficiFreq;
+                    if (verbose)
+                        printf("Device %u: max efficiency %lf at frequency %d MHz.\n", dev, mostEffici, mostEfficiFreq);
+
+                    // calculate critical frequency bounded by performance constraint using gmem util model.
+                    if (turn_Opt == 0) // if a single linear model is optimal.
+                    {
+                        if (slope_Opt > 0)
+                            freq_perfBound = (perfThres*(slope_Opt*(double)maxFreq+intercept_Opt) - intercept_Opt) / slope_Opt;
+                        else // lower frequency is better.
+                            freq_perfBound = (double)probFreqs[0];
+                        if (verbose)
+                            printf("Performance estimated by single linear model.\n");
+                    }
+                    else // if fold-line model.
+                    {
+                        if (slope1_Opt > 0)
+                        {
+                            if (slope2_Opt > 0)
+                            {
+                                criticalPerf = perfThres*(slope2_Opt*(double)maxFreq+intercept2_Opt);
+                                freq_perfBound = (criticalPerf - intercept2_Opt) / slope2_Opt;
+                                freq_cross = (intercept1_Opt-intercept2_Opt) / (slope2_Opt-slope1_Opt);
+                                if (freq_perfBound <= freq_cross)
+                                {
+                                    // should use low-freq-model instead.
+                                    freq_perfBound = (criticalPerf - intercept1_Opt) / slope1_Opt;
+                                    if (verbose)
+                                        printf("Performance assurance satisfied at low-segment.\n");
+                                }
+                                else
+                                {
+                                    if (verbose)
+                                        printf("Performance assurance satisfied at high-segment.\n");
+                                }
+                            }
+                            else if (slope2_Opt <= 0)
+                            {
+                                freq_cross = (intercept1_Opt-intercept2_Opt) / (slope2_Opt-slope1_Opt);
+                                criticalPerf = perfThres*(slope1_Opt*freq_cross+intercept1_Opt);
+                                if (verbose)
+                                    printf("Performance saturation predicted at %.lf MHz.\n", freq_cross);
+                                freq_perfBound = (criticalPerf - intercept1_Opt) / slope1_Opt;
+                                if (verbose)
+                                    printf("Performance assurance satisfied at low-segment.\n");
+                            }
+                        }// end if slope1_Opt>0.
+                        else
+                        {
+                            if (verbose)
+                                printf("Performance saturation predicted at %d MHz.\n", probFreqs[0]);
+                            freq_perfBound = (double)probFreqs[0];
+                        }
+                    }// end if fold-line model.
+                    if (verbose)
+                        printf("Device %u: performance assurance achieved at %.2lf MHz.\n", dev, freq_perfBound);
+
+                    *freqBound = freq_perfBound;
+                }// end if !skipmodel.
+            }// end if !optimalFound.
+        }// end if sumy > 0.
+        else
+        {
+            if (verbose)
+                printf("Device %u: mem bw not used, will set frequency by util.\n", dev);
+            *freqBound = (double)maxFreq;// will be bounded by freqCap later.
+            *freqEff = (double)freqAvgEff;// on A100, gmemutil may be always 0 for a few apps.
+        }
+    } // end if useRegression.
+    else // use the lowest frequency whose gmemUtil is maximal.
+    {
+        max_gmem = avg_gmemUtils[0];
+        max_gmem_freq = probFreqs[0];
+        // get the max_gmem value;
+        for (j = 1; j < numProbFreq; j++)
+        {
+            if (avg_gmemUtils[j] > max_gmem)
+            {
+                max_gmem = avg_gmemUtils[j];
+            }
+        }
+        // get the freq of max_gmem.
+        for (j = 0; j < numProbFreq; j++)
+        {
+            if (avg_gmemUtils[j] >= max_gmem*0.99)
+            {
+                max_gmem_freq = probFreqs[j];
+                break;
+            }
+        }
+        *freqBound = (double)max_gmem_freq;
+        *freqEff = (double)freqAvgEff;
+    }
+    return !skipmodel;
+}
+// End of file assure.c
@@ -0,0 +1,64 @@
+/* MIT License
+
+Copyright (c) 2023 Yijia Zhang
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+
+
+ * Assure model of GEEPAFS, shared by dvfs.c and the offline tools. See assure.c.
+ */
+#ifndef ASSURE_H
+#define ASSURE_H
+
+#include <stdbool.h>
+
+#define ASSURE_MAXPROBFREQ 4
+
+// Frequency constants of a supported machine. Run "nvidia-smi -q -d SUPPORTED_CLOCKS" to get available frequencies.
+typedef struct assureMachine_st
+{
+    const char* name;// "v100-maxq", "v100-300w" or "a100-insp".
+    unsigned int minSetFreq;// the lower bound for setting frequency.
+    unsigned int freqAvgEff;// the globally most power efficient frequency based on experiments from many apps.
+    unsigned int maxFreq;// max freq supported.
+    unsigned int setMemFreq;// the only available memory freq value on this machine.
+    int numAvailableFreqs;// number of available freqs supported by this machine, see getAvailableFreqs().
+    int numProbFreq;// number of freqs probed in the probing phase.
+    int probFreqs[ASSURE_MAXPROBFREQ];
+} assureMachine;
+
+extern const assureMachine assureMachines[];
+extern const int assureNumMachines;
+
+const assureMachine* assureFindMachine(const char* name);// NULL if the machine is not supported.
+double parseThres(const char* arg);// "p90", "90" or "0.9". Return -1 if invalid.
+double max(double a, double b);
+double min(double a, double b);
+void linearRegression(int num, double* X, double* Y, double* slope, double* intercept, double* regErr);
+void foldlineRegression(int xc, int num1, double* X1, double* Y1, int num2, double* X2, double* Y2, double* slope1, double* intercept1, double* slope2, double* intercept2, double* regErr);
+double utilFreqCap(double freq, double gutil, double perfThres, double maxFreq);
+void getAvailableFreqs(const char* machine, int* availableFreqs, int numAvailableFreqs);// machine is "v100-maxq", "v100-300w" or "a100-insp".
+
+// Fit the Assure model of GPU dev from numProbFreq*numProbRep probing records in the probing order.
+// work should hold at least 6*numProbFreq*numProbRep + 4*numProbFreq doubles.
+// Return false if the fitted model is discarded because of a large regression error.
+bool assureModelFit(unsigned int dev, int numProbFreq, int numProbRep, int* probFreqs, double* gmemUtil, double* gPower, double perfThres, unsigned int maxFreq, unsigned int freqAvgEff, bool useRegression, double regErrThres, bool verbose, double* work, double* freqBound, double* freqEff);
+
+#endif
+// End of file assure.h
@@ -0,0 +1,171 @@
+'''
+MIT License
+
+Copyright (c) 2023 Yijia Zhang
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+
+###
+Policy benchmark on the NVML simulator.
+This code runs every policy of dvfs.c against a library of synthetic workloads on a simulated GPU (see sim/nvml_sim.c),
+and reports energy, performance loss vs MaxFreq, performance-constraint violations, probing overhead and the CPU time of one
+daemon loop (thread CPU time of the loop body, without the wait).
+Each policy/workload pair runs in its own dvfs_sim process, all in parallel, for the same duration in real time.
+The simulator follows the real clock, so the results of a run depend on the timing of the daemon. Every pair therefore runs
+--repeat times with the same seed, and the table and JSON report the mean and a tolerance, half the range over the repeats.
+A difference between two commits is significant if it exceeds the sum of their tolerances.
+
+Build dvfs_sim by "make sim", then run "python3 benchPolicies.py", or run "make bench" to do both.
+Options: --duration seconds (default 60), --assurance percent (default 90), --policies and --workloads (comma-separated),
+--repeat runs per pair (default 3), --json file (default output/bench_policies.json).
+No GPU or root privileges are needed.
+'''
+import argparse
+import json
+import os
+import re
+import subprocess
+import tempfile
+
+policies = ['MaxFreq', 'NVboost', 'EfficientFix', 'UtilizScale', 'Assure']
+workloads = ['compute', 'memory', 'knee', 'phase', 'bursty', 'idle']
+tolMetrics = ['energy_J', 'perf_loss_vs_MaxFreq', 'violations', 'cpu_per_loop_us']# reported with a tolerance over the repeats.
+
+def main():
+    parser = argparse.ArgumentParser(description='Compare the dvfs policies on simulated workloads.')
+    parser.add_argument('--duration', type=float, default=60, help='seconds per run')
+    parser.add_argument('--assurance', type=int, default=90, help='performance constraint in percent, for Assure and the violation count')
+    parser.add_argument('--policies', default=','.join(policies))
+    parser.add_argument('--workloads', default=','.join(workloads))
+    parser.add_argument('--repeat', type=int, default=3, help='runs per policy/workload pair, for the tolerance')
+    parser.add_argument('--json', default='output/bench_policies.json', help='output file, empty to skip')
+    args = parser.parse_args()
+    results = benchPolicies(args.policies.split(','), args.workloads.split(','), args.duration, args.assurance, max(args.repeat, 1))
+    printTable(results)
+    if args.json:
+        with open(args.json, 'w') as f:
+            json.dump(results, f, indent=1, sort_keys=True)
+            f.write('\n')
+        print('Results saved to %s.' % args.json)
+
+def dvfsMachine():
+    # the simulated GPU must match the MACHINE compiled into dvfs_sim.
+    with open('dvfs.c') as f:
+        for line in f:
+            match = re.match(r'#define MACHINE "(.*)"', line)
+            if match:
+                return match.group(1)
+    return 'v100-300w'
+
+def startRun(policy, workload, rep, duration, assurance, machine, tmpdir):
+    tag = '%s_%s_%d' % (policy, workload, rep)
+    env = dict(os.environ)
+    env.update({
+        'NVML_SIM_MACHINE': machine,
+        'NVML_SIM_WORKLOAD': workload,
+        'NVML_SIM_DURATION': '%g' % duration,
+        'NVML_SIM_THRES': '%g' % (assurance / 100),
+        'NVML_SIM_SEED': '1',# the same noise in every repeat, so that the spread only comes from the timing.
+        'NVML_SIM_REPORT': os.path.join(tmpdir, tag + '.report'),
+        # every run has its own control socket, metrics socket and shared memory.
+        'DVFS_CTRL_SOCKET': os.path.join(tmpdir, tag + '.sock'),
+        'DVFS_METRICS_SOCKET': os.path.join(tmpdir, tag + '.metrics'),
+        'DVFS_SHM_NAME': '/dvfs_bench_%d_%s' % (os.getpid(), tag),
+    })
+    cmd = ['./dvfs_sim', 'mod', policy]
+    if policy == 'Assure':
+        cmd.append('p%d' % assurance)
+    return subprocess.Popen(cmd, stdout=subprocess.PIPE, stderr=subprocess.PIPE, env=env, universal_newlines=True)
+
+def parseRun(policy, workload, duration, stdout, reportfile):
+    result = {'policy': policy, 'workload': workload}
+    with open(reportfile) as f:
+        fields = dict(item.split('=') for item in f.readline().split())
+    result['energy_J'] = round(float(fields['energy']), 1)
+    result['perf_vs_maxclock'] = round(float(fields['work']) / float(fields['maxwork']), 4) if float(fields['maxwork']) > 0 else 1.0
+    result['avg_clock_MHz'] = round(float(fields['avgclk']))
+    result['freq_sets'] = int(fields['sets'])
+    result['windows'] = int(fields['windows'])
+    result['violations'] = int(fields['violations'])
+    result['work'] = float(fields['work'])
+    match = re.search(r'Probing phases: (\d+), time in probing ([\d.]+) s, loops: (\d+), CPU time ([\d.]+) s, loop CPU time ([\d.]+) us', stdout)
+    if match is None:
+        raise RuntimeError('%s on %s: no summary line in the dvfs output.' % (policy, workload))
+    result['probes'] = int(match.group(1))
+    result['probe_overhead'] = round(float(match.group(2)) / duration, 4)
+    result['cpu_s'] = round(float(match.group(4)), 3)# the whole process, including the startup and the other threads.
+    result['cpu_per_loop_us'] = float(match.group(5))
+    return result
+
+def benchPolicies(policyList, workloadList, duration, assurance, repeat):
+    if not os.path.exists('./dvfs_sim'):
+        raise RuntimeError('dvfs_sim not found. Run "make sim" first.')
+    machine = dvfsMachine()
+    runResults = []
+    with tempfile.TemporaryDirectory() as tmpdir:
+        runs = []
+        for rep in range(repeat):
+            for policy in policyList:
+                for workload in workloadList:
+                    runs.append((policy, workload, rep, startRun(policy, workload, rep, duration, assurance, machine, tmpdir)))
+        print('Running %d policy/workload pairs %d times for %g s on a simulated %s..' % (len(runs) // repeat, repeat, duration, machine))
+        for policy, workload, rep, proc in runs:
+            stdout, stderr = proc.communicate()
+            if proc.returncode != 0:
+                raise RuntimeError('%s on %s failed: %s' % (policy, workload, stderr.strip()))
+            r = parseRun(policy, workload, duration, stdout, os.path.join(tmpdir, '%s_%s_%d.report' % (policy, workload, rep)))
+            r['rep'] = rep
+            runResults.append(r)
+
+    # performance loss is relative to MaxFreq on the same workload in the same repeat.
+    maxWork = dict(((r['workload'], r['rep']), r['work']) for r in runResults if r['policy'] == 'MaxFreq')
+    for r in runResults:
+        base = maxWork.get((r['workload'], r['rep']), 0)
+        r['perf_loss_vs_MaxFreq'] = 1 - r['work'] / base if base > 0 else 0.0
+    results = []
+    for policy in policyList:
+        for workload in workloadList:
+            group = [r for r in runResults if r['policy'] == policy and r['workload'] == workload]
+            results.append(summarize(group))
+    return {'machine': machine, 'duration_s': duration, 'assurance': assurance, 'repeat': repeat, 'results': results}
+
+def summarize(group):
+    # the mean over the repeats, and for tolMetrics also the tolerance <metric>_tol, half the range.
+    digits = {'energy_J': 1, 'perf_vs_maxclock': 4, 'perf_loss_vs_MaxFreq': 4, 'probe_overhead': 4, 'cpu_s': 3, 'cpu_per_loop_us': 1}
+    result = {'policy': group[0]['policy'], 'workload': group[0]['workload']}
+    for key in group[0]:
+        if key in ('policy', 'workload', 'rep', 'work'):
+            continue
+        values = [r[key] for r in group]
+        result[key] = round(sum(values) / len(values), digits.get(key, 1)) + 0.0# no -0.0.
+        if key in tolMetrics:
+            result[key + '_tol'] = round((max(values) - min(values)) / 2, digits.get(key, 1))
+    return result
+
+def printTable(results):
+    cols = ['policy', 'workload', 'energy_J', 'perf_loss_vs_MaxFreq', 'violations', 'windows', 'probes', 'probe_overhead', 'avg_clock_MHz', 'freq_sets', 'cpu_per_loop_us']
+    widths = [max(len(c), 12) for c in cols]
+    print('  '.join(c.ljust(w) if i < 2 else c.rjust(w) for i, (c, w) in enumerate(zip(cols, widths))))
+    for r in results['results']:
+        cells = [('%s±%s' % (r[c], r[c + '_tol'])) if c in tolMetrics else str(r[c]) for c in cols]
+        print('  '.join(cell.ljust(w) if i < 2 else cell.rjust(w) for i, (cell, w) in enumerate(zip(cells, widths))))
+    print('Mean of %d runs with the same seed, ± half the range.' % results['repeat'])
+
+if __name__ == '__main__':
+    main()
@@ -18,6 +18,8 @@
 
 #include <helper_functions.h>   // helper functions for string parsing
 #include <helper_cuda.h>        // helper functions CUDA error checking and initialization
+#include <helper_result.h>      // structured result record
+#include <helper_cpu.h>         // threads and SIMD dispatch of the CPU reference
 #include <time.h>
 
 ////////////////////////////////////////////////////////////////////////////////
@@ -97,6 +99,7 @@ int main(int argc, char **argv)
     delta, ref, sum_delta, sum_ref, max_delta, L1norm, gpuTime;
 
     StopWatchInterface *hTimer = NULL;
+    BenchResult benchResult;
     int i;
 
     findCudaDevice(argc, (const char **)argv);
@@ -151,6 +154,7 @@ int main(int argc, char **argv)
     checkCudaErrors(cudaDeviceSynchronize());
     sdkResetTimer(&hTimer);
     sdkStartTimer(&hTimer);
+    benchResultStart(&benchResult, "BlackScholes");
 
     for (i = 0; i < NUM_ITERATIONS; i++)
     {
@@ -168,6 +172,7 @@ int main(int argc, char **argv)
     }
 
     checkCudaErrors(cudaDeviceSynchronize());
+    benchResultEnd(&benchResult);
     sdkStopTimer(&hTimer);
     gpuTime = sdkGetTimerValue(&hTimer) / NUM_ITERATIONS;
 
@@ -191,8 +196,10 @@ int main(int argc, char **argv)
 
 
     printf("Checking the results...\n");
-    printf("...running CPU calculations.\n\n");
+    printf("...running CPU calculations (%s, %d threads).\n", cpuIsaName(cpuIsa()), cpuThreadCount());
     //Calculate options values on CPU
+    sdkResetTimer(&hTimer);
+    sdkStartTimer(&hTimer);
     BlackScholesCPU(
         h_CallResultCPU,
         h_PutResultCPU,
@@ -203,6 +210,8 @@ int main(int argc, char **argv)
         VOLATILITY,
         OPT_N
     );
+    sdkStopTimer(&hTimer);
+    printf("BlackScholesCPU() time    : %f msec\n\n", sdkGetTimerValue(&hTimer));
 
     printf("Comparing the results...\n");
     //Calculate max absolute difference and L1 distance
@@ -249,6 +258,7 @@ int main(int argc, char **argv)
     printf("Shutdown done.\n");
 
     printf("\n[BlackScholes] - Test Summary\n");
+    benchResultWrite(&benchResult, NUM_ITERATIONS, 2.0 * OPT_N * NUM_ITERATIONS, "option", L1norm > 1e-6 ? BENCH_RESULT_FAIL : BENCH_RESULT_PASS);
 
     if (L1norm > 1e-6)
     {
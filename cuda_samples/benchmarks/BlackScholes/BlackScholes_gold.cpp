@@ -12,6 +12,7 @@
 
 
 #include <math.h>
+#include <helper_cpu.h>         // threads and SIMD dispatch of the CPU reference
 
 
 
@@ -69,8 +70,177 @@ static void BlackScholesBodyCPU(
 }
 
 
+#ifdef BENCH_CPU_X86
+///////////////////////////////////////////////////////////////////////////////
+// Vectorized double precision exp(), log() and CND() for the SIMD paths.
+// Both are accurate to a few ulp, so the results match BlackScholesBodyCPU()
+// to the float output. exp() clamps its argument at -708, log() takes positive
+// normal arguments, which covers the option data of this sample.
+///////////////////////////////////////////////////////////////////////////////
+static const double LN2_HI = 6.93147180369123816490e-01;
+static const double LN2_LO = 1.90821492927058770002e-10;
+static const double LOG2E = 1.44269504088896338700e+00;
+static const double SQRT2 = 1.41421356237309514547e+00;
+static const double EXP_MIN = -708.0, EXP_MAX = 709.0;
+// Taylor series of exp(r) for |r| <= ln2/2, truncated after r^13.
+static const double EXP_C[14] = {1.0, 1.0, 1.0 / 2, 1.0 / 6, 1.0 / 24, 1.0 / 120, 1.0 / 720, 1.0 / 5040, 1.0 / 40320,
+    1.0 / 362880, 1.0 / 3628800, 1.0 / 39916800, 1.0 / 479001600, 1.0 / 6227020800.0};
+static const double CND_A[5] = {0.31938153, -0.356563782, 1.781477937, -1.821255978, 1.330274429};
+static const double RSQRT2PI = 0.39894228040143267793994605993438;
+
+BENCH_CPU_TARGET_AVX2 static inline __m256d exp4(__m256d x)
+{
+    x = _mm256_min_pd(_mm256_max_pd(x, _mm256_set1_pd(EXP_MIN)), _mm256_set1_pd(EXP_MAX));
+    // x = n*ln2 + r, and exp(x) = 2^n * exp(r).
+    __m256d n = _mm256_round_pd(_mm256_mul_pd(x, _mm256_set1_pd(LOG2E)), _MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC);
+    __m256d r = _mm256_fnmadd_pd(n, _mm256_set1_pd(LN2_HI), x);
+    r = _mm256_fnmadd_pd(n, _mm256_set1_pd(LN2_LO), r);
+    __m256d p = _mm256_set1_pd(EXP_C[13]);
+    for (int k = 12; k >= 0; k--)
+        p = _mm256_fmadd_pd(p, r, _mm256_set1_pd(EXP_C[k]));
+    // 2^n from the integer n in the low bits of n + 1.5*2^52.
+    const __m256d magic = _mm256_set1_pd(6755399441055744.0);
+    __m256i ni = _mm256_sub_epi64(_mm256_castpd_si256(_mm256_add_pd(n, magic)), _mm256_castpd_si256(magic));
+    __m256i scale = _mm256_slli_epi64(_mm256_add_epi64(ni, _mm256_set1_epi64x(1023)), 52);
+    return _mm256_mul_pd(p, _mm256_castsi256_pd(scale));
+}
+
+BENCH_CPU_TARGET_AVX2 static inline __m256d log4(__m256d x)
+{
+    // x = m * 2^e with m in [sqrt(1/2), sqrt(2)), and log(m) = 2*atanh(s) with s = (m-1)/(m+1), |s| < 0.172.
+    const __m256d two52 = _mm256_set1_pd(4503599627370496.0);
+    __m256i bits = _mm256_castpd_si256(x);
+    __m256d e = _mm256_sub_pd(_mm256_castsi256_pd(_mm256_or_si256(_mm256_srli_epi64(bits, 52), _mm256_castpd_si256(two52))), two52);
+    e = _mm256_sub_pd(e, _mm256_set1_pd(1023.0));
+    __m256d m = _mm256_castsi256_pd(_mm256_or_si256(_mm256_and_si256(bits, _mm256_set1_epi64x(0x000fffffffffffffLL)),
+        _mm256_set1_epi64x(0x3ff0000000000000LL)));
+    __m256d big = _mm256_cmp_pd(m, _mm256_set1_pd(SQRT2), _CMP_GE_OQ);
+    m = _mm256_blendv_pd(m, _mm256_mul_pd(m, _mm256_set1_pd(0.5)), big);
+    e = _mm256_add_pd(e, _mm256_and_pd(big, _mm256_set1_pd(1.0)));
+    __m256d s = _mm256_div_pd(_mm256_sub_pd(m, _mm256_set1_pd(1.0)), _mm256_add_pd(m, _mm256_set1_pd(1.0)));
+    __m256d s2 = _mm256_mul_pd(s, s);
+    __m256d p = _mm256_set1_pd(1.0 / 21);
+    for (int k = 19; k >= 1; k -= 2)
+        p = _mm256_fmadd_pd(p, s2, _mm256_set1_pd(1.0 / k));
+    __m256d logm = _mm256_mul_pd(_mm256_mul_pd(_mm256_set1_pd(2.0), s), p);
+    return _mm256_fmadd_pd(e, _mm256_set1_pd(LN2_HI), _mm256_fmadd_pd(e, _mm256_set1_pd(LN2_LO), logm));
+}
+
+BENCH_CPU_TARGET_AVX2 static inline __m256d CND4(__m256d d)
+{
+    __m256d absd = _mm256_andnot_pd(_mm256_set1_pd(-0.0), d);
+    __m256d K = _mm256_div_pd(_mm256_set1_pd(1.0), _mm256_fmadd_pd(_mm256_set1_pd(0.2316419), absd, _mm256_set1_pd(1.0)));
+    __m256d p = _mm256_set1_pd(CND_A[4]);
+    for (int k = 3; k >= 0; k--)
+        p = _mm256_fmadd_pd(p, K, _mm256_set1_pd(CND_A[k]));
+    __m256d cnd = _mm256_mul_pd(_mm256_mul_pd(_mm256_set1_pd(RSQRT2PI), exp4(_mm256_mul_pd(_mm256_mul_pd(_mm256_set1_pd(-0.5), d), d))),
+        _mm256_mul_pd(K, p));
+    return _mm256_blendv_pd(cnd, _mm256_sub_pd(_mm256_set1_pd(1.0), cnd), _mm256_cmp_pd(d, _mm256_setzero_pd(), _CMP_GT_OQ));
+}
+
+BENCH_CPU_TARGET_AVX2 static void BlackScholesAVX2(float *h_CallResult, float *h_PutResult, const float *h_StockPrice,
+    const float *h_OptionStrike, const float *h_OptionYears, float Riskfree, float Volatility, long long begin, long long end)
+{
+    const __m256d R = _mm256_set1_pd(Riskfree), V = _mm256_set1_pd(Volatility);
+    const __m256d one = _mm256_set1_pd(1.0);
+    long long opt = begin;
+    for (; opt + 4 <= end; opt += 4)
+    {
+        __m256d S = _mm256_cvtps_pd(_mm_loadu_ps(h_StockPrice + opt));
+        __m256d X = _mm256_cvtps_pd(_mm_loadu_ps(h_OptionStrike + opt));
+        __m256d T = _mm256_cvtps_pd(_mm_loadu_ps(h_OptionYears + opt));
+        __m256d sqrtT = _mm256_sqrt_pd(T);
+        __m256d d1 = _mm256_div_pd(_mm256_fmadd_pd(_mm256_fmadd_pd(_mm256_mul_pd(_mm256_set1_pd(0.5), V), V, R), T,
+            log4(_mm256_div_pd(S, X))), _mm256_mul_pd(V, sqrtT));
+        __m256d d2 = _mm256_fnmadd_pd(V, sqrtT, d1);
+        __m256d CNDD1 = CND4(d1);
+        __m256d CNDD2 = CND4(d2);
+        __m256d XexpRT = _mm256_mul_pd(X, exp4(_mm256_mul_pd(_mm256_sub_pd(_mm256_setzero_pd(), R), T)));
+        __m256d call = _mm256_fmsub_pd(S, CNDD1, _mm256_mul_pd(XexpRT, CNDD2));
+        __m256d put = _mm256_fmsub_pd(XexpRT, _mm256_sub_pd(one, CNDD2), _mm256_mul_pd(S, _mm256_sub_pd(one, CNDD1)));
+        _mm_storeu_ps(h_CallResult + opt, _mm256_cvtpd_ps(call));
+        _mm_storeu_ps(h_PutResult + opt, _mm256_cvtpd_ps(put));
+    }
+    for (; opt < end; opt++)
+        BlackScholesBodyCPU(h_CallResult[opt], h_PutResult[opt], h_StockPrice[opt], h_OptionStrike[opt], h_OptionYears[opt],
+            Riskfree, Volatility);
+}
+
+BENCH_CPU_TARGET_AVX512 static inline __m512d exp8(__m512d x)
+{
+    x = _mm512_min_pd(_mm512_max_pd(x, _mm512_set1_pd(EXP_MIN)), _mm512_set1_pd(EXP_MAX));
+    __m512d n = _mm512_roundscale_pd(_mm512_mul_pd(x, _mm512_set1_pd(LOG2E)), _MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC);
+    __m512d r = _mm512_fnmadd_pd(n, _mm512_set1_pd(LN2_HI), x);
+    r = _mm512_fnmadd_pd(n, _mm512_set1_pd(LN2_LO), r);
+    __m512d p = _mm512_set1_pd(EXP_C[13]);
+    for (int k = 12; k >= 0; k--)
+        p = _mm512_fmadd_pd(p, r, _mm512_set1_pd(EXP_C[k]));
+    __m512i scale = _mm512_slli_epi64(_mm512_add_epi64(_mm512_cvtpd_epi64(n), _mm512_set1_epi64(1023)), 52);
+    return _mm512_mul_pd(p, _mm512_castsi512_pd(scale));
+}
+
+BENCH_CPU_TARGET_AVX512 static inline __m512d log8(__m512d x)
+{
+    __m512i bits = _mm512_castpd_si512(x);
+    __m512d e = _mm512_cvtepi64_pd(_mm512_sub_epi64(_mm512_srli_epi64(bits, 52), _mm512_set1_epi64(1023)));
+    __m512d m = _mm512_castsi512_pd(_mm512_or_si512(_mm512_and_si512(bits, _mm512_set1_epi64(0x000fffffffffffffLL)),
+        _mm512_set1_epi64(0x3ff0000000000000LL)));
+    __mmask8 big = _mm512_cmp_pd_mask(m, _mm512_set1_pd(SQRT2), _CMP_GE_OQ);
+    m = _mm512_mask_mul_pd(m, big, m, _mm512_set1_pd(0.5));
+    e = _mm512_mask_add_pd(e, big, e, _mm512_set1_pd(1.0));
+    __m512d s = _mm512_div_pd(_mm512_sub_pd(m, _mm512_set1_pd(1.0)), _mm512_add_pd(m, _mm512_set1_pd(1.0)));
+    __m512d s2 = _mm512_mul_pd(s, s);
+    __m512d p = _mm512_set1_pd(1.0 / 21);
+    for (int k = 19; k >= 1; k -= 2)
+        p = _mm512_fmadd_pd(p, s2, _mm512_set1_pd(1.0 / k));
+    __m512d logm = _mm512_mul_pd(_mm512_mul_pd(_mm512_set1_pd(2.0), s), p);
+    return _mm512_fmadd_pd(e, _mm512_set1_pd(LN2_HI), _mm512_fmadd_pd(e, _mm512_set1_pd(LN2_LO), logm));
+}
+
+BENCH_CPU_TARGET_AVX512 static inline __m512d CND8(__m512d d)
+{
+    __m512d K = _mm512_div_pd(_mm512_set1_pd(1.0), _mm512_fmadd_pd(_mm512_set1_pd(0.2316419), _mm512_abs_pd(d), _mm512_set1_pd(1.0)));
+    __m512d p = _mm512_set1_pd(CND_A[4]);
+    for (int k = 3; k >= 0; k--)
+        p = _mm512_fmadd_pd(p, K, _mm512_set1_pd(CND_A[k]));
+    __m512d cnd = _mm512_mul_pd(_mm512_mul_pd(_mm512_set1_pd(RSQRT2PI), exp8(_mm512_mul_pd(_mm512_mul_pd(_mm512_set1_pd(-0.5), d), d))),
+        _mm512_mul_pd(K, p));
+    return _mm512_mask_sub_pd(cnd, _mm512_cmp_pd_mask(d, _mm512_setzero_pd(), _CMP_GT_OQ), _mm512_set1_pd(1.0), cnd);
+}
+
+BENCH_CPU_TARGET_AVX512 static void BlackScholesAVX512(float *h_CallResult, float *h_PutResult, const float *h_StockPrice,
+    const float *h_OptionStrike, const float *h_OptionYears, float Riskfree, float Volatility, long long begin, long long end)
+{
+    const __m512d R = _mm512_set1_pd(Riskfree), V = _mm512_set1_pd(Volatility);
+    const __m512d one = _mm512_set1_pd(1.0);
+    long long opt = begin;
+    for (; opt + 8 <= end; opt += 8)
+    {
+        __m512d S = _mm512_cvtps_pd(_mm256_loadu_ps(h_StockPrice + opt));
+        __m512d X = _mm512_cvtps_pd(_mm256_loadu_ps(h_OptionStrike + opt));
+        __m512d T = _mm512_cvtps_pd(_mm256_loadu_ps(h_OptionYears + opt));
+        __m512d sqrtT = _mm512_sqrt_pd(T);
+        __m512d d1 = _mm512_div_pd(_mm512_fmadd_pd(_mm512_fmadd_pd(_mm512_mul_pd(_mm512_set1_pd(0.5), V), V, R), T,
+            log8(_mm512_div_pd(S, X))), _mm512_mul_pd(V, sqrtT));
+        __m512d d2 = _mm512_fnmadd_pd(V, sqrtT, d1);
+        __m512d CNDD1 = CND8(d1);
+        __m512d CNDD2 = CND8(d2);
+        __m512d XexpRT = _mm512_mul_pd(X, exp8(_mm512_mul_pd(_mm512_sub_pd(_mm512_setzero_pd(), R), T)));
+        __m512d call = _mm512_fmsub_pd(S, CNDD1, _mm512_mul_pd(XexpRT, CNDD2));
+        __m512d put = _mm512_fmsub_pd(XexpRT, _mm512_sub_pd(one, CNDD2), _mm512_mul_pd(S, _mm512_sub_pd(one, CNDD1)));
+        _mm256_storeu_ps(h_CallResult + opt, _mm512_cvtpd_ps(call));
+        _mm256_storeu_ps(h_PutResult + opt, _mm512_cvtpd_ps(put));
+    }
+    for (; opt < end; opt++)
+        BlackScholesBodyCPU(h_CallResult[opt], h_PutResult[opt], h_StockPrice[opt], h_OptionStrike[opt], h_OptionYears[opt],
+            Riskfree, Volatility);
+}
+#endif
+
+
 ////////////////////////////////////////////////////////////////////////////////
-// Process an array of optN options
+// Process an array of optN options, split across all cores. Each thread runs
+// the widest SIMD path of the CPU (see helper_cpu.h) on its chunk.
 ////////////////////////////////////////////////////////////////////////////////
 extern "C" void BlackScholesCPU(
     float *h_CallResult,
@@ -83,14 +253,30 @@ extern "C" void BlackScholesCPU(
     int optN
 )
 {
-    for (int opt = 0; opt < optN; opt++)
-        BlackScholesBodyCPU(
-            h_CallResult[opt],
-            h_PutResult[opt],
-            h_StockPrice[opt],
-            h_OptionStrike[opt],
-            h_OptionYears[opt],
-            Riskfree,
-            Volatility
-        );
+    const CpuIsa isa = cpuIsa();
+    cpuParallelFor(optN, 1024, [=](long long begin, long long end)
+    {
+#ifdef BENCH_CPU_X86
+        if (isa == CPU_ISA_AVX512)
+        {
+            BlackScholesAVX512(h_CallResult, h_PutResult, h_StockPrice, h_OptionStrike, h_OptionYears, Riskfree, Volatility, begin, end);
+            return;
+        }
+        if (isa == CPU_ISA_AVX2)
+        {
+            BlackScholesAVX2(h_CallResult, h_PutResult, h_StockPrice, h_OptionStrike, h_OptionYears, Riskfree, Volatility, begin, end);
+            return;
+        }
+#endif
+        for (long long opt = begin; opt < end; opt++)
+            BlackScholesBodyCPU(
+                h_CallResult[opt],
+                h_PutResult[opt],
+                h_StockPrice[opt],
+                h_OptionStrike[opt],
+                h_OptionYears[opt],
+                Riskfree,
+                Volatility
+            );
+    });
 }
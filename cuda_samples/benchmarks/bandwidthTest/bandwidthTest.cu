@@ -25,6 +25,7 @@
 // includes
 #include <helper_cuda.h>  // helper functions for CUDA error checking and initialization
 #include <helper_functions.h>  // helper for shared functions common to CUDA Samples
+#include <helper_result.h>     // structured result record
 
 #include <cuda.h>
 #include <time.h>
@@ -803,8 +804,10 @@ float testDeviceToDeviceTransfer(unsigned int memSize) {
       cudaMemcpy(d_idata, h_idata, memSize, cudaMemcpyHostToDevice));
 
   // run the memcopy
+  BenchResult benchResult;
   sdkStartTimer(&timer);
   checkCudaErrors(cudaEventRecord(start, 0));
+  benchResultStart(&benchResult, "bandwidthTest");
 
     time_t t;
     struct tm * lt;
@@ -826,6 +829,9 @@ float testDeviceToDeviceTransfer(unsigned int memSize) {
   // cudaDeviceSynchronize() is required in order to get
   // proper timing.
   checkCudaErrors(cudaDeviceSynchronize());
+  benchResultEnd(&benchResult);
+  // device to device copies are not validated. Each copy reads and writes memSize bytes.
+  benchResultWrite(&benchResult, MEMCOPY_ITERATIONS, 2.0 * memSize * MEMCOPY_ITERATIONS, "byte", BENCH_RESULT_UNCHECKED);
 
   // get the total elapsed time in ms
   sdkStopTimer(&timer);
@@ -12,13 +12,152 @@
 
 
 #include <assert.h>
+#include <vector>
+#include <helper_cpu.h>
 #include "convolutionFFT2D_common.h"
 
 
 
 ////////////////////////////////////////////////////////////////////////////////
-// Reference straightforward CPU convolution
+// Reference CPU convolution
+// Every output row gets the clamped source row of each kernel row, so the rows
+// need no clamping. The interior columns, where no kernel tap reaches past the
+// left or right border, are branch-free and vectorized along x; only the
+// kernelW - 1 border columns clamp x. Rows are processed in bands of
+// CONV_BAND_H by x tiles of CONV_TILE_W, so the source block of a tile stays in
+// cache, and the bands are split among threads.
+// Each pixel sums the float products in double in the same order as the
+// straightforward loop (ky outer, kx inner), so the result is bit-identical.
 ////////////////////////////////////////////////////////////////////////////////
+#define CONV_BAND_H 16
+#define CONV_TILE_W 256// a multiple of the vector step.
+
+// src[i] is the source row of kernel row i. left = kernelW - kernelX - 1 is the reach
+// of the kernel to the left: source column x - left + j is multiplied by kernel
+// column kernelW - 1 - j.
+static void convolutionRowInteriorScalar(float *dst, const float *const *src, const float *h_Kernel,
+    int kernelH, int kernelW, int left, int x0, int x1)
+{
+    for (int x = x0; x < x1; x++)
+    {
+        double sum = 0;
+
+        for (int i = 0; i < kernelH; i++)
+        {
+            const float *row = src[i] + x - left;
+            const float *krow = h_Kernel + (kernelH - 1 - i) * kernelW + kernelW - 1;
+
+            for (int j = 0; j < kernelW; j++)
+                sum += row[j] * krow[-j];
+        }
+
+        dst[x] = (float)sum;
+    }
+}
+
+#ifdef BENCH_CPU_X86
+BENCH_CPU_TARGET_AVX2 static void convolutionRowInteriorAVX2(float *dst, const float *const *src, const float *h_Kernel,
+    int kernelH, int kernelW, int left, int x0, int x1)
+{
+    int x = x0;
+
+    for (; x + 16 <= x1; x += 16)
+    {
+        __m256d acc0 = _mm256_setzero_pd(), acc1 = _mm256_setzero_pd();
+        __m256d acc2 = _mm256_setzero_pd(), acc3 = _mm256_setzero_pd();
+
+        for (int i = 0; i < kernelH; i++)
+        {
+            const float *row = src[i] + x - left;
+            const float *krow = h_Kernel + (kernelH - 1 - i) * kernelW + kernelW - 1;
+
+            for (int j = 0; j < kernelW; j++)
+            {
+                __m256 k = _mm256_set1_ps(krow[-j]);
+                __m256 p0 = _mm256_mul_ps(_mm256_loadu_ps(row + j), k);
+                __m256 p1 = _mm256_mul_ps(_mm256_loadu_ps(row + j + 8), k);
+                acc0 = _mm256_add_pd(acc0, _mm256_cvtps_pd(_mm256_castps256_ps128(p0)));
+                acc1 = _mm256_add_pd(acc1, _mm256_cvtps_pd(_mm256_extractf128_ps(p0, 1)));
+                acc2 = _mm256_add_pd(acc2, _mm256_cvtps_pd(_mm256_castps256_ps128(p1)));
+                acc3 = _mm256_add_pd(acc3, _mm256_cvtps_pd(_mm256_extractf128_ps(p1, 1)));
+            }
+        }
+
+        _mm_storeu_ps(dst + x, _mm256_cvtpd_ps(acc0));
+        _mm_storeu_ps(dst + x + 4, _mm256_cvtpd_ps(acc1));
+        _mm_storeu_ps(dst + x + 8, _mm256_cvtpd_ps(acc2));
+        _mm_storeu_ps(dst + x + 12, _mm256_cvtpd_ps(acc3));
+    }
+
+    convolutionRowInteriorScalar(dst, src, h_Kernel, kernelH, kernelW, left, x, x1);
+}
+
+BENCH_CPU_TARGET_AVX512 static void convolutionRowInteriorAVX512(float *dst, const float *const *src, const float *h_Kernel,
+    int kernelH, int kernelW, int left, int x0, int x1)
+{
+    int x = x0;
+
+    for (; x + 32 <= x1; x += 32)
+    {
+        __m512d acc0 = _mm512_setzero_pd(), acc1 = _mm512_setzero_pd();
+        __m512d acc2 = _mm512_setzero_pd(), acc3 = _mm512_setzero_pd();
+
+        for (int i = 0; i < kernelH; i++)
+        {
+            const float *row = src[i] + x - left;
+            const float *krow = h_Kernel + (kernelH - 1 - i) * kernelW + kernelW - 1;
+
+            for (int j = 0; j < kernelW; j++)
+            {
+                __m512 k = _mm512_set1_ps(krow[-j]);
+                __m512 p0 = _mm512_mul_ps(_mm512_loadu_ps(row + j), k);
+                __m512 p1 = _mm512_mul_ps(_mm512_loadu_ps(row + j + 16), k);
+                acc0 = _mm512_add_pd(acc0, _mm512_cvtps_pd(_mm512_castps512_ps256(p0)));
+                acc1 = _mm512_add_pd(acc1, _mm512_cvtps_pd(_mm512_extractf32x8_ps(p0, 1)));
+                acc2 = _mm512_add_pd(acc2, _mm512_cvtps_pd(_mm512_castps512_ps256(p1)));
+                acc3 = _mm512_add_pd(acc3, _mm512_cvtps_pd(_mm512_extractf32x8_ps(p1, 1)));
+            }
+        }
+
+        _mm256_storeu_ps(dst + x, _mm512_cvtpd_ps(acc0));
+        _mm256_storeu_ps(dst + x + 8, _mm512_cvtpd_ps(acc1));
+        _mm256_storeu_ps(dst + x + 16, _mm512_cvtpd_ps(acc2));
+        _mm256_storeu_ps(dst + x + 24, _mm512_cvtpd_ps(acc3));
+    }
+
+    convolutionRowInteriorScalar(dst, src, h_Kernel, kernelH, kernelW, left, x, x1);
+}
+#endif
+
+// Columns [x0, x1) of a row, with x clamped to the border.
+static void convolutionRowBorder(float *dst, const float *const *src, const float *h_Kernel,
+    int dataW, int kernelH, int kernelW, int left, int x0, int x1)
+{
+    for (int x = x0; x < x1; x++)
+    {
+        double sum = 0;
+
+        for (int i = 0; i < kernelH; i++)
+        {
+            const float *row = src[i];
+            const float *krow = h_Kernel + (kernelH - 1 - i) * kernelW + kernelW - 1;
+
+            for (int j = 0; j < kernelW; j++)
+            {
+                int dx = x + j - left;
+
+                if (dx < 0) dx = 0;
+
+                if (dx >= dataW) dx = dataW - 1;
+
+                sum += row[dx] * krow[-j];
+            }
+        }
+
+        dst[x] = (float)sum;
+    }
+}
+
 extern "C" void convolutionClampToBorderCPU(
     float *h_Result,
     float *h_Data,
@@ -31,28 +170,55 @@ extern "C" void convolutionClampToBorderCPU(
     int kernelX
 )
 {
-    for (int y = 0; y < dataH; y++)
-        for (int x = 0; x < dataW; x++)
+    typedef void (*RowInterior)(float *, const float *const *, const float *, int, int, int, int, int);
+    RowInterior rowInterior = convolutionRowInteriorScalar;
+#ifdef BENCH_CPU_X86
+    CpuIsa isa = cpuIsa();
+
+    if (isa == CPU_ISA_AVX512)
+        rowInterior = convolutionRowInteriorAVX512;
+    else if (isa == CPU_ISA_AVX2)
+        rowInterior = convolutionRowInteriorAVX2;
+#endif
+    // interior columns: x - left >= 0 and x + kernelX <= dataW - 1.
+    const int left = kernelW - kernelX - 1;
+    const int xBegin = left < dataW ? left : dataW;
+    const int xEnd = dataW - kernelX > xBegin ? dataW - kernelX : xBegin;
+
+    cpuParallelFor(dataH, CONV_BAND_H, [&](long long begin, long long end)
+    {
+        std::vector<const float *> src((size_t)CONV_BAND_H * kernelH);
+
+        for (int y0 = (int)begin; y0 < (int)end; y0 += CONV_BAND_H)
         {
-            double sum = 0;
+            int y1 = y0 + CONV_BAND_H < (int)end ? y0 + CONV_BAND_H : (int)end;
+
+            for (int y = y0; y < y1; y++)
+            {
+                const float **ySrc = &src[(size_t)(y - y0) * kernelH];
 
-            for (int ky = -(kernelH - kernelY - 1); ky <= kernelY; ky++)
-                for (int kx = -(kernelW - kernelX - 1); kx <= kernelX; kx++)
+                for (int i = 0; i < kernelH; i++)
                 {
-                    int dy = y + ky;
-                    int dx = x + kx;
+                    int dy = y + i - (kernelH - kernelY - 1);
 
                     if (dy < 0) dy = 0;
 
-                    if (dx < 0) dx = 0;
-
                     if (dy >= dataH) dy = dataH - 1;
 
-                    if (dx >= dataW) dx = dataW - 1;
-
-                    sum += h_Data[dy * dataW + dx] * h_Kernel[(kernelY - ky) * kernelW + (kernelX - kx)];
+                    ySrc[i] = h_Data + (size_t)dy * dataW;
                 }
 
-            h_Result[y * dataW + x] = (float)sum;
+                convolutionRowBorder(h_Result + (size_t)y * dataW, ySrc, h_Kernel, dataW, kernelH, kernelW, left, 0, xBegin);
+                convolutionRowBorder(h_Result + (size_t)y * dataW, ySrc, h_Kernel, dataW, kernelH, kernelW, left, xEnd, dataW);
+            }
+
+            for (int x0 = xBegin; x0 < xEnd; x0 += CONV_TILE_W)
+            {
+                int x1 = x0 + CONV_TILE_W < xEnd ? x0 + CONV_TILE_W : xEnd;
+
+                for (int y = y0; y < y1; y++)
+                    rowInterior(h_Result + (size_t)y * dataW, &src[(size_t)(y - y0) * kernelH], h_Kernel, kernelH, kernelW, left, x0, x1);
+            }
         }
+    });
 }
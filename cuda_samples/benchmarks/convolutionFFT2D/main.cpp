@@ -30,6 +30,8 @@
 // Helper functions for CUDA
 #include <helper_functions.h>
 #include <helper_cuda.h>
+#include <helper_result.h>
+#include <helper_cpu.h>         // threads and SIMD dispatch of the CPU reference
 
 #include "convolutionFFT2D_common.h"
 
@@ -193,7 +195,9 @@ bool test0(void)
     printf("...reading back GPU convolution results\n");
     checkCudaErrors(cudaMemcpy(h_ResultGPU, d_PaddedData, fftH * fftW * sizeof(float), cudaMemcpyDeviceToHost));
 
-    printf("...running reference CPU convolution\n");
+    printf("...running reference CPU convolution (%s, %d threads): ", cpuIsaName(cpuIsa()), cpuThreadCount());
+    sdkResetTimer(&hTimer);
+    sdkStartTimer(&hTimer);
     convolutionClampToBorderCPU(
         h_ResultCPU,
         h_Data,
@@ -205,6 +209,8 @@ bool test0(void)
         kernelY,
         kernelX
     );
+    sdkStopTimer(&hTimer);
+    printf("%f ms\n", sdkGetTimerValue(&hTimer));
 
     printf("...comparing the results: ");
     double sum_delta2 = 0;
@@ -384,7 +390,9 @@ bool  test1(void)
     printf("...reading back GPU FFT results\n");
     checkCudaErrors(cudaMemcpy(h_ResultGPU, d_PaddedData, fftH * fftW * sizeof(float), cudaMemcpyDeviceToHost));
 
-    printf("...running reference CPU convolution\n");
+    printf("...running reference CPU convolution (%s, %d threads): ", cpuIsaName(cpuIsa()), cpuThreadCount());
+    sdkResetTimer(&hTimer);
+    sdkStartTimer(&hTimer);
     convolutionClampToBorderCPU(
         h_ResultCPU,
         h_Data,
@@ -396,6 +404,8 @@ bool  test1(void)
         kernelY,
         kernelX
     );
+    sdkStopTimer(&hTimer);
+    printf("%f ms\n", sdkGetTimerValue(&hTimer));
 
     printf("...comparing the results: ");
     double sum_delta2 = 0;
@@ -558,6 +568,8 @@ bool test2(void)
     printf("\n%d-%d-%d %d:%d:%d\n" ,lt->tm_year+1900, lt->tm_mon+1, lt->tm_mday, lt->tm_hour, lt->tm_min, lt->tm_sec);
     sdkResetTimer(&hTimer);
     sdkStartTimer(&hTimer);
+    BenchResult benchResult;
+    benchResultStart(&benchResult, "convolutionFFT2D");
 
     int rep;
     const int repMax = 401000;
@@ -569,8 +581,11 @@ bool test2(void)
 
         checkCudaErrors(cudaDeviceSynchronize());
     }
+    benchResultEnd(&benchResult);
     sdkStopTimer(&hTimer);
     double gpuTime = sdkGetTimerValue(&hTimer);
+    // this test does not compare with the CPU result.
+    benchResultWrite(&benchResult, repMax, (double)repMax * (double)dataH * (double)dataW, "pixel", BENCH_RESULT_UNCHECKED);
     time(&t);
     lt = localtime(&t);
     printf("%d-%d-%d %d:%d:%d\n" ,lt->tm_year+1900, lt->tm_mon+1, lt->tm_mday, lt->tm_hour, lt->tm_min, lt->tm_sec);
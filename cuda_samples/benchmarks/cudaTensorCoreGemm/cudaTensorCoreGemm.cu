@@ -56,12 +56,15 @@
 // helper functions and utilities to work with CUDA
 #include <helper_cuda.h>
 #include <helper_functions.h>
+#include <helper_result.h>
+#include <helper_cpu.h>  // threads and SIMD dispatch of the CPU reference
 
 // Externally configurable parameters.
 
 #ifndef CPU_DEBUG
-// Set this to 1 to verify the correctness of the GPU-computed matrix.
-#define CPU_DEBUG 0
+// Set this to 0 to skip verifying the correctness of the GPU-computed matrix
+// with the host GEMM, after the timed region.
+#define CPU_DEBUG 1
 #endif
 
 #ifndef SHARED_MEMORY_LIMIT_64K
@@ -450,26 +453,72 @@ __global__ void simple_wmma_gemm(half *a, half *b, float *c, float *d, int m_ld,
   }
 }
 
+// Blocked, multithreaded and SIMD, in cudaTensorCoreGemm_gold.cpp. The halves
+// are passed as their bits.
+extern "C" void gemmHalfHost(const unsigned short *A, const unsigned short *B,
+                             float *C, float alpha, float beta, int m, int n,
+                             int k);
+
 __host__ void matMultiplyOnHost(half *A, half *B, float *C, float alpha,
                                 float beta, int numARows, int numAColumns,
                                 int numBRows, int numBColumns, int numCRows,
                                 int numCColumns) {
-  for (int i = 0; i < numCRows; i++) {
-    for (int j = 0; j < numCColumns; j++) {
-      float temp = 0.0;
+  gemmHalfHost((const unsigned short *)A, (const unsigned short *)B, C, alpha,
+               beta, numCRows, numCColumns, numAColumns);
+}
 
-      for (int k = 0; k < numAColumns; k++) {
-        temp += (float)A[i * numAColumns + k] * (float)B[j * numBRows + k];
-      }
+// With -cpu, time the host GEMM alone as a CPU throughput benchmark, -cpuReps
+// times (default 1). No GPU is used.
+int runHostGemm(int argc, char **argv) {
+  int reps = 1;
+  if (checkCmdLineFlag(argc, (const char **)argv, "cpuReps")) {
+    reps = getCmdLineArgumentInt(argc, (const char **)argv, "cpuReps");
+  }
 
-      C[i * numCColumns + j] = temp * alpha + beta * C[i * numCColumns + j];
-    }
+  printf("M: %d, N: %d, K: %d, host GEMM (%s, %d threads), %d reps\n",
+         M_GLOBAL, N_GLOBAL, K_GLOBAL, cpuIsaName(cpuIsa()), cpuThreadCount(),
+         reps);
+
+  half *A_h = (half *)malloc(sizeof(half) * M_GLOBAL * K_GLOBAL);
+  half *B_h = (half *)malloc(sizeof(half) * K_GLOBAL * N_GLOBAL);
+  float *C_h = (float *)malloc(sizeof(float) * M_GLOBAL * N_GLOBAL);
+  init_host_matrices(A_h, B_h, C_h);
+
+  BenchResult benchResult;
+  StopWatchInterface *timer = NULL;
+  sdkCreateTimer(&timer);
+  sdkStartTimer(&timer);
+  benchResultStart(&benchResult, "cudaTensorCoreGemm_cpu");
+  for (int rep = 0; rep < reps; rep++) {
+    matMultiplyOnHost(A_h, B_h, C_h, 1.1f, 1.2f, M_GLOBAL, K_GLOBAL, K_GLOBAL,
+                      N_GLOBAL, M_GLOBAL, N_GLOBAL);
   }
+  benchResultEnd(&benchResult);
+  sdkStopTimer(&timer);
+  benchResultWrite(&benchResult, reps,
+                   2.0 * M_GLOBAL * N_GLOBAL * K_GLOBAL * reps, "flop",
+                   BENCH_RESULT_UNCHECKED);
+
+  float milliseconds = sdkGetTimerValue(&timer);
+  printf("Time: %f ms\n", milliseconds);
+  printf("GFLOPS: %.2f\n", (((double)M_GLOBAL * N_GLOBAL * K_GLOBAL * 2) /
+                             (milliseconds / 1000.)) /
+                                1e9 * reps);
+
+  sdkDeleteTimer(&timer);
+  free(A_h);
+  free(B_h);
+  free(C_h);
+  return 0;
 }
 
 int main(int argc, char **argv) {
   printf("Initializing...\n");
 
+  if (checkCmdLineFlag(argc, (const char **)argv, "cpu")) {
+    return runHostGemm(argc, argv);
+  }
+
   int dev = findCudaDevice(argc, (const char **)argv);
 
   cudaDeviceProp deviceProp;
@@ -549,14 +598,18 @@ int main(int argc, char **argv) {
   const float beta = 1.2f;
     int loop;
     const int loopMax = 50000;
+    int numGemms = 1;
     time_t t;
     struct tm * lt;
+    BenchResult benchResult;
+    BenchResultStatus benchStatus = BENCH_RESULT_UNCHECKED;
 
   cudaEvent_t start, stop;
 
   checkCudaErrors(cudaEventCreate(&start));
   checkCudaErrors(cudaEventCreate(&stop));
   checkCudaErrors(cudaEventRecord(start));
+  benchResultStart(&benchResult, "cudaTensorCoreGemm");
 
     time(&t);
     lt = localtime(&t);
@@ -568,6 +621,7 @@ int main(int argc, char **argv) {
 
     checkCudaErrors(cudaFuncSetAttribute(
         compute_gemm, cudaFuncAttributeMaxDynamicSharedMemorySize, SHMEM_SZ));
+    numGemms = loopMax;
 
         for (loop = 0; loop < loopMax; loop++)
         {
@@ -577,11 +631,6 @@ int main(int argc, char **argv) {
     checkKernelErrors(
         (compute_gemm<<<deviceProp.multiProcessorCount, THREADS_PER_BLOCK,
                         SHMEM_SZ>>>(A, B, C, D, alpha, beta)));
-#if CPU_DEBUG
-    checkCudaErrors(cudaMemcpy(result_hD, D,
-                               sizeof(float) * M_GLOBAL * N_GLOBAL,
-                               cudaMemcpyDeviceToHost));
-#endif
         }
   } else {
     dim3 gridDim;
@@ -599,35 +648,54 @@ int main(int argc, char **argv) {
     printf("Computing... using simple_wmma_gemm kernel\n");
     simple_wmma_gemm<<<gridDim, blockDim>>>(A, B, C, D, M_GLOBAL, N_GLOBAL,
                                             K_GLOBAL, alpha, beta);
-#if CPU_DEBUG
-    checkCudaErrors(cudaMemcpy(result_hD, D,
-                               sizeof(float) * M_GLOBAL * N_GLOBAL,
-                               cudaMemcpyDeviceToHost));
-#endif
   }
 
   checkCudaErrors(cudaEventRecord(stop));
   checkCudaErrors(cudaEventSynchronize(stop));
+  benchResultEnd(&benchResult);
 
     time(&t);
     lt = localtime(&t);
     printf("%d-%d-%d %d:%d:%d\n" ,lt->tm_year+1900, lt->tm_mon+1, lt->tm_mday, lt->tm_hour, lt->tm_min, lt->tm_sec);
 #if CPU_DEBUG
-  printf("Verifying correctness of the computations...\n");
+  // every GEMM of the loop writes the same D, read it once after the timed region.
+  checkCudaErrors(cudaMemcpy(result_hD, D,
+                             sizeof(float) * M_GLOBAL * N_GLOBAL,
+                             cudaMemcpyDeviceToHost));
+
+  printf("Verifying correctness of the computations (%s, %d threads)...\n",
+         cpuIsaName(cpuIsa()), cpuThreadCount());
 
   memcpy(result_host, C_h, sizeof(float) * M_GLOBAL * N_GLOBAL);
 
+  StopWatchInterface *hostTimer = NULL;
+  sdkCreateTimer(&hostTimer);
+  sdkStartTimer(&hostTimer);
   matMultiplyOnHost(A_h, B_h, result_host, alpha, beta, M_GLOBAL, K_GLOBAL,
                     K_GLOBAL, N_GLOBAL, M_GLOBAL, N_GLOBAL);
+  sdkStopTimer(&hostTimer);
+  printf("Host GEMM time: %f ms\n", sdkGetTimerValue(&hostTimer));
+  sdkDeleteTimer(&hostTimer);
 
+  benchStatus = BENCH_RESULT_PASS;
+  int mismatches = 0;
   for (int i = 0; i < N_GLOBAL * M_GLOBAL; i++) {
-    if (fabs(result_hD[i] - result_host[i]) > 0.1f)
-      printf("mismatch i=%d result_hD=%f result_host=%f\n", i, result_hD[i],
-             result_host[i]);
+    if (fabs(result_hD[i] - result_host[i]) > 0.1f) {
+      if (mismatches++ < 10) {
+        printf("mismatch i=%d result_hD=%f result_host=%f\n", i, result_hD[i],
+               result_host[i]);
+      }
+      benchStatus = BENCH_RESULT_FAIL;
+    }
+  }
+  if (mismatches > 0) {
+    printf("%d mismatches\n", mismatches);
   }
   free(result_hD);
   free(result_host);
 #endif
+  // the result is only verified with CPU_DEBUG (the default).
+  benchResultWrite(&benchResult, numGemms, 2.0 * M_GLOBAL * N_GLOBAL * K_GLOBAL * numGemms, "flop", benchStatus);
 
   float milliseconds = 0;
 
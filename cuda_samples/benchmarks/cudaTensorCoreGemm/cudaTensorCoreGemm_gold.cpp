@@ -0,0 +1,322 @@
+/*
+ * Copyright 1993-2017 NVIDIA Corporation.  All rights reserved.
+ *
+ * Please refer to the NVIDIA end user license agreement (EULA) associated
+ * with this source code for terms and conditions that govern your use of
+ * this software. Any use, reproduction, disclosure, or distribution of
+ * this software and related documentation outside the terms of the EULA
+ * is strictly prohibited.
+ *
+ */
+
+// Host GEMM reference of cudaTensorCoreGemm: C = alpha * A * B + beta * C, with
+// A M x K row-major and B K x N column-major in half, and C M x N row-major in
+// float, the layouts of the sample. The halves are passed as their bits.
+//
+// It is blocked like the usual packed-panel CPU GEMM:
+// - The loops over N (GEMM_NC) and K (GEMM_KC) pack a GEMM_KC x GEMM_NC panel
+//   of B, converted to float, in micro-panels of nr columns.
+// - The threads take blocks of GEMM_MC rows of A, packed in micro-panels of
+//   GEMM_MR rows, which stay in L2 while the B micro-panels stream through L1.
+// - A microkernel keeps a GEMM_MR x nr tile of C in registers and adds one
+//   outer product per k with FMA: 6 x 16 with AVX2, 6 x 32 with AVX-512.
+// Packing converts with F16C. It is O(M*K + K*N) per panel, small next to the
+// O(M*N*K) microkernels.
+// C is scaled by beta / alpha first, the products are added, and the result
+// is scaled by alpha, as in compute_gemm.
+
+#include <string.h>
+#include <vector>
+#include <helper_cpu.h>         // threads and SIMD dispatch of the CPU reference
+
+#define GEMM_MR 6
+#define GEMM_NR_MAX 32
+#define GEMM_KC 256
+#define GEMM_MC 96// a multiple of GEMM_MR.
+#define GEMM_NC 2048
+
+static inline float halfToFloat(unsigned short h)
+{
+    unsigned int sign = (h & 0x8000u) << 16;
+    unsigned int exp = (h >> 10) & 0x1f;
+    unsigned int mant = h & 0x3ff;
+    unsigned int bits;
+    float f;
+
+    if (exp == 0x1f)
+        bits = sign | 0x7f800000u | (mant << 13) | (mant != 0 ? 0x400000u : 0);// NaNs are quieted, as by F16C.
+    else if (exp != 0)
+        bits = sign | ((exp + 112) << 23) | (mant << 13);
+    else if (mant == 0)
+        bits = sign;
+    else
+    {
+        // subnormal: normalize the mantissa.
+        exp = 113;
+
+        while (!(mant & 0x400))
+        {
+            mant <<= 1;
+            exp--;
+        }
+
+        bits = sign | (exp << 23) | ((mant & 0x3ff) << 13);
+    }
+
+    memcpy(&f, &bits, sizeof(f));
+    return f;
+}
+
+// dst[p * w + l] = src[l * ld + p] for the lines l < lines, 0 for lines <= l < w, p < kc.
+static void packPanelScalar(float *dst, const unsigned short *src, size_t ld, int lines, int w, int kc)
+{
+    for (int l = 0; l < w; l++)
+    {
+        if (l >= lines)
+        {
+            for (int p = 0; p < kc; p++)
+                dst[p * w + l] = 0;
+
+            continue;
+        }
+
+        for (int p = 0; p < kc; p++)
+            dst[p * w + l] = halfToFloat(src[l * ld + p]);
+    }
+}
+
+static void gemmKernelScalar(int kc, const float *Ap, const float *Bp, float *C, size_t ldc, int mr, int nr)
+{
+    float acc[GEMM_MR][8] = {{0}};
+
+    for (int p = 0; p < kc; p++)
+    {
+        for (int r = 0; r < GEMM_MR; r++)
+            for (int j = 0; j < 8; j++)
+                acc[r][j] += Ap[r] * Bp[j];
+
+        Ap += GEMM_MR;
+        Bp += 8;
+    }
+
+    for (int r = 0; r < mr; r++)
+        for (int j = 0; j < nr; j++)
+            C[r * ldc + j] += acc[r][j];
+}
+
+#ifdef BENCH_CPU_X86
+BENCH_CPU_TARGET_AVX2 static void packPanelF16C(float *dst, const unsigned short *src, size_t ld, int lines, int w, int kc)
+{
+    float line[8];
+
+    for (int l = 0; l < w; l++)
+    {
+        int p = 0;
+
+        if (l >= lines)
+        {
+            for (; p < kc; p++)
+                dst[p * w + l] = 0;
+
+            continue;
+        }
+
+        for (; p + 8 <= kc; p += 8)
+        {
+            _mm256_storeu_ps(line, _mm256_cvtph_ps(_mm_loadu_si128((const __m128i *)(src + l * ld + p))));
+
+            for (int q = 0; q < 8; q++)
+                dst[(p + q) * w + l] = line[q];
+        }
+
+        for (; p < kc; p++)
+            dst[p * w + l] = _cvtsh_ss(src[l * ld + p]);
+    }
+}
+
+// One row of the tile: two vectors of B times a broadcast element of A.
+#define GEMM_ROW_AVX2(r) \
+    a = _mm256_broadcast_ss(Ap + r); \
+    c##r##0 = _mm256_fmadd_ps(a, b0, c##r##0); \
+    c##r##1 = _mm256_fmadd_ps(a, b1, c##r##1);
+
+BENCH_CPU_TARGET_AVX2 static void gemmKernelAVX2(int kc, const float *Ap, const float *Bp, float *C, size_t ldc, int mr, int nr)
+{
+    __m256 c00 = _mm256_setzero_ps(), c01 = _mm256_setzero_ps(), c10 = _mm256_setzero_ps(), c11 = _mm256_setzero_ps();
+    __m256 c20 = _mm256_setzero_ps(), c21 = _mm256_setzero_ps(), c30 = _mm256_setzero_ps(), c31 = _mm256_setzero_ps();
+    __m256 c40 = _mm256_setzero_ps(), c41 = _mm256_setzero_ps(), c50 = _mm256_setzero_ps(), c51 = _mm256_setzero_ps();
+    __m256 a, b0, b1;
+    float tile[GEMM_MR * 16];
+
+    for (int p = 0; p < kc; p++)
+    {
+        b0 = _mm256_loadu_ps(Bp);
+        b1 = _mm256_loadu_ps(Bp + 8);
+        GEMM_ROW_AVX2(0)
+        GEMM_ROW_AVX2(1)
+        GEMM_ROW_AVX2(2)
+        GEMM_ROW_AVX2(3)
+        GEMM_ROW_AVX2(4)
+        GEMM_ROW_AVX2(5)
+        Ap += GEMM_MR;
+        Bp += 16;
+    }
+
+    _mm256_storeu_ps(tile, c00);
+    _mm256_storeu_ps(tile + 8, c01);
+    _mm256_storeu_ps(tile + 16, c10);
+    _mm256_storeu_ps(tile + 24, c11);
+    _mm256_storeu_ps(tile + 32, c20);
+    _mm256_storeu_ps(tile + 40, c21);
+    _mm256_storeu_ps(tile + 48, c30);
+    _mm256_storeu_ps(tile + 56, c31);
+    _mm256_storeu_ps(tile + 64, c40);
+    _mm256_storeu_ps(tile + 72, c41);
+    _mm256_storeu_ps(tile + 80, c50);
+    _mm256_storeu_ps(tile + 88, c51);
+
+    for (int r = 0; r < mr; r++)
+        for (int j = 0; j < nr; j++)
+            C[r * ldc + j] += tile[r * 16 + j];
+}
+
+#define GEMM_ROW_AVX512(r) \
+    a = _mm512_set1_ps(Ap[r]); \
+    c##r##0 = _mm512_fmadd_ps(a, b0, c##r##0); \
+    c##r##1 = _mm512_fmadd_ps(a, b1, c##r##1);
+
+BENCH_CPU_TARGET_AVX512 static void gemmKernelAVX512(int kc, const float *Ap, const float *Bp, float *C, size_t ldc, int mr, int nr)
+{
+    __m512 c00 = _mm512_setzero_ps(), c01 = _mm512_setzero_ps(), c10 = _mm512_setzero_ps(), c11 = _mm512_setzero_ps();
+    __m512 c20 = _mm512_setzero_ps(), c21 = _mm512_setzero_ps(), c30 = _mm512_setzero_ps(), c31 = _mm512_setzero_ps();
+    __m512 c40 = _mm512_setzero_ps(), c41 = _mm512_setzero_ps(), c50 = _mm512_setzero_ps(), c51 = _mm512_setzero_ps();
+    __m512 a, b0, b1;
+    float tile[GEMM_MR * 32];
+
+    for (int p = 0; p < kc; p++)
+    {
+        b0 = _mm512_loadu_ps(Bp);
+        b1 = _mm512_loadu_ps(Bp + 16);
+        GEMM_ROW_AVX512(0)
+        GEMM_ROW_AVX512(1)
+        GEMM_ROW_AVX512(2)
+        GEMM_ROW_AVX512(3)
+        GEMM_ROW_AVX512(4)
+        GEMM_ROW_AVX512(5)
+        Ap += GEMM_MR;
+        Bp += 32;
+    }
+
+    _mm512_storeu_ps(tile, c00);
+    _mm512_storeu_ps(tile + 16, c01);
+    _mm512_storeu_ps(tile + 32, c10);
+    _mm512_storeu_ps(tile + 48, c11);
+    _mm512_storeu_ps(tile + 64, c20);
+    _mm512_storeu_ps(tile + 80, c21);
+    _mm512_storeu_ps(tile + 96, c30);
+    _mm512_storeu_ps(tile + 112, c31);
+    _mm512_storeu_ps(tile + 128, c40);
+    _mm512_storeu_ps(tile + 144, c41);
+    _mm512_storeu_ps(tile + 160, c50);
+    _mm512_storeu_ps(tile + 176, c51);
+
+    for (int r = 0; r < mr; r++)
+        for (int j = 0; j < nr; j++)
+            C[r * ldc + j] += tile[r * 32 + j];
+}
+#endif
+
+static void scaleMatrix(float *C, size_t count, float s)
+{
+    cpuParallelFor(count, 4096, [&](long long begin, long long end)
+    {
+        for (long long i = begin; i < end; i++)
+            C[i] *= s;
+    });
+}
+
+extern "C" void gemmHalfHost(const unsigned short *A, const unsigned short *B, float *C,
+                             float alpha, float beta, int m, int n, int k)
+{
+    void (*packPanel)(float *, const unsigned short *, size_t, int, int, int) = packPanelScalar;
+    void (*kernel)(int, const float *, const float *, float *, size_t, int, int) = gemmKernelScalar;
+    int nr = 8;
+#ifdef BENCH_CPU_X86
+    CpuIsa isa = cpuIsa();
+
+    if (isa >= CPU_ISA_AVX2)
+    {
+        packPanel = packPanelF16C;
+        kernel = gemmKernelAVX2;
+        nr = 16;
+    }
+
+    if (isa == CPU_ISA_AVX512)
+    {
+        kernel = gemmKernelAVX512;
+        nr = 32;
+    }
+#endif
+    const size_t count = (size_t)m * n;
+
+    if (alpha == 0)
+    {
+        scaleMatrix(C, count, beta);
+        return;
+    }
+
+    scaleMatrix(C, count, beta / alpha);
+    std::vector<float> Bpack((size_t)GEMM_KC * ((GEMM_NC + GEMM_NR_MAX - 1) / GEMM_NR_MAX * GEMM_NR_MAX));
+
+    for (int jc = 0; jc < n; jc += GEMM_NC)
+    {
+        int nc = n - jc < GEMM_NC ? n - jc : GEMM_NC;
+        int numPanelsB = (nc + nr - 1) / nr;
+
+        for (int pc = 0; pc < k; pc += GEMM_KC)
+        {
+            int kc = k - pc < GEMM_KC ? k - pc : GEMM_KC;
+
+            cpuParallelFor(numPanelsB, 1, [&](long long begin, long long end)
+            {
+                for (long long q = begin; q < end; q++)
+                {
+                    int j0 = jc + (int)q * nr;
+                    packPanel(&Bpack[(size_t)q * nr * kc], B + (size_t)j0 * k + pc, k, n - j0 < nr ? n - j0 : nr, nr, kc);
+                }
+            });
+
+            cpuParallelFor((m + GEMM_MC - 1) / GEMM_MC, 1, [&](long long begin, long long end)
+            {
+                std::vector<float> Apack((size_t)GEMM_MC * kc);
+
+                for (long long ib = begin; ib < end; ib++)
+                {
+                    int i0 = (int)ib * GEMM_MC;
+                    int mc = m - i0 < GEMM_MC ? m - i0 : GEMM_MC;
+                    int numPanelsA = (mc + GEMM_MR - 1) / GEMM_MR;
+
+                    for (int r = 0; r < numPanelsA; r++)
+                    {
+                        int rows = mc - r * GEMM_MR < GEMM_MR ? mc - r * GEMM_MR : GEMM_MR;
+                        packPanel(&Apack[(size_t)r * GEMM_MR * kc], A + (size_t)(i0 + r * GEMM_MR) * k + pc, k, rows, GEMM_MR, kc);
+                    }
+
+                    for (int q = 0; q < numPanelsB; q++)
+                    {
+                        int cols = nc - q * nr < nr ? nc - q * nr : nr;
+
+                        for (int r = 0; r < numPanelsA; r++)
+                        {
+                            int rows = mc - r * GEMM_MR < GEMM_MR ? mc - r * GEMM_MR : GEMM_MR;
+                            kernel(kc, &Apack[(size_t)r * GEMM_MR * kc], &Bpack[(size_t)q * nr * kc],
+                                   C + (size_t)(i0 + r * GEMM_MR) * n + jc + q * nr, n, rows, cols);
+                        }
+                    }
+                }
+            });
+        }
+    }
+
+    scaleMatrix(C, count, alpha);
+}
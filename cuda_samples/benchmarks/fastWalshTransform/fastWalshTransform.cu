@@ -29,6 +29,9 @@
 #include <string.h>
 #include <helper_functions.h>
 #include <helper_cuda.h>
+#include <helper_result.h>
+#include <helper_cpu.h>
+#include <math.h>
 
 
 ////////////////////////////////////////////////////////////////////////////////
@@ -43,6 +46,13 @@ extern "C" void dyadicConvolutionCPU(
     int log2dataN,
     int log2kernelN
 );
+extern "C" void fastDyadicConvolutionCPU(
+    float *h_Result,
+    float *h_Data,
+    float *h_Kernel,
+    int log2dataN,
+    int log2kernelN
+);
 
 
 ////////////////////////////////////////////////////////////////////////////////
@@ -81,11 +91,13 @@ int main(int argc, char *argv[])
     float *d_Data,
           *d_Kernel;
 
-    double gpuTime;
+    double gpuTime, delta, ref, sum_delta2, sum_ref2, L2norm;
 
     StopWatchInterface *hTimer = NULL;
+    BenchResult benchResult;
     int i;
     int rep;
+    const int repMax = 54000;
 
     printf("%s Starting...\n\n", argv[0]);
 
@@ -133,7 +145,8 @@ int main(int argc, char *argv[])
 
     sdkResetTimer(&hTimer);
     sdkStartTimer(&hTimer);
-    for (rep = 0; rep < 54000; rep++)
+    benchResultStart(&benchResult, "fastWalshTransform");
+    for (rep = 0; rep < repMax; rep++)
     {
         fwtBatchGPU(d_Data, 1, log2Data);
         fwtBatchGPU(d_Kernel, 1, log2Data);
@@ -141,6 +154,7 @@ int main(int argc, char *argv[])
         fwtBatchGPU(d_Data, 1, log2Data);
         checkCudaErrors(cudaDeviceSynchronize());
     }
+    benchResultEnd(&benchResult);
     sdkStopTimer(&hTimer);
     gpuTime = sdkGetTimerValue(&hTimer);
     time(&t);
@@ -148,6 +162,71 @@ int main(int argc, char *argv[])
     printf("%d-%d-%d %d:%d:%d\n" ,lt->tm_year+1900, lt->tm_mon+1, lt->tm_mday, lt->tm_hour, lt->tm_min, lt->tm_sec);
     printf("GPU time: %f ms; GOP/s: %f\n", gpuTime, 30000 * NOPS / (gpuTime * 0.001 * 1E+9));
 
+    // The timed loop transforms d_Data and d_Kernel in place repeatedly, so one convolution is run again for validation.
+    printf("Validating one GPU dyadic convolution...\n");
+    checkCudaErrors(cudaMemset(d_Kernel, 0, DATA_SIZE));
+    checkCudaErrors(cudaMemcpy(d_Kernel, h_Kernel, KERNEL_SIZE, cudaMemcpyHostToDevice));
+    checkCudaErrors(cudaMemcpy(d_Data,   h_Data,     DATA_SIZE, cudaMemcpyHostToDevice));
+    fwtBatchGPU(d_Data, 1, log2Data);
+    fwtBatchGPU(d_Kernel, 1, log2Data);
+    modulateGPU(d_Data, d_Kernel, dataN);
+    fwtBatchGPU(d_Data, 1, log2Data);
+    checkCudaErrors(cudaMemcpy(h_ResultGPU, d_Data, DATA_SIZE, cudaMemcpyDeviceToHost));
+
+    printf("Running CPU dyadic convolution using Fast Walsh Transform (%s, %d threads)...\n", cpuIsaName(cpuIsa()), cpuThreadCount());
+    sdkResetTimer(&hTimer);
+    sdkStartTimer(&hTimer);
+    fastDyadicConvolutionCPU(h_ResultCPU, h_Data, h_Kernel, log2Data, log2Kernel);
+    sdkStopTimer(&hTimer);
+    printf("CPU time: %f ms\n", sdkGetTimerValue(&hTimer));
+
+    // BENCH_CPU_CROSSCHECK=1 also runs the straightforward references: the O(dataN * kernelN) convolution, and the O(N^2)
+    // Walsh transform on the first 2^12 data points.
+    if (getenv("BENCH_CPU_CROSSCHECK") != NULL && atoi(getenv("BENCH_CPU_CROSSCHECK")) != 0)
+    {
+        const int log2Check = log2Data < 12 ? log2Data : 12;
+        float *h_Check = (float *)malloc(DATA_SIZE);
+        printf("Cross-checking with the straightforward CPU dyadic convolution and Walsh transform...\n");
+        dyadicConvolutionCPU(h_Check, h_Data, h_Kernel, log2Data, log2Kernel);
+        sum_delta2 = 0;
+        sum_ref2   = 0;
+        for (i = 0; i < dataN; i++)
+        {
+            delta       = h_ResultCPU[i] - h_Check[i];
+            sum_delta2 += delta * delta;
+            sum_ref2   += (double)h_Check[i] * h_Check[i];
+        }
+        printf("Fast vs straightforward convolution L2 norm: %E\n", sqrt(sum_delta2 / sum_ref2));
+        fwtCPU(h_ResultGPU, h_Data, log2Check);// h_ResultGPU is scratch here, and read back again below.
+        slowWTcpu(h_Check, h_Data, log2Check);
+        sum_delta2 = 0;
+        sum_ref2   = 0;
+        for (i = 0; i < (1 << log2Check); i++)
+        {
+            delta       = h_ResultGPU[i] - h_Check[i];
+            sum_delta2 += delta * delta;
+            sum_ref2   += (double)h_Check[i] * h_Check[i];
+        }
+        printf("fwtCPU vs slowWTcpu L2 norm: %E\n", sqrt(sum_delta2 / sum_ref2));
+        free(h_Check);
+        checkCudaErrors(cudaMemcpy(h_ResultGPU, d_Data, DATA_SIZE, cudaMemcpyDeviceToHost));
+    }
+
+    printf("Comparing the results...\n");
+    sum_delta2 = 0;
+    sum_ref2   = 0;
+    for (i = 0; i < dataN; i++)
+    {
+        delta       = h_ResultCPU[i] - h_ResultGPU[i];
+        ref         = h_ResultCPU[i];
+        sum_delta2 += delta * delta;
+        sum_ref2   += ref * ref;
+    }
+    L2norm = sqrt(sum_delta2 / sum_ref2);
+    printf("L2 norm: %E\n", L2norm);
+    // NOPS per transform as in the GOP/s above, which counts 30000 repetitions.
+    benchResultWrite(&benchResult, repMax, repMax * NOPS, "op", L2norm < 1e-6 ? BENCH_RESULT_PASS : BENCH_RESULT_FAIL);
+
 
     printf("Shutting down...\n");
     sdkDeleteTimer(&hTimer);
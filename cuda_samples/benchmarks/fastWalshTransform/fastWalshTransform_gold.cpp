@@ -11,41 +11,215 @@
 
 
 
+#include <stdlib.h>
+#include <helper_cpu.h>         // threads and SIMD dispatch of the CPU reference
+
+
+
 ///////////////////////////////////////////////////////////////////////////////
-// CPU Fast Walsh Transform
+// Blocked, vectorized and multithreaded FWT in double precision.
+// Butterfly stages commute, so the stages with strides below FWT_BLOCK run
+// block by block in L1 cache, then the larger strides run as radix-4 passes
+// (two stages per pass over memory) split across threads.
 ///////////////////////////////////////////////////////////////////////////////
-extern"C" void fwtCPU(float *h_Output, float *h_Input, int log2N)
-{
-    const int N = 1 << log2N;
+static const int LOG2_FWT_BLOCK = 11;// 2^11 doubles = 16 KB.
+static const long long FWT_BLOCK = 1LL << LOG2_FWT_BLOCK;
 
-    for (int pos = 0; pos < N; pos++)
-        h_Output[pos] = h_Input[pos];
+static void fwtBlockScalar(double *a, long long n)
+{
+    for (long long stride = n / 2; stride >= 1; stride >>= 1)
+        for (long long base = 0; base < n; base += 2 * stride)
+            for (long long j = base; j < base + stride; j++)
+            {
+                double T1 = a[j];
+                double T2 = a[j + stride];
+                a[j] = T1 + T2;
+                a[j + stride] = T1 - T2;
+            }
+}
 
-    //Cycle through stages with different butterfly strides
-    for (int stride = N / 2; stride >= 1; stride >>= 1)
+// Radix-4 butterflies of strides s and 2s for q in [qBegin, qEnd) of the N/4 ones, or radix-2 of stride s for q of the N/2 ones.
+static void fwtPassScalar(double *a, long long s, int radix, long long qBegin, long long qEnd)
+{
+    for (long long q = qBegin; q < qEnd; q++)
     {
-        //Cycle through subvectors of (2 * stride) elements
-        for (int base = 0; base < N; base += 2 * stride)
+        double *p = a + q / s * radix * s + q % s;
+        if (radix == 2)
+        {
+            double T1 = p[0], T2 = p[s];
+            p[0] = T1 + T2;
+            p[s] = T1 - T2;
+            continue;
+        }
+        double x0 = p[0] + p[s], x1 = p[0] - p[s], x2 = p[2 * s] + p[3 * s], x3 = p[2 * s] - p[3 * s];
+        p[0] = x0 + x2;
+        p[s] = x1 + x3;
+        p[2 * s] = x0 - x2;
+        p[3 * s] = x1 - x3;
+    }
+}
 
-            //Butterfly index within subvector of (2 * stride) size
-            for (int j = 0; j < stride; j++)
+#ifdef BENCH_CPU_X86
+BENCH_CPU_TARGET_AVX2 static void fwtBlockAVX2(double *a, long long n)
+{
+    for (long long stride = n / 2; stride >= 4; stride >>= 1)
+        for (long long base = 0; base < n; base += 2 * stride)
+            for (long long j = base; j < base + stride; j += 4)
             {
-                int i0 = base + j +      0;
-                int i1 = base + j + stride;
+                __m256d T1 = _mm256_loadu_pd(a + j);
+                __m256d T2 = _mm256_loadu_pd(a + j + stride);
+                _mm256_storeu_pd(a + j, _mm256_add_pd(T1, T2));
+                _mm256_storeu_pd(a + j + stride, _mm256_sub_pd(T1, T2));
+            }
+    // strides 2 and 1 within a vector: v +- v with the halves or neighbours swapped.
+    for (long long j = 0; j < n; j += 4)
+    {
+        __m256d v = _mm256_loadu_pd(a + j);
+        __m256d p = _mm256_permute2f128_pd(v, v, 0x01);
+        v = _mm256_blend_pd(_mm256_add_pd(v, p), _mm256_sub_pd(p, v), 0xc);
+        p = _mm256_permute_pd(v, 0x5);
+        v = _mm256_blend_pd(_mm256_add_pd(v, p), _mm256_sub_pd(p, v), 0xa);
+        _mm256_storeu_pd(a + j, v);
+    }
+}
 
-                float T1 = h_Output[i0];
-                float T2 = h_Output[i1];
-                h_Output[i0] = T1 + T2;
-                h_Output[i1] = T1 - T2;
+BENCH_CPU_TARGET_AVX2 static void fwtPassAVX2(double *a, long long s, int radix, long long qBegin, long long qEnd)
+{
+    for (long long q = qBegin; q < qEnd; q += 4)
+    {
+        double *p = a + q / s * radix * s + q % s;
+        __m256d v0 = _mm256_loadu_pd(p), v1 = _mm256_loadu_pd(p + s);
+        if (radix == 2)
+        {
+            _mm256_storeu_pd(p, _mm256_add_pd(v0, v1));
+            _mm256_storeu_pd(p + s, _mm256_sub_pd(v0, v1));
+            continue;
+        }
+        __m256d v2 = _mm256_loadu_pd(p + 2 * s), v3 = _mm256_loadu_pd(p + 3 * s);
+        __m256d x0 = _mm256_add_pd(v0, v1), x1 = _mm256_sub_pd(v0, v1), x2 = _mm256_add_pd(v2, v3), x3 = _mm256_sub_pd(v2, v3);
+        _mm256_storeu_pd(p, _mm256_add_pd(x0, x2));
+        _mm256_storeu_pd(p + s, _mm256_add_pd(x1, x3));
+        _mm256_storeu_pd(p + 2 * s, _mm256_sub_pd(x0, x2));
+        _mm256_storeu_pd(p + 3 * s, _mm256_sub_pd(x1, x3));
+    }
+}
+
+BENCH_CPU_TARGET_AVX512 static void fwtBlockAVX512(double *a, long long n)
+{
+    for (long long stride = n / 2; stride >= 8; stride >>= 1)
+        for (long long base = 0; base < n; base += 2 * stride)
+            for (long long j = base; j < base + stride; j += 8)
+            {
+                __m512d T1 = _mm512_loadu_pd(a + j);
+                __m512d T2 = _mm512_loadu_pd(a + j + stride);
+                _mm512_storeu_pd(a + j, _mm512_add_pd(T1, T2));
+                _mm512_storeu_pd(a + j + stride, _mm512_sub_pd(T1, T2));
             }
+    // strides 4, 2 and 1 within a vector.
+    for (long long j = 0; j < n; j += 8)
+    {
+        __m512d v = _mm512_loadu_pd(a + j);
+        __m512d p = _mm512_shuffle_f64x2(v, v, _MM_SHUFFLE(1, 0, 3, 2));
+        v = _mm512_mask_blend_pd(0xf0, _mm512_add_pd(v, p), _mm512_sub_pd(p, v));
+        p = _mm512_permutex_pd(v, _MM_SHUFFLE(1, 0, 3, 2));
+        v = _mm512_mask_blend_pd(0xcc, _mm512_add_pd(v, p), _mm512_sub_pd(p, v));
+        p = _mm512_permute_pd(v, 0x55);
+        v = _mm512_mask_blend_pd(0xaa, _mm512_add_pd(v, p), _mm512_sub_pd(p, v));
+        _mm512_storeu_pd(a + j, v);
     }
 }
 
+BENCH_CPU_TARGET_AVX512 static void fwtPassAVX512(double *a, long long s, int radix, long long qBegin, long long qEnd)
+{
+    for (long long q = qBegin; q < qEnd; q += 8)
+    {
+        double *p = a + q / s * radix * s + q % s;
+        __m512d v0 = _mm512_loadu_pd(p), v1 = _mm512_loadu_pd(p + s);
+        if (radix == 2)
+        {
+            _mm512_storeu_pd(p, _mm512_add_pd(v0, v1));
+            _mm512_storeu_pd(p + s, _mm512_sub_pd(v0, v1));
+            continue;
+        }
+        __m512d v2 = _mm512_loadu_pd(p + 2 * s), v3 = _mm512_loadu_pd(p + 3 * s);
+        __m512d x0 = _mm512_add_pd(v0, v1), x1 = _mm512_sub_pd(v0, v1), x2 = _mm512_add_pd(v2, v3), x3 = _mm512_sub_pd(v2, v3);
+        _mm512_storeu_pd(p, _mm512_add_pd(x0, x2));
+        _mm512_storeu_pd(p + s, _mm512_add_pd(x1, x3));
+        _mm512_storeu_pd(p + 2 * s, _mm512_sub_pd(x0, x2));
+        _mm512_storeu_pd(p + 3 * s, _mm512_sub_pd(x1, x3));
+    }
+}
+#endif
+
+static void fwtDouble(double *a, int log2N)
+{
+    const long long N = 1LL << log2N;
+    const long long block = N < FWT_BLOCK ? N : FWT_BLOCK;
+    const CpuIsa isa = N >= 8 ? cpuIsa() : CPU_ISA_SCALAR;// a block holds at least one vector.
+    cpuParallelFor(N / block, 1, [=](long long begin, long long end)
+    {
+        for (long long b = begin; b < end; b++)
+        {
+#ifdef BENCH_CPU_X86
+            if (isa == CPU_ISA_AVX512)
+                fwtBlockAVX512(a + b * block, block);
+            else if (isa == CPU_ISA_AVX2)
+                fwtBlockAVX2(a + b * block, block);
+            else
+#endif
+                fwtBlockScalar(a + b * block, block);
+        }
+    });
+    for (long long s = block; s < N; s *= 4)
+    {
+        const int radix = s * 2 < N ? 4 : 2;
+        cpuParallelFor(N / radix, 64, [=](long long begin, long long end)
+        {
+#ifdef BENCH_CPU_X86
+            if (isa == CPU_ISA_AVX512)
+                fwtPassAVX512(a, s, radix, begin, end);
+            else if (isa == CPU_ISA_AVX2)
+                fwtPassAVX2(a, s, radix, begin, end);
+            else
+#endif
+                fwtPassScalar(a, s, radix, begin, end);
+        });
+    }
+}
+
+
+
+///////////////////////////////////////////////////////////////////////////////
+// CPU Fast Walsh Transform
+///////////////////////////////////////////////////////////////////////////////
+extern"C" void fwtCPU(float *h_Output, float *h_Input, int log2N)
+{
+    const int N = 1 << log2N;
+    double *a = (double *)malloc(N * sizeof(double));
+
+    cpuParallelFor(N, 4096, [=](long long begin, long long end)
+    {
+        for (long long pos = begin; pos < end; pos++)
+            a[pos] = h_Input[pos];
+    });
+
+    fwtDouble(a, log2N);
+
+    cpuParallelFor(N, 4096, [=](long long begin, long long end)
+    {
+        for (long long pos = begin; pos < end; pos++)
+            h_Output[pos] = (float)a[pos];
+    });
+
+    free(a);
+}
+
 
 
 ///////////////////////////////////////////////////////////////////////////////
 // Straightforward Walsh Transform: used to test both CPU and GPU FWT
 // Slow. Uses doubles because of straightforward accumulation
+// O(N^2), only run as an opt-in cross-check of fwtCPU() on small sizes.
 ///////////////////////////////////////////////////////////////////////////////
 extern"C" void slowWTcpu(float *h_Output, float *h_Input, int log2N)
 {
@@ -75,6 +249,7 @@ extern"C" void slowWTcpu(float *h_Output, float *h_Input, int log2N)
 ////////////////////////////////////////////////////////////////////////////////
 // Reference CPU dyadic convolution.
 // Extremely slow because of non-linear memory access patterns (cache thrashing)
+// Only run as an opt-in cross-check of fastDyadicConvolutionCPU().
 ////////////////////////////////////////////////////////////////////////////////
 extern "C" void dyadicConvolutionCPU(
     float *h_Result,
@@ -97,3 +272,50 @@ extern "C" void dyadicConvolutionCPU(
         h_Result[i] = (float)sum;
     }
 }
+
+
+
+////////////////////////////////////////////////////////////////////////////////
+// CPU dyadic convolution through the Walsh-Hadamard convolution theorem, as the
+// GPU computes it: FWT(FWT(data) * FWT(kernel padded to dataN)) / dataN.
+// O(dataN * log2dataN) in double precision, as accurate as the straightforward
+// dyadicConvolutionCPU().
+////////////////////////////////////////////////////////////////////////////////
+extern "C" void fastDyadicConvolutionCPU(
+    float *h_Result,
+    float *h_Data,
+    float *h_Kernel,
+    int log2dataN,
+    int log2kernelN
+)
+{
+    const long long   dataN = 1LL << log2dataN;
+    const long long kernelN = 1LL << log2kernelN;
+    double *d = (double *)malloc(dataN * sizeof(double));
+    double *k = (double *)malloc(dataN * sizeof(double));
+
+    cpuParallelFor(dataN, 4096, [=](long long begin, long long end)
+    {
+        for (long long i = begin; i < end; i++)
+        {
+            d[i] = h_Data[i];
+            k[i] = i < kernelN ? h_Kernel[i] : 0;
+        }
+    });
+    fwtDouble(d, log2dataN);
+    fwtDouble(k, log2dataN);
+    cpuParallelFor(dataN, 4096, [=](long long begin, long long end)
+    {
+        for (long long i = begin; i < end; i++)
+            d[i] *= k[i] / dataN;
+    });
+    fwtDouble(d, log2dataN);
+    cpuParallelFor(dataN, 4096, [=](long long begin, long long end)
+    {
+        for (long long i = begin; i < end; i++)
+            h_Result[i] = (float)d[i];
+    });
+
+    free(d);
+    free(k);
+}
@@ -45,6 +45,8 @@
 // includes, project
 #include <helper_functions.h>
 #include <helper_cuda.h>
+#include <helper_result.h>
+#include <helper_cpu.h>
 
 #include <cuda_runtime.h>
 
@@ -176,28 +178,12 @@ main(int argc, char **argv)
 
 ////////////////////////////////////////////////////////////////////////////////
 //! Compute sum reduction on CPU
-//! We use Kahan summation for an accurate sum of large arrays.
-//! http://en.wikipedia.org/wiki/Kahan_summation_algorithm
+//! Parallel compensated summation with SIMD lanes, in reductionMultiBlockCG_gold.cpp.
 //!
 //! @param data       pointer to input data
 //! @param size       number of input data elements
 ////////////////////////////////////////////////////////////////////////////////
-template<class T>
-T reduceCPU(T *data, int size)
-{
-    T sum = data[0];
-    T c = (T)0.0;
-
-    for (int i = 1; i < size; i++)
-    {
-        T y = data[i] - c;
-        T t = sum + y;
-        c = (t - sum) - y;
-        sum = t;
-    }
-
-    return sum;
-}
+extern "C" float reduceCPU(float *data, int size);
 
 unsigned int nextPow2(unsigned int x)
 {
@@ -361,9 +347,12 @@ runTest(int argc, char **argv, int device)
     sdkCreateTimer(&timer);
 
     float gpu_result = 0;
+    BenchResult benchResult;
 
+    benchResultStart(&benchResult, "reductionMultiBlockCG");
     gpu_result = benchmarkReduce(size, numThreads, numBlocks, maxThreads, maxBlocks,
                                  testIterations, timer, h_odata, d_idata, d_odata);
+    benchResultEnd(&benchResult);
 
     float reduceTime = sdkGetAverageTimerValue(&timer);
     time(&t);
@@ -373,13 +362,18 @@ runTest(int argc, char **argv, int device)
     printf("Bandwidth:    %f GB/s\n\n", (size * sizeof(int)) / (reduceTime * 1.0e6));
 
     // compute reference solution
-    float cpu_result = reduceCPU<float>(h_idata, size);
+    sdkResetTimer(&timer);
+    sdkStartTimer(&timer);
+    float cpu_result = reduceCPU(h_idata, size);
+    sdkStopTimer(&timer);
+    printf("CPU reduction (%s, %d threads): %f ms\n", cpuIsaName(cpuIsa()), cpuThreadCount(), sdkGetTimerValue(&timer));
     printf("GPU result = %0.12f\n", gpu_result);
     printf("CPU result = %0.12f\n", cpu_result);
 
     double threshold = 1e-8 * size;
     double diff = abs((double)gpu_result - (double)cpu_result);
     bTestPassed = (diff < threshold);
+    benchResultWrite(&benchResult, testIterations, (double)testIterations * size, "element", bTestPassed ? BENCH_RESULT_PASS : BENCH_RESULT_FAIL);
 
     // cleanup
     sdkDeleteTimer(&timer);
@@ -0,0 +1,197 @@
+/**
+ * Copyright 1993-2015 NVIDIA Corporation.  All rights reserved.
+ *
+ * Please refer to the NVIDIA end user license agreement (EULA) associated
+ * with this source code for terms and conditions that govern your use of
+ * this software. Any use, reproduction, disclosure, or distribution of
+ * this software and related documentation outside the terms of the EULA
+ * is strictly prohibited.
+ *
+ */
+
+
+
+#include <math.h>
+#include <vector>
+#include <helper_cpu.h>         // threads and SIMD dispatch of the CPU reference
+
+
+
+////////////////////////////////////////////////////////////////////////////////
+// Compensated sums
+// A serial Kahan sum is one dependency chain of four additions per element.
+// Here the data is cut into blocks of REDUCE_BLOCK elements. Each block is
+// summed in double by independent Kahan accumulators, one per SIMD lane, and
+// the lanes and the blocks are merged with Neumaier's summation, which also
+// holds when an addend is larger than the running sum. The blocks do not depend
+// on the thread count, so neither does the result.
+////////////////////////////////////////////////////////////////////////////////
+#define REDUCE_BLOCK 65536// elements, a multiple of the vector step.
+
+struct CompensatedSum
+{
+    double sum, c;// the value is sum + c.
+};
+
+static inline void neumaierAdd(CompensatedSum &acc, double x)
+{
+    double t = acc.sum + x;
+
+    if (fabs(acc.sum) >= fabs(x))
+        acc.c += (acc.sum - t) + x;
+    else
+        acc.c += (x - t) + acc.sum;
+
+    acc.sum = t;
+}
+
+// Kahan lanes keep sum - c, c being the low part lost by the last additions.
+static CompensatedSum reduceBlockScalar(const float *data, int n)
+{
+    CompensatedSum acc = {0, 0};
+    double sum = 0, c = 0;
+
+    for (int i = 0; i < n; i++)
+    {
+        double y = (double)data[i] - c;
+        double t = sum + y;
+        c = (t - sum) - y;
+        sum = t;
+    }
+
+    neumaierAdd(acc, sum);
+    neumaierAdd(acc, -c);
+    return acc;
+}
+
+#ifdef BENCH_CPU_X86
+BENCH_CPU_TARGET_AVX2 static inline __m256d kahanAddAVX2(__m256d sum, __m256d &c, __m256d x)
+{
+    __m256d y = _mm256_sub_pd(x, c);
+    __m256d t = _mm256_add_pd(sum, y);
+    c = _mm256_sub_pd(_mm256_sub_pd(t, sum), y);
+    return t;
+}
+
+BENCH_CPU_TARGET_AVX2 static CompensatedSum reduceBlockAVX2(const float *data, int n)
+{
+    __m256d s0 = _mm256_setzero_pd(), s1 = _mm256_setzero_pd(), s2 = _mm256_setzero_pd(), s3 = _mm256_setzero_pd();
+    __m256d c0 = _mm256_setzero_pd(), c1 = _mm256_setzero_pd(), c2 = _mm256_setzero_pd(), c3 = _mm256_setzero_pd();
+    int i = 0;
+
+    for (; i + 16 <= n; i += 16)
+    {
+        __m256 a = _mm256_loadu_ps(data + i);
+        __m256 b = _mm256_loadu_ps(data + i + 8);
+        s0 = kahanAddAVX2(s0, c0, _mm256_cvtps_pd(_mm256_castps256_ps128(a)));
+        s1 = kahanAddAVX2(s1, c1, _mm256_cvtps_pd(_mm256_extractf128_ps(a, 1)));
+        s2 = kahanAddAVX2(s2, c2, _mm256_cvtps_pd(_mm256_castps256_ps128(b)));
+        s3 = kahanAddAVX2(s3, c3, _mm256_cvtps_pd(_mm256_extractf128_ps(b, 1)));
+    }
+
+    double sums[16], cs[16];
+    _mm256_storeu_pd(sums, s0);
+    _mm256_storeu_pd(sums + 4, s1);
+    _mm256_storeu_pd(sums + 8, s2);
+    _mm256_storeu_pd(sums + 12, s3);
+    _mm256_storeu_pd(cs, c0);
+    _mm256_storeu_pd(cs + 4, c1);
+    _mm256_storeu_pd(cs + 8, c2);
+    _mm256_storeu_pd(cs + 12, c3);
+    CompensatedSum acc = reduceBlockScalar(data + i, n - i);
+
+    for (int l = 0; l < 16; l++)
+    {
+        neumaierAdd(acc, sums[l]);
+        neumaierAdd(acc, -cs[l]);
+    }
+
+    return acc;
+}
+
+BENCH_CPU_TARGET_AVX512 static inline __m512d kahanAddAVX512(__m512d sum, __m512d &c, __m512d x)
+{
+    __m512d y = _mm512_sub_pd(x, c);
+    __m512d t = _mm512_add_pd(sum, y);
+    c = _mm512_sub_pd(_mm512_sub_pd(t, sum), y);
+    return t;
+}
+
+BENCH_CPU_TARGET_AVX512 static CompensatedSum reduceBlockAVX512(const float *data, int n)
+{
+    __m512d s0 = _mm512_setzero_pd(), s1 = _mm512_setzero_pd(), s2 = _mm512_setzero_pd(), s3 = _mm512_setzero_pd();
+    __m512d c0 = _mm512_setzero_pd(), c1 = _mm512_setzero_pd(), c2 = _mm512_setzero_pd(), c3 = _mm512_setzero_pd();
+    int i = 0;
+
+    for (; i + 32 <= n; i += 32)
+    {
+        __m512 a = _mm512_loadu_ps(data + i);
+        __m512 b = _mm512_loadu_ps(data + i + 16);
+        s0 = kahanAddAVX512(s0, c0, _mm512_cvtps_pd(_mm512_castps512_ps256(a)));
+        s1 = kahanAddAVX512(s1, c1, _mm512_cvtps_pd(_mm512_extractf32x8_ps(a, 1)));
+        s2 = kahanAddAVX512(s2, c2, _mm512_cvtps_pd(_mm512_castps512_ps256(b)));
+        s3 = kahanAddAVX512(s3, c3, _mm512_cvtps_pd(_mm512_extractf32x8_ps(b, 1)));
+    }
+
+    double sums[32], cs[32];
+    _mm512_storeu_pd(sums, s0);
+    _mm512_storeu_pd(sums + 8, s1);
+    _mm512_storeu_pd(sums + 16, s2);
+    _mm512_storeu_pd(sums + 24, s3);
+    _mm512_storeu_pd(cs, c0);
+    _mm512_storeu_pd(cs + 8, c1);
+    _mm512_storeu_pd(cs + 16, c2);
+    _mm512_storeu_pd(cs + 24, c3);
+    CompensatedSum acc = reduceBlockScalar(data + i, n - i);
+
+    for (int l = 0; l < 32; l++)
+    {
+        neumaierAdd(acc, sums[l]);
+        neumaierAdd(acc, -cs[l]);
+    }
+
+    return acc;
+}
+#endif
+
+////////////////////////////////////////////////////////////////////////////////
+//! Compute sum reduction on CPU
+//! Compensated summation in double, see above. It is at least as accurate as
+//! the serial Kahan sum in float it replaces.
+//!
+//! @param data       pointer to input data
+//! @param size       number of input data elements
+////////////////////////////////////////////////////////////////////////////////
+extern "C" float reduceCPU(float *data, int size)
+{
+    CompensatedSum (*reduceBlock)(const float *, int) = reduceBlockScalar;
+#ifdef BENCH_CPU_X86
+    CpuIsa isa = cpuIsa();
+
+    if (isa == CPU_ISA_AVX512)
+        reduceBlock = reduceBlockAVX512;
+    else if (isa == CPU_ISA_AVX2)
+        reduceBlock = reduceBlockAVX2;
+#endif
+    int numBlocks = (size + REDUCE_BLOCK - 1) / REDUCE_BLOCK;
+    std::vector<CompensatedSum> partial(numBlocks);
+
+    cpuParallelFor(numBlocks, 1, [&](long long begin, long long end)
+    {
+        for (long long b = begin; b < end; b++)
+        {
+            int n = size - (int)b * REDUCE_BLOCK < REDUCE_BLOCK ? size - (int)b * REDUCE_BLOCK : REDUCE_BLOCK;
+            partial[b] = reduceBlock(data + b * REDUCE_BLOCK, n);
+        }
+    });
+
+    CompensatedSum acc = {0, 0};
+
+    for (int b = 0; b < numBlocks; b++)
+    {
+        neumaierAdd(acc, partial[b].sum);
+        neumaierAdd(acc, partial[b].c);
+    }
+
+    return (float)(acc.sum + acc.c);
+}
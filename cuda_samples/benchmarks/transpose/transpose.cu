@@ -30,6 +30,9 @@ namespace cg = cooperative_groups;
 #include <helper_string.h>    // helper for string parsing
 #include <helper_image.h>     // helper for image and data comparison
 #include <helper_cuda.h>      // helper for cuda error checking functions
+#include <helper_timer.h>     // helper for timing the CPU reference
+#include <helper_result.h>    // structured result record
+#include <helper_cpu.h>       // threads and SIMD dispatch of the CPU reference
 #include <time.h>
 
 const char *sSDKsample = "Transpose";
@@ -303,17 +306,9 @@ __global__ void transposeCoarseGrained(float *odata, float *idata, int width, in
 // host utility routines
 // ---------------------
 
-void computeTransposeGold(float *gold, float *idata,
-                          const  int size_x, const  int size_y)
-{
-    for (int y = 0; y < size_y; ++y)
-    {
-        for (int x = 0; x < size_x; ++x)
-        {
-            gold[(x * size_y) + y] = idata[(y * size_x) + x];
-        }
-    }
-}
+// blocked, multithreaded and SIMD, in transpose_gold.cpp.
+extern "C" void computeTransposeGold(float *gold, float *idata,
+                                     const  int size_x, const  int size_y);
 
 
 void getParams(int argc, char **argv, cudaDeviceProp &deviceProp, int &size_x, int &size_y, int max_tile_dim)
@@ -367,6 +362,8 @@ showHelp()
     printf("> The default matrix size can be overridden with these parameters\n");
     printf("\t-dimX=row_dim_size (matrix row    dimensions)\n");
     printf("\t-dimY=col_dim_size (matrix column dimensions)\n");
+    printf("> The CPU reference transpose can be timed as a baseline with\n");
+    printf("\t-cpuReps=n         (number of timed CPU transposes, default 0)\n");
 }
 
 
@@ -484,7 +481,41 @@ main(int argc, char **argv)
     checkCudaErrors(cudaMemcpy(d_idata, h_idata, mem_size, cudaMemcpyHostToDevice));
 
     // Compute reference transpose solution
+    StopWatchInterface *hTimer = NULL;
+    sdkCreateTimer(&hTimer);
+    sdkStartTimer(&hTimer);
     computeTransposeGold(transposeGold, h_idata, size_x, size_y);
+    sdkStopTimer(&hTimer);
+    printf("\nCPU reference transpose (%s, %d threads): %.5f ms\n", cpuIsaName(cpuIsa()), cpuThreadCount(), sdkGetTimerValue(&hTimer));
+
+    // optionally time the CPU transpose as a baseline, on the warm output buffer.
+    int cpuReps = 0;
+
+    if (checkCmdLineFlag(argc, (const char **)argv, "cpuReps"))
+    {
+        cpuReps = getCmdLineArgumentInt(argc, (const char **) argv, "cpuReps");
+    }
+
+    if (cpuReps > 0)
+    {
+        sdkResetTimer(&hTimer);
+        sdkStartTimer(&hTimer);
+
+        for (int i=0; i < cpuReps; i++)
+        {
+            computeTransposeGold(transposeGold, h_idata, size_x, size_y);
+        }
+
+        sdkStopTimer(&hTimer);
+        float cpuTime = sdkGetTimerValue(&hTimer);
+        printf("transpose CPU (%s, %d threads), Throughput = %.4f GB/s, Time = %.5f ms, Size = %u fp32 elements\n",
+               cpuIsaName(cpuIsa()), cpuThreadCount(),
+               2.0f * 1000.0f * mem_size/(1024*1024*1024)/(cpuTime/cpuReps),
+               cpuTime/cpuReps,
+               (size_x *size_y));
+    }
+
+    sdkDeleteTimer(&hTimer);
 
     // print out common data for all kernels
     printf("\nMatrix size: %dx%d (%dx%d tiles), tile size: %dx%d, block size: %dx%d\n\n",
@@ -499,6 +530,7 @@ main(int argc, char **argv)
     //
 
     bool success = true;
+    BenchResult benchResult;
     time_t t;
     struct tm * lt;
     time(&t);
@@ -574,6 +606,7 @@ main(int argc, char **argv)
 
         // take measurements for loop over kernel launches
         checkCudaErrors(cudaEventRecord(start, 0));
+        benchResultStart(&benchResult, "transpose");
 
         for (int i=0; i < NUM_REPS; i++)
         {
@@ -585,6 +618,7 @@ main(int argc, char **argv)
 
         checkCudaErrors(cudaEventRecord(stop, 0));
         checkCudaErrors(cudaEventSynchronize(stop));
+        benchResultEnd(&benchResult);
         float kernelTime;
         checkCudaErrors(cudaEventElapsedTime(&kernelTime, start, stop));
 
@@ -607,6 +641,9 @@ main(int argc, char **argv)
             success = false;
         }
 
+        // each repetition reads and writes the matrix once.
+        benchResultWrite(&benchResult, NUM_REPS, 2.0 * mem_size * NUM_REPS, "byte", res ? BENCH_RESULT_PASS : BENCH_RESULT_FAIL);
+
         // report effective bandwidths
         float kernelBandwidth = 2.0f * 1000.0f * mem_size/(1024*1024*1024)/(kernelTime/NUM_REPS);
         printf("transpose %s, Throughput = %.4f GB/s, Time = %.5f ms, Size = %u fp32 elements, NumDevsUsed = %u, Workgroup = %u\n",
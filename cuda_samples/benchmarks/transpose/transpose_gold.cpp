@@ -0,0 +1,111 @@
+/*
+ * Copyright 1993-2015 NVIDIA Corporation.  All rights reserved.
+ *
+ * Please refer to the NVIDIA end user license agreement (EULA) associated
+ * with this source code for terms and conditions that govern your use of
+ * this software. Any use, reproduction, disclosure, or distribution of
+ * this software and related documentation outside the terms of the EULA
+ * is strictly prohibited.
+ *
+ */
+
+
+
+#include <stddef.h>
+#include <helper_cpu.h>         // threads and SIMD dispatch of the CPU reference
+
+
+
+////////////////////////////////////////////////////////////////////////////////
+// Reference transpose: gold[x * size_y + y] = idata[y * size_x + x].
+// The straightforward loop writes gold with a stride of size_y floats, a new
+// cache line and, for large matrices, a new page on every store. Here the
+// matrix is cut into TRANSPOSE_BLOCK x TRANSPOSE_BLOCK blocks, whose input and
+// output fit in L1 together and touch few pages, and each block into 8x8 tiles
+// transposed in AVX2 registers. Each thread owns a band of output rows, so the
+// threads never write the same cache line.
+////////////////////////////////////////////////////////////////////////////////
+#define TRANSPOSE_BLOCK 64// a multiple of 8.
+
+// The rectangle [x0, x1) x [y0, y1) of idata.
+static void transposeRectScalar(float *gold, const float *idata, int size_x, int size_y, int x0, int x1, int y0, int y1)
+{
+    for (int x = x0; x < x1; ++x)
+        for (int y = y0; y < y1; ++y)
+            gold[(size_t)x * size_y + y] = idata[(size_t)y * size_x + x];
+}
+
+#ifdef BENCH_CPU_X86
+BENCH_CPU_TARGET_AVX2 static inline void transposeTile8x8AVX2(float *out, size_t ldOut, const float *in, size_t ldIn)
+{
+    __m256 r0 = _mm256_loadu_ps(in);
+    __m256 r1 = _mm256_loadu_ps(in + ldIn);
+    __m256 r2 = _mm256_loadu_ps(in + 2 * ldIn);
+    __m256 r3 = _mm256_loadu_ps(in + 3 * ldIn);
+    __m256 r4 = _mm256_loadu_ps(in + 4 * ldIn);
+    __m256 r5 = _mm256_loadu_ps(in + 5 * ldIn);
+    __m256 r6 = _mm256_loadu_ps(in + 6 * ldIn);
+    __m256 r7 = _mm256_loadu_ps(in + 7 * ldIn);
+
+    // interleave pairs of rows, then pairs of pairs, within each 128-bit lane.
+    __m256 t0 = _mm256_unpacklo_ps(r0, r1);
+    __m256 t1 = _mm256_unpackhi_ps(r0, r1);
+    __m256 t2 = _mm256_unpacklo_ps(r2, r3);
+    __m256 t3 = _mm256_unpackhi_ps(r2, r3);
+    __m256 t4 = _mm256_unpacklo_ps(r4, r5);
+    __m256 t5 = _mm256_unpackhi_ps(r4, r5);
+    __m256 t6 = _mm256_unpacklo_ps(r6, r7);
+    __m256 t7 = _mm256_unpackhi_ps(r6, r7);
+    r0 = _mm256_shuffle_ps(t0, t2, _MM_SHUFFLE(1, 0, 1, 0));
+    r1 = _mm256_shuffle_ps(t0, t2, _MM_SHUFFLE(3, 2, 3, 2));
+    r2 = _mm256_shuffle_ps(t1, t3, _MM_SHUFFLE(1, 0, 1, 0));
+    r3 = _mm256_shuffle_ps(t1, t3, _MM_SHUFFLE(3, 2, 3, 2));
+    r4 = _mm256_shuffle_ps(t4, t6, _MM_SHUFFLE(1, 0, 1, 0));
+    r5 = _mm256_shuffle_ps(t4, t6, _MM_SHUFFLE(3, 2, 3, 2));
+    r6 = _mm256_shuffle_ps(t5, t7, _MM_SHUFFLE(1, 0, 1, 0));
+    r7 = _mm256_shuffle_ps(t5, t7, _MM_SHUFFLE(3, 2, 3, 2));
+    // then swap the 128-bit lanes: rows 0-3 take the low lanes, rows 4-7 the high lanes.
+    _mm256_storeu_ps(out, _mm256_permute2f128_ps(r0, r4, 0x20));
+    _mm256_storeu_ps(out + ldOut, _mm256_permute2f128_ps(r1, r5, 0x20));
+    _mm256_storeu_ps(out + 2 * ldOut, _mm256_permute2f128_ps(r2, r6, 0x20));
+    _mm256_storeu_ps(out + 3 * ldOut, _mm256_permute2f128_ps(r3, r7, 0x20));
+    _mm256_storeu_ps(out + 4 * ldOut, _mm256_permute2f128_ps(r0, r4, 0x31));
+    _mm256_storeu_ps(out + 5 * ldOut, _mm256_permute2f128_ps(r1, r5, 0x31));
+    _mm256_storeu_ps(out + 6 * ldOut, _mm256_permute2f128_ps(r2, r6, 0x31));
+    _mm256_storeu_ps(out + 7 * ldOut, _mm256_permute2f128_ps(r3, r7, 0x31));
+}
+
+BENCH_CPU_TARGET_AVX2 static void transposeRectAVX2(float *gold, const float *idata, int size_x, int size_y, int x0, int x1, int y0, int y1)
+{
+    int x8 = x0 + (x1 - x0) / 8 * 8;
+    int y8 = y0 + (y1 - y0) / 8 * 8;
+
+    for (int y = y0; y < y8; y += 8)
+        for (int x = x0; x < x8; x += 8)
+            transposeTile8x8AVX2(gold + (size_t)x * size_y + y, size_y, idata + (size_t)y * size_x + x, size_x);
+
+    transposeRectScalar(gold, idata, size_x, size_y, x8, x1, y0, y1);
+    transposeRectScalar(gold, idata, size_x, size_y, x0, x8, y8, y1);
+}
+#endif
+
+extern "C" void computeTransposeGold(float *gold, float *idata, const int size_x, const int size_y)
+{
+    void (*transposeRect)(float *, const float *, int, int, int, int, int, int) = transposeRectScalar;
+#ifdef BENCH_CPU_X86
+
+    if (cpuIsa() >= CPU_ISA_AVX2)
+        transposeRect = transposeRectAVX2;
+#endif
+
+    cpuParallelFor(size_x, TRANSPOSE_BLOCK, [&](long long begin, long long end)
+    {
+        for (int x0 = (int)begin; x0 < (int)end; x0 += TRANSPOSE_BLOCK)
+        {
+            int x1 = x0 + TRANSPOSE_BLOCK < (int)end ? x0 + TRANSPOSE_BLOCK : (int)end;
+
+            for (int y0 = 0; y0 < size_y; y0 += TRANSPOSE_BLOCK)
+                transposeRect(gold, idata, size_x, size_y, x0, x1, y0, y0 + TRANSPOSE_BLOCK < size_y ? y0 + TRANSPOSE_BLOCK : size_y);
+        }
+    });
+}
@@ -0,0 +1,111 @@
+/* MIT License
+
+Copyright (c) 2023 Yijia Zhang
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+
+
+ * Threads and SIMD dispatch of the CPU reference implementations (the *_gold.cpp files) in cuda_samples/benchmarks.
+ * The references validate the GPU results after the timed region. Run serially, they can take longer than the GPU work,
+ * and the GPU idles between the measured phases of an experiment.
+ * - cpuParallelFor(n, grain, fn) calls fn(begin, end) on disjoint chunks of [0, n) from cpuThreadCount() threads. Chunk
+ *   borders are multiples of grain, e.g. a SIMD width or a cache block. Set BENCH_CPU_THREADS to change the thread count,
+ *   the default is all cores. BENCH_CPU_THREADS=1 runs fn in the calling thread.
+ * - cpuIsa() is the widest SIMD instruction set supported by the CPU and the compiler, checked at runtime, so one binary
+ *   runs anywhere. The vector paths are compiled with target attributes (BENCH_CPU_TARGET_AVX2, BENCH_CPU_TARGET_AVX512)
+ *   and need no compiler flags. Set BENCH_CPU_ISA=scalar, avx2 or avx512 to cap it, e.g. to compare with the scalar path.
+ * Link with -lpthread.
+ */
+#ifndef COMMON_HELPER_CPU_H_
+#define COMMON_HELPER_CPU_H_
+
+#include <stdlib.h>
+#include <string.h>
+#include <thread>
+#include <vector>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define BENCH_CPU_X86 1
+#include <immintrin.h>
+#define BENCH_CPU_TARGET_AVX2 __attribute__((target("avx2,fma,f16c")))
+#define BENCH_CPU_TARGET_AVX512 __attribute__((target("avx512f,avx512dq,avx2,fma,f16c")))
+#endif
+
+enum CpuIsa
+{
+    CPU_ISA_SCALAR = 0,
+    CPU_ISA_AVX2,// with FMA and F16C.
+    CPU_ISA_AVX512,// F and DQ.
+};
+
+inline const char *cpuIsaName(CpuIsa isa)
+{
+    return isa == CPU_ISA_AVX512 ? "avx512" : isa == CPU_ISA_AVX2 ? "avx2" : "scalar";
+}
+
+inline CpuIsa cpuIsa()
+{
+    CpuIsa isa = CPU_ISA_SCALAR;
+    const char *cap = getenv("BENCH_CPU_ISA");
+#ifdef BENCH_CPU_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma") && __builtin_cpu_supports("f16c"))
+        isa = CPU_ISA_AVX2;
+    if (isa == CPU_ISA_AVX2 && __builtin_cpu_supports("avx512f") && __builtin_cpu_supports("avx512dq"))
+        isa = CPU_ISA_AVX512;
+#endif
+    if (cap != NULL && strcmp(cap, "scalar") == 0)
+        isa = CPU_ISA_SCALAR;
+    else if (cap != NULL && strcmp(cap, "avx2") == 0 && isa > CPU_ISA_AVX2)
+        isa = CPU_ISA_AVX2;
+    return isa;
+}
+
+inline int cpuThreadCount()
+{
+    const char *env = getenv("BENCH_CPU_THREADS");
+    int n = env != NULL ? atoi(env) : 0;
+    if (n <= 0)
+        n = (int)std::thread::hardware_concurrency();
+    return n > 0 ? n : 1;
+}
+
+template <typename Fn>
+void cpuParallelFor(long long n, long long grain, Fn fn)
+{
+    long long chunks = (n + grain - 1) / grain;
+    long long numThreads = cpuThreadCount() < chunks ? cpuThreadCount() : chunks;
+    std::vector<std::thread> threads;
+    if (numThreads <= 1)
+    {
+        if (n > 0)
+            fn(0LL, n);
+        return;
+    }
+    for (long long t = 0; t < numThreads; t++)
+    {
+        long long begin = chunks * t / numThreads * grain;
+        long long end = chunks * (t + 1) / numThreads * grain;
+        threads.push_back(std::thread(fn, begin, end < n ? end : n));
+    }
+    for (size_t t = 0; t < threads.size(); t++)
+        threads[t].join();
+}
+
+#endif  // COMMON_HELPER_CPU_H_
@@ -0,0 +1,152 @@
+/* MIT License
+
+Copyright (c) 2023 Yijia Zhang
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+
+
+ * Structured result records of the benchmarks in cuda_samples/benchmarks.
+ * A benchmark calls benchResultStart() right before its timed region, benchResultEnd() right after it (after the device is
+ * synchronized), and benchResultWrite() with the iterations, work and validation status of the run. The record is one JSON line:
+ *   {"app": "BlackScholes", "pid": 123, "gpu": "0", "tag": "iteration 0", "start_ns": ..., "end_ns": ..., "seconds": ...,
+ *    "iterations": ..., "work": ..., "work_unit": "option", "throughput": ..., "throughput_unit": "option/s", "status": "PASS"}
+ * start_ns and end_ns are CLOCK_MONOTONIC, the clock of dvfs.c, and throughput is work / seconds of the timed region.
+ * The line is appended to the file or FIFO named by the environment variable BENCH_RESULT_FILE, with a single write(), so
+ * concurrent benchmarks can share one file, and a reader of a FIFO never sees a partial record. A FIFO without a reader is skipped.
+ * Without BENCH_RESULT_FILE, nothing is written. gpu is CUDA_VISIBLE_DEVICES and tag is BENCH_RESULT_TAG, both set by the launcher.
+ * benchResultStart() and benchResultEnd() also post begin/end markers with the same timestamps to the control socket of a
+ * running dvfs daemon ("mark" in dvfsctl.h), which records them inline with its samples, so the app window can be cut out of
+ * the daemon's trace to the loop. The socket is DVFS_CTRL_SOCKET, or the default of dvfsctl.h. Set BENCH_MARKERS=0 to disable.
+ */
+#ifndef COMMON_HELPER_RESULT_H_
+#define COMMON_HELPER_RESULT_H_
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#define BENCH_DVFS_CTRL_SOCKET "/var/run/dvfs.sock"// DVFS_CTRL_SOCKET of dvfsctl.h.
+
+enum BenchResultStatus
+{
+    BENCH_RESULT_PASS = 0,
+    BENCH_RESULT_FAIL,
+    BENCH_RESULT_UNCHECKED,// the benchmark does not validate its results.
+};
+
+struct BenchResult
+{
+    const char *app;
+    unsigned long long startNs;// CLOCK_MONOTONIC.
+    unsigned long long endNs;
+};
+
+inline unsigned long long benchResultNow()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (unsigned long long)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+// Post a marker to the dvfs daemon. Nothing blocks: if the daemon is not running or busy, the marker is dropped.
+inline bool benchResultMark(const char *kind, const char *app, unsigned long long ns)
+{
+    const char *path = getenv("DVFS_CTRL_SOCKET");
+    const char *markers = getenv("BENCH_MARKERS");
+    const char *gpu = getenv("CUDA_VISIBLE_DEVICES");
+    struct sockaddr_un addr;
+    char cmd[256];
+    int fd, len;
+    bool ok;
+
+    if (markers != NULL && strcmp(markers, "0") == 0)
+        return false;
+    len = snprintf(cmd, sizeof(cmd), "mark %s %llu %s %s\n", kind, ns, app, gpu != NULL && gpu[0] != '\0' ? gpu : "-");
+    if (len <= 0 || len >= (int)sizeof(cmd))
+        return false;
+    fd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK, 0);
+    if (fd < 0)
+        return false;
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    strncpy(addr.sun_path, path != NULL ? path : BENCH_DVFS_CTRL_SOCKET, sizeof(addr.sun_path) - 1);
+    // the reply is not read. The daemon takes the pid from the socket.
+    ok = connect(fd, (struct sockaddr *)&addr, sizeof(addr)) == 0 && send(fd, cmd, len, MSG_NOSIGNAL) == len;
+    close(fd);
+    return ok;
+}
+
+inline void benchResultStart(BenchResult *r, const char *app)
+{
+    r->app = app;
+    r->startNs = benchResultNow();
+    r->endNs = r->startNs;
+    benchResultMark("begin", app, r->startNs);
+}
+
+inline void benchResultEnd(BenchResult *r)
+{
+    r->endNs = benchResultNow();
+    benchResultMark("end", r->app, r->endNs);
+}
+
+// work is the total work of the timed region in workUnit, e.g. 2*M*N*K*loops "flop". Return false if the record is not written.
+inline bool benchResultWrite(const BenchResult *r, double iterations, double work, const char *workUnit, BenchResultStatus status)
+{
+    static const char *const statusNames[] = {"PASS", "FAIL", "UNCHECKED"};
+    const char *path = getenv("BENCH_RESULT_FILE");
+    const char *gpu = getenv("CUDA_VISIBLE_DEVICES");
+    const char *tag = getenv("BENCH_RESULT_TAG");
+    char line[1024];
+    double seconds = (r->endNs - r->startNs) / 1e9;
+    int len, fd;
+
+    if (path == NULL || path[0] == '\0')
+        return false;
+    len = snprintf(line, sizeof(line),
+        "{\"app\": \"%s\", \"pid\": %d, \"gpu\": \"%s\", \"tag\": \"%s\", \"start_ns\": %llu, \"end_ns\": %llu, \"seconds\": %.9f, \"iterations\": %.17g, "
+        "\"work\": %.17g, \"work_unit\": \"%s\", \"throughput\": %.17g, \"throughput_unit\": \"%s/s\", \"status\": \"%s\"}\n",
+        r->app, (int)getpid(), gpu != NULL ? gpu : "", tag != NULL ? tag : "", r->startNs, r->endNs, seconds, iterations,
+        work, workUnit, seconds > 0 ? work / seconds : 0, workUnit, statusNames[status]);
+    if (len <= 0 || len >= (int)sizeof(line))
+        return false;
+    // O_NONBLOCK: opening a FIFO without a reader fails with ENXIO instead of blocking the benchmark.
+    fd = open(path, O_WRONLY | O_APPEND | O_CREAT | O_NONBLOCK, 0644);
+    if (fd < 0)
+    {
+        fprintf(stderr, "Result record not written to %s: %s\n", path, strerror(errno));
+        return false;
+    }
+    if (write(fd, line, len) != len)
+    {
+        fprintf(stderr, "Result record not written to %s: %s\n", path, strerror(errno));
+        close(fd);
+        return false;
+    }
+    close(fd);
+    return true;
+}
+
+#endif  // COMMON_HELPER_RESULT_H_
@@ -40,9 +40,10 @@ SOFTWARE.
 //#define MACHINE "a100-insp"
 
 // Other GPU types are not directly supported so far. To use this code for another GPU type,
-// constants minSetFreq, freqAvgEff, maxFreq, setMemFreq, numAvailableFreqs, numProbFreq, probFreqs,
-// and the function getAvailableFreqs() need to be updated.
+// add its constants minSetFreq, freqAvgEff, maxFreq, setMemFreq, numAvailableFreqs, numProbFreq, probFreqs to assureMachines[],
+// and update the function getAvailableFreqs() in assure.c.
 
+#define _GNU_SOURCE// struct ucred of the control socket peer.
 #include <stdio.h>
 #include <stdbool.h>
 #include <stdlib.h>
@@ -53,6 +54,18 @@ SOFTWARE.
 #include <string.h>
 #include <math.h>
 #include <time.h>
+#include <poll.h>
+#include <errno.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <sys/resource.h>
+#include "dvfsctl.h"
+#include "dvfsshm.h"
+#include "dvfsmetrics.h"
+#include "dvfstrace.h"
+#include "dvfsacct.h"
+#include "assure.h"
 
 static volatile int keepRunning = 1;
 
@@ -61,173 +74,211 @@ void intHandler(int dummy) // function used for the interruptable loop.
     keepRunning = 0;
 }
 
-double max(double a, double b)
+nvmlReturn_t getComputeProcesses(nvmlDevice_t device, nvmlProcessInfo_t** infos, unsigned int* capacity, unsigned int* count) // read the compute processes of the device. *infos grows if they do not fit.
 {
-    if (a >= b)
-        return a;
-    else
-        return b;
+    nvmlProcessInfo_t* grown;
+    nvmlReturn_t result;
+    *count = *capacity;
+    result = nvmlDeviceGetComputeRunningProcesses(device, count, *infos);
+    if (NVML_ERROR_INSUFFICIENT_SIZE == result && *count > *capacity)// *count is the number of processes.
+    {
+        grown = (nvmlProcessInfo_t*)realloc(*infos, sizeof(nvmlProcessInfo_t)*(*count + 8));// room for a few new ones.
+        if (grown == NULL)
+            return result;
+        *infos = grown;
+        *capacity = *count + 8;
+        *count = *capacity;
+        result = nvmlDeviceGetComputeRunningProcesses(device, count, *infos);
+    }
+    return result;
 }
 
-double min(double a, double b)
+int newSamples(nvmlDevice_t device, nvmlSamplingType_t type, unsigned long long* lastSeen, unsigned long long* period, double* value) // read the samples newer than *lastSeen and advance it to the newest.
+// Return the number of new samples, or -1 if the device does not report this type. *value is the newest sample, *period the sample interval in microseconds.
 {
-    if (a >= b)
-        return b;
+    static nvmlSample_t* samples = NULL;// grown to the size of the driver's buffer. Only the main loop calls this.
+    static unsigned int capacity = 0;
+    nvmlSample_t* grown;
+    nvmlValueType_t valueType;
+    unsigned int count = 0, s, newest = 0;
+    unsigned long long previous = *lastSeen;
+    nvmlReturn_t result = nvmlDeviceGetSamples(device, type, *lastSeen, &valueType, &count, NULL);// query the buffer size.
+    if (NVML_SUCCESS == result && count > capacity)
+    {
+        grown = (nvmlSample_t*)realloc(samples, sizeof(nvmlSample_t)*count);
+        if (grown == NULL)
+            return -1;
+        samples = grown;
+        capacity = count;
+    }
+    if (NVML_SUCCESS == result)
+    {
+        count = capacity;
+        result = nvmlDeviceGetSamples(device, type, *lastSeen, &valueType, &count, samples);
+    }
+    if (NVML_ERROR_NOT_FOUND == result)
+        return 0;// no sample since lastSeen.
+    if (NVML_SUCCESS != result || count == 0)
+        return NVML_SUCCESS == result ? 0 : -1;
+    for (s = 1; s < count; s++)
+    {
+        if (samples[s].timeStamp > samples[newest].timeStamp)
+            newest = s;
+    }
+    for (s = 0; s < count; s++) // the interval to the sample before the newest one.
+    {
+        if (samples[s].timeStamp < samples[newest].timeStamp && (previous == 0 || samples[s].timeStamp > previous))
+            previous = samples[s].timeStamp;
+    }
+    if (previous > 0 && previous < samples[newest].timeStamp)
+        *period = samples[newest].timeStamp - previous;
+    *lastSeen = samples[newest].timeStamp;
+    if (NVML_VALUE_TYPE_DOUBLE == valueType)
+        *value = samples[newest].sampleValue.dVal;
+    else if (NVML_VALUE_TYPE_UNSIGNED_INT == valueType)
+        *value = samples[newest].sampleValue.uiVal;
+    else if (NVML_VALUE_TYPE_UNSIGNED_LONG == valueType)
+        *value = samples[newest].sampleValue.ulVal;
+    else if (NVML_VALUE_TYPE_SIGNED_LONG_LONG == valueType)
+        *value = samples[newest].sampleValue.sllVal;
     else
-        return a;
+        *value = samples[newest].sampleValue.ullVal;
+    return count;
 }
 
-void linearRegression(int num, double* X, double* Y, double* slope, double* intercept, double* regErr) // linear regression.
+int findTenant(unsigned int* tenantPid, int maxTenants, unsigned int pid, bool insert) // find the slot of a tenant among one GPU's tenants. Return -1 if not found.
 {
-    int k;
-    double sumx=0, sumxsq=0, sumy=0, sumxy=0, sumysq=0, div, xd, yd, a, b;
-    for (k=0; k<num; k++)
+    int t, freeSlot = -1;
+    for (t = 0; t < maxTenants; t++)
     {
-        xd = X[k];
-        yd = Y[k];
-        sumx += xd;
-        sumxsq += xd*xd;
-        sumy += yd;
-        sumxy += xd*yd;
-        sumysq += yd*yd;
+        if (tenantPid[t] == pid)
+            return t;
+        if (tenantPid[t] == 0 && freeSlot < 0)
+            freeSlot = t;
     }
-    div = num*sumxsq - sumx*sumx;
-    a = (num*sumxy-sumx*sumy) / div;
-    b = (sumy*sumxsq-sumx*sumxy) / div;
-    *slope = a;
-    *intercept = b;
-    *regErr = sumysq + a*a*sumxsq + num*b*b - 2*a*sumxy - 2*b*sumy + 2*a*b*sumx;
+    if (insert && freeSlot >= 0)
+        tenantPid[freeSlot] = pid;
+    return insert ? freeSlot : -1;
 }
 
-void foldlineRegression(int xc, int num1, double* X1, double* Y1, int num2, double* X2, double* Y2, double* slope1, double* intercept1, double* slope2, double* intercept2, double* regErr) // Fold-line regression with the assumption that the fold-point's x position is at xc.
+bool pidDescendsFrom(unsigned int pid, unsigned int ancestor) // check if pid is ancestor or one of its descendants, by reading /proc/<pid>/stat.
 {
-    int i, j;
-    double err=0, a1, b1, a2, b2, H, c11, c12, c13, c14, c21, c22, c23, c24, c31, c32, c33, c34, n;
-    double sum1_x=0, sum1_y=0, sum2_x=0, sum2_y=0, sum2_xsq=0, sum2_xy=0, sum1_xsq=0, sum1_xy=0;
-    n = num1 + num2;
-    for (i=0; i<num1; i++)
+    char path[64], buf[512];
+    char* p;
+    FILE* fp;
+    int depth, ppid;
+    for (depth = 0; depth < 16 && pid > 1; depth++)
     {
-        sum1_x += X1[i];
-        sum1_y += Y1[i];
-        sum1_xsq += X1[i]*X1[i];
-        sum1_xy += X1[i]*Y1[i];
+        if (pid == ancestor)
+            return true;
+        sprintf(path, "/proc/%u/stat", pid);
+        fp = fopen(path, "r");
+        if (fp == NULL)
+            return false;
+        p = fgets(buf, sizeof(buf), fp);
+        fclose(fp);
+        if (p == NULL || (p = strrchr(buf, ')')) == NULL || sscanf(p+1, " %*c %d", &ppid) != 1)
+            return false;// the process name may include spaces, so parse after the last ')'.
+        pid = ppid;
     }
-    for (j=0; j<num2; j++)
+    return false;
+}
+
+double jobThres(unsigned int pid, unsigned int gpu, unsigned int* jobPid, unsigned long long* jobMask, double* jobThresholds, int maxJobs, double defaultThres) // the threshold registered by the job owning pid on this gpu.
+{
+    int k;
+    for (k = 0; k < maxJobs; k++)
     {
-        sum2_x += X2[j];
-        sum2_y += Y2[j];
-        sum2_xsq += X2[j]*X2[j];
-        sum2_xy += X2[j]*Y2[j];
+        if (jobPid[k] != 0 && (jobMask[k] >> gpu & 1) && pidDescendsFrom(pid, jobPid[k]))
+            return jobThresholds[k];
     }
+    return defaultThres;
+}
 
-    c11 = sum1_xsq + num2*xc*xc;
-    c12 = xc*sum2_x - num2*xc*xc;
-    c13 = sum1_x + xc*num2;
-    c14 = - sum1_xy - sum2_y*xc;
-    c21 = xc*sum2_x - num2*xc*xc;
-    c22 = sum2_xsq - 2*xc*sum2_x + num2*xc*xc;
-    c23 = sum2_x - num2*xc;
-    c24 = - sum2_xy + xc*sum2_y;
-    c31 = sum1_x + num2*xc;
-    c32 = sum2_x - num2*xc;
-    c33 = n;
-    c34 = - sum1_y - sum2_y;
-
-    H = c11*c22*c33 + c12*c23*c31 + c21*c32*c13 - c13*c22*c31 - c12*c21*c33 - c11*c23*c32;
-    if (H == 0)
+int ctrlOpen(const char* path) // open the listening control socket. Return -1 if failed.
+{
+    struct sockaddr_un addr;
+    struct stat st;
+    int fd;
+    if (lstat(path, &st) == 0 && !S_ISSOCK(st.st_mode))
     {
-        a1 = -1; b1 = -2; a2 = -3; b2 = -4; err = 12345678;
+        printf("Error: %s exists and is not a socket.\n", path);
+        return -1;
     }
-    else
+    fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0)
+        return -1;
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    strncpy(addr.sun_path, path, sizeof(addr.sun_path)-1);
+    unlink(path);// remove the socket left by a killed daemon. Only a socket, checked above.
+    if (bind(fd, (struct sockaddr*)&addr, sizeof(addr)) < 0 || listen(fd, 8) < 0)
     {
-        a1 = -(c14*c22*c33 + c12*c23*c34 + c13*c24*c32 - c13*c22*c34 - c12*c24*c33 - c23*c32*c14) / H;
-        a2 = -(c11*c24*c33 + c21*c34*c13 + c14*c23*c31 - c13*c31*c24 - c11*c23*c34 - c33*c14*c21) / H;
-        b1 = -(c11*c22*c34 + c21*c32*c14 + c12*c24*c31 - c22*c14*c31 - c12*c21*c34 - c11*c32*c24) / H;
-        b2 = xc*(a1-a2) + b1;
-        for (i=0; i<num1; i++)
-        {
-            err += (a1*X1[i] + b1 - Y1[i])*(a1*X1[i] + b1 - Y1[i]);
-        }
-        for (j=0; j<num2; j++)
-        {
-            err += (a2*X2[j] + b2 - Y2[j])*(a2*X2[j] + b2 - Y2[j]);
-        }
+        close(fd);
+        return -1;
     }
-    *slope1 = a1;
-    *intercept1 = b1;
-    *slope2 = a2;
-    *intercept2 = b2;
-    *regErr = err;
+    chmod(path, 0660);// only root and its group can change the policy.
+    return fd;
 }
 
-void getAvailableFreqs(int* availableFreqs, int numAvailableFreqs) // get all available frequency values.
+int ctrlAccept(int ctrlFd, long int waitTime, char* cmd, int size) // wait up to waitTime microseconds for a control command. Return the client fd, or -1 if no command arrives.
 {
-    // Run "nvidia-smi -q -d SUPPORTED_CLOCKS" to get available frequencies and update this function if needed.
-    if (strcmp(MACHINE, "v100-maxq") == 0)
+    struct pollfd pfd;
+    struct timeval tv;
+    int fd, len = 0;
+    ssize_t n;
+    pfd.fd = ctrlFd;
+    pfd.events = POLLIN;
+    if (poll(&pfd, 1, waitTime/1000) <= 0)
     {
-        int idx = 1;
-        int freq = 135;
-        bool seven = true;
-        availableFreqs[0] = freq;
-        while (freq <= 1440)
-        {
-            if (seven)
-            {
-                freq += 7;
-                seven = false;
-            }
-            else
-            {
-                freq += 8;
-                seven = true;
-            }
-            if (freq <= 1440)
-            {
-                availableFreqs[idx] = freq;
-                idx += 1;
-            }
-        }
+        if (waitTime % 1000 > 0)
+            usleep(waitTime % 1000);
+        return -1;
     }
-    else if (strcmp(MACHINE, "v100-300w") == 0)
+    fd = accept(ctrlFd, NULL, NULL);
+    if (fd < 0)
+        return -1;
+    tv.tv_sec = 0;
+    tv.tv_usec = 100000;// a stalled client should not hold the main loop.
+    setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+    while (len < size-1 && (n = read(fd, cmd+len, size-1-len)) > 0)
     {
-        int idx = 1;
-        int freq = 135;
-        bool seven = true;
-        availableFreqs[0] = freq;
-        while (freq <= 1530)
-        {
-            if (seven)
-            {
-                freq += 7;
-                seven = false;
-            }
-            else
-            {
-                freq += 8;
-                seven = true;
-            }
-            if (freq <= 1530)
-            {
-                availableFreqs[idx] = freq;
-                idx += 1;
-            }
-        }
+        len += n;
+        if (memchr(cmd, '\n', len) != NULL)
+            break;
     }
-    else if (strcmp(MACHINE, "a100-insp") == 0)
+    cmd[len] = '\0';
+    cmd[strcspn(cmd, "\r\n")] = '\0';
+    return fd;
+}
+
+int ctrlTarget(const char* arg, unsigned int device_count, unsigned int* first, unsigned int* last) // parse the GPU argument of a control command. Return -1 if invalid.
+{
+    char* end;
+    long int idx;
+    if (strcmp(arg, "all") == 0)
     {
-	    int idx = 1;
-	    int freq = 210;
-	    availableFreqs[0] = freq;
-	    while (freq <= 1410)
-	    {
-	        freq += 15;
-	        if (freq <= 1410)
-	        {
-		    availableFreqs[idx] = freq;
-		    idx += 1;
-	        }
-	    }
+        *first = 0;
+        *last = device_count-1;
+        return 0;
     }
+    idx = strtol(arg, &end, 10);
+    if (end == arg || *end != '\0' || idx < 0 || idx >= device_count)
+        return -1;
+    *first = idx;
+    *last = idx;
+    return 0;
+}
+
+nvmlReturn_t resetClocks(nvmlDevice_t device) // hand the GPU frequency back to the driver.
+{
+    nvmlReturn_t result = nvmlDeviceResetGpuLockedClocks(device);
+    if (NVML_SUCCESS != result && NVML_ERROR_NOT_SUPPORTED != result)
+        return result;
+    result = nvmlDeviceResetApplicationsClocks(device);
+    if (NVML_ERROR_NOT_SUPPORTED == result)
+        return NVML_SUCCESS;
+    return result;
 }
 
 int main(int argc, char* argv[])
@@ -240,61 +291,66 @@ int main(int argc, char* argv[])
     int numAvailableFreqs;// number of available freqs supported by this machine.
     int numProbFreq; // number of freqs to be probed in the probing phase. the freq values are in variable probFreqs.
     int* const probFreqs = (int*)malloc(sizeof(int)*20);// reserve enough space for probing freqs.
+    int ifreq;
 
-    // Run "nvidia-smi -q -d SUPPORTED_CLOCKS" to get available frequencies and update the following parameters if needed.
-    if (strcmp(MACHINE, "v100-maxq") == 0)
+    // the constants of each machine are in assureMachines[] of assure.c, shared with the offline tools.
+    const assureMachine* const machine = assureFindMachine(MACHINE);
+    if (machine == NULL)
     {
-        minSetFreq = 855; freqAvgEff = 855; maxFreq = 1440; setMemFreq = 810; numAvailableFreqs = 175;
-        numProbFreq = 4;
-        probFreqs[0] = 855; // frequency values for probing.
-        probFreqs[1] = 1050;
-        probFreqs[2] = 1245;
-        probFreqs[3] = 1440;
-    }
-    else if (strcmp(MACHINE, "v100-300w") == 0)
-    {
-        minSetFreq = 952; freqAvgEff = 952; maxFreq = 1530; setMemFreq = 877; numAvailableFreqs = 187;
-        numProbFreq = 4;
-        probFreqs[0] = 952; // frequency values for probing.
-        probFreqs[1] = 1147;
-        probFreqs[2] = 1335;
-        probFreqs[3] = 1530;
-    }
-    else if (strcmp(MACHINE, "a100-insp") == 0)
-    {
-        minSetFreq = 1110; freqAvgEff = 1110; maxFreq = 1410; setMemFreq = 1593; numAvailableFreqs = 81;
-        numProbFreq = 4;
-        probFreqs[0] = 1110; // frequency values for probing.
-        probFreqs[1] = 1215;
-        probFreqs[2] = 1320;
-        probFreqs[3] = 1410;
+        printf("Error: unsupported MACHINE %s.\n", MACHINE);
+        free(probFreqs);
+        return 1;
     }
+    minSetFreq = machine->minSetFreq; freqAvgEff = machine->freqAvgEff; maxFreq = machine->maxFreq; setMemFreq = machine->setMemFreq;
+    numAvailableFreqs = machine->numAvailableFreqs;
+    numProbFreq = machine->numProbFreq;
+    for (ifreq = 0; ifreq < numProbFreq; ifreq++)
+        probFreqs[ifreq] = machine->probFreqs[ifreq];// frequency values for probing.
 
     const char *allArg = "mod for modulate";
     const char *argAbbre= "mod";
     printf("Apply policy: %s\n",argv[2]);
     //char *freqsetAlg = "Assure";// NVboost, MaxFreq, EfficientFix, UtilizScale.
     char *freqsetAlg = argv[2];
-    double perfThres = 0.90;// key parameter in Assure. performance should not drop below this percentage when doing DVFS.
-    if (strcmp(argv[1], "mod") == 0 && strcmp(freqsetAlg, "Assure") == 0)
+    double perfThres = 0.90;// key parameter in Assure. performance should not drop below this percentage when doing DVFS. Jobs may register their own values.
+    if (argc > 3 && strcmp(argv[1], "mod") == 0 && strcmp(freqsetAlg, "Assure") == 0)
     {
-        if (strcmp(argv[3], "p95") == 0)
-            perfThres = 0.95;
-        if (strcmp(argv[3], "p90") == 0)
-            perfThres = 0.90;
-        if (strcmp(argv[3], "p85") == 0)
-            perfThres = 0.85;
+        // any value like "p90", "92.5" or "0.9" is accepted.
+        perfThres = parseThres(argv[3]);
+        if (perfThres < 0)
+        {
+            printf("Error: invalid performance constraint %s.\n", argv[3]);
+            return 1;
+        }
     }
     const bool useFreqCap = true;// whether set an upper bound.
     const bool useRegression = true;
-    const int loopDelay = 200;// minimal interval of each loop in milliseconds. Used in multiple policies.
-    const double probDelay = 15;// interval between two probing phase in seconds.
+    int loopDelay = 200;// minimal interval of each loop in milliseconds. Used in multiple policies. Can be changed through the control socket.
+    double probDelay = 15;// interval between two probing phase in seconds. Can be changed through the control socket.
     const int numProbRep = 2; // reptition of each frequency point in the probing phase.
     const double regErrThres = 100; // average regression error threshold per point, beyond which regression model is discarded.
 
     const int probInterval = 20;// used in baseline policies.
     const int movingAvg_windowSize = 16;// window size for calcuting the moving avg/std.
 
+    const bool useIdlePark = true;// park idle GPUs at the lowest supported frequency and wake them up on activity. Not used in NVboost.
+    const double idleParkDelay = 10;// seconds of zero util without compute process before a GPU is parked.
+    const int idleLoopDelay = 50;// loop interval in milliseconds when all GPUs are parked, to detect activity quickly.
+    const int rampTolerance = 15;// in MHz. Ramp is finished when the SM clock is within this range of the wake frequency.
+    const double rampTimeout = 5;// in seconds. Stop waiting for the ramp if the clock is throttled below the wake frequency.
+
+    const bool useAdaptiveDwell = true;// record each probe once mem util and power are sampled at the probe frequency only, in the loop after loopDelay plus one sample period at most.
+    const int probeClockPoll = 10;// in milliseconds. While a probe waits for the SM clock, the clock is polled at this interval between two loops.
+    const int probeMinDwell = 167;// in milliseconds after the SM clock reached the probe frequency, if the device does not report its samples. NVML averages util and power over a sample period of 1/6 to 1 s.
+    const double settleUtilTol = 2;// without samples, mem util change between two ticks, in percent, within which the reading is stable.
+    const double settlePowerTol = 0.05;// without samples, relative power change between two ticks within which the reading is stable.
+
+    const bool useTenants = true;// read per-process utilization. With 2 or more tenants on a GPU (MPS or time-slicing), Assure keeps every tenant within the constraint.
+    const int maxTenants = 8;// max number of processes tracked per GPU.
+    const int maxProcSamples = 64;// initial buffer size for nvmlDeviceGetProcessUtilization(), grown if NVML has more samples.
+    const int tenantExpire = 25;// loops without any utilization sample before a tenant is treated as exited.
+    const int maxJobs = 64;// max number of job thresholds registered through the control socket.
+
     // Utility variables.
     const bool onlySetFreqForOne = false;// default false. If true, only set freq for one gpu to avoid affecting other jobs.
     const int onlySetGPUIdx = 1;// effective only when onlySetFreqForOne is true.
@@ -302,23 +358,71 @@ int main(int argc, char* argv[])
     const bool onlySetAppFreq = true;// default true. true - nvmlDeviceSetApplicationsClocks(); false - nvmlDeviceSetGpuLockedClocks().
     const bool verbose = false;// default false.
     const bool skipSetFreq = false;// default false. true is only used to measure the cost of this tool.
+    const bool useCtrlSocket = true;// default true. Accept runtime commands from dvfsctl. See dvfsctl.h.
+    const bool useShm = true;// default true. Publish the latest samples and decisions in shared memory. See dvfsshm.h.
+    const bool useMetrics = true;// default true. Serve OpenMetrics if the environment variable DVFS_METRICS_PORT or DVFS_METRICS_SOCKET is set. See dvfsmetrics.h.
+    const bool useTrace = true;// default true. If the environment variable DVFS_TRACE names a file, also write the samples there as a binary trace. See dvfstrace.h.
+    const bool useAcct = true;// default true. Account the energy, clocks and performance loss of each compute process, printed as a job record when it exits. See dvfsacct.h.
 
     // Dependent variables. No need to change.
     nvmlReturn_t result;
     nvmlDevice_t device;
     nvmlUtilization_t util;
     nvmlClockType_t freq;
-    unsigned int power, device_count, i, k, setFreq, turn, turn_Opt, ifreq;// warning: unsigned int should not loop from high to low.
+    unsigned int power, device_count, i, k, setFreq;// warning: unsigned int should not loop from high to low.
     struct timeval starttime, endtime;
     long unsigned int duration, addTime;
     long unsigned int accumuTime = 0;
-    int j, iAvail, iprob, reminder, mostEfficiFreq, max_gmem_freq;
-    int recordNum=0, cycle=0, lastprobPhase=0, idx1=0, idx2=0, idx_oldest=0, changeDetect_delay=0;
+    long unsigned int nowTime = 0;
+    long unsigned int lastLoopTime = loopDelay*1000;// duration of the last loop in microseconds, used for energy attribution.
+    int thisLoopDelay = loopDelay;
+    int j, iAvail, iprob, reminder;
+    int recordNum=0, cycle=0, lastprobPhase=0, idx_oldest=0, changeDetect_delay=0;
     int probPhase = numProbFreq * numProbRep; // probing start at the beginning. This variable is not constant.
     const int numProbRec = numProbFreq * numProbRep;
-    double slope_Opt, slope1, slope2, slope1_Opt, slope2_Opt, intercept_Opt, intercept1, intercept2, intercept1_Opt, intercept2_Opt, sumy, regErr, regErr1, regErr2, regErrMin, freq_perfBound, freq_cross, variance, sum_gutil, mostEffici, criticalPerf, thisCap, max_gmem, freqBound, freqPerf, freqOpt, freqEff, f, c0, c1, c2, c3;
-    bool optimalFound, process_exist, freqsetHappen, skipmodel, applyFreqSet;
+    double variance, sum_gutil, thisCap, freqBound, freqPerf, freqOpt, freqEff, f, c0, c1, c2, c3;
+    bool process_exist, freqsetHappen, applyFreqSet;
     bool initialLoop=true;
+    bool activity, allParked, probeRequest=false, anyAssure;
+    bool probeHold=false;// true while the probing phase waits for the last probe to settle.
+    unsigned long long settleNow, settleLimit;
+    struct timeval settleWall;
+    const nvmlSamplingType_t probeSampleTypes[2] = {NVML_MEMORY_UTILIZATION_SAMPLES, NVML_TOTAL_POWER_SAMPLES};// the readings a probe records.
+    int numNew, ist;
+    bool settled, freshReading, sampled[2], clockPending;
+    const char* const policyNames[] = {"MaxFreq", "NVboost", "EfficientFix", "UtilizScale", "Assure"};
+    const char* ctrlPath = getenv("DVFS_CTRL_SOCKET");
+    char ctrlCmd[DVFS_CTRL_MAXLEN], ctrlOp[32], ctrlArg1[32], ctrlArg2[32], ctrlArg3[32], ctrlArg4[32];
+    char* ctrlTok;
+    unsigned long long ctrlMask;
+    int ctrlFd = -1, clientFd, ctrlArgc, ipol;
+    struct ucred peer;
+    socklen_t peerLen;
+    unsigned int ctrlFirst, ctrlLast;
+    long int waitTime, sliceTime;
+    double ctrlValue;
+    dvfsShmSegment* shm = NULL;
+    dvfsShmGpu* shmRec;
+    unsigned long long loopCount = 0;
+    dvfsMetrics* metrics = NULL;
+    unsigned long long metricsTime;
+    const char* tracePath = getenv("DVFS_TRACE");
+    const char* metricsPort = getenv("DVFS_METRICS_PORT");
+    const char* metricsSocket = getenv("DVFS_METRICS_SOCKET");
+    dvfsTrace* trace = NULL;
+    dvfsAcct* acct = NULL;
+    unsigned int procListCount, procListCapacity = maxProcSamples;
+    nvmlReturn_t procListResult;// NVML_ERROR_UNINITIALIZED if the compute processes were not read in this loop.
+    unsigned long long energyMj;
+    int numProbes = 0;// completed probing phases.
+    double probeTime = 0;// seconds spent in probing phases.
+    struct rusage usage;
+    struct timespec loopCpuStart, loopCpuEnd;
+    double loopCpuTime = 0;// CPU time of the main thread in the loops, excluding the wait, in seconds.
+    int iten, slot, numTenants;
+    unsigned int procCount, procCapacity = maxProcSamples, sumSmUtil;
+    nvmlProcessUtilizationSample_t* procGrown;
+    double tenantThres, tenantBound, tenantEff;
     time_t t;
     struct tm * lt;
 
@@ -354,10 +458,6 @@ int main(int argc, char* argv[])
     int** const gpuUtils_sq = (int**)malloc(sizeof(int*)*device_count);// a 2-d array. Each row is for a certain gpu.
     double** const gmemUtils = (double**)malloc(sizeof(double*)*device_count);// a 2-d array. Each row is for a certain gpu.
     double** const gPowers = (double**)malloc(sizeof(double*)*device_count);// a 2-d array. Each row is for a certain gpu.
-    double* const avg_gmemUtils = (double*)malloc(sizeof(double)*numProbFreq);// record the average gmemUtil for each probing frequency.
-    double* const avg_gPowers = (double*)malloc(sizeof(double)*numProbFreq);// record the average gPower for each probing frequency.
-    double* const modelPerf = (double*)malloc(sizeof(double)*numProbFreq);// record model-estimated performance.
-    double* const powerEffici = (double*)malloc(sizeof(double)*numProbFreq);// record power efficiency.
     for (i = 0; i < device_count; i++)
     {
         optimizedFreqs[i] = maxFreq;// initialized value.
@@ -382,18 +482,7 @@ int main(int argc, char* argv[])
             gPowers[i][j] = 0;
         }
     }
-    double* const x = (double*)malloc(sizeof(double)*numProbRec);
-    double* const y = (double*)malloc(sizeof(double)*numProbRec);
-    double* const x1 = (double*)malloc(sizeof(double)*numProbRec);
-    double* const y1 = (double*)malloc(sizeof(double)*numProbRec);
-    double* const x2 = (double*)malloc(sizeof(double)*numProbRec);
-    double* const y2 = (double*)malloc(sizeof(double)*numProbRec);
-    double* const x3 = (double*)malloc(sizeof(double)*numProbRec);
-    double* const y3 = (double*)malloc(sizeof(double)*numProbRec);
-    for (i = 0; i < numProbRec; i++)
-    {
-        x[i] = 0; y[i] = 0; x1[i] = 0; y1[i] = 0; x2[i] = 0; y2[i] = 0; x3[i] = 0; y3[i] = 0;
-    }
+    double* const modelWork = (double*)malloc(sizeof(double)*(6*numProbRec + 4*numProbFreq));// work space of assureModelFit().
     double* const gutil_moving_avg = (double*)malloc(sizeof(double)*device_count);
     double* const gutil_moving_sqsum = (double*)malloc(sizeof(double)*device_count);
     double* const gutil_moving_std = (double*)malloc(sizeof(double)*device_count);
@@ -403,8 +492,120 @@ int main(int argc, char* argv[])
         gutil_moving_avg[i] = 0;
         gutil_moving_sqsum[i] = 0;
     }
+    double* const idleStart = (double*)malloc(sizeof(double)*device_count);// time in microseconds since the GPU is idle. -1 means active.
+    bool* const gpuParked = (bool*)malloc(sizeof(bool)*device_count);
+    int* const parkEvent = (int*)malloc(sizeof(int)*device_count);// 1 if the GPU is parked in this loop, for printing.
+    long unsigned int* const wakeTime = (long unsigned int*)malloc(sizeof(long unsigned int)*device_count);// time when activity is detected. 0 means no ramp pending.
+    unsigned int* const wakeFreq = (unsigned int*)malloc(sizeof(unsigned int)*device_count);
+    long int* const rampTime = (long int*)malloc(sizeof(long int)*device_count);// measured time-to-ramp in microseconds. 0 means nothing to report, -1 means timeout.
+    for (i = 0; i < device_count; i++)
+    {
+        idleStart[i] = -1;
+        gpuParked[i] = false;
+        parkEvent[i] = 0;
+        wakeTime[i] = 0;
+        wakeFreq[i] = maxFreq;
+        rampTime[i] = 0;
+    }
+    // Adaptive probe dwell. Times are CLOCK_MONOTONIC in nanoseconds, see dvfsMetricsNow().
+    bool* const probeWait = (bool*)malloc(sizeof(bool)*device_count);// true until the last probe set of the GPU has settled.
+    unsigned int* const probeSetFreq = (unsigned int*)malloc(sizeof(unsigned int)*device_count);
+    unsigned long long* const probeSetTime = (unsigned long long*)malloc(sizeof(unsigned long long)*device_count);
+    unsigned long long* const probeClockTime = (unsigned long long*)malloc(sizeof(unsigned long long)*device_count);// when the SM clock reached the probe frequency. 0 means not yet.
+    unsigned long long* const probeClockWall = (unsigned long long*)malloc(sizeof(unsigned long long)*device_count);// the same in microseconds of gettimeofday(), as NVML sample timestamps.
+    unsigned long long* const probeSampleSeen = (unsigned long long*)malloc(sizeof(unsigned long long)*device_count*2);// timestamp of the newest sample of each of probeSampleTypes.
+    unsigned long long* const probeSamplePeriod = (unsigned long long*)malloc(sizeof(unsigned long long)*device_count*2);// sample interval in microseconds, 0 if not known yet.
+    double* const probeSampleValue = (double*)malloc(sizeof(double)*device_count*2);// the newest sample.
+    double* const probeLastMem = (double*)malloc(sizeof(double)*device_count);// mem util and power of the last tick.
+    double* const probeLastPower = (double*)malloc(sizeof(double)*device_count);
+    double* const probeSettledMem = (double*)malloc(sizeof(double)*device_count);// the settled samples to record, -1 to record the readings.
+    double* const probeSettledPower = (double*)malloc(sizeof(double)*device_count);
+    double* const settleClockSum = (double*)malloc(sizeof(double)*device_count);// measured time-to-effect in milliseconds: clock, and all readings.
+    double* const settleSum = (double*)malloc(sizeof(double)*device_count);
+    double* const settleMax = (double*)malloc(sizeof(double)*device_count);
+    int* const settleCount = (int*)malloc(sizeof(int)*device_count);
+    int* const settleTimeouts = (int*)malloc(sizeof(int)*device_count);// probes recorded after loopDelay without settling.
+    int* const probeDiscarded = (int*)malloc(sizeof(int)*device_count);// transient samples not recorded.
+    for (i = 0; i < device_count; i++)
+    {
+        probeWait[i] = false;
+        probeSettledMem[i] = -1;
+        probeSettledPower[i] = -1;
+        settleClockSum[i] = 0;
+        settleSum[i] = 0;
+        settleMax[i] = 0;
+        settleCount[i] = 0;
+        settleTimeouts[i] = 0;
+        probeDiscarded[i] = 0;
+        for (ist = 0; ist < 2; ist++)
+        {
+            probeSampleSeen[i*2+ist] = 0;
+            probeSamplePeriod[i*2+ist] = 0;
+        }
+    }
+    // Tenant records. Tenant t of GPU i is at index i*maxTenants+t. tenantPid 0 means an empty slot.
+    unsigned int* const tenantPid = (unsigned int*)malloc(sizeof(unsigned int)*device_count*maxTenants);
+    unsigned int* const tenantSmUtil = (unsigned int*)malloc(sizeof(unsigned int)*device_count*maxTenants);
+    unsigned int* const tenantMemUtil = (unsigned int*)malloc(sizeof(unsigned int)*device_count*maxTenants);
+    int* const tenantLastSeen = (int*)malloc(sizeof(int)*device_count*maxTenants);// loops since the last utilization sample.
+    bool* const tenantProbed = (bool*)malloc(sizeof(bool)*device_count*maxTenants);// true if the tenant is present during the whole probing phase.
+    double* const tenantCap = (double*)malloc(sizeof(double)*device_count*maxTenants);
+    double* const tenantEnergy = (double*)malloc(sizeof(double)*device_count*maxTenants);// attributed energy in joules.
+    double* const tenantTime = (double*)malloc(sizeof(double)*device_count*maxTenants);// lifetime in seconds.
+    double* const tenantMemUtils = (double*)malloc(sizeof(double)*device_count*maxTenants*numProbRec);// probing records of each tenant.
+    unsigned long long* const procLastSeen = (unsigned long long*)malloc(sizeof(unsigned long long)*device_count);// timestamp of the last process sample.
+    nvmlReturn_t* const procError = (nvmlReturn_t*)malloc(sizeof(nvmlReturn_t)*device_count);// the last error of the process query, printed once.
+    nvmlProcessUtilizationSample_t* procSamples = (nvmlProcessUtilizationSample_t*)malloc(sizeof(nvmlProcessUtilizationSample_t)*procCapacity);
+    for (i = 0; i < device_count*maxTenants; i++)
+    {
+        tenantPid[i] = 0;
+        tenantProbed[i] = false;
+    }
+    for (i = 0; i < device_count; i++)
+    {
+        procLastSeen[i] = 0;
+        procError[i] = NVML_SUCCESS;
+    }
+    // Per-job accounting, gathered in the loop through the GPUs and passed to dvfsAcctUpdate() after the sample line.
+    nvmlProcessInfo_t* procList = (nvmlProcessInfo_t*)malloc(sizeof(nvmlProcessInfo_t)*procListCapacity);// the compute processes of one GPU, for the accounting and idle park.
+    unsigned int* const acctPids = (unsigned int*)malloc(sizeof(unsigned int)*device_count*maxProcSamples);
+    double* const acctWeights = (double*)malloc(sizeof(double)*device_count*maxProcSamples);
+    int* const acctNumPids = (int*)malloc(sizeof(int)*device_count);// -1 if the process list was not read in this loop.
+    double* const acctEnergy = (double*)malloc(sizeof(double)*device_count);// energy of the last loop in joules.
+    unsigned int* const acctFreq = (unsigned int*)malloc(sizeof(unsigned int)*device_count);
+    unsigned long long* const acctLastEnergy = (unsigned long long*)malloc(sizeof(unsigned long long)*device_count);// board energy counter in mJ. 0 if not read.
+    for (i = 0; i < device_count; i++)
+    {
+        acctNumPids[i] = -1;
+        acctLastEnergy[i] = 0;
+    }
+    // Per-GPU state changed by the control socket.
+    const char** const gpuAlg = (const char**)malloc(sizeof(const char*)*device_count);// policy of each GPU, initialized by argv[2].
+    int* const pinFreq = (int*)malloc(sizeof(int)*device_count);// pinned frequency. 0 means not pinned.
+    bool* const gpuExcluded = (bool*)malloc(sizeof(bool)*device_count);
+    bool* const ctrlApply = (bool*)malloc(sizeof(bool)*device_count);// apply the new setting in the next loop.
+    double* const lastFreqBound = (double*)malloc(sizeof(double)*device_count);// last Assure model result, for dump.
+    double* const lastFreqEff = (double*)malloc(sizeof(double)*device_count);
+    for (i = 0; i < device_count; i++)
+    {
+        gpuAlg[i] = freqsetAlg;
+        pinFreq[i] = 0;
+        gpuExcluded[i] = false;
+        ctrlApply[i] = false;
+        lastFreqBound[i] = -1;
+        lastFreqEff[i] = -1;
+    }
+    // Job thresholds. A job registers its pid, its GPUs and its own threshold. Entries expire when the pid exits.
+    unsigned int* const jobPid = (unsigned int*)malloc(sizeof(unsigned int)*maxJobs);// 0 means an empty entry.
+    unsigned long long* const jobMask = (unsigned long long*)malloc(sizeof(unsigned long long)*maxJobs);// bit i for GPU i.
+    double* const jobThresholds = (double*)malloc(sizeof(double)*maxJobs);
+    double* const gpuThres = (double*)malloc(sizeof(double)*device_count);// the tightest active threshold of each GPU.
+    for (k = 0; k < maxJobs; k++)
+        jobPid[k] = 0;
+    for (i = 0; i < device_count; i++)
+        gpuThres[i] = perfThres;
     int* const availableFreqs = (int*)malloc(sizeof(int)*numAvailableFreqs);
-    getAvailableFreqs(availableFreqs, numAvailableFreqs);
+    getAvailableFreqs(MACHINE, availableFreqs, numAvailableFreqs);
     if (verbose)
     {
         printf("Available frequencies:\n");
@@ -470,12 +671,167 @@ int main(int argc, char* argv[])
     }
     printf("\n");
 
+    // Open the control socket.
+    if (useCtrlSocket)
+    {
+        if (ctrlPath == NULL)
+            ctrlPath = DVFS_CTRL_SOCKET;
+        ctrlFd = ctrlOpen(ctrlPath);
+        if (ctrlFd < 0)
+            printf("Warning: cannot open control socket %s. Runtime commands are disabled.\n", ctrlPath);
+        else
+            printf("Control socket: %s\n", ctrlPath);
+        signal(SIGPIPE, SIG_IGN);// a client may close before reading the reply.
+    }
+
+    // Create the shared-memory telemetry.
+    if (useShm)
+    {
+        shm = dvfsShmCreate(device_count);
+        if (shm == NULL)
+            printf("Warning: cannot create shared memory %s. Telemetry is not published.\n", dvfsShmName());
+    }
+    if (useMetrics && ((metricsPort != NULL && metricsPort[0] != '\0') || (metricsSocket != NULL && metricsSocket[0] != '\0')))
+    {
+        metrics = dvfsMetricsStart(device_count, shm);
+        if (metrics == NULL)
+            printf("Warning: cannot open the metrics endpoint. Metrics are not served.\n");
+    }
+    if (useTrace && tracePath != NULL && tracePath[0] != '\0')
+    {
+        trace = dvfsTraceCreate(tracePath, device_count, MACHINE, dvfsTraceDaemonSchema, DVFS_TRACE_NUMCOLUMNS, DVFS_TRACE_BLOCKROWS);
+        if (trace == NULL)
+            printf("Warning: cannot create trace %s. Samples are only printed.\n", tracePath);
+        else
+            printf("Trace: %s\n", tracePath);
+    }
+    if (useAcct)
+    {
+        acct = dvfsAcctStart(device_count, maxTenants, availableFreqs, numAvailableFreqs);
+        if (acct == NULL)
+            printf("Warning: cannot start the job accounting. Job records are not printed.\n");
+    }
+
     // main loop.
     signal(SIGINT, intHandler);
     printf("Main loop start..\n");
     while (keepRunning) // press ctrl+c can break this loop.
     {
         gettimeofday(&starttime, NULL);
+        clock_gettime(CLOCK_THREAD_CPUTIME_ID, &loopCpuStart);
+        nowTime = starttime.tv_sec * 1000000 + starttime.tv_usec;
+        dvfsTraceSetInt(trace, DVFS_TRACE_TIME, 0, nowTime);
+        dvfsTraceSetInt(trace, DVFS_TRACE_MONOTONIC, 0, dvfsMetricsNow());
+        dvfsTraceSetInt(trace, DVFS_TRACE_PROBPHASE, 0, probPhase);
+        anyAssure = false;
+        for (i = 0; i < device_count; i++)
+        {
+            if (strcmp(gpuAlg[i], "Assure") == 0)
+                anyAssure = true;
+            // apply the tightest threshold of the jobs registered on this GPU. Without any job, use the default.
+            gpuThres[i] = -1;
+            for (k = 0; k < maxJobs; k++)
+            {
+                if (jobPid[k] != 0 && (jobMask[k] >> i & 1))
+                    gpuThres[i] = max(gpuThres[i], jobThresholds[k]);
+            }
+            if (gpuThres[i] < 0)
+                gpuThres[i] = perfThres;
+        }
+
+        // Adaptive dwell: measure the time-to-effect of the last probe set before the readings of this loop, so that the probe is
+        // recorded, and the next one set, in the loop in which it settled. NVML averages mem util and power over a sample period, so
+        // the reading is transient until a whole sample period has passed since the SM clock reached the probe frequency. Where the
+        // device reports its samples, this is read from their timestamps, and a loop without a new sample only repeats a stale
+        // reading. Otherwise, the reading must be probeMinDwell after the clock and agree with the last loop.
+        for (i = 0; probeHold && i < device_count; i++)
+        {
+            if (!probeWait[i])
+                continue;
+            result = nvmlDeviceGetHandleByIndex(i, &device);
+            if (NVML_SUCCESS == result)
+                result = nvmlDeviceGetUtilizationRates(device, &util);
+            if (NVML_SUCCESS == result)
+                result = nvmlDeviceGetClockInfo(device, 1, &freq);// 1 refers to SM domain.
+            if (NVML_SUCCESS == result)
+                result = nvmlDeviceGetPowerUsage(device, &power);
+            if (NVML_SUCCESS != result || strcmp(gpuAlg[i], "Assure") != 0 || gpuParked[i] || (util.gpu == 0 && util.memory == 0))
+            {
+                // nothing to settle on an idle or parked GPU, or one that left Assure. Do not hold the other GPUs for it.
+                probeWait[i] = false;
+                continue;
+            }
+            settleNow = dvfsMetricsNow();
+            if (probeClockTime[i] == 0 && abs((int)freq - (int)probeSetFreq[i]) <= rampTolerance)
+            {
+                probeClockTime[i] = settleNow;
+                gettimeofday(&settleWall, NULL);
+                probeClockWall[i] = settleWall.tv_sec * 1000000ULL + settleWall.tv_usec;
+            }
+            settled = probeClockTime[i] > 0;
+            freshReading = false;
+            settleLimit = probeMinDwell*1000ULL;
+            for (ist = 0; ist < 2; ist++)
+            {
+                numNew = newSamples(device, probeSampleTypes[ist], &probeSampleSeen[i*2+ist], &probeSamplePeriod[i*2+ist], &probeSampleValue[i*2+ist]);
+                sampled[ist] = numNew >= 0;
+                if (numNew >= 0)
+                {
+                    if (probeSamplePeriod[i*2+ist] > 0)
+                        settleLimit = max(settleLimit, probeSamplePeriod[i*2+ist]);
+                    freshReading = freshReading || numNew > 0;
+                    if (probeClockTime[i] == 0 || probeSampleSeen[i*2+ist] < probeClockWall[i] + (probeSamplePeriod[i*2+ist] > 0 ? probeSamplePeriod[i*2+ist] : probeMinDwell*1000ULL))
+                        settled = false;// the newest sample still averages over the old clock.
+                }
+                else if (ist == 0)
+                {
+                    freshReading = freshReading || util.memory != probeLastMem[i];
+                    if (probeClockTime[i] == 0 || settleNow - probeClockTime[i] < probeMinDwell*1000000ULL || fabs(util.memory - probeLastMem[i]) > settleUtilTol)
+                        settled = false;
+                }
+                else
+                {
+                    freshReading = freshReading || (double)power/1000 != probeLastPower[i];
+                    if (probeClockTime[i] == 0 || settleNow - probeClockTime[i] < probeMinDwell*1000000ULL || fabs((double)power/1000 - probeLastPower[i]) > settlePowerTol*probeLastPower[i])
+                        settled = false;
+                }
+            }
+            if (settled)
+            {
+                // the probe records the newest samples rather than the readings of this loop, which may still be older.
+                if (sampled[0])
+                    probeSettledMem[i] = probeSampleValue[i*2];
+                if (sampled[1])
+                    probeSettledPower[i] = probeSampleValue[i*2+1] / 1000;
+                probeWait[i] = false;
+                settleCount[i] += 1;
+                settleClockSum[i] += (probeClockTime[i] - probeSetTime[i]) / 1e6;
+                settleSum[i] += (settleNow - probeSetTime[i]) / 1e6;
+                settleMax[i] = max(settleMax[i], (settleNow - probeSetTime[i]) / 1e6);
+                dvfsMetricsObserve(metrics, DVFS_HIST_PROBE_SETTLE, settleNow - probeSetTime[i]);
+            }
+            else if (settleNow - probeSetTime[i] >= loopDelay*1000000ULL + settleLimit*1000)
+            {
+                // e.g. the clock is throttled below the probe frequency. Record the readings of this loop as with a fixed dwell.
+                probeWait[i] = false;
+                settleTimeouts[i] += 1;
+                dvfsMetricsCount(metrics, i, DVFS_COUNT_PROBE_TIMEOUTS);
+            }
+            else if (freshReading)
+                probeDiscarded[i] += 1;
+            probeLastMem[i] = util.memory;
+            probeLastPower[i] = (double)power/1000;
+        }
+        if (probeHold)
+        {
+            probeHold = false;
+            for (i = 0; i < device_count; i++)
+            {
+                if (probeWait[i])
+                    probeHold = true;// keep the probing phase at this probe until every probed GPU has settled.
+            }
+        }
+
         if (printUtil)
         {
             time(&t);
@@ -494,7 +850,9 @@ int main(int argc, char* argv[])
             }
 
             // get gpu utilization rate (including gmem bandwidth util).
+            metricsTime = dvfsMetricsNow();
             result = nvmlDeviceGetUtilizationRates(device, &util);
+            dvfsMetricsObserve(metrics, DVFS_HIST_NVML, dvfsMetricsNow() - metricsTime);
             if (NVML_SUCCESS != result)
             { 
                 printf("Failed to get utilization rate for GPU %u: %s\n", i, nvmlErrorString(result));
@@ -502,7 +860,9 @@ int main(int argc, char* argv[])
             }
 
             // get gpu frequency.
+            metricsTime = dvfsMetricsNow();
             result = nvmlDeviceGetClockInfo(device, 1, &freq);// 1 refers to SM domain.
+            dvfsMetricsObserve(metrics, DVFS_HIST_NVML, dvfsMetricsNow() - metricsTime);
             if (NVML_SUCCESS != result)
             { 
                 printf("Failed to get clock frequency for GPU %u: %s\n", i, nvmlErrorString(result));
@@ -510,34 +870,189 @@ int main(int argc, char* argv[])
             }
 
             // get gpu power usage.
+            metricsTime = dvfsMetricsNow();
             result = nvmlDeviceGetPowerUsage(device, &power);
+            dvfsMetricsObserve(metrics, DVFS_HIST_NVML, dvfsMetricsNow() - metricsTime);
             if (NVML_SUCCESS != result)
             {
                 printf("Failed to get power usage for GPU %u: %s\n", i, nvmlErrorString(result));
                 goto Error;
             }
 
+            // get per-process utilization and attribute the energy of the last loop to the tenants.
+            if (useTenants)
+            {
+                procCount = procCapacity;
+                metricsTime = dvfsMetricsNow();
+                result = nvmlDeviceGetProcessUtilization(device, procSamples, &procCount, procLastSeen[i]);
+                if (NVML_ERROR_INSUFFICIENT_SIZE == result)
+                {
+                    // more samples than the buffer holds. Ask for their number, grow the buffer and read again.
+                    procCount = 0;
+                    nvmlDeviceGetProcessUtilization(device, NULL, &procCount, procLastSeen[i]);
+                    procCount = max(procCount, procCapacity*2);
+                    procGrown = (nvmlProcessUtilizationSample_t*)realloc(procSamples, sizeof(nvmlProcessUtilizationSample_t)*procCount);
+                    if (procGrown != NULL)
+                    {
+                        procSamples = procGrown;
+                        procCapacity = procCount;
+                        result = nvmlDeviceGetProcessUtilization(device, procSamples, &procCount, procLastSeen[i]);
+                    }
+                }
+                dvfsMetricsObserve(metrics, DVFS_HIST_NVML, dvfsMetricsNow() - metricsTime);
+                if (NVML_ERROR_NOT_FOUND == result)
+                    procCount = 0;// no new sample since procLastSeen[i].
+                else if (NVML_SUCCESS != result)
+                {
+                    if (result != procError[i])
+                        printf("Failed to get process utilization for GPU %u: %s. Tenants are kept until it succeeds.\n", i, nvmlErrorString(result));
+                    procCount = 0;
+                }
+                if (NVML_SUCCESS == result || NVML_ERROR_NOT_FOUND == result)
+                {
+                    // age the tenants only if NVML answered. Without an answer, their samples are not known to be missing.
+                    for (iten = 0; iten < maxTenants; iten++)
+                    {
+                        if (tenantPid[i*maxTenants+iten] != 0)
+                            tenantLastSeen[i*maxTenants+iten] += 1;
+                    }
+                }
+                procError[i] = result;
+                for (k = 0; k < procCount; k++)
+                {
+                    if (procSamples[k].timeStamp > procLastSeen[i])
+                        procLastSeen[i] = procSamples[k].timeStamp;
+                    slot = findTenant(&tenantPid[i*maxTenants], maxTenants, procSamples[k].pid, false);
+                    if (slot < 0)
+                    {
+                        // a new tenant.
+                        slot = findTenant(&tenantPid[i*maxTenants], maxTenants, procSamples[k].pid, true);
+                        if (slot < 0)
+                            continue;// too many tenants. The extra ones are not tracked.
+                        slot += i*maxTenants;
+                        tenantSmUtil[slot] = 0; tenantMemUtil[slot] = 0;
+                        tenantEnergy[slot] = 0; tenantTime[slot] = 0;
+                        tenantProbed[slot] = false;// not present at the start of probing.
+                    }
+                    else
+                    {
+                        slot += i*maxTenants;
+                        if (tenantLastSeen[slot] == 0 && tenantSmUtil[slot] >= procSamples[k].smUtil)
+                            continue;// several samples in one loop, keep the larger one.
+                    }
+                    tenantSmUtil[slot] = procSamples[k].smUtil;
+                    tenantMemUtil[slot] = procSamples[k].memUtil;
+                    tenantLastSeen[slot] = 0;
+                }
+                // split the energy by sm util. If all tenants are at 0 util, split it equally.
+                sumSmUtil = 0; numTenants = 0;
+                for (iten = 0; iten < maxTenants; iten++)
+                {
+                    slot = i*maxTenants+iten;
+                    if (tenantPid[slot] != 0 && tenantLastSeen[slot] <= tenantExpire)
+                    {
+                        sumSmUtil += tenantSmUtil[slot];
+                        numTenants += 1;
+                    }
+                }
+                for (iten = 0; iten < maxTenants; iten++)
+                {
+                    slot = i*maxTenants+iten;
+                    if (tenantPid[slot] != 0 && tenantLastSeen[slot] <= tenantExpire)
+                    {
+                        if (sumSmUtil > 0)
+                            tenantEnergy[slot] += (double)power/1000 * lastLoopTime/1000000 * tenantSmUtil[slot] / sumSmUtil;
+                        else
+                            tenantEnergy[slot] += (double)power/1000 * lastLoopTime/1000000 / numTenants;
+                        tenantTime[slot] += (double)lastLoopTime/1000000;
+                    }
+                }
+            }
+
+            // gather the compute processes and the energy of the last loop for the job accounting. Idle park reuses the process list.
+            procListResult = NVML_ERROR_UNINITIALIZED;
+            if (acct != NULL)
+            {
+                metricsTime = dvfsMetricsNow();
+                procListResult = getComputeProcesses(device, &procList, &procListCapacity, &procListCount);
+                dvfsMetricsObserve(metrics, DVFS_HIST_NVML, dvfsMetricsNow() - metricsTime);
+                // keep the jobs if the list is not complete.
+                acctNumPids[i] = NVML_SUCCESS == procListResult && procListCount <= (unsigned int)maxProcSamples ? (int)procListCount : -1;
+                for (k = 0; (int)k < acctNumPids[i]; k++)
+                {
+                    acctPids[i*maxProcSamples+k] = procList[k].pid;
+                    acctWeights[i*maxProcSamples+k] = 0;// an equal split without the tenant sm util.
+                    slot = useTenants ? findTenant(&tenantPid[i*maxTenants], maxTenants, procList[k].pid, false) : -1;
+                    if (slot >= 0 && tenantLastSeen[i*maxTenants+slot] <= tenantExpire)
+                        acctWeights[i*maxProcSamples+k] = tenantSmUtil[i*maxTenants+slot];
+                }
+                // the board energy counter if supported, otherwise the power times the loop time.
+                acctEnergy[i] = (double)power/1000 * lastLoopTime/1000000;
+                if (NVML_SUCCESS == nvmlDeviceGetTotalEnergyConsumption(device, &energyMj))
+                {
+                    if (acctLastEnergy[i] > 0 && energyMj >= acctLastEnergy[i])
+                        acctEnergy[i] = (energyMj - acctLastEnergy[i]) / 1000.0;
+                    acctLastEnergy[i] = energyMj;
+                }
+                acctFreq[i] = freq;
+            }
+
+            // measure the time-to-ramp after waking from idle park.
+            if (useIdlePark && wakeTime[i] > 0)
+            {
+                if ((unsigned int)freq + rampTolerance >= wakeFreq[i])
+                {
+                    rampTime[i] = max(1, (double)(nowTime - wakeTime[i]));
+                    wakeTime[i] = 0;
+                }
+                else if (nowTime - wakeTime[i] >= rampTimeout*1000000)
+                {
+                    rampTime[i] = -1;
+                    wakeTime[i] = 0;
+                }
+            }
+
+            // Calculate moving average. And record gpu utilization into 2-d array **gpuUtils.
+            // Calculating average should start from the oldest value. idx_oldest markes the oldest position.
+            gutil_moving_avg[i] = gutil_moving_avg[i] - (double)gpuUtils[i][idx_oldest] / movingAvg_windowSize + (double)util.gpu / movingAvg_windowSize;// update the moving average.
+            gutil_moving_sqsum[i] = gutil_moving_sqsum[i] - (double)gpuUtils_sq[i][idx_oldest] + (double)util.gpu * (double)util.gpu;// update the moving sum of square of gpuUtil.
+            variance = gutil_moving_sqsum[i]/movingAvg_windowSize - gutil_moving_avg[i]*gutil_moving_avg[i];
+            if (variance > 0)
+                gutil_moving_std[i] = sqrt(variance);
+            else
+                gutil_moving_std[i] = 0;
+            gpuUtils[i][idx_oldest] = util.gpu;
+            gpuUtils_sq[i][idx_oldest] = util.gpu * util.gpu;
+            if (i == device_count-1)
+            {
+                // forward idx_oldest by 1 position.
+                if (idx_oldest < movingAvg_windowSize-1)
+                    idx_oldest += 1;
+                else
+                    idx_oldest = 0;
+            }
+
             // set GPU frequency.
             // MaxFreq policy.
-            if (strcmp(freqsetAlg, "MaxFreq") == 0)
+            if (strcmp(gpuAlg[i], "MaxFreq") == 0)
             {
                 setFreq = maxFreq;
                 applyFreqSet = initialLoop;
             }
             // EfficientFix policy.
-            if (strcmp(freqsetAlg, "EfficientFix") == 0)
+            if (strcmp(gpuAlg[i], "EfficientFix") == 0)
             {
                 setFreq = freqAvgEff;
                 applyFreqSet = initialLoop;
             }
             // NVboost policy. Using the default policy, not applying user freq set.
-            if (strcmp(freqsetAlg, "NVboost") == 0)
+            if (strcmp(gpuAlg[i], "NVboost") == 0)
             {
                 setFreq = freqAvgEff;
                 applyFreqSet = false;
             }
             // UtilizScale policy.
-            if (strcmp(freqsetAlg, "UtilizScale") == 0)
+            if (strcmp(gpuAlg[i], "UtilizScale") == 0)
             {
                 if (cycle == 1)
                 {
@@ -571,43 +1086,44 @@ int main(int argc, char* argv[])
                 }
             }
             // Assure policy.
-            if (strcmp(freqsetAlg, "Assure") == 0)
+            if (strcmp(gpuAlg[i], "Assure") == 0)
             {
-                // Calculate moving average. And record gpu utilization into 2-d array **gpuUtils.
-                // Calculating average should start from the oldest value. idx_oldest markes the oldest position.
-                gutil_moving_avg[i] = gutil_moving_avg[i] - (double)gpuUtils[i][idx_oldest] / movingAvg_windowSize + (double)util.gpu / movingAvg_windowSize;// update the moving average.
-                gutil_moving_sqsum[i] = gutil_moving_sqsum[i] - (double)gpuUtils_sq[i][idx_oldest] + (double)util.gpu * (double)util.gpu;// update the moving sum of square of gpuUtil.
-                variance = gutil_moving_sqsum[i]/movingAvg_windowSize - gutil_moving_avg[i]*gutil_moving_avg[i];
-                if (variance > 0)
-                    gutil_moving_std[i] = sqrt(variance);
-                else
-                    gutil_moving_std[i] = 0;
-                gpuUtils[i][idx_oldest] = util.gpu;
-                gpuUtils_sq[i][idx_oldest] = util.gpu * util.gpu;
-                if (i == device_count-1)
-                {
-                    // forward idx_oldest by 1 position.
-                    if (idx_oldest < movingAvg_windowSize-1)
-                        idx_oldest += 1;
-                    else
-                        idx_oldest = 0;
-                }
-
-                if (lastprobPhase > 0)// lastprobPhase starts from numProbRec.
+                if (lastprobPhase > 0 && !probeHold)// lastprobPhase starts from numProbRec.
                 {
                     // During probing phase, record gpu memory bandwidth utilization into 2-d array **gmemUtils.
                     // Record gpu power usage into **gPowers.
                     // Index of gmemUtils[i] should start from 0.
                     // Be careful that the recorded util values corresponds to the last frequency setting.
+                    // With useAdaptiveDwell, nothing is recorded while probeHold, i.e. until the last setting has settled on all GPUs.
                     if (verbose && i==0)
                         printf("lastprobPhase %d, ", lastprobPhase);
-                    gmemUtils[i][numProbRec-lastprobPhase] = (double)util.memory;
-                    gPowers[i][numProbRec-lastprobPhase] = (double)power/1000;// on V100, power is in mW.
+                    gmemUtils[i][numProbRec-lastprobPhase] = probeSettledMem[i] >= 0 ? probeSettledMem[i] : (double)util.memory;
+                    gPowers[i][numProbRec-lastprobPhase] = probeSettledPower[i] >= 0 ? probeSettledPower[i] : (double)power/1000;// on V100, power is in mW.
+                    probeSettledMem[i] = -1;
+                    probeSettledPower[i] = -1;
+
+                    if (useTenants)
+                    {
+                        // record the mem bw util of each tenant, and its own freq cap by its sm util.
+                        for (iten = 0; iten < maxTenants; iten++)
+                        {
+                            slot = i*maxTenants+iten;
+                            if (lastprobPhase == numProbRec)
+                                tenantProbed[slot] = (tenantPid[slot] != 0);
+                            if (tenantPid[slot] == 0 || !tenantProbed[slot])
+                                continue;
+                            tenantMemUtils[slot*numProbRec+numProbRec-lastprobPhase] = (double)tenantMemUtil[slot];
+                            tenantThres = jobThres(tenantPid[slot], i, jobPid, jobMask, jobThresholds, maxJobs, perfThres);
+                            thisCap = utilFreqCap((double)freq, (double)tenantSmUtil[slot], tenantThres, (double)maxFreq);
+                            if (lastprobPhase == numProbRec || thisCap > tenantCap[slot])
+                                tenantCap[slot] = thisCap;
+                        }
+                    }
 
                     if (useFreqCap)
                     {
                         // calculate the freq cap according to the current gpu util and gpu freq.
-                        thisCap = (double)freq / ((1-perfThres)*((double)freq/(double)maxFreq+100/max(1,(double)util.gpu)-1) + (double)freq/(double)maxFreq);// max(1,) is used to avoid division by 0.
+                        thisCap = utilFreqCap((double)freq, (double)util.gpu, gpuThres[i], (double)maxFreq);
                         //thisCap = perfThres*(double)freq*(double)util.gpu/100;
                         // freqCap[i] records the largest cap during probing.
                         if (lastprobPhase == numProbRec)
@@ -626,6 +1142,8 @@ int main(int argc, char* argv[])
                 {
                     // in probing phase, force changing gpu freqs to prob the response of gpu utils.
                     iprob = numProbRec - probPhase; // iprob start at 0 and increase.
+                    if (probeHold)
+                        iprob -= 1;// keep the probe frequency that is settling.
                     reminder = iprob % (2*numProbFreq);
                     if (reminder < numProbFreq)
                         setFreq = probFreqs[reminder];
@@ -649,18 +1167,93 @@ int main(int argc, char* argv[])
                     else
                         setFreq = optimizedFreqs[i];// calculated when probPhase==0.
                 }
-                if (probPhase >= -1)
+                if (probPhase >= -1 && !probeHold)
                     applyFreqSet = true;
                 else
                     applyFreqSet = false;// not apply freq set to reduce delay.
             }// end if Assure.
 
+            // Idle park. A parked GPU stays at the lowest supported frequency regardless of the policy.
+            if (useIdlePark && strcmp(gpuAlg[i], "NVboost") != 0 && pinFreq[i] == 0 && !gpuExcluded[i])
+            {
+                if (NVML_ERROR_UNINITIALIZED == procListResult && util.gpu == 0 && util.memory == 0)
+                {
+                    metricsTime = dvfsMetricsNow();
+                    procListResult = getComputeProcesses(device, &procList, &procListCapacity, &procListCount);
+                    dvfsMetricsObserve(metrics, DVFS_HIST_NVML, dvfsMetricsNow() - metricsTime);
+                }
+                // a compute process counts as activity. If the list is not supported, rely on utilization only.
+                activity = util.gpu > 0 || util.memory > 0 || (NVML_SUCCESS == procListResult && procListCount > 0) || NVML_ERROR_INSUFFICIENT_SIZE == procListResult;
+                if (activity)
+                {
+                    idleStart[i] = -1;
+                    if (gpuParked[i])
+                    {
+                        // wake up within this loop. Jump to max frequency until a new model is available.
+                        gpuParked[i] = false;
+                        if (strcmp(gpuAlg[i], "UtilizScale") == 0 || (strcmp(gpuAlg[i], "Assure") == 0 && probPhase < -1))
+                        {
+                            optimizedFreqs[i] = maxFreq;
+                            setFreq = maxFreq;
+                        }
+                        applyFreqSet = true;
+                        wakeTime[i] = nowTime;
+                        wakeFreq[i] = setFreq;
+                        probeRequest = true;// the workload is new, so probe as soon as possible.
+                    }
+                }
+                else
+                {
+                    if (idleStart[i] < 0)
+                        idleStart[i] = nowTime;
+                    if (gpuParked[i])
+                    {
+                        setFreq = availableFreqs[0];
+                        applyFreqSet = false;// already parked, avoid unnecessary freqset.
+                    }
+                    else if (nowTime - idleStart[i] >= idleParkDelay*1000000 && !(strcmp(gpuAlg[i], "Assure") == 0 && probPhase >= -1))
+                    {
+                        gpuParked[i] = true;
+                        parkEvent[i] = 1;
+                        wakeTime[i] = 0;
+                        setFreq = availableFreqs[0];
+                        applyFreqSet = true;
+                    }
+                }
+            }
+            else if (useIdlePark)
+            {
+                gpuParked[i] = false;// pinned or excluded GPUs are not parked.
+                idleStart[i] = -1;
+            }
+
+            // Settings from the control socket override the policy.
+            if (ctrlApply[i] && !gpuParked[i] && strcmp(gpuAlg[i], "NVboost") != 0)
+                applyFreqSet = true;// a new policy or setting is applied in this loop.
+            if (pinFreq[i] > 0)
+            {
+                setFreq = pinFreq[i];
+                applyFreqSet = ctrlApply[i];
+            }
+            if (gpuExcluded[i] || (ctrlApply[i] && strcmp(gpuAlg[i], "NVboost") == 0))
+            {
+                if (ctrlApply[i])
+                {
+                    result = resetClocks(device);
+                    if (NVML_SUCCESS != result)
+                        printf("\t\t Failed to reset frequency for GPU %u: %s\n", i, nvmlErrorString(result));
+                }
+                applyFreqSet = false;
+            }
+            ctrlApply[i] = false;
+
             // Execute frequency set.
             // Note: Avoiding unnecessary freqset can significantly reduce delay, from 90 ms to 13 ms.
             // Note: When power is high, actual freq may be consistently lower than setFreq due to thermal throttling.
             if (applyFreqSet)
             {
                 freqsetHappen = false;
+                metricsTime = dvfsMetricsNow();
                 if (onlySetAppFreq)
                 {
                     if (onlySetFreqForOne)
@@ -682,6 +1275,22 @@ int main(int argc, char* argv[])
 
                 if (freqsetHappen)
                 {
+                    dvfsMetricsObserve(metrics, DVFS_HIST_NVML, dvfsMetricsNow() - metricsTime);
+                    dvfsMetricsCount(metrics, i, NVML_SUCCESS == result ? DVFS_COUNT_SETS_ISSUED : DVFS_COUNT_SETS_FAILED);
+                    if (useAdaptiveDwell && NVML_SUCCESS == result && strcmp(gpuAlg[i], "Assure") == 0 && probPhase > 0 && pinFreq[i] == 0)
+                    {
+                        // a probe frequency is set. Wait for it to settle before recording.
+                        probeWait[i] = true;
+                        probeSetFreq[i] = setFreq;
+                        probeSetTime[i] = dvfsMetricsNow();
+                        probeClockTime[i] = 0;
+                        probeSettledMem[i] = -1;
+                        probeSettledPower[i] = -1;
+                        probeLastMem[i] = util.memory;
+                        probeLastPower[i] = (double)power/1000;
+                        for (ist = 0; ist < 2; ist++) // skip the samples before the set, and learn the sample interval.
+                            newSamples(device, probeSampleTypes[ist], &probeSampleSeen[i*2+ist], &probeSamplePeriod[i*2+ist], &probeSampleValue[i*2+ist]);
+                    }
                     if (NVML_ERROR_NO_PERMISSION == result)
                         printf("\t\t Error: Need root privileges: %s\n", nvmlErrorString(result));
                     else if (NVML_ERROR_NOT_SUPPORTED == result)
@@ -699,17 +1308,55 @@ int main(int argc, char* argv[])
             }
             else
             {
+                if (!gpuExcluded[i] && strcmp(gpuAlg[i], "NVboost") != 0)
+                    dvfsMetricsCount(metrics, i, DVFS_COUNT_SETS_SUPPRESSED);
                 if (printUtil)
                 {
                     printf("%u, %u, %u, %u, -1, ", util.gpu, util.memory, power, freq);// -1 is a flag for this case.
                 }
             }
+
+            dvfsTraceSetInt(trace, DVFS_TRACE_UTIL, i, util.gpu);
+            dvfsTraceSetInt(trace, DVFS_TRACE_MEMUTIL, i, util.memory);
+            dvfsTraceSetInt(trace, DVFS_TRACE_POWER, i, power);
+            dvfsTraceSetInt(trace, DVFS_TRACE_FREQ, i, freq);
+            dvfsTraceSetInt(trace, DVFS_TRACE_SETFREQ, i, applyFreqSet ? (int)setFreq : -1);
+            dvfsTraceSetInt(trace, DVFS_TRACE_TARGETFREQ, i, gpuParked[i] ? availableFreqs[0] : (pinFreq[i] > 0 ? pinFreq[i] : optimizedFreqs[i]));
+
+            // Publish this GPU's sample and decision. Readers retry while seq is odd.
+            if (shm != NULL && i < DVFS_SHM_MAXGPU)
+            {
+                shmRec = &shm->gpu[i];
+                dvfsShmBeginWrite(shmRec);
+                shmRec->loop = loopCount;
+                shmRec->sampleTime = nowTime;
+                shmRec->util = util.gpu;
+                shmRec->memUtil = util.memory;
+                shmRec->power = power;
+                shmRec->freq = freq;
+                shmRec->setFreq = applyFreqSet ? (int)setFreq : -1;
+                shmRec->optimizedFreq = gpuParked[i] ? availableFreqs[0] : (pinFreq[i] > 0 ? pinFreq[i] : optimizedFreqs[i]);
+                shmRec->energy += (unsigned long long)((double)power * lastLoopTime / 1000000);// mW * us -> mJ.
+                strncpy(shmRec->policy, gpuAlg[i], sizeof(shmRec->policy)-1);
+                shmRec->perfThres = gpuThres[i];
+                shmRec->freqBound = lastFreqBound[i];
+                shmRec->freqEff = lastFreqEff[i];
+                shmRec->freqCap = lastFreqBound[i] < 0 ? -1 : freqCap[i];
+                shmRec->probPhase = strcmp(gpuAlg[i], "Assure") == 0 ? probPhase : -99;
+                shmRec->parked = gpuParked[i];
+                shmRec->pinFreq = pinFreq[i];
+                shmRec->excluded = gpuExcluded[i];
+                shmRec->numProbRec = numProbRec < DVFS_SHM_MAXPROB ? numProbRec : DVFS_SHM_MAXPROB;
+                memcpy(shmRec->gmemUtils, gmemUtils[i], sizeof(double)*shmRec->numProbRec);
+                memcpy(shmRec->gPowers, gPowers[i], sizeof(double)*shmRec->numProbRec);
+                dvfsShmEndWrite(shmRec);
+            }
         }// loop all GPU ends.
 
         // In Assure, if just finished probing phase, fit the performance model and calculate the optimized freq.
-        if (strcmp(argv[1], "mod") == 0 && strcmp(freqsetAlg, "Assure") == 0)
+        if (anyAssure)
         {
-            if (probPhase == 0)// i.e., when just finished probing.
+            if (probPhase == 0 && !probeHold)// i.e., when just finished probing.
             {
                 // calculate the freq cap according to gpu util.
                 if (verbose && useFreqCap)
@@ -740,339 +1387,57 @@ int main(int argc, char* argv[])
 
                 for (i = 0; i < device_count; i++)
                 {
-                    // Calculate avg_gmemUtils and avg_gPowers.
-                    // construct the x, y input for the single linear model.
-                    // Numbers should be converted into double.
-                    sumy = 0;
-                    for (j = 0; j < numProbFreq; j++)
+                    if (strcmp(gpuAlg[i], "Assure") != 0)
+                        continue;
+                    // Fit the model with the probing records of this GPU.
+                    metricsTime = dvfsMetricsNow();
+                    if (!assureModelFit(i, numProbFreq, numProbRep, probFreqs, gmemUtils[i], gPowers[i], gpuThres[i], maxFreq, freqAvgEff, useRegression, regErrThres, verbose, modelWork, &freqBound, &freqEff))
+                        dvfsMetricsCount(metrics, i, DVFS_COUNT_MODELS_DISCARDED);
+                    dvfsMetricsObserve(metrics, DVFS_HIST_MODEL_FIT, dvfsMetricsNow() - metricsTime);
+                    dvfsMetricsCount(metrics, i, DVFS_COUNT_PROBES);
+                    lastFreqBound[i] = freqBound;
+                    lastFreqEff[i] = freqEff;
+
+                    if (useFreqCap)
                     {
-                        avg_gmemUtils[j] = 0;
-                        avg_gPowers[j] = 0;
+                        freqPerf = min(freqBound, freqCap[i]);
+                        if (verbose && freqBound > freqCap[i])
+                            printf("Device %u: set frequency %.1f capped by gpu util.\n", i, freqCap[i]);
                     }
-                    for (j = 0; j < numProbRec; j++)
+                    else
                     {
-                        reminder = j % (2*numProbFreq);
-                        y[j] = gmemUtils[i][j];
-                        sumy += y[j];
-                        if (reminder < numProbFreq)
-                        {
-                            x[j] = (double)probFreqs[reminder];
-                            avg_gmemUtils[reminder] += y[j] / (double)numProbRep;
-                            avg_gPowers[reminder] += gPowers[i][j] / (double)numProbRep;
-                        }
-                        else
-                        {
-                            x[j] = (double)probFreqs[2*numProbFreq-1-reminder];
-                            avg_gmemUtils[2*numProbFreq-1-reminder] += y[j] / (double)numProbRep;
-                            avg_gPowers[2*numProbFreq-1-reminder] += gPowers[i][j] / (double)numProbRep;
-                        }
+                        freqPerf = freqBound;
                     }
 
-                    // Fit the model with fold-line regression.
-                    if (useRegression)
+                    // With multiple tenants, use the lowest frequency that keeps every tenant within its own constraint.
+                    numTenants = 0;
+                    if (useTenants)
                     {
-                        // optimize frequency when all the gmem util is nonzero.
-                        if (sumy > 0)
-                        {
-                            // print avg_gmemUtils.
-                            if (verbose)
-                            {
-                                printf("Device %u: avg mem util at each frequency:", i);
-                                for (j = 0; j < numProbFreq; j++)
-                                    printf("\t%.2lf", avg_gmemUtils[j]);// from low to high frequency.
-                                printf("\n");
-                                printf("Device %u: avg device power at each frequency:", i);
-                                for (j = 0; j < numProbFreq; j++)
-                                    printf("\t%.2lf", avg_gPowers[j]);
-                                printf("\n");
-                            }
-                            optimalFound = false;
-
-                            // Build the performance and power efficiency model to optimize frequency.
-                            if (!optimalFound)
-                            {
-                                // fit the points with a single linear model.
-                                linearRegression(numProbRec, x, y, &slope_Opt, &intercept_Opt, &regErr);
-                                regErrMin = regErr;
-                                turn_Opt = 0;
-                                if (verbose)
-                                {
-                                    printf("Device %u: turn=non, slope=%lf, intercept=%lf, regErr=%lf\n", i, slope_Opt, intercept_Opt, regErr);
-                                }
-                                // Partition the points and fit the points with two linear models connected by a turning point.
-                                for (turn = 2; turn <= numProbFreq - 2; turn++)// "turn" marks how many points are in the 1st model.
-                                {
-                                    // Partition the points to fit two linear models.
-                                    // *1 for lower frequency, and *2 for higher frequency.
-                                    idx1 = 0; idx2 = 0;
-                                    for (j = 0; j < numProbRec; j++)
-                                    {
-                                        reminder = j % (2*numProbFreq);
-                                        if (reminder < numProbFreq)
-                                            ifreq = reminder;
-                                        else
-                                            ifreq = 2*numProbFreq-1-reminder;
-                                        if (ifreq < turn)
-                                        {
-                                            x1[idx1] = (double)probFreqs[ifreq];// lower frequency.
-                                            y1[idx1] = gmemUtils[i][j];
-                                            idx1 += 1;
-                                        }
-                                        else
-                                        {
-                                            x2[idx2] = (double)probFreqs[ifreq];// higher frequency.
-                                            y2[idx2] = gmemUtils[i][j];
-                                            idx2 += 1;
-                                        }
-                                    }
-                                    linearRegression(turn*numProbRep, x1, y1, &slope1, &intercept1, &regErr1);
-                                    linearRegression((numProbFreq-turn)*numProbRep, x2, y2, &slope2, &intercept2, &regErr2);
-
-                                    if (slope2 != slope1)
-                                        freq_cross = (intercept1-intercept2) / (slope2-slope1);
-                                    else
-                                        freq_cross = -1;
-                                    if (freq_cross >= probFreqs[turn-1] && freq_cross <= probFreqs[turn])
-                                    {
-                                        // this fold-line is valid.
-                                        regErr = regErr1 + regErr2;
-                                    }
-                                    else
-                                    {
-                                        // re-fit the fold-line and let the cross to happen at probFreqs[turn-1].
-                                        foldlineRegression(probFreqs[turn-1], turn*numProbRep, x1, y1, (numProbFreq-turn)*numProbRep, x2, y2, &slope1, &intercept1, &slope2, &intercept2, &regErr);
-                                    }
-
-                                    if (verbose)
-                                        printf("Device %u: turn=%u, slope1=%lf, intercept1=%lf, slope2=%lf, intercept2=%lf, regErr=%lf. ", i, turn, slope1, intercept1, slope2, intercept2, regErr);
-
-                                    if (slope1 <= slope2)// theoretically impossible case, abandon this partition.
-                                    {
-                                        if (verbose)
-                                            printf("slope1 <= slope2, abandon this partition.\n");
-                                    }
-                                    else
-                                    {
-                                        if (regErr < regErrMin)// update this as the optimal model.
-                                        {
-                                            turn_Opt = turn;
-                                            regErrMin = regErr;
-                                            slope1_Opt = slope1; intercept1_Opt = intercept1;
-                                            slope2_Opt = slope2; intercept2_Opt = intercept2;
-                                            if (verbose)
-                                                printf("Better model found.\n");
-                                        }
-                                        else
-                                        {
-                                            if (verbose)
-                                                printf("Larger reg err, not used.\n");
-                                        }
-                                    }
-                                }// end for turn position.
-
-                                // if regression error too large, do not use regression model. Set freq by util.
-                                if (regErrMin > numProbRec * regErrThres)
-                                {
-                                    if (verbose)
-                                        printf("All regression err too large, discard model.\n");
-                                    skipmodel = true;
-                                    // set a high frequency for assurance.
-                                    freqBound = (double)maxFreq;// will be bounded by freqCap later.
-                                    freqEff = (double)freqAvgEff;
-                                }
-                                else
-                                    skipmodel = false;
-
-                                if (!skipmodel)
-                                {
-                                    // Estimate power efficiency only at the probed frequencies.
-                                    if (turn_Opt == 0)
-                                    {
-                                        for (j = 0; j < numProbFreq; j++)
-                                        {
-                                            if (slope_Opt > 0)// assume performance correlates to gmemutil.
-                                                modelPerf[j] = slope_Opt*(double)probFreqs[j]+intercept_Opt;
-                                            else // assume the lowest frequency's performance is maximal.
-                                                modelPerf[j] = slope_Opt*(double)probFreqs[0]+intercept_Opt;
-                                        }
-                                    }
-                                    else // fold-line model.
-                                    {
-                                        // slope1_Opt for lower frequency, and slope2_Opt for higher.
-                                        if (slope1_Opt > 0 && slope2_Opt > 0)
-                                        {
-                                            for (j = 0; j < numProbFreq; j++)
-                                            {
-                                                if (j >= turn_Opt)
-                                                {
-                                                    // model for higher frequency.
-                                                    modelPerf[j] = slope2_Opt*(double)probFreqs[j]+intercept2_Opt;
-                                                }
-                                                else
-                                                {
-                                                    // model for lower frequency.
-                                                    modelPerf[j] = slope1_Opt*(double)probFreqs[j]+intercept1_Opt;
-                                                }
-                                            }
-                                        }
-                                        else if (slope2_Opt <= 0 && slope1_Opt > 0)// maximum is in the middle.
-                                        {
-                                            for (j = 0; j < numProbFreq; j++)
-                                            {
-                                                if (j < turn_Opt)
-                                                {
-                                                    // model for lower frequency.
-                                                    modelPerf[j] = slope1_Opt*(double)probFreqs[j]+intercept1_Opt;
-                                                }
-                                                else
-                                                {
-                                                    // use the estimated performance at cross.
-                                                    freq_cross = (intercept1_Opt-intercept2_Opt) / (slope2_Opt-slope1_Opt);
-                                                    modelPerf[j] = (slope2_Opt*intercept1_Opt-slope1_Opt*intercept2_Opt) / (slope2_Opt-slope1_Opt);
-                                                }
-                                            }
-                                        }
-                                        else // slope1_Opt <= 0.
-                                        {
-                                            for (j = 0; j < numProbFreq; j++)
-                                            {
-                                                // estimate performance using the lowest frequency.
-                                                modelPerf[j] = slope1_Opt*(double)probFreqs[0]+intercept1_Opt;
-                                            }
-                                        }
-                                    }//end if model with turing point.
-
-                                    // calculate the power efficiency.
-                                    for (j = 0; j < numProbFreq; j++)
-                                    {
-                                        powerEffici[j] = modelPerf[j] / avg_gPowers[j];
-                                    }
-                                    if (verbose)
-                                    {
-                                        printf("Device %u: modeled performance:", i);
-                                        for (j = 0; j < numProbFreq; j++)
-                                            printf("\t%lf", modelPerf[j]);// print from low to high frequency.
-                                        printf("\n");
-                                        printf("Device %u: power efficiency:", i);
-                                        for (j = 0; j < numProbFreq; j++)
-                                            printf("\t%lf", powerEffici[j]);// print from low to high frequency.
-                                        printf("\n");
-                                    }
-
-                                    // find the most power efficient frequency.
-                                    mostEffici = powerEffici[0];
-                                    mostEfficiFreq = probFreqs[0];
-                                    for (j = 1; j < numProbFreq; j++)
-                                    {
-                                        if (powerEffici[j] > mostEffici)
-                                        {
-                                            mostEffici = powerEffici[j];
-                                            mostEfficiFreq = probFreqs[j];
-                                        }
-                                    }
-                                    freqEff = (double)mostEfficiFreq;
-                                    if (verbose)
-                                        printf("Device %u: max efficiency %lf at frequency %d MHz.\n", i, mostEffici, mostEfficiFreq);
-
-                                    // calculate critical frequency bounded by performance constraint using gmem util model.
-                                    if (turn_Opt == 0) // if a single linear model is optimal.
-                                    {
-                                        if (slope_Opt > 0)
-                                            freq_perfBound = (perfThres*(slope_Opt*(double)maxFreq+intercept_Opt) - intercept_Opt) / slope_Opt;
-                                        else // lower frequency is better.
-                                            freq_perfBound = (double)probFreqs[0];
-                                        if (verbose)
-                                            printf("Performance estimated by single linear model.\n");
-                                    }
-                                    else // if fold-line model.
-                                    {
-                                        if (slope1_Opt > 0)
-                                        {
-                                            if (slope2_Opt > 0)
-                                            {
-                                                criticalPerf = perfThres*(slope2_Opt*(double)maxFreq+intercept2_Opt);
-                                                freq_perfBound = (criticalPerf - intercept2_Opt) / slope2_Opt;
-                                                freq_cross = (intercept1_Opt-intercept2_Opt) / (slope2_Opt-slope1_Opt);
-                                                if (freq_perfBound <= freq_cross)
-                                                {
-                                                    // should use low-freq-model instead.
-                                                    freq_perfBound = (criticalPerf - intercept1_Opt) / slope1_Opt;
-                                                    if (verbose)
-                                                        printf("Performance assurance satisfied at low-segment.\n");
-                                                }
-                                                else
-                                                {
-                                                    if (verbose)
-                                                        printf("Performance assurance satisfied at high-segment.\n");
-                                                }
-                                            }
-                                            else if (slope2_Opt <= 0)
-                                            {
-                                                freq_cross = (intercept1_Opt-intercept2_Opt) / (slope2_Opt-slope1_Opt);
-                                                criticalPerf = perfThres*(slope1_Opt*freq_cross+intercept1_Opt);
-                                                if (verbose)
-                                                    printf("Performance saturation predicted at %.lf MHz.\n", freq_cross);
-                                                freq_perfBound = (criticalPerf - intercept1_Opt) / slope1_Opt;
-                                                if (verbose)
-                                                    printf("Performance assurance satisfied at low-segment.\n");
-                                            }
-                                        }// end if slope1_Opt>0.
-                                        else
-                                        {
-                                            if (verbose)
-                                                printf("Performance saturation predicted at %d MHz.\n", probFreqs[0]);
-                                            freq_perfBound = (double)probFreqs[0];
-                                        }
-                                    }// end if fold-line model.
-                                    if (verbose)
-                                        printf("Device %u: performance assurance achieved at %.2lf MHz.\n", i, freq_perfBound);
-
-                                    freqBound = freq_perfBound;
-                                }// end if !skipmodel.
-                            }// end if !optimalFound.
-                        }// end if sumy > 0.
-                        else
+                        for (iten = 0; iten < maxTenants; iten++)
                         {
-                            if (verbose)
-                                printf("Device %u: mem bw not used, will set frequency by util.\n", i);
-                            freqBound = (double)maxFreq;// will be bounded by freqCap later.
-                            freqEff = (double)freqAvgEff;// on A100, gmemutil may be always 0 for a few apps.
+                            if (tenantPid[i*maxTenants+iten] != 0 && tenantProbed[i*maxTenants+iten])
+                                numTenants += 1;
                         }
-                    } // end if useRegression.
-                    else // use the lowest frequency whose gmemUtil is maximal.
+                    }
+                    if (numTenants >= 2)
                     {
-                        max_gmem = avg_gmemUtils[0];
-                        max_gmem_freq = probFreqs[0];
-                        // get the max_gmem value;
-                        for (j = 1; j < numProbFreq; j++)
+                        freqPerf = 0;
+                        for (iten = 0; iten < maxTenants; iten++)
                         {
-                            if (avg_gmemUtils[j] > max_gmem)
-                            {
-                                max_gmem = avg_gmemUtils[j];
-                            }
-                        }
-                        // get the freq of max_gmem.
-                        for (j = 0; j < numProbFreq; j++)
-                        {
-                            if (avg_gmemUtils[j] >= max_gmem*0.99)
-                            {
-                                max_gmem_freq = probFreqs[j];
-                                break;
-                            }
+                            slot = i*maxTenants+iten;
+                            if (tenantPid[slot] == 0 || !tenantProbed[slot])
+                                continue;
+                            tenantThres = jobThres(tenantPid[slot], i, jobPid, jobMask, jobThresholds, maxJobs, perfThres);
+                            metricsTime = dvfsMetricsNow();
+                            if (!assureModelFit(i, numProbFreq, numProbRep, probFreqs, &tenantMemUtils[slot*numProbRec], gPowers[i], tenantThres, maxFreq, freqAvgEff, useRegression, regErrThres, verbose, modelWork, &tenantBound, &tenantEff))
+                                dvfsMetricsCount(metrics, i, DVFS_COUNT_MODELS_DISCARDED);
+                            dvfsMetricsObserve(metrics, DVFS_HIST_MODEL_FIT, dvfsMetricsNow() - metricsTime);
+                            if (useFreqCap)
+                                tenantBound = min(tenantBound, tenantCap[slot]);
+                            if (verbose)
+                                printf("Device %u: tenant pid %u needs %.1f MHz.\n", i, tenantPid[slot], tenantBound);
+                            freqPerf = max(freqPerf, tenantBound);
                         }
-                        freqBound = (double)max_gmem_freq;
-                        freqEff = (double)freqAvgEff;
-                    }
-
-                    if (useFreqCap)
-                    {
-                        freqPerf = min(freqBound, freqCap[i]);
-                        if (verbose && freqBound > freqCap[i])
-                            printf("Device %u: set frequency %.1f capped by gpu util.\n", i, freqCap[i]);
-                    }
-                    else
-                    {
-                        freqPerf = freqBound;
                     }
                     freqOpt = max(freqPerf, freqEff);
                     if (verbose && freqPerf >= freqEff)
@@ -1110,18 +1475,294 @@ int main(int argc, char* argv[])
         gettimeofday(&endtime, NULL);
         duration = (endtime.tv_sec - starttime.tv_sec) * 1000000 + endtime.tv_usec - starttime.tv_usec;
         printf("%lu\n", duration);
-        if (duration < loopDelay*1000)// loopDelay is in milliseconds.
+        dvfsMetricsObserve(metrics, DVFS_HIST_TICK, duration*1000);
+        clock_gettime(CLOCK_THREAD_CPUTIME_ID, &loopCpuEnd);
+        loopCpuTime += (loopCpuEnd.tv_sec - loopCpuStart.tv_sec) + (loopCpuEnd.tv_nsec - loopCpuStart.tv_nsec) / 1e9;
+        dvfsTraceSetInt(trace, DVFS_TRACE_LOOP, 0, duration);
+        if (dvfsTraceEndRow(trace) != 0)
+        {
+            printf("Warning: cannot write trace %s. Trace stopped.\n", tracePath);
+            dvfsTraceClose(trace);
+            trace = NULL;
+        }
+        // account the last loop to the jobs of each GPU. Exited jobs are printed after the sample line.
+        for (i = 0; acct != NULL && i < device_count; i++)
         {
-            usleep(loopDelay*1000-duration);
-            addTime = loopDelay*1000;
+            if (acctNumPids[i] < 0)
+                continue;
+            dvfsAcctUpdate(acct, i, &acctPids[i*maxProcSamples], &acctWeights[i*maxProcSamples], acctNumPids[i], nowTime,
+                lastLoopTime/1000000.0, acctEnergy[i], acctFreq[i],
+                dvfsAcctRelPerf(acctFreq[i], maxFreq, numProbFreq, numProbRep, probFreqs, gmemUtils[i]),
+                strcmp(gpuAlg[i], "Assure") == 0 && (probPhase >= 0 || probeHold));
+        }
+        if (useTenants)
+        {
+            // report the energy attribution of exited tenants.
+            for (i = 0; i < device_count*maxTenants; i++)
+            {
+                if (tenantPid[i] != 0 && tenantLastSeen[i] > tenantExpire)
+                {
+                    printf("Device %u: tenant pid %u exited, energy %.1f J over %.1f s.\n", i/maxTenants, tenantPid[i], tenantEnergy[i], tenantTime[i]);
+                    tenantPid[i] = 0;
+                }
+            }
+        }
+        thisLoopDelay = loopDelay;
+        if (useIdlePark)
+        {
+            // report park/wake events on separate lines so that the metric lines are not broken.
+            allParked = true;
+            for (i = 0; i < device_count; i++)
+            {
+                if (parkEvent[i] == 1)
+                    printf("Device %u: idle for %.f s, parked at %d MHz.\n", i, idleParkDelay, availableFreqs[0]);
+                if (rampTime[i] > 0)
+                    printf("Device %u: woke from idle park, ramped to %u MHz in %ld us.\n", i, wakeFreq[i], rampTime[i]);
+                else if (rampTime[i] < 0)
+                    printf("Device %u: woke from idle park, %u MHz not reached within %.f s.\n", i, wakeFreq[i], rampTimeout);
+                parkEvent[i] = 0;
+                rampTime[i] = 0;
+                if (!gpuParked[i])
+                    allParked = false;
+            }
+            if (allParked)
+                thisLoopDelay = idleLoopDelay;// sample at a higher rate so that the wake-up happens fast.
         }
+        if (duration < thisLoopDelay*1000)// loopDelay is in milliseconds.
+            addTime = thisLoopDelay*1000;
         else
             addTime = duration;
+        lastLoopTime = addTime;
+        loopCount += 1;
+        if (anyAssure && probPhase >= 0)
+        {
+            probeTime += addTime / 1000000.0;
+            if (probPhase == 0 && !probeHold)
+            {
+                numProbes += 1;
+                for (i = 0; i < device_count; i++)
+                {
+                    if (strcmp(gpuAlg[i], "Assure") == 0)
+                        dvfsAcctProbeDone(acct, i);
+                }
+            }
+        }
 
-        if (strcmp(argv[1], "mod") == 0 && strcmp(freqsetAlg, "Assure") == 0)
+        // Serve control commands while waiting for the next loop. Commands only change variables,
+        // which are read in the next loop, so every command applies between two loops.
+        while (1)
+        {
+            gettimeofday(&endtime, NULL);
+            waitTime = thisLoopDelay*1000 - ((endtime.tv_sec - starttime.tv_sec) * 1000000 + endtime.tv_usec - starttime.tv_usec);
+            if (waitTime <= 0)
+                break;// the loop is due. Queued commands are served in the next one.
+            // adaptive dwell: a probe settles one sample period after the SM clock reached it, so the clock is watched closer than loopDelay.
+            clockPending = false;
+            for (i = 0; anyAssure && i < device_count; i++)
+            {
+                if (!probeWait[i] || probeClockTime[i] > 0 || NVML_SUCCESS != nvmlDeviceGetHandleByIndex(i, &device) || NVML_SUCCESS != nvmlDeviceGetClockInfo(device, 1, &freq))
+                    continue;
+                if (abs((int)freq - (int)probeSetFreq[i]) <= rampTolerance)
+                {
+                    probeClockTime[i] = dvfsMetricsNow();
+                    gettimeofday(&settleWall, NULL);
+                    probeClockWall[i] = settleWall.tv_sec * 1000000ULL + settleWall.tv_usec;
+                }
+                else
+                    clockPending = true;
+            }
+            sliceTime = (clockPending && waitTime > probeClockPoll*1000L) ? probeClockPoll*1000L : waitTime;
+            if (ctrlFd < 0)
+            {
+                usleep(sliceTime);
+                if (sliceTime < waitTime)
+                    continue;
+                break;
+            }
+            clientFd = ctrlAccept(ctrlFd, sliceTime, ctrlCmd, sizeof(ctrlCmd));
+            if (clientFd < 0 && sliceTime < waitTime)
+                continue;
+            if (clientFd < 0)
+                break;
+            ctrlArgc = sscanf(ctrlCmd, "%31s %31s %31s %31s %31s", ctrlOp, ctrlArg1, ctrlArg2, ctrlArg3, ctrlArg4);
+            if (ctrlArgc < 1)
+                dprintf(clientFd, "ERR empty command\n");
+            else if (strcmp(ctrlOp, "policy") == 0 && ctrlArgc == 3 && ctrlTarget(ctrlArg1, device_count, &ctrlFirst, &ctrlLast) == 0)
+            {
+                for (ipol = 0; ipol < 5; ipol++)
+                {
+                    if (strcmp(ctrlArg2, policyNames[ipol]) == 0)
+                        break;
+                }
+                if (ipol == 5)
+                    dprintf(clientFd, "ERR unknown policy %s\n", ctrlArg2);
+                else
+                {
+                    for (i = ctrlFirst; i <= ctrlLast; i++)
+                    {
+                        if (strcmp(policyNames[ipol], "Assure") == 0 && strcmp(gpuAlg[i], "Assure") != 0)
+                        {
+                            optimizedFreqs[i] = maxFreq;// until the first model is fitted.
+                            probeRequest = true;
+                        }
+                        else if (strcmp(policyNames[ipol], "UtilizScale") == 0)
+                            optimizedFreqs[i] = maxFreq;
+                        gpuAlg[i] = policyNames[ipol];
+                        ctrlApply[i] = true;
+                    }
+                    dprintf(clientFd, "OK policy %s\n", policyNames[ipol]);
+                }
+            }
+            else if (strcmp(ctrlOp, "thres") == 0 && ctrlArgc == 2 && (ctrlValue = parseThres(ctrlArg1)) > 0)
+            {
+                perfThres = ctrlValue;
+                probeRequest = true;// refit the model with the new constraint.
+                dprintf(clientFd, "OK perfThres %.3f\n", perfThres);
+            }
+            else if (strcmp(ctrlOp, "loopdelay") == 0 && ctrlArgc == 2 && atoi(ctrlArg1) >= 10)
+            {
+                loopDelay = atoi(ctrlArg1);
+                dprintf(clientFd, "OK loopDelay %d ms\n", loopDelay);
+            }
+            else if (strcmp(ctrlOp, "probdelay") == 0 && ctrlArgc == 2 && atof(ctrlArg1) >= 1)
+            {
+                probDelay = atof(ctrlArg1);
+                dprintf(clientFd, "OK probDelay %.1f s\n", probDelay);
+            }
+            else if (strcmp(ctrlOp, "pin") == 0 && ctrlArgc == 3 && ctrlTarget(ctrlArg1, device_count, &ctrlFirst, &ctrlLast) == 0 && atoi(ctrlArg2) >= availableFreqs[0] && atoi(ctrlArg2) <= availableFreqs[numAvailableFreqs-1])
+            {
+                // use the nearest available frequency that is not lower.
+                for (iAvail = 0; iAvail < numAvailableFreqs-1; iAvail++)
+                {
+                    if (availableFreqs[iAvail] >= atoi(ctrlArg2))
+                        break;
+                }
+                for (i = ctrlFirst; i <= ctrlLast; i++)
+                {
+                    pinFreq[i] = availableFreqs[iAvail];
+                    ctrlApply[i] = true;
+                }
+                dprintf(clientFd, "OK pinned at %d MHz\n", availableFreqs[iAvail]);
+            }
+            else if ((strcmp(ctrlOp, "unpin") == 0 || strcmp(ctrlOp, "exclude") == 0 || strcmp(ctrlOp, "include") == 0) && ctrlArgc == 2 && ctrlTarget(ctrlArg1, device_count, &ctrlFirst, &ctrlLast) == 0)
+            {
+                for (i = ctrlFirst; i <= ctrlLast; i++)
+                {
+                    if (strcmp(ctrlOp, "unpin") == 0)
+                        pinFreq[i] = 0;
+                    else
+                        gpuExcluded[i] = (strcmp(ctrlOp, "exclude") == 0);
+                    ctrlApply[i] = true;
+                }
+                if (strcmp(ctrlOp, "exclude") != 0)
+                    probeRequest = true;// the model may be outdated.
+                dprintf(clientFd, "OK %s\n", ctrlOp);
+            }
+            else if (strcmp(ctrlOp, "register") == 0 && ctrlArgc == 4 && atoi(ctrlArg1) > 0 && (ctrlValue = parseThres(ctrlArg3)) > 0)
+            {
+                // the GPU argument is "all" or a comma separated list like "0,2,3".
+                ctrlMask = 0;
+                for (ctrlTok = strtok(ctrlArg2, ","); ctrlTok != NULL; ctrlTok = strtok(NULL, ","))
+                {
+                    if (ctrlTarget(ctrlTok, device_count, &ctrlFirst, &ctrlLast) < 0 || ctrlLast >= 64)
+                    {
+                        ctrlMask = 0;
+                        break;
+                    }
+                    for (i = ctrlFirst; i <= ctrlLast; i++)
+                        ctrlMask |= 1ULL << i;
+                }
+                slot = -1;
+                for (k = 0; k < maxJobs; k++)
+                {
+                    if (jobPid[k] == (unsigned int)atoi(ctrlArg1) || (jobPid[k] == 0 && slot < 0))
+                        slot = k;// an existing entry of the same pid is replaced.
+                    if (jobPid[k] == (unsigned int)atoi(ctrlArg1))
+                        break;
+                }
+                if (ctrlMask == 0)
+                    dprintf(clientFd, "ERR invalid GPU list\n");
+                else if (kill(atoi(ctrlArg1), 0) < 0 && errno == ESRCH)
+                    dprintf(clientFd, "ERR no process %s\n", ctrlArg1);
+                else if (slot < 0)
+                    dprintf(clientFd, "ERR too many jobs\n");
+                else
+                {
+                    jobPid[slot] = atoi(ctrlArg1);
+                    jobMask[slot] = ctrlMask;
+                    jobThresholds[slot] = ctrlValue;
+                    probeRequest = true;// refit the model with the new constraint.
+                    dprintf(clientFd, "OK job %u threshold %.3f\n", jobPid[slot], ctrlValue);
+                }
+            }
+            else if (strcmp(ctrlOp, "unregister") == 0 && ctrlArgc == 2 && atoi(ctrlArg1) > 0)
+            {
+                for (k = 0; k < maxJobs; k++)
+                {
+                    if (jobPid[k] == (unsigned int)atoi(ctrlArg1))
+                        jobPid[k] = 0;
+                }
+                dprintf(clientFd, "OK unregister %s\n", ctrlArg1);
+            }
+            else if (strcmp(ctrlOp, "mark") == 0 && ctrlArgc >= 4 && (strcmp(ctrlArg1, "begin") == 0 || strcmp(ctrlArg1, "end") == 0))
+            {
+                // a benchmark event on the CLOCK_MONOTONIC timeline of the samples, recorded inline after the sample of loop loopCount-1.
+                peerLen = sizeof(peer);
+                if (getsockopt(clientFd, SOL_SOCKET, SO_PEERCRED, &peer, &peerLen) != 0)
+                    peer.pid = 0;
+                printf("Marker: %s %s, gpu %s, pid %d, monotonic_ns %s, loop %llu, received_ns %llu\n", ctrlArg1, ctrlArg3,
+                    ctrlArgc >= 5 ? ctrlArg4 : "-", (int)peer.pid, ctrlArg2, loopCount, dvfsMetricsNow());
+                dprintf(clientFd, "OK\n");
+            }
+            else if (strcmp(ctrlOp, "probe") == 0 && ctrlArgc == 1)
+            {
+                probeRequest = true;
+                dprintf(clientFd, "OK probe requested\n");
+            }
+            else if (strcmp(ctrlOp, "dump") == 0 && ctrlArgc == 1)
+            {
+                dprintf(clientFd, "OK perfThres %.3f, loopDelay %d ms, probDelay %.1f s, probPhase %d\n", perfThres, loopDelay, probDelay, probPhase);
+                for (i = 0; i < device_count; i++)
+                {
+                    dprintf(clientFd, "GPU %u: policy %s, perfThres %.3f, optimizedFreq %d, pinFreq %d, excluded %d, parked %d, freqBound %.1f, freqEff %.1f, freqCap %.1f, mem bw util records:",
+                        i, gpuAlg[i], gpuThres[i], optimizedFreqs[i], pinFreq[i], gpuExcluded[i], gpuParked[i], lastFreqBound[i], lastFreqEff[i], lastFreqBound[i] < 0 ? -1 : freqCap[i]);
+                    for (j = 0; j < numProbRec; j++)
+                        dprintf(clientFd, " %.lf", gmemUtils[i][j]);
+                    dprintf(clientFd, "\n");
+                }
+                for (k = 0; k < maxJobs; k++)
+                {
+                    if (jobPid[k] != 0)
+                        dprintf(clientFd, "Job %u: threshold %.3f, GPU mask 0x%llx\n", jobPid[k], jobThresholds[k], jobMask[k]);
+                }
+            }
+            else
+                dprintf(clientFd, "ERR invalid command: %s\n", ctrlCmd);
+            if (strncmp(ctrlCmd, "dump", 4) != 0 && strncmp(ctrlCmd, "mark", 4) != 0)
+                printf("Control command: %s\n", ctrlCmd);
+            close(clientFd);
+        }
+
+        // remove the thresholds of exited jobs.
+        for (k = 0; k < maxJobs; k++)
+        {
+            if (jobPid[k] != 0 && kill(jobPid[k], 0) < 0 && errno == ESRCH)
+            {
+                printf("Job %u exited, threshold %.3f removed.\n", jobPid[k], jobThresholds[k]);
+                jobPid[k] = 0;
+            }
+        }
+
+        if (anyAssure && !probeHold)// with probeHold, the probing phase stays at this probe.
         {
             // determine whether or not enter the probing phase.
             lastprobPhase = probPhase;
+            if (probeRequest && probPhase < -1)
+            {
+                // a GPU just woke up from idle park, or a probe is requested by a control command. Start probing at once instead of waiting for probDelay.
+                accumuTime = probDelay*1000000;
+                probeRequest = false;
+            }
             if (accumuTime >= probDelay*1000000)// probDelay is in seconds.
             {
                 // every probDelay seconds, check if process exist.
@@ -1129,7 +1770,8 @@ int main(int argc, char* argv[])
                 sum_gutil = 0;
                 for (i = 0; i < device_count; i++)
                 {
-                    sum_gutil += gutil_moving_avg[i];
+                    if (strcmp(gpuAlg[i], "Assure") == 0)
+                        sum_gutil += gutil_moving_avg[i];
                 }
                 if (sum_gutil >= 1)// sum_gutil is double type.
                 {
@@ -1160,6 +1802,11 @@ int main(int argc, char* argv[])
                 if (probPhase > -99) // use a low limit to prevent overflow.
                     probPhase -= 1;
             }
+            for (i = 0; i < device_count; i++)
+            {
+                if (probeWait[i])
+                    probeHold = true;// a probe was set in this loop.
+            }
         }// end if Assure.
         initialLoop = false;
     }// end of main while loop.
@@ -1202,8 +1849,39 @@ int main(int argc, char* argv[])
         }
     }
     printf("\n");
+    getrusage(RUSAGE_SELF, &usage);
+    printf("Probing phases: %d, time in probing %.1f s, loops: %llu, CPU time %.3f s, loop CPU time %.1f us per loop.\n", numProbes, probeTime, loopCount,
+        usage.ru_utime.tv_sec + usage.ru_stime.tv_sec + (usage.ru_utime.tv_usec + usage.ru_stime.tv_usec) / 1e6,
+        loopCount > 0 ? loopCpuTime * 1e6 / loopCount : 0);
+    for (i = 0; i < device_count; i++)
+    {
+        if (settleCount[i] > 0 || settleTimeouts[i] > 0)
+            printf("Device %u: probes settled %d, clock in avg %.1f ms, readings in avg %.1f ms, max %.1f ms, timeouts %d, transient samples discarded %d.\n",
+                i, settleCount[i], settleCount[i] > 0 ? settleClockSum[i]/settleCount[i] : 0, settleCount[i] > 0 ? settleSum[i]/settleCount[i] : 0,
+                settleMax[i], settleTimeouts[i], probeDiscarded[i]);
+    }
 
     // Terminate.
+    dvfsAcctStop(acct, nowTime);
+    if (dvfsTraceClose(trace) != 0)
+        printf("Warning: trace %s may be incomplete.\n", tracePath);
+    dvfsMetricsStop(metrics);// before the shared memory, which it reads.
+    dvfsShmDestroy(shm);
+    if (ctrlFd >= 0)
+    {
+        close(ctrlFd);
+        unlink(ctrlPath);
+    }
+    free(gpuAlg);
+    free(pinFreq);
+    free(gpuExcluded);
+    free(ctrlApply);
+    free(lastFreqBound);
+    free(lastFreqEff);
+    free(jobPid);
+    free(jobMask);
+    free(jobThresholds);
+    free(gpuThres);
     free(probFreqs);
     free(optimizedFreqs);
     for (i = 0; i < device_count; i++)
@@ -1217,18 +1895,57 @@ int main(int argc, char* argv[])
     free(gpuUtils_sq);
     free(gmemUtils);
     free(gPowers);
-    free(modelPerf);
     free(allModelPerf);
     free(allModelPower);
     free(allPowerEffici);
-    free(powerEffici);
     free(gutil_moving_avg);
     free(gutil_moving_sqsum);
     free(gutil_moving_std);
-    free(avg_gmemUtils);
     free(freqCap);
-    free(x); free(x1); free(x2); free(x3);
-    free(y); free(y1); free(y2); free(y3);
+    free(idleStart);
+    free(gpuParked);
+    free(parkEvent);
+    free(wakeTime);
+    free(wakeFreq);
+    free(rampTime);
+    free(probeWait);
+    free(probeSetFreq);
+    free(probeSetTime);
+    free(probeClockTime);
+    free(probeClockWall);
+    free(probeSampleSeen);
+    free(probeSamplePeriod);
+    free(probeSampleValue);
+    free(probeLastMem);
+    free(probeLastPower);
+    free(probeSettledMem);
+    free(probeSettledPower);
+    free(settleClockSum);
+    free(settleSum);
+    free(settleMax);
+    free(settleCount);
+    free(settleTimeouts);
+    free(probeDiscarded);
+    free(tenantPid);
+    free(tenantSmUtil);
+    free(tenantMemUtil);
+    free(tenantLastSeen);
+    free(tenantProbed);
+    free(tenantCap);
+    free(tenantEnergy);
+    free(tenantTime);
+    free(tenantMemUtils);
+    free(procLastSeen);
+    free(procSamples);
+    free(procError);
+    free(procList);
+    free(acctPids);
+    free(acctWeights);
+    free(acctNumPids);
+    free(acctEnergy);
+    free(acctFreq);
+    free(acctLastEnergy);
+    free(modelWork);
     result = nvmlShutdown();
     if (NVML_SUCCESS != result)
         printf("Failed to shutdown NVML: %s\n", nvmlErrorString(result));
@@ -1236,6 +1953,12 @@ int main(int argc, char* argv[])
     return 0;
 
 Error:
+    dvfsAcctStop(acct, nowTime);
+    dvfsTraceClose(trace);
+    dvfsMetricsStop(metrics);
+    dvfsShmDestroy(shm);
+    if (ctrlFd >= 0)
+        unlink(ctrlPath);
     result = nvmlShutdown();
     if (NVML_SUCCESS != result)
         printf("Failed to shutdown NVML: %s\n", nvmlErrorString(result));
@@ -0,0 +1,254 @@
+/* MIT License
+
+Copyright (c) 2023 Yijia Zhang
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+
+
+ * Per-job energy and performance accounting of the dvfs daemon. See dvfsacct.h.
+ * Jobs are kept in maxJobs slots per GPU. The loop does no allocation: the time-at-clock histograms are allocated at start.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include "dvfsacct.h"
+
+#define RECORD_MAXLEN 8192
+
+typedef struct acctJob_st
+{
+    unsigned int pid;// 0 means an empty slot.
+    bool seen;// in the process list of this loop.
+    unsigned long long startUs, lastUs;
+    double seconds, energy, probeSeconds, perfSum;
+    int probes;
+    double* timeAt;// seconds at each available clock.
+} acctJob;
+
+struct dvfsAcct_st
+{
+    unsigned int numGpus;
+    int maxJobs, numFreqs;
+    int* freqs;
+    acctJob* jobs;// job j of GPU i is at i*maxJobs+j.
+    double* timeAt;
+    const char* path;
+};
+
+dvfsAcct* dvfsAcctStart(unsigned int numGpus, int maxJobs, const int* freqs, int numFreqs)
+{
+    dvfsAcct* acct = (dvfsAcct*)calloc(1, sizeof(dvfsAcct));
+    int j;
+    if (acct == NULL)
+        return NULL;
+    acct->numGpus = numGpus;
+    acct->maxJobs = maxJobs;
+    acct->numFreqs = numFreqs;
+    acct->freqs = (int*)malloc(sizeof(int)*numFreqs);
+    acct->jobs = (acctJob*)calloc(numGpus*maxJobs, sizeof(acctJob));
+    acct->timeAt = (double*)calloc((size_t)numGpus*maxJobs*numFreqs, sizeof(double));
+    if (acct->freqs == NULL || acct->jobs == NULL || acct->timeAt == NULL)
+    {
+        free(acct->freqs);
+        free(acct->jobs);
+        free(acct->timeAt);
+        free(acct);
+        return NULL;
+    }
+    memcpy(acct->freqs, freqs, sizeof(int)*numFreqs);
+    for (j = 0; j < (int)numGpus*maxJobs; j++)
+        acct->jobs[j].timeAt = &acct->timeAt[(size_t)j*numFreqs];
+    acct->path = getenv("DVFS_ACCT");
+    return acct;
+}
+
+static int freqBin(const dvfsAcct* acct, unsigned int freq)// index of the nearest available clock.
+{
+    int lo = 0, hi = acct->numFreqs - 1;
+    while (lo < hi)
+    {
+        int mid = (lo + hi) / 2;
+        if (acct->freqs[mid] < (int)freq)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    if (lo > 0 && (int)freq - acct->freqs[lo-1] < acct->freqs[lo] - (int)freq)
+        lo -= 1;
+    return lo;
+}
+
+static void emitJob(dvfsAcct* acct, unsigned int gpu, acctJob* job, bool exited)
+{
+    char rec[RECORD_MAXLEN];
+    int len, f, fd;
+    bool first = true;
+    len = snprintf(rec, sizeof(rec), "{\"gpu\": %u, \"pid\": %u, \"start_us\": %llu, \"end_us\": %llu, \"seconds\": %.3f, \"energy_j\": %.3f, "
+        "\"avg_power_w\": %.3f, \"probes\": %d, \"probe_s\": %.3f, \"perf_loss\": %.4f, \"time_at_clock\": {",
+        gpu, job->pid, job->startUs, job->lastUs, job->seconds, job->energy, job->seconds > 0 ? job->energy / job->seconds : 0,
+        job->probes, job->probeSeconds, job->seconds > 0 ? 1 - job->perfSum / job->seconds : 0);
+    for (f = 0; f < acct->numFreqs && len < RECORD_MAXLEN - 64; f++)
+    {
+        if (job->timeAt[f] <= 0)
+            continue;
+        len += snprintf(rec+len, sizeof(rec)-len, "%s\"%d\": %.3f", first ? "" : ", ", acct->freqs[f], job->timeAt[f]);
+        first = false;
+    }
+    len += snprintf(rec+len, sizeof(rec)-len, "}, \"exited\": %s}\n", exited ? "true" : "false");
+    if (len >= RECORD_MAXLEN)
+        return;
+    printf("Job record: %s", rec);
+    if (acct->path != NULL && acct->path[0] != '\0')
+    {
+        fd = open(acct->path, O_WRONLY | O_APPEND | O_CREAT, 0644);
+        if (fd >= 0)
+        {
+            if (write(fd, rec, len) != len)
+                printf("Warning: job record not written to %s.\n", acct->path);
+            close(fd);
+        }
+    }
+}
+
+void dvfsAcctUpdate(dvfsAcct* acct, unsigned int gpu, const unsigned int* pids, const double* weights, unsigned int n,
+    unsigned long long nowUs, double seconds, double energy, unsigned int freq, double relPerf, bool probing)
+{
+    acctJob* jobs;
+    double sumWeight = 0, share;
+    unsigned int k;
+    int j, freeSlot, bin;
+    if (acct == NULL || gpu >= acct->numGpus)
+        return;
+    jobs = &acct->jobs[gpu*acct->maxJobs];
+    for (j = 0; j < acct->maxJobs; j++)
+        jobs[j].seen = false;
+    for (k = 0; k < n; k++)
+        sumWeight += weights[k];
+    bin = freqBin(acct, freq);
+    for (k = 0; k < n; k++)
+    {
+        freeSlot = -1;
+        for (j = 0; j < acct->maxJobs; j++)
+        {
+            if (jobs[j].pid == pids[k])
+                break;
+            if (jobs[j].pid == 0 && freeSlot < 0)
+                freeSlot = j;
+        }
+        if (j == acct->maxJobs)
+        {
+            if (freeSlot < 0)
+                continue;// too many jobs. The extra ones are not accounted.
+            j = freeSlot;
+            memset(jobs[j].timeAt, 0, sizeof(double)*acct->numFreqs);
+            jobs[j].pid = pids[k];
+            jobs[j].startUs = nowUs;
+            jobs[j].seconds = 0;
+            jobs[j].energy = 0;
+            jobs[j].probeSeconds = 0;
+            jobs[j].perfSum = 0;
+            jobs[j].probes = 0;
+        }
+        share = sumWeight > 0 ? weights[k] / sumWeight : 1.0 / n;
+        jobs[j].seen = true;
+        jobs[j].lastUs = nowUs;
+        jobs[j].seconds += seconds;
+        jobs[j].energy += energy * share;
+        jobs[j].perfSum += relPerf * seconds;
+        jobs[j].timeAt[bin] += seconds;
+        if (probing)
+            jobs[j].probeSeconds += seconds;
+    }
+    for (j = 0; j < acct->maxJobs; j++)
+    {
+        if (jobs[j].pid != 0 && !jobs[j].seen)
+        {
+            emitJob(acct, gpu, &jobs[j], true);
+            jobs[j].pid = 0;
+        }
+    }
+}
+
+void dvfsAcctProbeDone(dvfsAcct* acct, unsigned int gpu)
+{
+    int j;
+    if (acct == NULL || gpu >= acct->numGpus)
+        return;
+    for (j = 0; j < acct->maxJobs; j++)
+    {
+        if (acct->jobs[gpu*acct->maxJobs+j].pid != 0)
+            acct->jobs[gpu*acct->maxJobs+j].probes += 1;
+    }
+}
+
+void dvfsAcctStop(dvfsAcct* acct, unsigned long long nowUs)
+{
+    unsigned int i;
+    int j;
+    if (acct == NULL)
+        return;
+    for (i = 0; i < acct->numGpus; i++)
+    {
+        for (j = 0; j < acct->maxJobs; j++)
+        {
+            acctJob* job = &acct->jobs[i*acct->maxJobs+j];
+            if (job->pid != 0)
+            {
+                job->lastUs = nowUs;
+                emitJob(acct, i, job, false);
+            }
+        }
+    }
+    free(acct->freqs);
+    free(acct->jobs);
+    free(acct->timeAt);
+    free(acct);
+}
+
+double dvfsAcctRelPerf(unsigned int freq, unsigned int maxFreq, int numProbFreq, int numProbRep, const int* probFreqs, const double* gmemUtil)
+{
+    double avg[32] = {0};
+    double perf;
+    int j, r, numProbRec = numProbFreq * numProbRep;
+    if (numProbFreq < 2 || numProbFreq > 32)
+        return freq < maxFreq ? (double)freq / maxFreq : 1;
+    // the records go up and down the probing clocks, as in assureModelFit().
+    for (j = 0; j < numProbRec; j++)
+    {
+        r = j % (2*numProbFreq);
+        avg[r < numProbFreq ? r : 2*numProbFreq-1-r] += gmemUtil[j] / numProbRep;
+    }
+    if (avg[numProbFreq-1] <= 0)
+        return freq < maxFreq ? (double)freq / maxFreq : 1;
+    if ((int)freq >= probFreqs[numProbFreq-1])
+        return 1;
+    if ((int)freq <= probFreqs[0])
+        perf = avg[0];
+    else
+    {
+        for (j = 1; j < numProbFreq - 1 && (int)freq > probFreqs[j]; j++)
+            ;
+        perf = avg[j-1] + (avg[j] - avg[j-1]) * ((int)freq - probFreqs[j-1]) / (double)(probFreqs[j] - probFreqs[j-1]);
+    }
+    perf /= avg[numProbFreq-1];
+    return perf < 1 ? perf : 1;// noise may make a lower clock look faster.
+}
+// End of file dvfsacct.c
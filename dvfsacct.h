@@ -0,0 +1,58 @@
+/* MIT License
+
+Copyright (c) 2023 Yijia Zhang
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+
+
+ * Per-job energy and performance accounting of the dvfs daemon.
+ * A job is a compute process on a GPU, from nvmlDeviceGetComputeRunningProcesses(). Every loop, the daemon passes the
+ * processes of each GPU with the energy of the loop, which is split among them by weight, the SM clock and the estimated
+ * performance relative to the max clock. When a process leaves the list, one job record is emitted:
+ *   Job record: {"gpu": 0, "pid": 123, "start_us": ..., "end_us": ..., "seconds": 12.3, "energy_j": 2345.6, "avg_power_w": 190.7,
+ *    "probes": 2, "probe_s": 1.6, "perf_loss": 0.031, "time_at_clock": {"952": 1.2, "1530": 11.1}, "exited": true}
+ * It is printed to the log, and appended as a JSON line to the file named by the environment variable DVFS_ACCT, if set.
+ * At daemon exit, the jobs still running are emitted with "exited": false.
+ * perf_loss is 1 - the time-weighted mean of the relative performance, see dvfsAcctRelPerf().
+ */
+#ifndef DVFSACCT_H
+#define DVFSACCT_H
+
+#include <stdbool.h>
+
+typedef struct dvfsAcct_st dvfsAcct;
+
+// freqs are the available clocks in ascending order, the bins of the time-at-clock histogram. Return NULL if failed.
+dvfsAcct* dvfsAcctStart(unsigned int numGpus, int maxJobs, const int* freqs, int numFreqs);
+// Account one loop of GPU gpu: the pids of its compute processes with their weights (all 0 means an equal split),
+// the loop time in seconds and energy in joules. probing is true while the clock is set by a probing phase.
+// Jobs of the GPU not in pids are finished and emitted. acct may be NULL.
+void dvfsAcctUpdate(dvfsAcct* acct, unsigned int gpu, const unsigned int* pids, const double* weights, unsigned int n,
+    unsigned long long nowUs, double seconds, double energy, unsigned int freq, double relPerf, bool probing);
+// A probing phase of GPU gpu completed, count it for every job on the GPU.
+void dvfsAcctProbeDone(dvfsAcct* acct, unsigned int gpu);
+// Emit the running jobs and free.
+void dvfsAcctStop(dvfsAcct* acct, unsigned long long nowUs);
+
+// Performance at freq relative to the max probing clock, from the mem bw util of the last probing phase (the Assure premise
+// that it scales with performance), interpolated between the probing clocks. Without records, freq/maxFreq (compute bound).
+double dvfsAcctRelPerf(unsigned int freq, unsigned int maxFreq, int numProbFreq, int numProbRep, const int* probFreqs, const double* gmemUtil);
+
+#endif
+// End of file dvfsacct.h
@@ -0,0 +1,102 @@
+/* MIT License
+
+Copyright (c) 2023 Yijia Zhang
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+
+ * Command line client of the dvfs control socket.
+ * Run "make" to compile. Example: "sudo ./dvfsctl policy 0 Assure", "sudo ./dvfsctl thres p95", "sudo ./dvfsctl dump".
+ * The command list is in dvfsctl.h. The exit code is 0 if the daemon replies OK.
+ */
+#include <stdio.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include "dvfsctl.h"
+
+int main(int argc, char* argv[])
+{
+    struct sockaddr_un addr;
+    char cmd[DVFS_CTRL_MAXLEN];
+    char reply[4096];
+    const char* path = getenv("DVFS_CTRL_SOCKET");
+    int fd, i, len = 0;
+    ssize_t n;
+    bool ok = false;
+
+    if (argc < 2)
+    {
+        printf("Usage: %s <command> [arguments]. See dvfsctl.h for the command list.\n", argv[0]);
+        return 1;
+    }
+    if (path == NULL)
+        path = DVFS_CTRL_SOCKET;
+
+    // join the arguments into one command line.
+    cmd[0] = '\0';
+    for (i = 1; i < argc; i++)
+    {
+        if (len + strlen(argv[i]) + 2 >= DVFS_CTRL_MAXLEN)
+        {
+            printf("Error: command too long.\n");
+            return 1;
+        }
+        len += sprintf(cmd+len, "%s%s", i > 1 ? " " : "", argv[i]);
+    }
+    len += sprintf(cmd+len, "\n");
+
+    fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0)
+    {
+        perror("socket");
+        return 1;
+    }
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    strncpy(addr.sun_path, path, sizeof(addr.sun_path)-1);
+    if (connect(fd, (struct sockaddr*)&addr, sizeof(addr)) < 0)
+    {
+        printf("Error: cannot connect to the dvfs daemon at %s.\n", path);
+        close(fd);
+        return 1;
+    }
+    if (write(fd, cmd, len) != len)
+    {
+        perror("write");
+        close(fd);
+        return 1;
+    }
+    shutdown(fd, SHUT_WR);
+
+    // print the reply until the daemon closes the connection.
+    i = 0;
+    while ((n = read(fd, reply, sizeof(reply))) > 0)
+    {
+        if (i == 0 && n >= 2 && strncmp(reply, "OK", 2) == 0)
+            ok = true;
+        fwrite(reply, 1, n, stdout);
+        i += n;
+    }
+    close(fd);
+    return ok ? 0 : 1;
+}
+// End of file dvfsctl.c
@@ -0,0 +1,51 @@
+/* MIT License
+
+Copyright (c) 2023 Yijia Zhang
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+
+ * Control socket shared by the dvfs daemon and the dvfsctl client.
+ * One command line is sent per connection. The reply starts with "OK" or "ERR", followed by optional lines.
+ * Commands:
+ *   policy <gpu|all> <MaxFreq|NVboost|EfficientFix|UtilizScale|Assure>
+ *   thres <value>          performance constraint, e.g. 0.9, 90 or p90.
+ *   loopdelay <ms>
+ *   probdelay <s>
+ *   pin <gpu|all> <MHz>    fix the frequency regardless of the policy.
+ *   unpin <gpu|all>
+ *   exclude <gpu|all>      stop tuning the GPU and reset its clocks.
+ *   include <gpu|all>
+ *   register <pid> <gpu list|all> <value>
+ *                          set the threshold of a job on its GPUs, e.g. "register 1234 0,1 p95".
+ *                          Each GPU uses the tightest threshold among its jobs. The entry expires when the pid exits.
+ *   unregister <pid>
+ *   probe                  start an Assure probing phase at the next loop.
+ *   mark <begin|end> <monotonic ns> <label> [gpu]
+ *                          record a benchmark event inline in the log, as "Marker: ..." after the last sample line, with
+ *                          the pid of the sender. Posted by cuda_samples/common/inc/helper_result.h.
+ *   dump                   print the policy state and the last model of each GPU.
+ */
+#ifndef DVFSCTL_H
+#define DVFSCTL_H
+
+#define DVFS_CTRL_SOCKET "/var/run/dvfs.sock"// default path. Can be changed by the environment variable DVFS_CTRL_SOCKET.
+#define DVFS_CTRL_MAXLEN 256// max length of a command line.
+
+#endif
+// End of file dvfsctl.h
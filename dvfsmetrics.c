@@ -0,0 +1,300 @@
+/* MIT License
+
+Copyright (c) 2023 Yijia Zhang
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+
+
+ * OpenMetrics endpoint of the dvfs daemon. See dvfsmetrics.h.
+ */
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <poll.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <sys/un.h>
+#include "dvfsmetrics.h"
+
+// Upper bounds of the histogram buckets in nanoseconds, from 10 us to 1 s.
+static const unsigned long long bucketBounds[DVFS_METRICS_NBUCKET] = {
+    10000, 25000, 50000, 100000, 250000, 500000,
+    1000000, 2500000, 5000000, 10000000, 25000000, 50000000,
+    100000000, 250000000, 500000000, 1000000000};
+
+static const char* const counterNames[DVFS_NCOUNTER] = {
+    "dvfs_probes", "dvfs_models_discarded", "dvfs_freq_sets_issued", "dvfs_freq_sets_suppressed", "dvfs_freq_sets_failed",
+    "dvfs_probe_settle_timeouts"};
+static const char* const counterHelps[DVFS_NCOUNTER] = {
+    "Probing phases completed.",
+    "Fitted models discarded because of a large regression error.",
+    "Frequency set calls to NVML.",
+    "Loops in which the policy kept the frequency without calling NVML.",
+    "Frequency set calls that failed.",
+    "Probes recorded after loopDelay because the readings did not settle."};
+static const char* const histNames[DVFS_NHIST] = {"dvfs_tick_seconds", "dvfs_nvml_call_seconds", "dvfs_model_fit_seconds", "dvfs_probe_settle_seconds"};
+static const char* const histHelps[DVFS_NHIST] = {
+    "Time of one loop of the daemon, excluding the wait.",
+    "Time of one NVML call in the loop.",
+    "Time of one Assure model fit.",
+    "Time from a probe frequency set until the SM clock, mem util and power are stable."};
+
+unsigned long long dvfsMetricsNow(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (unsigned long long)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+void dvfsMetricsObserve(dvfsMetrics* m, enum dvfsMetricsHistogram h, unsigned long long ns)
+{
+    int b;
+    if (m == NULL)
+        return;
+    for (b = 0; b < DVFS_METRICS_NBUCKET; b++)
+    {
+        if (ns <= bucketBounds[b])
+            break;
+    }
+    atomic_fetch_add_explicit(&m->hist[h].bucket[b], 1, memory_order_relaxed);
+    atomic_fetch_add_explicit(&m->hist[h].count, 1, memory_order_relaxed);
+    atomic_fetch_add_explicit(&m->hist[h].sumNs, ns, memory_order_relaxed);
+}
+
+static void writeMetrics(dvfsMetrics* m, FILE* out) // format all metrics in the OpenMetrics text format.
+{
+    static const char* const gaugeNames[4] = {"dvfs_gpu_clock_mhz", "dvfs_gpu_setpoint_mhz", "dvfs_gpu_utilization_ratio", "dvfs_gpu_power_watts"};
+    static const char* const gaugeHelps[4] = {"SM clock.", "Frequency setpoint of the policy.", "GPU utilization.", "GPU power usage."};
+    dvfsShmGpu* snap = NULL;
+    unsigned int i, numGpu = 0;
+    unsigned long long cumu, count, sum;
+    int g, c, h, b;
+
+    if (m->shm != NULL)
+    {
+        numGpu = m->shm->deviceCount;
+        snap = (dvfsShmGpu*)malloc(sizeof(dvfsShmGpu) * (numGpu > 0 ? numGpu : 1));
+    }
+    if (snap != NULL)// without memory, the scrape has no gauges, but still the counters and histograms.
+    {
+        for (i = 0; i < numGpu; i++)
+        {
+            if (dvfsShmRead(m->shm, i, &snap[i]) != 0)// a consistent copy of each GPU.
+                memset(&snap[i], 0, sizeof(dvfsShmGpu));// skipped below as not sampled yet.
+        }
+        for (g = 0; g < 4; g++)
+        {
+            fprintf(out, "# TYPE %s gauge\n# HELP %s %s\n", gaugeNames[g], gaugeNames[g], gaugeHelps[g]);
+            for (i = 0; i < numGpu; i++)
+            {
+                if (snap[i].loop == 0 && snap[i].sampleTime == 0)
+                    continue;// not sampled yet.
+                fprintf(out, "%s{gpu=\"%u\",policy=\"%s\"} ", gaugeNames[g], i, snap[i].policy);
+                if (g == 0)
+                    fprintf(out, "%u\n", snap[i].freq);
+                else if (g == 1)
+                    fprintf(out, "%d\n", snap[i].optimizedFreq);
+                else if (g == 2)
+                    fprintf(out, "%.2f\n", snap[i].util / 100.0);
+                else
+                    fprintf(out, "%.3f\n", snap[i].power / 1000.0);
+            }
+        }
+        fprintf(out, "# TYPE dvfs_gpu_energy_joules counter\n# HELP dvfs_gpu_energy_joules Energy integrated from the sampled power.\n");
+        for (i = 0; i < numGpu; i++)
+        {
+            if (snap[i].loop == 0 && snap[i].sampleTime == 0)
+                continue;// a counter is not reported rather than reset.
+            fprintf(out, "dvfs_gpu_energy_joules_total{gpu=\"%u\"} %.3f\n", i, snap[i].energy / 1000.0);
+        }
+        free(snap);
+    }
+
+    for (c = 0; c < DVFS_NCOUNTER; c++)
+    {
+        fprintf(out, "# TYPE %s counter\n# HELP %s %s\n", counterNames[c], counterNames[c], counterHelps[c]);
+        for (i = 0; i < m->deviceCount && i < DVFS_SHM_MAXGPU; i++)
+            fprintf(out, "%s_total{gpu=\"%u\"} %llu\n", counterNames[c], i, atomic_load_explicit(&m->counter[i][c], memory_order_relaxed));
+    }
+
+    for (h = 0; h < DVFS_NHIST; h++)
+    {
+        // read count and sum first, so that the buckets are never behind _count by more than the in-flight observations.
+        count = atomic_load_explicit(&m->hist[h].count, memory_order_relaxed);
+        sum = atomic_load_explicit(&m->hist[h].sumNs, memory_order_relaxed);
+        fprintf(out, "# TYPE %s histogram\n# HELP %s %s\n", histNames[h], histNames[h], histHelps[h]);
+        cumu = 0;
+        for (b = 0; b <= DVFS_METRICS_NBUCKET; b++)
+        {
+            cumu += atomic_load_explicit(&m->hist[h].bucket[b], memory_order_relaxed);
+            if (b == DVFS_METRICS_NBUCKET)
+            {
+                if (cumu < count)
+                    cumu = count;// +Inf must equal _count.
+                count = cumu;
+                fprintf(out, "%s_bucket{le=\"+Inf\"} %llu\n", histNames[h], cumu);
+            }
+            else
+                fprintf(out, "%s_bucket{le=\"%g\"} %llu\n", histNames[h], bucketBounds[b] / 1e9, cumu);
+        }
+        fprintf(out, "%s_count %llu\n%s_sum %.9f\n", histNames[h], count, histNames[h], sum / 1e9);
+    }
+    fprintf(out, "# EOF\n");
+}
+
+static void serveClient(dvfsMetrics* m, int fd) // answer one HTTP request.
+{
+    char req[1024];
+    char* body = NULL;
+    size_t bodyLen = 0;
+    FILE* out;
+    int n, len = 0;
+    struct pollfd pfd;
+
+    // read the request head. Scrapers send a short GET, so a small buffer and a short timeout are enough.
+    pfd.fd = fd;
+    pfd.events = POLLIN;
+    while (len < (int)sizeof(req) - 1 && poll(&pfd, 1, 1000) > 0)
+    {
+        n = read(fd, req + len, sizeof(req) - 1 - len);
+        if (n <= 0)
+            break;
+        len += n;
+        req[len] = '\0';
+        if (strstr(req, "\r\n\r\n") != NULL || strstr(req, "\n\n") != NULL)
+            break;
+    }
+    req[len] = '\0';
+
+    if (strncmp(req, "GET /metrics ", 13) != 0 && strncmp(req, "GET / ", 6) != 0)
+    {
+        dprintf(fd, "HTTP/1.1 404 Not Found\r\nContent-Length: 0\r\nConnection: close\r\n\r\n");
+        return;
+    }
+    out = open_memstream(&body, &bodyLen);
+    if (out == NULL)
+        return;
+    writeMetrics(m, out);
+    fclose(out);
+    dprintf(fd, "HTTP/1.1 200 OK\r\nContent-Type: application/openmetrics-text; version=1.0.0; charset=utf-8\r\nContent-Length: %zu\r\nConnection: close\r\n\r\n", bodyLen);
+    if (write(fd, body, bodyLen) < 0)
+        perror("metrics write");
+    free(body);
+}
+
+static void* serveMetrics(void* arg) // thread of the endpoint.
+{
+    dvfsMetrics* m = (dvfsMetrics*)arg;
+    struct pollfd pfd;
+    int fd;
+
+    // scrapes run at the lowest priority, so they do not delay the control loop.
+    setpriority(PRIO_PROCESS, (id_t)syscall(SYS_gettid), 19);
+    pfd.fd = m->listenFd;
+    pfd.events = POLLIN;
+    while (atomic_load(&m->running))
+    {
+        if (poll(&pfd, 1, 200) <= 0)
+            continue;
+        fd = accept(m->listenFd, NULL, NULL);
+        if (fd < 0)
+            continue;
+        serveClient(m, fd);
+        close(fd);
+    }
+    return NULL;
+}
+
+dvfsMetrics* dvfsMetricsStart(unsigned int deviceCount, const dvfsShmSegment* shm)
+{
+    dvfsMetrics* m = (dvfsMetrics*)calloc(1, sizeof(dvfsMetrics));
+    const char* path = getenv("DVFS_METRICS_SOCKET");
+    const char* port = getenv("DVFS_METRICS_PORT");
+    struct sockaddr_un addrUn;
+    struct sockaddr_in addrIn;
+    struct stat st;
+    int one = 1;
+
+    if (m == NULL)
+        return NULL;
+    m->deviceCount = deviceCount;
+    m->shm = shm;
+    if (path != NULL && path[0] != '\0')
+    {
+        if (strlen(path) >= sizeof(addrUn.sun_path) || (lstat(path, &st) == 0 && !S_ISSOCK(st.st_mode)))
+            goto Fail;// never unlink a file that is not a socket.
+        m->listenFd = socket(AF_UNIX, SOCK_STREAM, 0);
+        if (m->listenFd < 0)
+            goto Fail;
+        memset(&addrUn, 0, sizeof(addrUn));
+        addrUn.sun_family = AF_UNIX;
+        strcpy(addrUn.sun_path, path);
+        unlink(path);// remove a stale socket left by a killed daemon.
+        if (bind(m->listenFd, (struct sockaddr*)&addrUn, sizeof(addrUn)) != 0)
+            goto FailClose;
+        strcpy(m->sockPath, path);
+    }
+    else
+    {
+        m->listenFd = socket(AF_INET, SOCK_STREAM, 0);
+        if (m->listenFd < 0)
+            goto Fail;
+        setsockopt(m->listenFd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+        memset(&addrIn, 0, sizeof(addrIn));
+        addrIn.sin_family = AF_INET;
+        addrIn.sin_addr.s_addr = htonl(INADDR_LOOPBACK);// localhost only.
+        addrIn.sin_port = htons(port != NULL && atoi(port) > 0 ? atoi(port) : DVFS_METRICS_PORT);
+        if (bind(m->listenFd, (struct sockaddr*)&addrIn, sizeof(addrIn)) != 0)
+            goto FailClose;
+    }
+    if (listen(m->listenFd, 8) != 0)
+        goto FailClose;
+    atomic_store(&m->running, 1);
+    if (pthread_create(&m->thread, NULL, serveMetrics, m) != 0)
+        goto FailClose;
+    return m;
+
+FailClose:
+    close(m->listenFd);
+    if (m->sockPath[0] != '\0')
+        unlink(m->sockPath);
+Fail:
+    free(m);
+    return NULL;
+}
+
+void dvfsMetricsStop(dvfsMetrics* m)
+{
+    if (m == NULL)
+        return;
+    atomic_store(&m->running, 0);
+    pthread_join(m->thread, NULL);// the thread polls with a short timeout.
+    close(m->listenFd);
+    if (m->sockPath[0] != '\0')
+        unlink(m->sockPath);
+    free(m);
+}
+// End of file dvfsmetrics.c
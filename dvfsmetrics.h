@@ -0,0 +1,94 @@
+/* MIT License
+
+Copyright (c) 2023 Yijia Zhang
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+
+
+ * OpenMetrics endpoint of the dvfs daemon.
+ * The daemon counts events and latencies with relaxed atomic adds, so the control loop never takes a lock or makes a syscall for metrics.
+ * The endpoint is opt-in. A separate low-priority thread serves "GET /metrics" on 127.0.0.1 at the port in the environment variable DVFS_METRICS_PORT,
+ * or on a Unix socket at the path in DVFS_METRICS_SOCKET. Without either, the daemon opens no endpoint and the updates below do nothing.
+ * Gauges (clock, setpoint, util, power) and the energy counter are read from the shared-memory telemetry (dvfsshm.h), so a scrape does not touch NVML.
+ */
+#ifndef DVFSMETRICS_H
+#define DVFSMETRICS_H
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include "dvfsshm.h"
+
+#define DVFS_METRICS_PORT 9410// the suggested port, e.g. DVFS_METRICS_PORT=9410. Also used if DVFS_METRICS_PORT is not a number.
+#define DVFS_METRICS_NBUCKET 16// histogram buckets, plus +Inf.
+
+// Per-GPU counters.
+enum dvfsMetricsCounter
+{
+    DVFS_COUNT_PROBES = 0,// probing phases completed.
+    DVFS_COUNT_MODELS_DISCARDED,// fitted models discarded for a large regression error.
+    DVFS_COUNT_SETS_ISSUED,// frequency set calls.
+    DVFS_COUNT_SETS_SUPPRESSED,// loops in which the policy kept the frequency without calling NVML.
+    DVFS_COUNT_SETS_FAILED,
+    DVFS_COUNT_PROBE_TIMEOUTS,// probes recorded after loopDelay without settling.
+    DVFS_NCOUNTER
+};
+
+// Latency histograms.
+enum dvfsMetricsHistogram
+{
+    DVFS_HIST_TICK = 0,// one loop of the daemon, excluding the wait.
+    DVFS_HIST_NVML,// one NVML call in the loop.
+    DVFS_HIST_MODEL_FIT,// one assureModelFit().
+    DVFS_HIST_PROBE_SETTLE,// from a probe set until the readings are stable.
+    DVFS_NHIST
+};
+
+typedef struct dvfsHistogram_st
+{
+    atomic_ullong bucket[DVFS_METRICS_NBUCKET+1];// not cumulative. The last one is +Inf.
+    atomic_ullong count;
+    atomic_ullong sumNs;
+} dvfsHistogram;
+
+typedef struct dvfsMetrics_st
+{
+    unsigned int deviceCount;
+    const dvfsShmSegment* shm;// may be NULL, then gauges are not served.
+    atomic_ullong counter[DVFS_SHM_MAXGPU][DVFS_NCOUNTER];
+    dvfsHistogram hist[DVFS_NHIST];
+    int listenFd;
+    char sockPath[108];// empty when serving TCP.
+    atomic_int running;
+    pthread_t thread;
+} dvfsMetrics;
+
+dvfsMetrics* dvfsMetricsStart(unsigned int deviceCount, const dvfsShmSegment* shm);// Return NULL if the endpoint cannot be opened.
+void dvfsMetricsStop(dvfsMetrics* m);
+unsigned long long dvfsMetricsNow(void);// CLOCK_MONOTONIC in nanoseconds.
+
+// Hot-path updates. Both accept m == NULL, so the caller does not need to check whether metrics are enabled.
+static inline void dvfsMetricsCount(dvfsMetrics* m, unsigned int gpu, enum dvfsMetricsCounter c)
+{
+    if (m != NULL && gpu < DVFS_SHM_MAXGPU)
+        atomic_fetch_add_explicit(&m->counter[gpu][c], 1, memory_order_relaxed);
+}
+void dvfsMetricsObserve(dvfsMetrics* m, enum dvfsMetricsHistogram h, unsigned long long ns);
+
+#endif
+// End of file dvfsmetrics.h
@@ -0,0 +1,145 @@
+/* MIT License
+
+Copyright (c) 2023 Yijia Zhang
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+
+ * Shared-memory telemetry of the dvfs daemon. See dvfsshm.h.
+ * The segment is created the same way as sharedMemoryCreate() in cuda_samples/common/src/helper_multiprocess.cpp,
+ * in plain C so that the daemon does not need the CUDA samples to build.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sched.h>
+#include <sys/mman.h>
+#include "dvfsshm.h"
+
+const char* dvfsShmName(void)
+{
+    const char* name = getenv("DVFS_SHM_NAME");
+    return (name != NULL && name[0] == '/') ? name : DVFS_SHM_NAME;
+}
+
+dvfsShmSegment* dvfsShmCreate(unsigned int deviceCount)
+{
+    dvfsShmSegment* seg;
+    unsigned int i;
+    int fd = shm_open(dvfsShmName(), O_RDWR | O_CREAT, 0644);// readers only need read access.
+    if (fd < 0)
+        return NULL;
+    if (ftruncate(fd, sizeof(dvfsShmSegment)) != 0)
+    {
+        close(fd);
+        return NULL;
+    }
+    seg = (dvfsShmSegment*)mmap(NULL, sizeof(dvfsShmSegment), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);// the mapping stays valid.
+    if (seg == MAP_FAILED)
+        return NULL;
+    memset(seg, 0, sizeof(dvfsShmSegment));
+    seg->version = DVFS_SHM_VERSION;
+    seg->size = sizeof(dvfsShmSegment);
+    seg->deviceCount = deviceCount < DVFS_SHM_MAXGPU ? deviceCount : DVFS_SHM_MAXGPU;
+    seg->pid = getpid();
+    for (i = 0; i < DVFS_SHM_MAXGPU; i++)
+        seg->gpu[i].index = i;
+    atomic_store(&seg->running, 1);
+    atomic_thread_fence(memory_order_release);
+    seg->magic = DVFS_SHM_MAGIC;// written last, so a reader never sees a half-initialized header.
+    return seg;
+}
+
+void dvfsShmBeginWrite(dvfsShmGpu* rec)
+{
+    unsigned int seq = atomic_load_explicit(&rec->seq, memory_order_relaxed);
+    atomic_store_explicit(&rec->seq, seq+1, memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);// the odd counter is visible before any field changes.
+}
+
+void dvfsShmEndWrite(dvfsShmGpu* rec)
+{
+    unsigned int seq = atomic_load_explicit(&rec->seq, memory_order_relaxed);
+    atomic_store_explicit(&rec->seq, seq+1, memory_order_release);
+}
+
+void dvfsShmDestroy(dvfsShmSegment* seg)
+{
+    if (seg == NULL)
+        return;
+    atomic_store(&seg->running, 0);
+    munmap(seg, sizeof(dvfsShmSegment));
+    shm_unlink(dvfsShmName());// mapped readers keep their view until they close it.
+}
+
+const dvfsShmSegment* dvfsShmOpen(void)
+{
+    dvfsShmSegment* seg;
+    int fd = shm_open(dvfsShmName(), O_RDONLY, 0);
+    if (fd < 0)
+        return NULL;
+    seg = (dvfsShmSegment*)mmap(NULL, sizeof(dvfsShmSegment), PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (seg == MAP_FAILED)
+        return NULL;
+    if (seg->magic != DVFS_SHM_MAGIC || seg->version != DVFS_SHM_VERSION || seg->size != sizeof(dvfsShmSegment))
+    {
+        munmap(seg, sizeof(dvfsShmSegment));
+        return NULL;
+    }
+    atomic_thread_fence(memory_order_acquire);
+    return seg;
+}
+
+int dvfsShmRead(const dvfsShmSegment* seg, unsigned int gpu, dvfsShmGpu* snapshot)
+{
+    const dvfsShmGpu* rec;
+    unsigned int seq1, seq2;
+    int retry;
+    if (gpu >= seg->deviceCount)
+        return -1;
+    rec = &seg->gpu[gpu];
+    for (retry = 0; retry < DVFS_SHM_MAXRETRY; retry++)
+    {
+        seq1 = atomic_load_explicit((atomic_uint*)&rec->seq, memory_order_acquire);
+        if (seq1 & 1)
+        {
+            // the daemon is writing. A record left odd by a terminated daemon is never completed.
+            if (atomic_load_explicit((atomic_int*)&seg->running, memory_order_relaxed) == 0)
+                return -2;
+            sched_yield();
+            continue;
+        }
+        memcpy(snapshot, rec, sizeof(dvfsShmGpu));
+        atomic_thread_fence(memory_order_acquire);// the copy completes before the counter is read again.
+        seq2 = atomic_load_explicit((atomic_uint*)&rec->seq, memory_order_relaxed);
+        if (seq1 == seq2)
+            return 0;
+    }
+    return -2;// e.g. the daemon was killed while writing this record.
+}
+
+void dvfsShmClose(const dvfsShmSegment* seg)
+{
+    if (seg != NULL)
+        munmap((void*)seg, sizeof(dvfsShmSegment));
+}
+// End of file dvfsshm.c
@@ -0,0 +1,94 @@
+/* MIT License
+
+Copyright (c) 2023 Yijia Zhang
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+
+ * Shared-memory telemetry published by the dvfs daemon.
+ * The daemon writes the latest sample and decision of each GPU into the POSIX shared memory DVFS_SHM_NAME every loop.
+ * Each GPU record is protected by a seqlock, so any number of local readers get consistent snapshots without locks or syscalls.
+ * Readers link dvfsshm.o (or libdvfsshm.a) and use dvfsShmOpen(), dvfsShmRead() and dvfsShmClose().
+ * The layout has a fixed size. Increase DVFS_SHM_VERSION when it changes.
+ */
+#ifndef DVFSSHM_H
+#define DVFSSHM_H
+
+#include <stdatomic.h>
+
+#define DVFS_SHM_NAME "/dvfs_telemetry"// environment variable DVFS_SHM_NAME overrides it.
+#define DVFS_SHM_MAGIC 0x53465644// "DVFS".
+#define DVFS_SHM_VERSION 1
+#define DVFS_SHM_MAXGPU 64
+#define DVFS_SHM_MAXPROB 64// max number of probing records kept per GPU.
+#define DVFS_SHM_MAXRETRY 100000// a reader gives up after this many torn reads, e.g. if the daemon was killed while writing.
+
+typedef struct dvfsShmGpu_st
+{
+    atomic_uint seq;// odd while the daemon is writing this record.
+    unsigned int index;
+    unsigned long long loop;// loop counter of the daemon.
+    unsigned long long sampleTime;// time of the sample in microseconds since the epoch.
+    unsigned int util;// gpu util in percent.
+    unsigned int memUtil;// gpu memory bandwidth util in percent.
+    unsigned int power;// in mW.
+    unsigned int freq;// SM clock in MHz.
+    int setFreq;// frequency set in this loop. -1 if no frequency is set.
+    int optimizedFreq;// current frequency setpoint of the policy.
+    unsigned long long energy;// in mJ, integrated from power since the daemon started.
+    char policy[16];
+    double perfThres;
+    double freqBound;// last Assure model result. -1 before the first model.
+    double freqEff;
+    double freqCap;
+    int probPhase;// >0 while probing.
+    int parked;
+    int pinFreq;// 0 if not pinned.
+    int excluded;
+    int numProbRec;// valid entries in gmemUtils and gPowers.
+    int pad;
+    double gmemUtils[DVFS_SHM_MAXPROB];// probing records of the last probing phase.
+    double gPowers[DVFS_SHM_MAXPROB];
+} dvfsShmGpu;
+
+typedef struct dvfsShmSegment_st
+{
+    unsigned int magic;
+    unsigned int version;
+    unsigned int size;// sizeof(dvfsShmSegment), to detect a layout mismatch.
+    unsigned int deviceCount;
+    atomic_int running;// 0 after the daemon terminates.
+    int pid;// pid of the daemon.
+    dvfsShmGpu gpu[DVFS_SHM_MAXGPU];
+} dvfsShmSegment;
+
+const char* dvfsShmName(void);// DVFS_SHM_NAME, or the environment variable of the same name.
+
+// Writer side, used by the daemon.
+dvfsShmSegment* dvfsShmCreate(unsigned int deviceCount);// Return NULL if failed.
+void dvfsShmBeginWrite(dvfsShmGpu* rec);
+void dvfsShmEndWrite(dvfsShmGpu* rec);
+void dvfsShmDestroy(dvfsShmSegment* seg);
+
+// Reader side.
+const dvfsShmSegment* dvfsShmOpen(void);// Return NULL if the daemon is not running or the layout does not match.
+int dvfsShmRead(const dvfsShmSegment* seg, unsigned int gpu, dvfsShmGpu* snapshot);// Return 0 on success, -1 if gpu is invalid, -2 if no consistent copy can be read.
+void dvfsShmClose(const dvfsShmSegment* seg);
+
+#endif
+// End of file dvfsshm.h
@@ -0,0 +1,263 @@
+/* MIT License
+
+Copyright (c) 2023 Yijia Zhang
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+
+
+ * Columnar binary trace writer. See dvfstrace.h.
+ * The current block is kept in memory and written with one pwrite() when it is full, so the daemon writes about once
+ * every blockRows loops. The header is written at create and rewritten at close with the block count and index offset.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/time.h>
+#include "dvfstrace.h"
+
+const dvfsTraceColumn dvfsTraceDaemonSchema[DVFS_TRACE_NUMCOLUMNS] = {
+    {"time", "us", "<i8", 0},
+    {"monotonic", "ns", "<u8", 0},
+    {"loop", "us", "<u4", 0},
+    {"probphase", "", "<i4", 0},
+    {"util", "%", "<u4", 1},
+    {"memutil", "%", "<u4", 1},
+    {"power", "mW", "<u4", 1},
+    {"freq", "MHz", "<u4", 1},
+    {"setfreq", "MHz", "<i4", 1},
+    {"targetfreq", "MHz", "<i4", 1}};
+
+enum traceType {TYPE_I4 = 0, TYPE_U4, TYPE_I8, TYPE_U8, TYPE_F8};
+
+struct dvfsTrace_st
+{
+    int fd;
+    int failed;
+    dvfsTraceHeader header;
+    dvfsTraceColumnDesc* desc;
+    enum traceType* types;
+    char* block;// the current block, blockSize bytes.
+    unsigned int rows;// rows in the current block.
+    dvfsTraceIndexEntry* index;
+    unsigned long long numBlocks, capBlocks;
+};
+
+static int writeAt(dvfsTrace* trace, const void* buf, size_t size, unsigned long long offset)
+{
+    const char* p = (const char*)buf;
+    while (size > 0)
+    {
+        ssize_t n = pwrite(trace->fd, p, size, offset);
+        if (n <= 0)
+        {
+            trace->failed = 1;
+            return -1;
+        }
+        p += n;
+        size -= n;
+        offset += n;
+    }
+    return 0;
+}
+
+dvfsTrace* dvfsTraceCreate(const char* path, unsigned int numGpus, const char* machine, const dvfsTraceColumn* columns,
+    unsigned int numColumns, unsigned int blockRows)
+{
+    dvfsTrace* trace;
+    struct timeval now;
+    unsigned int c, offset = sizeof(dvfsTraceBlockHeader);
+    if (numGpus == 0 || numColumns == 0 || blockRows == 0 || strcmp(columns[0].dtype, "<i8") != 0)
+        return NULL;
+    trace = (dvfsTrace*)calloc(1, sizeof(dvfsTrace));
+    if (trace == NULL)
+        return NULL;
+    trace->desc = (dvfsTraceColumnDesc*)calloc(numColumns, sizeof(dvfsTraceColumnDesc));
+    trace->types = (enum traceType*)calloc(numColumns, sizeof(enum traceType));
+    if (trace->desc == NULL || trace->types == NULL)
+        goto Fail;
+    for (c = 0; c < numColumns; c++)
+    {
+        dvfsTraceColumnDesc* d = &trace->desc[c];
+        const char* dtype = columns[c].dtype;
+        if (strcmp(dtype, "<i4") == 0)
+            trace->types[c] = TYPE_I4;
+        else if (strcmp(dtype, "<u4") == 0)
+            trace->types[c] = TYPE_U4;
+        else if (strcmp(dtype, "<i8") == 0)
+            trace->types[c] = TYPE_I8;
+        else if (strcmp(dtype, "<u8") == 0)
+            trace->types[c] = TYPE_U8;
+        else if (strcmp(dtype, "<f8") == 0)
+            trace->types[c] = TYPE_F8;
+        else
+            goto Fail;
+        strncpy(d->name, columns[c].name, sizeof(d->name)-1);
+        strncpy(d->unit, columns[c].unit, sizeof(d->unit)-1);
+        memcpy(d->dtype, dtype, 3);
+        d->perGpu = columns[c].perGpu ? 1 : 0;
+        d->width = dtype[2] - '0';
+        d->offset = offset;
+        offset += (d->width * blockRows * (d->perGpu ? numGpus : 1) + 7) / 8 * 8;// 8-byte aligned columns.
+    }
+
+    memcpy(trace->header.magic, DVFS_TRACE_MAGIC, 8);
+    trace->header.version = DVFS_TRACE_VERSION;
+    trace->header.headerSize = (sizeof(dvfsTraceHeader) + numColumns * sizeof(dvfsTraceColumnDesc) + 63) / 64 * 64;
+    trace->header.numGpus = numGpus;
+    trace->header.numColumns = numColumns;
+    trace->header.blockRows = blockRows;
+    trace->header.blockSize = offset;
+    gettimeofday(&now, NULL);
+    trace->header.createTime = (int64_t)now.tv_sec * 1000000 + now.tv_usec;
+    strncpy(trace->header.machine, machine, sizeof(trace->header.machine)-1);
+    trace->block = (char*)calloc(1, offset);
+    if (trace->block == NULL)
+        goto Fail;
+
+    trace->fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (trace->fd < 0)
+        goto Fail;
+    if (writeAt(trace, &trace->header, sizeof(dvfsTraceHeader), 0) != 0
+        || writeAt(trace, trace->desc, numColumns * sizeof(dvfsTraceColumnDesc), sizeof(dvfsTraceHeader)) != 0
+        || ftruncate(trace->fd, trace->header.headerSize) != 0)
+    {
+        close(trace->fd);
+        goto Fail;
+    }
+    return trace;
+
+Fail:
+    free(trace->desc);
+    free(trace->types);
+    free(trace->block);
+    free(trace);
+    return NULL;
+}
+
+static char* cell(dvfsTrace* trace, unsigned int column, unsigned int gpu)
+{
+    const dvfsTraceColumnDesc* d = &trace->desc[column];
+    unsigned int row = d->perGpu ? gpu * trace->header.blockRows + trace->rows : trace->rows;
+    return trace->block + d->offset + (size_t)row * d->width;
+}
+
+void dvfsTraceSetInt(dvfsTrace* trace, unsigned int column, unsigned int gpu, long long value)
+{
+    char* p;
+    if (trace == NULL || column >= trace->header.numColumns || gpu >= trace->header.numGpus)
+        return;
+    p = cell(trace, column, gpu);
+    switch (trace->types[column])
+    {
+        case TYPE_I4: *(int32_t*)p = (int32_t)value; break;
+        case TYPE_U4: *(uint32_t*)p = (uint32_t)value; break;
+        case TYPE_I8: *(int64_t*)p = (int64_t)value; break;
+        case TYPE_U8: *(uint64_t*)p = (uint64_t)value; break;
+        case TYPE_F8: *(double*)p = (double)value; break;
+    }
+}
+
+void dvfsTraceSetReal(dvfsTrace* trace, unsigned int column, unsigned int gpu, double value)
+{
+    if (trace == NULL || column >= trace->header.numColumns || gpu >= trace->header.numGpus)
+        return;
+    if (trace->types[column] == TYPE_F8)
+        *(double*)cell(trace, column, gpu) = value;
+    else
+        dvfsTraceSetInt(trace, column, gpu, (long long)value);
+}
+
+// Write the current block into its slot, and record it in the index.
+static int writeBlock(dvfsTrace* trace)
+{
+    dvfsTraceBlockHeader* bh = (dvfsTraceBlockHeader*)trace->block;
+    const int64_t* time = (const int64_t*)(trace->block + trace->desc[0].offset);
+    unsigned long long offset = trace->header.headerSize + trace->numBlocks * trace->header.blockSize;
+    dvfsTraceIndexEntry* entry;
+    bh->magic = DVFS_TRACE_BLOCK_MAGIC;
+    bh->rows = trace->rows;
+    bh->index = trace->numBlocks;
+    bh->first = time[0];
+    bh->last = time[trace->rows - 1];
+    if (trace->numBlocks == trace->capBlocks)
+    {
+        unsigned long long cap = trace->capBlocks == 0 ? 64 : trace->capBlocks * 2;
+        dvfsTraceIndexEntry* index = (dvfsTraceIndexEntry*)realloc(trace->index, cap * sizeof(dvfsTraceIndexEntry));
+        if (index == NULL)
+        {
+            trace->failed = 1;
+            return -1;
+        }
+        trace->index = index;
+        trace->capBlocks = cap;
+    }
+    entry = &trace->index[trace->numBlocks];
+    entry->offset = offset;
+    entry->rows = bh->rows;
+    entry->pad = 0;
+    entry->first = bh->first;
+    entry->last = bh->last;
+    if (writeAt(trace, trace->block, trace->header.blockSize, offset) != 0)
+        return -1;
+    trace->numBlocks++;
+    return 0;
+}
+
+int dvfsTraceEndRow(dvfsTrace* trace)
+{
+    int ret = 0;
+    if (trace == NULL)
+        return 0;
+    trace->rows++;
+    if (trace->rows == trace->header.blockRows)
+    {
+        ret = writeBlock(trace);
+        memset(trace->block, 0, trace->header.blockSize);
+        trace->rows = 0;
+    }
+    return ret;
+}
+
+int dvfsTraceClose(dvfsTrace* trace)
+{
+    uint32_t indexHeader[4] = {DVFS_TRACE_INDEX_MAGIC, 0, 0, 0};
+    int ret;
+    if (trace == NULL)
+        return 0;
+    if (trace->rows > 0)
+        writeBlock(trace);
+    trace->header.numBlocks = trace->numBlocks;
+    trace->header.indexOffset = trace->header.headerSize + trace->numBlocks * trace->header.blockSize;
+    indexHeader[1] = (uint32_t)trace->numBlocks;
+    if (writeAt(trace, indexHeader, sizeof(indexHeader), trace->header.indexOffset) == 0
+        && writeAt(trace, trace->index, trace->numBlocks * sizeof(dvfsTraceIndexEntry), trace->header.indexOffset + sizeof(indexHeader)) == 0)
+        writeAt(trace, &trace->header, sizeof(dvfsTraceHeader), 0);// the index is only referenced once it is complete.
+    ret = trace->failed ? -1 : 0;
+    if (close(trace->fd) != 0)
+        ret = -1;
+    free(trace->desc);
+    free(trace->types);
+    free(trace->block);
+    free(trace->index);
+    free(trace);
+    return ret;
+}
+// End of file dvfstrace.c
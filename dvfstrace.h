@@ -0,0 +1,130 @@
+/* MIT License
+
+Copyright (c) 2023 Yijia Zhang
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+
+
+ * Columnar binary traces of the dvfs daemon, the binary counterpart of the text log in output/dvfs_*.out.
+ * A trace is self-describing, all integers are little-endian:
+ *   - a header (dvfsTraceHeader) with the version, GPU count, machine, rows per block and block size,
+ *   - one descriptor (dvfsTraceColumnDesc) per column with its name, unit, numpy dtype, and its offset in a block,
+ *   - fixed-size blocks. A block has a header (dvfsTraceBlockHeader) and then every column as a contiguous array:
+ *     values[blockRows] for a per-row column, values[numGpus][blockRows] for a per-GPU column. All blocks but the last are full.
+ *   - at close, a block index (dvfsTraceIndexEntry per block), located by indexOffset in the header.
+ * Since blocks have a fixed size, a reader can map the file and view every column without copying (see dvfstrace.py),
+ * and a trace cut short (without index) can still be read block by block. New columns only extend the schema; readers
+ * look columns up by name. Increase DVFS_TRACE_VERSION when the layout of the headers changes.
+ */
+#ifndef DVFSTRACE_H
+#define DVFSTRACE_H
+
+#include <stdint.h>
+
+#define DVFS_TRACE_MAGIC "DVFSTRCE"
+#define DVFS_TRACE_BLOCK_MAGIC 0x314b4c42// "BLK1".
+#define DVFS_TRACE_INDEX_MAGIC 0x31584449// "IDX1".
+#define DVFS_TRACE_VERSION 1
+#define DVFS_TRACE_BLOCKROWS 256// rows per block of the daemon, about 50 s at the default loopDelay.
+
+typedef struct dvfsTraceHeader_st
+{
+    char magic[8];
+    uint32_t version;
+    uint32_t headerSize;// bytes before the first block, including the column descriptors.
+    uint32_t numGpus;
+    uint32_t numColumns;
+    uint32_t blockRows;
+    uint32_t blockSize;// bytes of one block, including its header.
+    uint64_t numBlocks;// 0 until the trace is closed.
+    uint64_t indexOffset;// 0 until the trace is closed.
+    int64_t createTime;// in microseconds since the epoch.
+    char machine[32];
+    char reserved[40];
+} dvfsTraceHeader;// 128 bytes.
+
+typedef struct dvfsTraceColumnDesc_st
+{
+    char name[32];
+    char unit[16];
+    char dtype[4];// numpy dtype: "<i4", "<u4", "<i8", "<u8" or "<f8".
+    uint32_t perGpu;// 1 if the column has one value per GPU per row.
+    uint32_t offset;// of the column in a block.
+    uint32_t width;// bytes per value.
+} dvfsTraceColumnDesc;// 64 bytes.
+
+typedef struct dvfsTraceBlockHeader_st
+{
+    uint32_t magic;
+    uint32_t rows;// valid rows in this block.
+    uint64_t index;
+    int64_t first;// first and last value of column 0 (the time) in this block.
+    int64_t last;
+    char reserved[32];
+} dvfsTraceBlockHeader;// 64 bytes.
+
+typedef struct dvfsTraceIndexEntry_st
+{
+    uint64_t offset;
+    uint32_t rows;
+    uint32_t pad;
+    int64_t first;
+    int64_t last;
+} dvfsTraceIndexEntry;// 32 bytes, after a 16-byte index header {magic, count, 0}.
+
+typedef struct dvfsTraceColumn_st
+{
+    const char* name;
+    const char* unit;
+    const char* dtype;
+    int perGpu;
+} dvfsTraceColumn;
+
+// The schema of the daemon's trace. Column 0 must be an 8-byte integer time.
+enum dvfsTraceDaemonColumn
+{
+    DVFS_TRACE_TIME = 0,// wall time of the loop start, as in the text log.
+    DVFS_TRACE_MONOTONIC,// CLOCK_MONOTONIC of the loop start, the clock of dvfsmetrics.h and helper_result.h.
+    DVFS_TRACE_LOOP,// duration of the loop, the last column of the text log.
+    DVFS_TRACE_PROBPHASE,
+    DVFS_TRACE_UTIL,
+    DVFS_TRACE_MEMUTIL,
+    DVFS_TRACE_POWER,
+    DVFS_TRACE_FREQ,
+    DVFS_TRACE_SETFREQ,// -1 if no frequency is set, as in the text log.
+    DVFS_TRACE_TARGETFREQ,// current frequency setpoint of the policy.
+    DVFS_TRACE_NUMCOLUMNS
+};
+extern const dvfsTraceColumn dvfsTraceDaemonSchema[DVFS_TRACE_NUMCOLUMNS];
+
+typedef struct dvfsTrace_st dvfsTrace;
+
+// Return NULL if failed. The file is truncated.
+dvfsTrace* dvfsTraceCreate(const char* path, unsigned int numGpus, const char* machine, const dvfsTraceColumn* columns,
+    unsigned int numColumns, unsigned int blockRows);
+// Set a value of the current row. gpu is ignored for a per-row column. Unset values are 0.
+void dvfsTraceSetInt(dvfsTrace* trace, unsigned int column, unsigned int gpu, long long value);
+void dvfsTraceSetReal(dvfsTrace* trace, unsigned int column, unsigned int gpu, double value);
+// Finish the current row. A full block is written to the file. Return -1 if the write failed.
+int dvfsTraceEndRow(dvfsTrace* trace);
+// Write the last block and the index, and close. Return -1 if a write failed. trace may be NULL.
+int dvfsTraceClose(dvfsTrace* trace);
+
+#endif
+// End of file dvfstrace.h
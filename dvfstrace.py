@@ -0,0 +1,126 @@
+'''
+MIT License
+
+Copyright (c) 2023 Yijia Zhang
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+
+###
+Reader of the columnar binary traces written by dvfs.c (environment variable DVFS_TRACE). The format is described in dvfstrace.h.
+The file is mapped with numpy.memmap, and the blocks are viewed as one structured array, so columns are read without copying:
+    trace = DvfsTrace('output/dvfs_Assure_p90.dtr')
+    trace.column('power')         # zero-copy view, shape (blocks, gpus, blockRows) or (blocks, blockRows) for per-row columns.
+    trace.series('power', gpu=0)  # the valid rows of one GPU as a 1-d array (one copy).
+    trace.dataframe()             # all columns in the layout of the text log, e.g. power_0, requires pandas.
+Usage as a script: python3 dvfstrace.py trace.dtr, prints the schema and a summary.
+'''
+import sys
+import numpy as np
+
+MAGIC = b'DVFSTRCE'
+VERSION = 1
+BLOCK_MAGIC = 0x314b4c42
+INDEX_MAGIC = 0x31584449
+
+headerDtype = np.dtype([('magic', 'S8'), ('version', '<u4'), ('headerSize', '<u4'), ('numGpus', '<u4'), ('numColumns', '<u4'),
+    ('blockRows', '<u4'), ('blockSize', '<u4'), ('numBlocks', '<u8'), ('indexOffset', '<u8'), ('createTime', '<i8'),
+    ('machine', 'S32'), ('reserved', 'V40')])
+columnDtype = np.dtype([('name', 'S32'), ('unit', 'S16'), ('dtype', 'S4'), ('perGpu', '<u4'), ('offset', '<u4'), ('width', '<u4')])
+blockHeaderDtype = np.dtype([('magic', '<u4'), ('rows', '<u4'), ('index', '<u8'), ('first', '<i8'), ('last', '<i8'), ('reserved', 'V32')])
+indexDtype = np.dtype([('offset', '<u8'), ('rows', '<u4'), ('pad', '<u4'), ('first', '<i8'), ('last', '<i8')])
+
+class DvfsTrace:
+    def __init__(self, path):
+        self.path = path
+        self._map = np.memmap(path, dtype=np.uint8, mode='r')
+        header = self._map[:headerDtype.itemsize].view(headerDtype)[0]
+        if bytes(header['magic']) != MAGIC or int(header['version']) != VERSION:
+            raise ValueError('%s is not a dvfs trace of version %d' % (path, VERSION))
+        self.numGpus = int(header['numGpus'])
+        self.blockRows = int(header['blockRows'])
+        self.machine = bytes(header['machine']).rstrip(b'\0').decode()
+        self.createTime = int(header['createTime']) / 1e6
+        headerSize, blockSize = int(header['headerSize']), int(header['blockSize'])
+        desc = self._map[headerDtype.itemsize:headerDtype.itemsize + columnDtype.itemsize * int(header['numColumns'])].view(columnDtype)
+        self.columns = {}# name -> (unit, dtype, perGpu).
+        fields = {'names': ['header'], 'formats': [blockHeaderDtype], 'offsets': [0], 'itemsize': blockSize}
+        for d in desc:
+            name = bytes(d['name']).rstrip(b'\0').decode()
+            dtype = np.dtype(bytes(d['dtype']).rstrip(b'\0').decode())
+            shape = (self.numGpus, self.blockRows) if d['perGpu'] else (self.blockRows,)
+            self.columns[name] = (bytes(d['unit']).rstrip(b'\0').decode(), dtype, bool(d['perGpu']))
+            fields['names'].append(name)
+            fields['formats'].append((dtype, shape))
+            fields['offsets'].append(int(d['offset']))
+        self._blockDtype = np.dtype(fields)
+
+        # the block index of a closed trace, otherwise all complete blocks in the file (the daemon did not exit cleanly).
+        if int(header['indexOffset']) > 0:
+            numBlocks = int(header['numBlocks'])
+        else:
+            numBlocks = (len(self._map) - headerSize) // blockSize
+        self.blocks = self._map[headerSize:headerSize + numBlocks * blockSize].view(self._blockDtype)
+        valid = self.blocks['header']['magic'] == BLOCK_MAGIC
+        if not valid.all():
+            self.blocks = self.blocks[:np.argmin(valid)]
+        self.index = self.blocks['header'][['rows', 'first', 'last']]
+        self.rows = int(self.index['rows'].sum())
+
+    def column(self, name):
+        # zero-copy view of a column over all blocks. Rows beyond index['rows'] of the last block are not valid.
+        return self.blocks[name]
+
+    def series(self, name, gpu=None):
+        col = self.blocks[name]
+        if self.columns[name][2]:
+            col = col[:, gpu if gpu is not None else 0, :]
+        return col.reshape(-1)[:self.rows]
+
+    def window(self, start, end):
+        # range of rows with start <= time (us) <= end, found with the block index and a binary search in the time column.
+        time = self.series('time')
+        return np.searchsorted(time, start, side='left'), np.searchsorted(time, end, side='right')
+
+    def dataframe(self):
+        import pandas as pd
+        data = {}
+        for name, (unit, dtype, perGpu) in self.columns.items():
+            if perGpu:
+                for gpu in range(self.numGpus):
+                    data['%s_%d' % (name, gpu)] = self.series(name, gpu)
+            else:
+                data[name] = self.series(name)
+        return pd.DataFrame(data)
+
+def main():
+    if len(sys.argv) < 2:
+        print('Usage: python3 dvfstrace.py trace.dtr')
+        return
+    trace = DvfsTrace(sys.argv[1])
+    print('Machine %s, %d GPUs, %d rows in %d blocks of %d rows.' % (trace.machine, trace.numGpus, trace.rows, len(trace.blocks),
+        trace.blockRows))
+    for name, (unit, dtype, perGpu) in trace.columns.items():
+        line = '%-12s %-4s %-4s %s' % (name, unit, dtype.str, 'per GPU' if perGpu else 'per row')
+        if trace.rows > 0:
+            values = trace.series(name) if not perGpu else np.concatenate([trace.series(name, g) for g in range(trace.numGpus)])
+            line += '  min %g, mean %g, max %g' % (values.min(), values.mean(), values.max())
+        print(line)
+
+if __name__ == '__main__':
+    main()
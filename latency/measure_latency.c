@@ -20,22 +20,33 @@ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
 OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
 SOFTWARE.
 
- * GPU metrics reading and frequency tuning latency measurement.
- * If changeFreq is true, it sets GPU frequency to oscillate between two values to measure latency.
- * Use "make" to compile.
- * Run by "sudo ./measure_latency -1" to measure all GPUs; change to a number other than -1 measures the specified GPU.
- * Use Ctrl-C to stop. Frequency is reset automatically at stop.
- * Bool constants printDateTime, getUtilization, getFrequency, getPower, changeFreq can be adjusted.
+ * GPU metrics reading and frequency tuning latency profiler.
+ * Each NVML call is timed individually with CLOCK_MONOTONIC over many iterations, and p50/p90/p99/max latencies are reported
+ * per call. The set calls oscillate the GPU frequency between two values, so that nvmlDeviceSetApplicationsClocks() and
+ * nvmlDeviceSetGpuLockedClocks() can be compared. Scaling is measured by running each call from 1..N threads on 1..N GPUs
+ * concurrently: GPU g is driven by thread (g mod threads), and with more threads than GPUs, threads share a GPU.
+ * Use "make" to compile ("make sim" for the NVML simulator in ../sim).
+ * Run by "./measure_latency [options]". The set calls need root, e.g. "sudo ./measure_latency -c setapp,setlocked".
+ * Options:
+ *   -g GPU         the GPU to measure, -1 means all GPUs. [0] (A single number as the only argument is also accepted.)
+ *   -c calls       comma-separated calls out of handle, util, clock, power, energy, temp, procs, setapp, setlocked. [util,clock,power]
+ *   -n iterations  iterations per thread of each read call. [1000]
+ *   -N iterations  iterations per thread of each set call, which is much slower. [100]
+ *   -t threads     comma-separated thread counts. [1]
+ *   -G gpus        comma-separated GPU counts, starting at GPU 0. Overrides -g.
+ *   -j             print JSON lines instead of csv.
+ * One line is printed per call, thread count and GPU count, with latencies in microseconds and the aggregate calls per second.
+ * Use Ctrl-C to stop early. Frequency is reset automatically at stop if any set call was measured.
  */
 #include <stdio.h>
 #include <stdbool.h>
 #include <stdlib.h>
 #include <nvml.h>
-#include <sys/time.h>
 #include <unistd.h>
 #include <signal.h>
 #include <string.h>
 #include <time.h>
+#include <pthread.h>
 
  // Please select one of the following MACHINE choices by editing the "#define" lines.:
  // ("v100-maxq" is V100 GPU with TDP 163 W; "v100-300w" is V100 GPU with TDP 300 W; "a100-insp" is A100 GPU with TDP 400 W.)
@@ -44,275 +55,485 @@ SOFTWARE.
 #define MACHINE "v100-300w"
 //#define MACHINE "a100-insp"
 
+#define MAXLIST 16
+#define MAXGPU 64
+
 static volatile int keepRunning = 1;
 void intHandler(int dummy) // function used for the interruptable loop.
 {
+    (void)dummy;
     keepRunning = 0;
 }
 
-int main(int argc, char* argv[])
+static unsigned int minSetFreq;
+static unsigned int maxFreq;
+static unsigned int setMemFreq;
+
+// the profiled calls. iter is used by the set calls to oscillate between two frequencies.
+static nvmlReturn_t callHandle(unsigned int gpu, nvmlDevice_t device, int iter)
+{
+    (void)iter;
+    return nvmlDeviceGetHandleByIndex(gpu, &device);
+}
+static nvmlReturn_t callUtil(unsigned int gpu, nvmlDevice_t device, int iter)
+{
+    (void)gpu; (void)iter;
+    nvmlUtilization_t util;
+    return nvmlDeviceGetUtilizationRates(device, &util);
+}
+static nvmlReturn_t callClock(unsigned int gpu, nvmlDevice_t device, int iter)
+{
+    (void)gpu; (void)iter;
+    unsigned int freq;
+    return nvmlDeviceGetClockInfo(device, 1, &freq);// 1 refers to SM domain.
+}
+static nvmlReturn_t callPower(unsigned int gpu, nvmlDevice_t device, int iter)
+{
+    (void)gpu; (void)iter;
+    unsigned int power;
+    return nvmlDeviceGetPowerUsage(device, &power);
+}
+static nvmlReturn_t callEnergy(unsigned int gpu, nvmlDevice_t device, int iter)
+{
+    (void)gpu; (void)iter;
+    unsigned long long energy;
+    return nvmlDeviceGetTotalEnergyConsumption(device, &energy);
+}
+static nvmlReturn_t callTemp(unsigned int gpu, nvmlDevice_t device, int iter)
 {
-    unsigned int minSetFreq;
-    unsigned int maxFreq;
-    unsigned int setMemFreq;
+    (void)gpu; (void)iter;
+    unsigned int temp;
+    return nvmlDeviceGetTemperature(device, 0, &temp);// 0 refers to the GPU die sensor.
+}
+static nvmlReturn_t callProcs(unsigned int gpu, nvmlDevice_t device, int iter)
+{
+    (void)gpu; (void)iter;
+    nvmlProcessInfo_t infos[32];
+    unsigned int infoCount = 32;
+    return nvmlDeviceGetComputeRunningProcesses(device, &infoCount, infos);
+}
+static nvmlReturn_t callSetApp(unsigned int gpu, nvmlDevice_t device, int iter)
+{
+    (void)gpu;
+    return nvmlDeviceSetApplicationsClocks(device, setMemFreq, iter % 2 == 0 ? minSetFreq : maxFreq);
+}
+static nvmlReturn_t callSetLocked(unsigned int gpu, nvmlDevice_t device, int iter)
+{
+    (void)gpu;
+    unsigned int setFreq = iter % 2 == 0 ? minSetFreq : maxFreq;
+    return nvmlDeviceSetGpuLockedClocks(device, setFreq, setFreq);
+}
 
-    // Run "nvidia-smi -q -d SUPPORTED_CLOCKS" to get available frequencies and update the following parameters if needed.
-    if (strcmp(MACHINE, "v100-maxq") == 0)
-    {
-        minSetFreq = 855; maxFreq = 1440; setMemFreq = 810;
-    }
-    else if (strcmp(MACHINE, "v100-300w") == 0)
-    {
-        minSetFreq = 952; maxFreq = 1530; setMemFreq = 877;
-    }
-    else if (strcmp(MACHINE, "a100-insp") == 0)
+static const struct
+{
+    const char* name;
+    nvmlReturn_t (*call)(unsigned int gpu, nvmlDevice_t device, int iter);
+    bool isSet;
+} calls[] = {
+    {"handle", callHandle, false}, {"util", callUtil, false}, {"clock", callClock, false}, {"power", callPower, false},
+    {"energy", callEnergy, false}, {"temp", callTemp, false}, {"procs", callProcs, false},
+    {"setapp", callSetApp, true}, {"setlocked", callSetLocked, true},
+};
+#define NUMCALLS (int)(sizeof(calls)/sizeof(calls[0]))
+
+struct gate // starts the workers at once, or releases them without running if the setup failed.
+{
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    int state;// 0 closed, 1 run, -1 abort.
+};
+
+struct worker
+{
+    pthread_t thread;
+    struct gate* gate;
+    int call;
+    int numGpus;
+    unsigned int gpus[MAXGPU];
+    nvmlDevice_t devices[MAXGPU];
+    int iterations;
+    double* samples;// latency of each call in ns.
+    int numSamples;
+    int numErrors;
+    nvmlReturn_t lastError;
+    double start, end;// time span of this worker in ns.
+};
+
+static double nowNs(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+static void* workerMain(void* arg) // run one call on the GPUs of this worker, round robin.
+{
+    struct worker* w = (struct worker*)arg;
+    int k, g, state;
+    double t0;
+    nvmlReturn_t result;
+    pthread_mutex_lock(&w->gate->lock);
+    while (w->gate->state == 0)
+        pthread_cond_wait(&w->gate->cond, &w->gate->lock);
+    state = w->gate->state;
+    pthread_mutex_unlock(&w->gate->lock);
+    if (state < 0)
+        return NULL;// the setup failed.
+    w->start = nowNs();
+    for (k = 0; k < w->iterations && keepRunning; k++)
+        for (g = 0; g < w->numGpus; g++)
+        {
+            t0 = nowNs();
+            result = calls[w->call].call(w->gpus[g], w->devices[g], k);
+            w->samples[w->numSamples++] = nowNs() - t0;
+            if (NVML_SUCCESS != result)
+            {
+                w->numErrors += 1;
+                w->lastError = result;
+            }
+        }
+    w->end = nowNs();
+    return NULL;
+}
+
+static void openGate(struct gate* gate, int state)
+{
+    pthread_mutex_lock(&gate->lock);
+    gate->state = state;
+    pthread_cond_broadcast(&gate->cond);
+    pthread_mutex_unlock(&gate->lock);
+}
+
+static int parseList(const char* arg, int* values) // comma-separated integers. Return the count.
+{
+    char buf[256];
+    char* tok;
+    char* save = NULL;
+    int n = 0;
+    snprintf(buf, sizeof(buf), "%s", arg);
+    for (tok = strtok_r(buf, ",", &save); tok != NULL && n < MAXLIST; tok = strtok_r(NULL, ",", &save))
     {
-        minSetFreq = 1110; maxFreq = 1410; setMemFreq = 1593;
+        values[n] = atoi(tok);
+        if (values[n] > 0)
+            n += 1;
     }
+    return n;
+}
+
+static int cmpDouble(const void* a, const void* b)
+{
+    double x = *(const double*)a, y = *(const double*)b;
+    return (x > y) - (x < y);
+}
 
-    printf("Argument: %s\n",argv[1]);
-    int argument = atoi(argv[1]);// gpu ID. -1 means all gpu.
-    const int loopDelay = 200;// interval of each loop in milliseconds.
-    const bool onlySetAppFreq = true;// default true. true - nvmlDeviceSetApplicationsClocks(); false - nvmlDeviceSetGpuLockedClocks().
-    const bool printDateTime = false;
-    const bool getUtilization = true;
-    const bool getFrequency = false;
-    const bool getPower = true;
-    const bool changeFreq = false;
+static double percentile(const double* sorted, int n, double p) // nearest rank.
+{
+    int rank = (int)(p * n + 0.999999);
+    if (rank < 1)
+        rank = 1;
+    if (rank > n)
+        rank = n;
+    return sorted[rank-1];
+}
 
+static int resetClocks(unsigned int device_count) // reset all GPU clocks. Return 0 on success.
+{
     nvmlReturn_t result;
     nvmlDevice_t device;
-    nvmlUtilization_t util;
-    nvmlClockType_t freq;
-    unsigned int power, device_count, i, setFreq, iterflag;// warning: unsigned int cannot loop from high to low.
-    struct timeval starttime, endtime;
-    long unsigned int duration;
-    time_t t;
-    struct tm * lt;
-
-    // Initialize.
-    printf("MACHINE %s\n", MACHINE);
-    printf("GPU freqset latency measurement start..\n");
-    printf("Latency is shown in the rightmost column (unit: microsecond).\n");
-    result = nvmlInit_v2();
-    if (NVML_SUCCESS != result)
-    { 
-        printf("Failed to initialize NVML: %s\n", nvmlErrorString(result));
-        return 1;
-    }
-    result = nvmlDeviceGetCount(&device_count);
-    if (NVML_SUCCESS != result)
-    { 
-        printf("Failed to query GPU count: %s\n", nvmlErrorString(result));
-        goto Error;
-    }
-
-    // Reset all GPU clocks.
-    printf("Reset GPU frequency for: ");
+    unsigned int i;
+    fprintf(stderr, "Reset GPU frequency for: ");
     for (i = 0; i < device_count; i++)
     {
         result = nvmlDeviceGetHandleByIndex(i, &device);
         if (NVML_SUCCESS != result)
-        { 
-            printf("Failed to get handle for GPU %u: %s\n", i, nvmlErrorString(result));
-            goto Error;
+        {
+            fprintf(stderr, "Failed to get handle for GPU %u: %s\n", i, nvmlErrorString(result));
+            return 1;
         }
 
         result = nvmlDeviceResetGpuLockedClocks(device);
         if (NVML_ERROR_NO_PERMISSION == result)
-        {
-            printf("\t\t Error: Need root privileges: %s\n", nvmlErrorString(result));
-            goto Error;
-        }
+            fprintf(stderr, "\t\t Need root privileges: %s\n", nvmlErrorString(result));
         else if (NVML_ERROR_NOT_SUPPORTED == result)
-            printf("\t\t Operation not supported.\n");
+            fprintf(stderr, "\t\t Operation not supported.\n");
         else if (NVML_SUCCESS != result)
         {
-            printf("\t\t Failed to reset locked frequency for GPU %u: %s\n", i, nvmlErrorString(result));
-            goto Error;
-        } 
+            fprintf(stderr, "\t\t Failed to reset locked frequency for GPU %u: %s\n", i, nvmlErrorString(result));
+            return 1;
+        }
 
         result = nvmlDeviceResetApplicationsClocks(device);
         if (NVML_ERROR_NO_PERMISSION == result)
-            printf("\t\t Need root privileges: %s\n", nvmlErrorString(result));
+            fprintf(stderr, "\t\t Need root privileges: %s\n", nvmlErrorString(result));
         else if (NVML_ERROR_NOT_SUPPORTED == result)
-            printf("\t\t Operation not supported.\n");
+            fprintf(stderr, "\t\t Operation not supported.\n");
         else if (NVML_SUCCESS != result)
         {
-            printf("\t\t Failed to reset application frequency for GPU %u: %s\n", i, nvmlErrorString(result));
-            goto Error;
-        } 
+            fprintf(stderr, "\t\t Failed to reset application frequency for GPU %u: %s\n", i, nvmlErrorString(result));
+            return 1;
+        }
         else if (NVML_SUCCESS == result)
         {
-            printf("device %u. ", i);
+            fprintf(stderr, "device %u. ", i);
         }
     }
-    printf("\n");
+    fprintf(stderr, "\n");
+    return 0;
+}
 
-    // main loop.
-    iterflag = 0;
-    signal(SIGINT, intHandler);
-    printf("Main loop start..\n");
-    while (keepRunning) // press ctrl+c can break this loop.
+int main(int argc, char* argv[])
+{
+    // Run "nvidia-smi -q -d SUPPORTED_CLOCKS" to get available frequencies and update the following parameters if needed.
+    if (strcmp(MACHINE, "v100-maxq") == 0)
     {
-        gettimeofday(&starttime, NULL);
-        if (printDateTime)
-        {
-            time(&t);
-            lt = localtime(&t);
-            printf("%d-%d-%d %d:%d:%d, " ,lt->tm_year+1900, lt->tm_mon+1, lt->tm_mday, lt->tm_hour, lt->tm_min, lt->tm_sec);
-        }
-        // loop through each GPU.
-        for (i = 0; i < device_count; i++)
+        minSetFreq = 855; maxFreq = 1440; setMemFreq = 810;
+    }
+    else if (strcmp(MACHINE, "v100-300w") == 0)
+    {
+        minSetFreq = 952; maxFreq = 1530; setMemFreq = 877;
+    }
+    else if (strcmp(MACHINE, "a100-insp") == 0)
+    {
+        minSetFreq = 1110; maxFreq = 1410; setMemFreq = 1593;
+    }
+
+    int argument = 0;// gpu ID. -1 means all gpu.
+    int readIterations = 1000, setIterations = 100;
+    int threadList[MAXLIST] = {1}, gpuList[MAXLIST] = {1};
+    int numThreadList = 1, numGpuList = 0;
+    bool callSelected[NUMCALLS] = {false};
+    bool json = false, anySet = false;
+
+    nvmlReturn_t result;
+    unsigned int device_count;
+    int a, c, it, ig, t, g, numThreads, numGpus, firstGpu, total, errors;
+    char buf[256];
+    char* tok;
+    char* save;
+    double wall, first, last, *samples;
+    struct worker* workers;
+    struct gate gate;
+    bool setupFailed;
+
+    callSelected[1] = callSelected[2] = callSelected[3] = true;// util, clock, power.
+    if (argc == 2 && (atoi(argv[1]) != 0 || strcmp(argv[1], "0") == 0))
+        argument = atoi(argv[1]);// the old usage "./measure_latency GPU".
+    else
+        for (a = 1; a < argc; a++)
         {
-            if ((argument == -1) || (argument == i))// this will skip other GPUs.
+            if (strcmp(argv[a], "-g") == 0 && a+1 < argc)
+                argument = atoi(argv[++a]);
+            else if (strcmp(argv[a], "-c") == 0 && a+1 < argc)
             {
-                result = nvmlDeviceGetHandleByIndex(i, &device);
-                if (NVML_SUCCESS != result)
-                { 
-                    printf("Failed to get handle for GPU %u: %s\n", i, nvmlErrorString(result));
-                    goto Error;
-                }
-
-                if (getUtilization)
+                memset(callSelected, 0, sizeof(callSelected));
+                snprintf(buf, sizeof(buf), "%s", argv[++a]);
+                save = NULL;
+                for (tok = strtok_r(buf, ",", &save); tok != NULL; tok = strtok_r(NULL, ",", &save))
                 {
-                    // get gpu utilization rate (including gmem bandwidth util).
-                    result = nvmlDeviceGetUtilizationRates(device, &util);
-                    if (NVML_SUCCESS != result)
-                    { 
-                        printf("Failed to get utilization rate for GPU %u: %s\n", i, nvmlErrorString(result));
-                        goto Error;
-                    }
-                    else
-                        printf("%u, %u, ", util.gpu, util.memory);
+                    for (c = 0; c < NUMCALLS; c++)
+                        if (strcmp(tok, calls[c].name) == 0)
+                            callSelected[c] = true;
                 }
+            }
+            else if (strcmp(argv[a], "-n") == 0 && a+1 < argc)
+                readIterations = atoi(argv[++a]);
+            else if (strcmp(argv[a], "-N") == 0 && a+1 < argc)
+                setIterations = atoi(argv[++a]);
+            else if (strcmp(argv[a], "-t") == 0 && a+1 < argc)
+                numThreadList = parseList(argv[++a], threadList);
+            else if (strcmp(argv[a], "-G") == 0 && a+1 < argc)
+                numGpuList = parseList(argv[++a], gpuList);
+            else if (strcmp(argv[a], "-j") == 0)
+                json = true;
+            else
+            {
+                printf("Usage: %s [-g GPU] [-c calls] [-n read iterations] [-N set iterations] [-t thread list] [-G GPU count list] [-j]\n", argv[0]);
+                return 1;
+            }
+        }
+    if (readIterations < 1 || setIterations < 1 || numThreadList == 0)
+    {
+        printf("Iterations and thread counts should be positive.\n");
+        return 1;
+    }
 
-                if (getFrequency)
-                {
-                    // get gpu frequency.
-                    result = nvmlDeviceGetClockInfo(device, 1, &freq);// 1 refers to SM domain.
-                    if (NVML_SUCCESS != result)
-                    { 
-                        printf("Failed to get clock frequency for GPU %u: %s\n", i, nvmlErrorString(result));
-                        goto Error;
-                    }
-                    else
-                        printf("%u, ", freq);
-                }
+    // Initialize. Messages go to stderr, so that stdout is only the results.
+    fprintf(stderr, "MACHINE %s\n", MACHINE);
+    fprintf(stderr, "NVML latency profiler start..\n");
+    result = nvmlInit_v2();
+    if (NVML_SUCCESS != result)
+    { 
+        fprintf(stderr, "Failed to initialize NVML: %s\n", nvmlErrorString(result));
+        return 1;
+    }
+    result = nvmlDeviceGetCount(&device_count);
+    if (NVML_SUCCESS != result)
+    { 
+        fprintf(stderr, "Failed to query GPU count: %s\n", nvmlErrorString(result));
+        goto Error;
+    }
+    if (device_count > MAXGPU)
+        device_count = MAXGPU;
+    if (argument >= (int)device_count)
+    {
+        fprintf(stderr, "GPU %d does not exist, there are %u GPUs.\n", argument, device_count);
+        goto Error;
+    }
+    firstGpu = argument == -1 ? 0 : argument;
+    if (numGpuList == 0)
+    {
+        gpuList[0] = argument == -1 ? (int)device_count : 1;
+        numGpuList = 1;
+    }
+    else
+        firstGpu = 0;
+    for (c = 0; c < NUMCALLS; c++)
+        anySet = anySet || (callSelected[c] && calls[c].isSet);
+    if (anySet && resetClocks(device_count) != 0)
+        goto Error;
 
-                if (getPower)
-                {
-                    // get gpu power usage.
-                    result = nvmlDeviceGetPowerUsage(device, &power);
-                    if (NVML_SUCCESS != result)
+    // main loop over calls, thread counts and GPU counts.
+    signal(SIGINT, intHandler);
+    if (!json)
+        printf("call,threads,gpus,calls,errors,mean_us,p50_us,p90_us,p99_us,max_us,calls_per_s\n");
+    for (c = 0; c < NUMCALLS && keepRunning; c++)
+    {
+        if (!callSelected[c])
+            continue;
+        for (it = 0; it < numThreadList && keepRunning; it++)
+        for (ig = 0; ig < numGpuList && keepRunning; ig++)
+        {
+            numThreads = threadList[it];
+            numGpus = gpuList[ig];
+            if (firstGpu + numGpus > (int)device_count)
+            {
+                fprintf(stderr, "Skip %d GPUs, there are %u GPUs.\n", numGpus, device_count);
+                continue;
+            }
+
+            // GPU g is driven by thread (g mod numThreads); with more threads than GPUs, thread t drives GPU (t mod numGpus).
+            workers = (struct worker*)calloc(numThreads, sizeof(struct worker));
+            if (workers == NULL)
+            {
+                fprintf(stderr, "Failed to allocate %d workers.\n", numThreads);
+                goto Error;
+            }
+            pthread_mutex_init(&gate.lock, NULL);
+            pthread_cond_init(&gate.cond, NULL);
+            gate.state = 0;
+            setupFailed = false;
+            for (t = 0; t < numThreads && !setupFailed; t++)
+            {
+                workers[t].gate = &gate;
+                workers[t].call = c;
+                workers[t].iterations = calls[c].isSet ? setIterations : readIterations;
+                for (g = 0; g < numGpus && !setupFailed; g++)
+                    if ((numThreads <= numGpus && g % numThreads == t) || (numThreads > numGpus && g == t % numGpus))
                     {
-                        printf("Failed to get power usage for GPU %u: %s\n", i, nvmlErrorString(result));
-                        goto Error;
+                        workers[t].gpus[workers[t].numGpus] = firstGpu + g;
+                        result = nvmlDeviceGetHandleByIndex(firstGpu + g, &workers[t].devices[workers[t].numGpus]);
+                        if (NVML_SUCCESS != result)
+                        {
+                            fprintf(stderr, "Failed to get handle for GPU %d: %s\n", firstGpu + g, nvmlErrorString(result));
+                            setupFailed = true;
+                        }
+                        workers[t].numGpus += 1;
                     }
-                    else
-                        printf("%u, ", power);
+                workers[t].samples = (double*)malloc(sizeof(double) * workers[t].iterations * (workers[t].numGpus > 0 ? workers[t].numGpus : 1));
+                if (!setupFailed && workers[t].samples == NULL)
+                {
+                    fprintf(stderr, "Failed to allocate the samples of thread %d.\n", t);
+                    setupFailed = true;
                 }
-
-                if (changeFreq)
+                if (!setupFailed && pthread_create(&workers[t].thread, NULL, workerMain, &workers[t]) != 0)
                 {
-                    // set freq to simply oscillate between two values.
-                    if (iterflag == 0)
-                        setFreq = minSetFreq;
-                    else
-                        setFreq = maxFreq;
-
-                    // Execute frequency set.
-                    if (onlySetAppFreq)
-                    {
-                        result = nvmlDeviceSetApplicationsClocks(device, setMemFreq, setFreq);
-                    }
-                    else
-                    {
-                        result = nvmlDeviceSetGpuLockedClocks(device, setFreq, setFreq);
-                    }
-
-                    if (NVML_ERROR_NO_PERMISSION == result)
-                        printf("\t\t Error: Need root privileges: %s\n", nvmlErrorString(result));
-                    else if (NVML_ERROR_NOT_SUPPORTED == result)
-                        printf("\t\t Operation not supported.\n");
-                    else if (NVML_SUCCESS != result)
-                    {
-                        printf("\t\t Failed to set frequency for GPU %u: %s\n", i, nvmlErrorString(result));
-                        goto Error;
-                    } 
-                    else if (NVML_SUCCESS == result)
-                    {
-                        printf("%u, ", setFreq);
-                    }
+                    fprintf(stderr, "Failed to create thread %d.\n", t);
+                    setupFailed = true;
                 }
-            }// end if not the GPU to be measured.
-        }// loop all GPU ends.
-
-        // wait until the next loopDelay millisecond if not already reached.
-        gettimeofday(&endtime, NULL);
-        duration = (endtime.tv_sec - starttime.tv_sec) * 1000000 + endtime.tv_usec - starttime.tv_usec;
-        printf("%lu\n", duration);
-        if (duration < loopDelay*1000)// loopDelay is in milliseconds.
-        {
-            usleep(loopDelay*1000-duration);
-        }
-        // change iterflag.
-        if (iterflag == 0)
-            iterflag = 1;
-        else
-            iterflag = 0;
-    }// end of main while loop.
-
-    // Reset all GPU clocks before terminate.
-    printf("Reset GPU frequency for: ");
-    for (i = 0; i < device_count; i++)
-    {
-        result = nvmlDeviceGetHandleByIndex(i, &device);
-        if (NVML_SUCCESS != result)
-        { 
-            printf("Failed to get handle for GPU %u: %s\n", i, nvmlErrorString(result));
-            goto Error;
-        }
-
-        result = nvmlDeviceResetGpuLockedClocks(device);
-        if (NVML_ERROR_NO_PERMISSION == result)
-            printf("\t\t Need root privileges: %s\n", nvmlErrorString(result));
-        else if (NVML_ERROR_NOT_SUPPORTED == result)
-            printf("\t\t Operation not supported.\n");
-        else if (NVML_SUCCESS != result)
-        {
-            printf("\t\t Failed to reset locked frequency for GPU %u: %s\n", i, nvmlErrorString(result));
-            goto Error;
-        } 
+                if (setupFailed)
+                    break;// workers[t] has no thread.
+            }
+            // start the created threads, or release them without running if the setup failed. t threads were created.
+            openGate(&gate, setupFailed ? -1 : 1);
+            numThreads = t;
+            for (t = 0; t < numThreads; t++)
+                pthread_join(workers[t].thread, NULL);
+            pthread_cond_destroy(&gate.cond);
+            pthread_mutex_destroy(&gate.lock);
+            if (setupFailed)
+            {
+                for (t = 0; t <= numThreads; t++)
+                    free(workers[t].samples);
+                free(workers);
+                goto Error;
+            }
+            first = workers[0].start;// from the first start to the last end of all threads.
+            last = workers[0].end;
+            for (t = 1; t < numThreads; t++)
+            {
+                if (workers[t].start < first)
+                    first = workers[t].start;
+                if (workers[t].end > last)
+                    last = workers[t].end;
+            }
+            wall = last - first;
 
-        result = nvmlDeviceResetApplicationsClocks(device);
-        if (NVML_ERROR_NO_PERMISSION == result)
-            printf("\t\t Need root privileges: %s\n", nvmlErrorString(result));
-        else if (NVML_ERROR_NOT_SUPPORTED == result)
-            printf("\t\t Operation not supported.\n");
-        else if (NVML_SUCCESS != result)
-        {
-            printf("\t\t Failed to reset application frequency for GPU %u: %s\n", i, nvmlErrorString(result));
-            goto Error;
-        } 
-        else if (NVML_SUCCESS == result)
-        {
-            printf("device %u. ", i);
+            // merge the samples of all threads and report.
+            total = 0;
+            errors = 0;
+            for (t = 0; t < numThreads; t++)
+                total += workers[t].numSamples;
+            samples = (double*)malloc(sizeof(double) * (total > 0 ? total : 1));
+            if (samples == NULL)
+                fprintf(stderr, "Failed to allocate %d samples of %s with %d threads on %d GPUs. Not reported.\n", total, calls[c].name, numThreads, numGpus);
+            total = 0;
+            for (t = 0; t < numThreads; t++)
+            {
+                if (samples != NULL)
+                    memcpy(&samples[total], workers[t].samples, sizeof(double) * workers[t].numSamples);
+                total += workers[t].numSamples;
+                errors += workers[t].numErrors;
+                if (workers[t].numErrors > 0)
+                    fprintf(stderr, "%s, thread %d of %d: %d errors, last: %s\n", calls[c].name, t, numThreads, workers[t].numErrors, nvmlErrorString(workers[t].lastError));
+                free(workers[t].samples);
+            }
+            free(workers);
+            if (samples != NULL && total > 0)
+            {
+                double mean = 0;
+                for (t = 0; t < total; t++)
+                    mean += samples[t];
+                mean /= total;
+                qsort(samples, total, sizeof(double), cmpDouble);
+                if (json)
+                    printf("{\"call\": \"%s\", \"threads\": %d, \"gpus\": %d, \"calls\": %d, \"errors\": %d, \"mean_us\": %.3f, \"p50_us\": %.3f, \"p90_us\": %.3f, \"p99_us\": %.3f, \"max_us\": %.3f, \"calls_per_s\": %.1f}\n",
+                        calls[c].name, numThreads, numGpus, total, errors, mean/1000, percentile(samples, total, 0.5)/1000, percentile(samples, total, 0.9)/1000,
+                        percentile(samples, total, 0.99)/1000, samples[total-1]/1000, total / (wall/1e9));
+                else
+                    printf("%s,%d,%d,%d,%d,%.3f,%.3f,%.3f,%.3f,%.3f,%.1f\n",
+                        calls[c].name, numThreads, numGpus, total, errors, mean/1000, percentile(samples, total, 0.5)/1000, percentile(samples, total, 0.9)/1000,
+                        percentile(samples, total, 0.99)/1000, samples[total-1]/1000, total / (wall/1e9));
+                fflush(stdout);
+            }
+            free(samples);
         }
     }
-    printf("\n");
+
+    // Reset all GPU clocks before terminate.
+    if (anySet && resetClocks(device_count) != 0)
+        goto Error;
 
     // Terminate.
     result = nvmlShutdown();
     if (NVML_SUCCESS != result)
-        printf("Failed to shutdown NVML: %s\n", nvmlErrorString(result));
-    printf("GPU freqset tool terminated.\n");
+        fprintf(stderr, "Failed to shutdown NVML: %s\n", nvmlErrorString(result));
+    fprintf(stderr, "NVML latency profiler terminated.\n");
     return 0;
 
 Error:
     result = nvmlShutdown();
     if (NVML_SUCCESS != result)
-        printf("Failed to shutdown NVML: %s\n", nvmlErrorString(result));
+        fprintf(stderr, "Failed to shutdown NVML: %s\n", nvmlErrorString(result));
     return 1;
 }
-// End of file measure_latency.c
\ No newline at end of file
+// End of file measure_latency.c
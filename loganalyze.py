@@ -0,0 +1,107 @@
+'''
+MIT License
+
+Copyright (c) 2023 Yijia Zhang
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+
+###
+Python binding of the dvfs log index in analyze/loganalyze.c. Use "make" in ./analyze/ to build analyze/libloganalyze.so.
+    index = LogIndex('output/dvfs_Assure_p90_demo.out')
+    w = index.query(starttime, endtime, gpu) # datetime, inclusive. w['power'] in W, w['energy'] in J.
+The log is parsed once when the index is opened, and each query is two binary searches.
+'''
+import calendar
+import ctypes
+import os
+
+class LogWindow(ctypes.Structure):
+    _fields_ = [('samples', ctypes.c_long), ('util', ctypes.c_double), ('memUtil', ctypes.c_double),
+        ('power', ctypes.c_double), ('freq', ctypes.c_double), ('energy', ctypes.c_double)]
+
+LIBPATH = os.path.join(os.path.dirname(os.path.abspath(__file__)), 'analyze', 'libloganalyze.so')
+_lib = None
+
+def _load():
+    global _lib
+    if _lib is None:
+        lib = ctypes.CDLL(LIBPATH, use_errno=True)
+        lib.logIndexOpen.restype = ctypes.c_void_p
+        lib.logIndexOpen.argtypes = [ctypes.c_char_p]
+        lib.logIndexClose.argtypes = [ctypes.c_void_p]
+        lib.logIndexGpus.argtypes = [ctypes.c_void_p]
+        lib.logIndexSamples.restype = ctypes.c_long
+        lib.logIndexSamples.argtypes = [ctypes.c_void_p]
+        lib.logIndexQuery.restype = ctypes.c_long
+        lib.logIndexQuery.argtypes = [ctypes.c_void_p, ctypes.c_longlong, ctypes.c_longlong, ctypes.c_int, ctypes.POINTER(LogWindow)]
+        _lib = lib
+    return _lib
+
+def available():
+    # whether analyze/libloganalyze.so is built.
+    try:
+        _load()
+        return True
+    except OSError:
+        return False
+
+def buildId():
+    # identifies the build of analyze/libloganalyze.so by its size and mtime, so that results cached from it are redone
+    # after a rebuild. None if it is not built.
+    if not available():
+        return None
+    st = os.stat(LIBPATH)
+    return '%d-%d' % (st.st_size, st.st_mtime_ns)
+
+def logTime(t):
+    # seconds of a datetime as encoded by the index: its calendar time, without time zone.
+    return calendar.timegm(t.timetuple())
+
+class LogIndex:
+    def __init__(self, path):
+        self._lib = _load()
+        self._index = self._lib.logIndexOpen(path.encode())
+        if not self._index:
+            err = ctypes.get_errno()
+            raise OSError(err, os.strerror(err), path)
+        self.numGpus = self._lib.logIndexGpus(self._index)
+        self.samples = self._lib.logIndexSamples(self._index)
+
+    def query(self, starttime, endtime, gpu):
+        '''
+        Mean util, memUtil, power (W) and freq (MHz), and the energy (J) of GPU gpu over the loops in [starttime, endtime].
+        '''
+        w = LogWindow()
+        if self._lib.logIndexQuery(self._index, logTime(starttime), logTime(endtime), gpu, ctypes.byref(w)) < 0:
+            raise IndexError('GPU %d not in the log' % gpu)
+        return {'samples': w.samples, 'util': w.util, 'memUtil': w.memUtil, 'power': w.power, 'freq': w.freq, 'energy': w.energy}
+
+    def close(self):
+        if self._index:
+            self._lib.logIndexClose(self._index)
+            self._index = None
+
+    def __del__(self):
+        self.close()
+
+    def __enter__(self):
+        return self
+
+    def __exit__(self, *args):
+        self.close()
@@ -0,0 +1,272 @@
+/* MIT License
+
+Copyright (c) 2023 Yijia Zhang
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+
+
+ * Microbenchmark of the Assure model fitting in assure.c, the CPU-heavy part of dvfs.c.
+ * For every combination of numProbFreq, numProbRep and GPU count, synthetic probing records (a fold-line with noise) are fitted
+ * by assureModelFit(), as dvfs.c does at the end of each probing phase. Every sample times a number of fitting rounds over all GPUs,
+ * and the median, min and p90 of ns per fit over the samples are reported, with the allocations per fit (malloc, calloc and realloc
+ * are wrapped at link time) and the cache misses per fit (perf_event_open, "n/a" if not permitted).
+ *
+ * Use "make" to compile. Usage:
+ *   ./fitbench [-f numProbFreq list] [-r numProbRep list] [-g GPU count list] [-s samples] [-t ms per sample] [-c]
+ * Defaults: -f 4,8,16,32,64 -r 1,2,4,8,16,32 -g 1,4,16 -s 15 -t 20. -c prints csv instead of a table.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+#include "assure.h"
+
+#define MAXLIST 16
+#define MAXSAMPLE 101
+
+// Allocation counters, see -Wl,--wrap in the Makefile.
+static unsigned long long numAllocs = 0;
+void* __real_malloc(size_t size);
+void* __real_calloc(size_t n, size_t size);
+void* __real_realloc(void* p, size_t size);
+void* __wrap_malloc(size_t size)
+{
+    numAllocs += 1;
+    return __real_malloc(size);
+}
+void* __wrap_calloc(size_t n, size_t size)
+{
+    numAllocs += 1;
+    return __real_calloc(n, size);
+}
+void* __wrap_realloc(void* p, size_t size)
+{
+    numAllocs += 1;
+    return __real_realloc(p, size);
+}
+
+static int parseList(const char* arg, int* values) // comma-separated integers. Return the count.
+{
+    char buf[256];
+    char* tok;
+    char* save = NULL;
+    int n = 0;
+    snprintf(buf, sizeof(buf), "%s", arg);
+    for (tok = strtok_r(buf, ",", &save); tok != NULL && n < MAXLIST; tok = strtok_r(NULL, ",", &save))
+    {
+        values[n] = atoi(tok);
+        if (values[n] > 0)
+            n += 1;
+    }
+    return n;
+}
+
+static int openCacheMisses(void) // perf counter of cache misses of this thread. Return -1 if not available.
+{
+    struct perf_event_attr attr;
+    memset(&attr, 0, sizeof(attr));
+    attr.type = PERF_TYPE_HARDWARE;
+    attr.size = sizeof(attr);
+    attr.config = PERF_COUNT_HW_CACHE_MISSES;
+    attr.disabled = 1;
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    return (int)syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+}
+
+static double nowNs(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+static int cmpDouble(const void* a, const void* b)
+{
+    double x = *(const double*)a, y = *(const double*)b;
+    return (x > y) - (x < y);
+}
+
+static void makeRecords(int numProbFreq, int numProbRep, int* probFreqs, int gpu, double* gmemUtil, double* gPower) // probing records of one GPU.
+{
+    // a fold-line: mem util grows with frequency up to a knee, then flattens. The knee and the noise differ per GPU.
+    const double knee = probFreqs[0] + (probFreqs[numProbFreq-1] - probFreqs[0]) * (0.3 + 0.05 * (gpu % 9));
+    unsigned int seed = 12345u + gpu;
+    int j, reminder, ifreq;
+    double f;
+    for (j = 0; j < numProbFreq*numProbRep; j++)
+    {
+        // the same up-down probing order as dvfs.c.
+        reminder = j % (2*numProbFreq);
+        ifreq = reminder < numProbFreq ? reminder : 2*numProbFreq-1-reminder;
+        f = probFreqs[ifreq];
+        seed = seed * 1103515245u + 12345u;
+        gmemUtil[j] = 80 * min(f, knee) / knee + 2.0 * ((seed >> 16) & 0x7fff) / 0x7fff - 1;
+        gPower[j] = 60 + 180 * (f / probFreqs[numProbFreq-1]) * (f / probFreqs[numProbFreq-1]) * (f / probFreqs[numProbFreq-1]);
+    }
+}
+
+int main(int argc, char* argv[])
+{
+    int freqList[MAXLIST] = {4, 8, 16, 32, 64}, repList[MAXLIST] = {1, 2, 4, 8, 16, 32}, gpuList[MAXLIST] = {1, 4, 16};
+    int numFreqList = 5, numRepList = 6, numGpuList = 3, numSamples = 15;
+    double sampleTime = 20;// ms.
+    bool csv = false;
+    int i, ifl, irl, igl, numProbFreq, numProbRep, numProbRec, numGpu, g, s, round, numRounds;
+    int* probFreqs;
+    double *gmemUtils, *gPowers, *work;
+    double samples[MAXSAMPLE], t0, t1, freqBound, freqEff, sink = 0;
+    long long misses, missTotal;
+    unsigned long long allocs;
+    int perfFd = openCacheMisses();
+    const unsigned int maxFreq = 1530, freqAvgEff = 952;
+
+    for (i = 1; i < argc; i++)
+    {
+        if (strcmp(argv[i], "-f") == 0 && i+1 < argc)
+            numFreqList = parseList(argv[++i], freqList);
+        else if (strcmp(argv[i], "-r") == 0 && i+1 < argc)
+            numRepList = parseList(argv[++i], repList);
+        else if (strcmp(argv[i], "-g") == 0 && i+1 < argc)
+            numGpuList = parseList(argv[++i], gpuList);
+        else if (strcmp(argv[i], "-s") == 0 && i+1 < argc)
+            numSamples = atoi(argv[++i]);
+        else if (strcmp(argv[i], "-t") == 0 && i+1 < argc)
+            sampleTime = atof(argv[++i]);
+        else if (strcmp(argv[i], "-c") == 0)
+            csv = true;
+        else
+        {
+            printf("Usage: %s [-f numProbFreq list] [-r numProbRep list] [-g GPU count list] [-s samples] [-t ms per sample] [-c]\n", argv[0]);
+            return 1;
+        }
+    }
+    if (numSamples < 1 || numSamples > MAXSAMPLE)
+        numSamples = 15;
+    if (perfFd < 0 && !csv)
+        printf("Cache misses are not available (perf_event_open not permitted).\n");
+
+    if (csv)
+        printf("numProbFreq,numProbRep,numGpu,median_ns_per_fit,min_ns_per_fit,p90_ns_per_fit,allocs_per_fit,cache_misses_per_fit\n");
+    else
+        printf("%11s %10s %6s %16s %14s %14s %14s %20s\n", "numProbFreq", "numProbRep", "GPUs", "median ns/fit", "min ns/fit", "p90 ns/fit", "allocs/fit", "cache misses/fit");
+    for (ifl = 0; ifl < numFreqList; ifl++)
+    for (irl = 0; irl < numRepList; irl++)
+    for (igl = 0; igl < numGpuList; igl++)
+    {
+        numProbFreq = freqList[ifl];
+        numProbRep = repList[irl];
+        numGpu = gpuList[igl];
+        numProbRec = numProbFreq * numProbRep;
+        if (numProbFreq < 4)
+            continue;// the fold-line needs at least 2 frequencies on each side.
+
+        // inputs, set up as in dvfs.c. Frequencies are spread over the v100-300w probing range.
+        probFreqs = (int*)malloc(sizeof(int)*numProbFreq);
+        for (i = 0; i < numProbFreq; i++)
+            probFreqs[i] = 952 + (int)((double)(maxFreq - 952) * i / (numProbFreq - 1));
+        gmemUtils = (double*)malloc(sizeof(double)*numGpu*numProbRec);
+        gPowers = (double*)malloc(sizeof(double)*numGpu*numProbRec);
+        work = (double*)malloc(sizeof(double)*(6*numProbRec + 4*numProbFreq));
+        for (g = 0; g < numGpu; g++)
+            makeRecords(numProbFreq, numProbRep, probFreqs, g, &gmemUtils[g*numProbRec], &gPowers[g*numProbRec]);
+
+        // calibrate the rounds per sample, after a warm-up round.
+        numRounds = 1;
+        while (1)
+        {
+            t0 = nowNs();
+            for (round = 0; round < numRounds; round++)
+                for (g = 0; g < numGpu; g++)
+                {
+                    assureModelFit(g, numProbFreq, numProbRep, probFreqs, &gmemUtils[g*numProbRec], &gPowers[g*numProbRec], 0.9, maxFreq, freqAvgEff, true, 100, false, work, &freqBound, &freqEff);
+                    sink += freqBound;
+                }
+            t1 = nowNs();
+            if (t1 - t0 >= sampleTime * 1e6 / 4 || numRounds >= (1 << 24))
+                break;
+            numRounds *= 2;
+        }
+        numRounds = (int)(numRounds * (sampleTime * 1e6) / (t1 - t0)) + 1;
+
+        // measure.
+        missTotal = 0;
+        allocs = numAllocs;
+        for (s = 0; s < numSamples; s++)
+        {
+            if (perfFd >= 0)
+            {
+                ioctl(perfFd, PERF_EVENT_IOC_RESET, 0);
+                ioctl(perfFd, PERF_EVENT_IOC_ENABLE, 0);
+            }
+            t0 = nowNs();
+            for (round = 0; round < numRounds; round++)
+                for (g = 0; g < numGpu; g++)
+                {
+                    assureModelFit(g, numProbFreq, numProbRep, probFreqs, &gmemUtils[g*numProbRec], &gPowers[g*numProbRec], 0.9, maxFreq, freqAvgEff, true, 100, false, work, &freqBound, &freqEff);
+                    sink += freqBound;
+                }
+            t1 = nowNs();
+            if (perfFd >= 0)
+            {
+                ioctl(perfFd, PERF_EVENT_IOC_DISABLE, 0);
+                if (read(perfFd, &misses, sizeof(misses)) == sizeof(misses))
+                    missTotal += misses;
+            }
+            samples[s] = (t1 - t0) / ((double)numRounds * numGpu);
+        }
+        allocs = numAllocs - allocs;
+        qsort(samples, numSamples, sizeof(double), cmpDouble);
+
+        if (csv)
+        {
+            printf("%d,%d,%d,%.1f,%.1f,%.1f,%.3f,", numProbFreq, numProbRep, numGpu, samples[numSamples/2], samples[0], samples[(int)(0.9*(numSamples-1))],
+                (double)allocs / ((double)numSamples * numRounds * numGpu));
+            if (perfFd >= 0)
+                printf("%.2f\n", (double)missTotal / ((double)numSamples * numRounds * numGpu));
+            else
+                printf("n/a\n");
+        }
+        else
+        {
+            printf("%11d %10d %6d %16.1f %14.1f %14.1f %14.3f ", numProbFreq, numProbRep, numGpu, samples[numSamples/2], samples[0], samples[(int)(0.9*(numSamples-1))],
+                (double)allocs / ((double)numSamples * numRounds * numGpu));
+            if (perfFd >= 0)
+                printf("%20.2f\n", (double)missTotal / ((double)numSamples * numRounds * numGpu));
+            else
+                printf("%20s\n", "n/a");
+        }
+        fflush(stdout);
+        free(probFreqs);
+        free(gmemUtils);
+        free(gPowers);
+        free(work);
+    }
+    if (sink == 12345.678)
+        printf(" ");// keep the fits from being optimized away.
+    if (perfFd >= 0)
+        close(perfFd);
+    return 0;
+}
+// End of file fitbench.c
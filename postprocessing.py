@@ -24,12 +24,34 @@ SOFTWARE.
 ###
 Scripts for post-processing experimental results.
 This code takes .out files as input, and outputs .csv files.
+
+Usage: "python3 postprocessing.py" parses the demo pair. "python3 postprocessing.py --batch" parses every experiment in ./output/
+(and its sub-folders, e.g. one per node) in parallel and merges them into one table, see parseBatch().
 '''
+import argparse
+import hashlib
+import io
+import json
+import multiprocessing
+import os
+import re
 import pandas as pd
 from datetime import datetime
+import loganalyze
+
+PROCESSED_HEADLINE = 'iter,app,performance,gpupower(W),power-efficiency,exetime(s),start,end,gpuUtil,gmemUtil,frequency'
+PARSER_VERSION = 1# increase when the output of parseAppRuns() changes, so that the batch cache is rebuilt.
 
 def main():
-    parseAllApps(resultfile='allApps_Assure_p90_2iter_demo.out', gpufile='dvfs_Assure_p90_demo.out', outfile='processed_Assure_p90_demo.csv')
+    parser = argparse.ArgumentParser(description='Post-process the outputs of runExp.py.')
+    parser.add_argument('--batch', action='store_true', help='parse all experiment pairs in ./output/ and merge them')
+    parser.add_argument('--jobs', type=int, default=None, help='parallel processes for --batch, default all cores')
+    parser.add_argument('--outfile', default='batch_processed.csv', help='merged table of --batch, in ./output/')
+    args = parser.parse_args()
+    if args.batch:
+        parseBatch(outfile=args.outfile, jobs=args.jobs)
+    else:
+        parseAllApps(resultfile='allApps_Assure_p90_2iter_demo.out', gpufile='dvfs_Assure_p90_demo.out', outfile='processed_Assure_p90_demo.csv')
 
 def appResultLine(app):
     resultLine = 'noResultLine'
@@ -107,7 +129,7 @@ def getGpuPowerEffici_dataframe(app, gpupowerlines, numGPU, starttime, endtime,
     for i in range(8):# there are at most 8 GPUs in our server.
         cols = cols + ['gutil_%d' % i, 'gmemutil_%d' % i, 'gpower_%d' % i, 'gfreq_%d' % i, 'gfreqset_%d' % i]
     cols.append('delay')
-    tempfile = open('temp_getGpuPowerEffici_dataframe.csv', 'w') # a temporary file, can be deleted later.
+    tempfile = io.StringIO() # the lines in the window, in memory so that parallel workers of parseBatch() do not share a file.
     jump, readidx = 0, startidx
     while 1:
         readidx += jump
@@ -125,9 +147,9 @@ def getGpuPowerEffici_dataframe(app, gpupowerlines, numGPU, starttime, endtime,
                 jump = 1
             else:
                 break
-    tempfile.close()
-    df = pd.read_csv('temp_getGpuPowerEffici_dataframe.csv', sep=', ', names=cols)
-    avg = df.mean()
+    tempfile.seek(0)
+    df = pd.read_csv(tempfile, sep=', ', names=cols, engine='python')
+    avg = df.mean(numeric_only=True)
     if detectGPU:
         usedGPU = [i for i in range(8) if avg['gutil_%d' % i]>1]
         if len(usedGPU) != numGPU:
@@ -143,30 +165,69 @@ def getGpuPowerEffici_dataframe(app, gpupowerlines, numGPU, starttime, endtime,
     gpufreqValue = sum([avg['gfreq_%d' % i] for i in usedGPU])/len(usedGPU)
     return gpupowerValue, gutilValue, gmemutilValue, gpufreqValue, readidx
 
-def parseAllApps(resultfile, gpufile, outfile):
+def getGpuPowerEffici_index(app, index, numGPU, starttime, endtime, detectGPU, gpuList):
+    '''
+    The same as getGpuPowerEffici_dataframe(), on a log index of loganalyze.py: each window is a binary search instead of a scan.
+    '''
+    windows = [index.query(starttime, endtime, i) for i in range(index.numGpus)]
+    if detectGPU:
+        usedGPU = [i for i in range(index.numGpus) if windows[i]['util']>1]
+        if len(usedGPU) != numGPU:
+            print('App %s, %d used GPU detected, not matching the preset %d GPU.' % (app, len(usedGPU), numGPU))
+    else:
+        if len(gpuList) == 0:
+            usedGPU = list(range(numGPU))
+        else:
+            usedGPU = gpuList
+    gutilValue = sum([windows[i]['util'] for i in usedGPU])/len(usedGPU)
+    gmemutilValue = sum([windows[i]['memUtil'] for i in usedGPU])/len(usedGPU)
+    gpupowerValue = sum([windows[i]['power'] for i in usedGPU])
+    gpufreqValue = sum([windows[i]['freq'] for i in usedGPU])/len(usedGPU)
+    return gpupowerValue, gutilValue, gmemutilValue, gpufreqValue
+
+def parseAllApps(resultfile, gpufile, outfile, gpuList=None):
     '''
     Read and parse all apps.
     In a server with multiple GPUs, we assume the GPUs not running our benchmark
     applications are not utilized during experiments. Then, 'detectGPU' if true
     will select the used GPU based on average GPU utilization.
     Or, you may also put the GPU index that runs the benchmarks into 'gpuList'.
+    For the per-GPU streams of "runExp.py --parallel", set gpuList=[N] for allApps_..._gpuN.out.
     '''
     folder = '.'
-    detectGPU = True
-    gpuList = []
-    
-    result = open('%s/output/%s' % (folder, outfile), 'w')
-    appout = open('%s/output/%s' % (folder, resultfile), 'r', encoding='utf-8')
-    with open('%s/output/%s' % (folder, gpufile), 'r') as gpuf:
-        gpupowerlines = gpuf.readlines()
-    headline = 'iter,app,performance,gpupower(W),power-efficiency,exetime(s),start,end,gpuUtil,gmemUtil,frequency'
-    result.write(headline+'\n')
+    datalines = parseAppRuns('%s/output/%s' % (folder, resultfile), '%s/output/%s' % (folder, gpufile), gpuList)
+    with open('%s/output/%s' % (folder, outfile), 'w') as result:
+        result.write(PROCESSED_HEADLINE + '\n')
+        for dataline in datalines:
+            result.write(dataline + '\n')
+    # further calculate the average of all runs.
+    df = pd.read_csv('%s/output/%s' % (folder, outfile))
+    avgIter = df.groupby(df['app']).mean(numeric_only=True)
+    avgIter['exetime_std'] = df.groupby(df['app']).std(numeric_only=True)['exetime(s)'] # add standard deviation.
+    avgIter['gpupower_std'] = df.groupby(df['app']).std(numeric_only=True)['gpupower(W)']
+    avgIter.to_csv('%s/output/avgIter_%s' % (folder, outfile))
+
+def parseAppRuns(resultpath, gpupath, gpuList=None, verbose=True):
+    '''
+    The parser of parseAllApps() on file paths. Return the csv lines (without the headline PROCESSED_HEADLINE) of every app run.
+    '''
+    if gpuList is None:
+        gpuList = []
+    detectGPU = len(gpuList) == 0
+    datalines = []
+    appout = open(resultpath, 'r', encoding='utf-8')
+    # the native log index (analyze/) replaces the scan of getGpuPowerEffici_dataframe() when it is built.
+    index = loganalyze.LogIndex(gpupath) if loganalyze.available() else None
+    if index is None:
+        with open(gpupath, 'r') as gpuf:
+            gpupowerlines = gpuf.readlines()
     app, resultLine, endLine = 'noApp', 'noLine', 'noLine'
     iteration, thistime, lasttime, performance, readidx = -1, -1, -1, -1, 1
     for line in appout:
         if line.startswith('Iteration') and line.endswith(':\n'):
             iteration = int(line.split()[1][:-1])
-            print('Iteration: %d' % iteration)
+            if verbose:
+                print('Iteration: %d' % iteration)
         if iteration >= 0:# skip the warm-up run.
             if line.startswith('Application name:') and len(line.split())==3:
                 app = line.split()[2]
@@ -181,21 +242,224 @@ def parseAllApps(resultfile, gpufile, outfile):
                 exetime = (thistime - lasttime).seconds
                 performance = appPerf_fromEndLine(app, performance, exetime)
                 numGPU = 1 # all of the cuda samples use only 1 GPU card.
-                gpupowerValue, gutilValue, gmemutilValue, gpufreqValue, readidx = getGpuPowerEffici_dataframe(app, 
-                    gpupowerlines, numGPU, lasttime, thistime, startidx=readidx, detectGPU=detectGPU, gpuList=gpuList)
+                if index is not None:
+                    gpupowerValue, gutilValue, gmemutilValue, gpufreqValue = getGpuPowerEffici_index(app, index, numGPU,
+                        lasttime, thistime, detectGPU=detectGPU, gpuList=gpuList)
+                else:
+                    gpupowerValue, gutilValue, gmemutilValue, gpufreqValue, readidx = getGpuPowerEffici_dataframe(app, 
+                        gpupowerlines, numGPU, lasttime, thistime, startidx=readidx, detectGPU=detectGPU, gpuList=gpuList)
                 gpuEff = performance / gpupowerValue # power efficiency of GPU.
                 start = lasttime.strftime('%Y-%m-%d %H:%M:%S.%f')[:-3]# microseconds are removed.
                 end = thistime.strftime('%Y-%m-%d %H:%M:%S.%f')[:-3]
                 dataline = '%d,%s,%.3f,%.1f,%.3f,%.2f,%s,%s,%.2f,%.2f,%.f' % (iteration, app, performance, gpupowerValue, gpuEff, exetime, start, end, gutilValue, gmemutilValue, gpufreqValue)
-                result.write(dataline + '\n')
+                datalines.append(dataline)
     appout.close()
-    result.close()
-    # further calculate the average of all runs.
-    df = pd.read_csv('%s/output/%s' % (folder, outfile))
-    avgIter = df.groupby(df['app']).mean()
-    avgIter['exetime_std'] = df.groupby(df['app']).std()['exetime(s)'] # add standard deviation.
-    avgIter['gpupower_std'] = df.groupby(df['app']).std()['gpupower(W)']
-    avgIter.to_csv('%s/output/avgIter_%s' % (folder, outfile))
+    if index is not None:
+        index.close()
+    return datalines
+
+def loadResultRecords(recordfile):
+    '''
+    Read the result records of the benchmarks (one JSON line per run, see cuda_samples/common/inc/helper_result.h)
+    written to output/<name>_results.jsonl by runExp.py. The warm-up runs are dropped.
+    '''
+    df = pd.read_json('./output/%s' % recordfile, lines=True)
+    df = df[df['tag'] != 'warmup'].copy()
+    df['iter'] = df['tag'].str.split().str[-1].astype(int)
+    return df
+
+def parseMarkers(gpufile):
+    '''
+    Read the benchmark markers recorded by dvfs.c ("Marker: ..." lines, posted by helper_result.h) and pair begin and end of
+    each timed region. Return a dataframe with app, gpu, pid, start_ns, end_ns on the CLOCK_MONOTONIC timeline of the trace.
+    '''
+    open_ = {}
+    runs = []
+    with open('./output/%s' % gpufile, 'r') as f:
+        for line in f:
+            if not line.startswith('Marker: '):
+                continue
+            fields = dict(x.split(' ', 1) for x in line[len('Marker: '):].strip().split(', '))
+            kind, app = [x for x in fields.items() if x[0] in ('begin', 'end')][0]
+            key = (int(fields['pid']), app)
+            if kind == 'begin':
+                open_[key] = (fields['gpu'], int(fields['monotonic_ns']))
+            elif key in open_:
+                gpu, startNs = open_.pop(key)
+                runs.append({'app': app, 'gpu': gpu, 'pid': key[0], 'start_ns': startNs, 'end_ns': int(fields['monotonic_ns'])})
+    return pd.DataFrame(runs, columns=['app', 'gpu', 'pid', 'start_ns', 'end_ns'])
+
+def windowEnergy(trace, startNs, endNs, gpu):
+    '''
+    Energy (J) of a GPU in [startNs, endNs] from a binary trace (dvfstrace.py). Each power sample holds until the next sample,
+    and the samples at both ends count only for their overlap with the window, so the window is exact to the loop.
+    '''
+    import numpy as np
+    t = trace.series('monotonic').astype(np.int64)
+    if len(t) == 0:
+        return 0.0
+    # sample i holds from t[i] to t[i+1]. The last one holds for the previous interval.
+    nxt = np.append(t[1:], t[-1] + (t[-1] - t[-2] if len(t) > 1 else 0))
+    i0 = max(np.searchsorted(t, startNs, side='right') - 1, 0)
+    i1 = np.searchsorted(t, endNs, side='left')
+    overlap = np.clip(nxt[i0:i1], startNs, endNs) - np.clip(t[i0:i1], startNs, endNs)
+    return float(np.sum(trace.series('power', gpu)[i0:i1] / 1000.0 * overlap / 1e9))
+
+def parseMarkedApps(gpufile, tracefile, outfile, recordfile=None):
+    '''
+    The same table as parseAllApps(), with the app windows from the markers and the samples from the binary trace, instead of
+    the 1-second timestamps of the text outputs. exetime and energy are exact to the loop. GPUs are taken from the markers
+    (CUDA_VISIBLE_DEVICES), otherwise the busiest GPU in the window is used. With recordfile (output/<name>_results.jsonl),
+    the throughput of the benchmark is joined by pid and start time.
+    '''
+    import numpy as np
+    import dvfstrace
+    trace = dvfstrace.DvfsTrace('./output/%s' % tracefile)
+    t = trace.series('monotonic').astype(np.int64)
+    runs = parseMarkers(gpufile)
+    rows = []
+    for run in runs.itertuples():
+        i0, i1 = np.searchsorted(t, run.start_ns, side='left'), np.searchsorted(t, run.end_ns, side='right')
+        if run.gpu.isdigit() and int(run.gpu) < trace.numGpus:
+            gpu = int(run.gpu)
+        else:
+            gpu = int(np.argmax([trace.series('util', g)[i0:i1].mean() if i1 > i0 else 0 for g in range(trace.numGpus)]))
+        exetime = (run.end_ns - run.start_ns) / 1e9
+        energy = windowEnergy(trace, run.start_ns, run.end_ns, gpu)
+        rows.append({'app': run.app, 'gpu': gpu, 'pid': run.pid, 'start_ns': run.start_ns, 'end_ns': run.end_ns,
+            'exetime(s)': exetime, 'energy(J)': energy, 'gpupower(W)': energy / exetime if exetime > 0 else 0, 'samples': i1 - i0,
+            'gpuUtil': trace.series('util', gpu)[i0:i1].mean() if i1 > i0 else 0,
+            'gmemUtil': trace.series('memutil', gpu)[i0:i1].mean() if i1 > i0 else 0,
+            'frequency': trace.series('freq', gpu)[i0:i1].mean() if i1 > i0 else 0})
+    df = pd.DataFrame(rows)
+    if recordfile is not None and len(df) > 0:
+        records = loadResultRecords(recordfile)[['pid', 'start_ns', 'iter', 'throughput', 'throughput_unit', 'status']]
+        df = df.merge(records, on=['pid', 'start_ns'], how='left')
+        df['energy/work'] = df['energy(J)'] / (df['throughput'] * df['exetime(s)'])
+    df.to_csv('./output/%s' % outfile, index=False)
+    return df
+
+def findExperiments(folder='./output'):
+    '''
+    Find the experiment pairs written by runExp.py in folder and its sub-folders: each result stream allApps_<policy>[_p<N>]_<K>iter<suffix>.out
+    or allApps_..._gpu<N>.out (runExp.py --parallel) with its dvfs log dvfs_<policy>[_p<N>]<suffix>.out in the same folder.
+    The sub-folder (e.g. one per node) is the 'node' of the experiment. Folders starting with '.' are skipped.
+    '''
+    pattern = re.compile(r'^allApps_(?P<policy>[A-Za-z]+)(?:_p(?P<assurance>\d+))?_(?P<iterations>\d+)iter(?P<suffix>.*?)(?:_gpu(?P<gpu>\d+))?\.out$')
+    pairs = []
+    for root, dirs, files in os.walk(folder):
+        dirs[:] = sorted(d for d in dirs if not d.startswith('.'))
+        for name in sorted(files):
+            m = pattern.match(name)
+            if m is None:
+                continue
+            assurance = '_p%s' % m.group('assurance') if m.group('assurance') else ''
+            gpufile = 'dvfs_%s%s%s.out' % (m.group('policy'), assurance, m.group('suffix'))
+            if not os.path.isfile(os.path.join(root, gpufile)):
+                print('No dvfs log %s for %s, skipped.' % (gpufile, os.path.join(root, name)))
+                continue
+            node = os.path.relpath(root, folder)
+            pairs.append({'node': '' if node == '.' else node, 'policy': m.group('policy'),
+                'assurance': int(m.group('assurance')) if m.group('assurance') else -1, 'iterations': int(m.group('iterations')),
+                'suffix': m.group('suffix'), 'gpu': int(m.group('gpu')) if m.group('gpu') else -1,
+                'resultfile': os.path.join(root, name), 'gpufile': os.path.join(root, gpufile)})
+    return pairs
+
+def fileHash(path):
+    h = hashlib.sha256()
+    with open(path, 'rb') as f:
+        for chunk in iter(lambda: f.read(1 << 20), b''):
+            h.update(chunk)
+    return h.hexdigest()
+
+def batchParse(job):
+    # a worker of parseBatch(): parse one pair into its cache file. Return an error message, or None.
+    pair, cachefile = job
+    try:
+        datalines = parseAppRuns(pair['resultfile'], pair['gpufile'], [pair['gpu']] if pair['gpu'] >= 0 else [], verbose=False)
+    except Exception as e:
+        return '%s: %s' % (pair['resultfile'], e)
+    tmpfile = '%s.%d.tmp' % (cachefile, os.getpid())
+    with open(tmpfile, 'w') as f:
+        f.write(PROCESSED_HEADLINE + '\n')
+        for dataline in datalines:
+            f.write(dataline + '\n')
+    os.replace(tmpfile, cachefile)# a cache file is either complete or missing.
+    return None
+
+def parseBatch(outfile='batch_processed.csv', folder='./output', jobs=None):
+    '''
+    Parse all experiment pairs of findExperiments() and merge them into output/<outfile>, one row per app run with the
+    node, policy, assurance, iterations, suffix and gpu of its experiment (-1 if not in the file name), and the averages of
+    all runs per app into output/avgIter_<outfile>.
+    The table of each pair is cached in <folder>/.cache/, keyed by the sha256 of both input files, PARSER_VERSION, and the
+    parser path (the native loganalyze index and its build, or the pandas fallback), so a re-run only parses new or changed pairs. The hashes are remembered by file size and mtime, so unchanged files are
+    not read again either. New pairs are parsed in parallel with jobs processes (default all cores).
+    '''
+    cachedir = os.path.join(folder, '.cache')
+    os.makedirs(cachedir, exist_ok=True)
+    hashfile = os.path.join(cachedir, 'hashes.json')
+    hashes = {}
+    if os.path.isfile(hashfile):
+        with open(hashfile, 'r') as f:
+            hashes = json.load(f)
+    pairs = findExperiments(folder)
+    if len(pairs) == 0:
+        print('No experiments found in %s.' % folder)
+        return None
+
+    # hash the new and modified files. A dvfs log is shared by all result streams of a run, and hashed once.
+    paths = sorted(set([p['resultfile'] for p in pairs] + [p['gpufile'] for p in pairs]))
+    stats = {path: os.stat(path) for path in paths}
+    stale = [path for path in paths if hashes.get(path, [None, None])[:2] != [stats[path].st_size, stats[path].st_mtime_ns]]
+    pool = multiprocessing.Pool(jobs) if len(stale) > 1 else None
+    for path, digest in zip(stale, pool.map(fileHash, stale) if pool is not None else map(fileHash, stale)):
+        hashes[path] = [stats[path].st_size, stats[path].st_mtime_ns, digest]
+    with open(hashfile, 'w') as f:
+        json.dump({path: hashes[path] for path in paths}, f)
+
+    parser = 'native %s' % loganalyze.buildId() if loganalyze.available() else 'pandas'# the path parseAppRuns() takes.
+    todo = []
+    for pair in pairs:
+        key = hashlib.sha256(('%d %s %s %s %d' % (PARSER_VERSION, parser, hashes[pair['resultfile']][2], hashes[pair['gpufile']][2],
+            pair['gpu'])).encode()).hexdigest()
+        pair['cachefile'] = os.path.join(cachedir, 'processed_%s.csv' % key[:32])
+        if not os.path.isfile(pair['cachefile']):
+            todo.append((pair, pair['cachefile']))
+    print('%d experiments, %d cached, %d to parse.' % (len(pairs), len(pairs) - len(todo), len(todo)))
+    if len(todo) > 1 and pool is None:
+        pool = multiprocessing.Pool(jobs)
+    failed = set()
+    for (pair, cachefile), error in zip(todo, pool.imap(batchParse, todo) if pool is not None else map(batchParse, todo)):
+        if error is not None:
+            print('Failed to parse %s' % error)
+            failed.add(cachefile)
+    if pool is not None:
+        pool.close()
+        pool.join()
+
+    tables = []
+    for pair in pairs:
+        if pair['cachefile'] in failed:
+            continue
+        df = pd.read_csv(pair['cachefile'])
+        for pos, col in enumerate(['node', 'policy', 'assurance', 'iterations', 'suffix', 'gpu']):
+            df.insert(pos, col, pair[col])
+        df['resultfile'] = os.path.relpath(pair['resultfile'], folder)
+        tables.append(df)
+    if len(tables) == 0:
+        return None
+    merged = pd.concat(tables, ignore_index=True)
+    merged.to_csv(os.path.join(folder, outfile), index=False)
+    keys = ['node', 'policy', 'assurance', 'suffix', 'app']
+    numeric = merged.drop(columns=['iterations', 'gpu', 'iter', 'start', 'end', 'resultfile'])
+    avgIter = numeric.groupby(keys).mean()
+    avgIter['exetime_std'] = numeric.groupby(keys).std()['exetime(s)']
+    avgIter['gpupower_std'] = numeric.groupby(keys).std()['gpupower(W)']
+    avgIter['runs'] = numeric.groupby(keys).size()
+    avgIter.to_csv(os.path.join(folder, 'avgIter_%s' % outfile))
+    print('%d runs of %d experiments written to %s.' % (len(merged), len(tables), os.path.join(folder, outfile)))
+    return merged
 
 if __name__ == '__main__':
     main()
\ No newline at end of file
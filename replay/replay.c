@@ -0,0 +1,570 @@
+/* MIT License
+
+Copyright (c) 2023 Yijia Zhang
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+
+
+ * Offline trace replay of the Assure policy.
+ * It reads traces in the output/dvfs_*.out format (util, mem util, power, freq, setFreq of each GPU per loop) and replays
+ * the Assure policy on them in virtual time, with the same model code as dvfs.c (assure.c). The trace only shows each GPU
+ * at its recorded frequency, so a response curve per workload maps the recorded samples to the frequency chosen in the replay:
+ * mem util scales with the relative performance, and power with the relative power of the curve.
+ * The chosen frequencies, the predicted energy and the predicted performance loss against MaxFreq are reported.
+ * The settings perfThres, probDelay and movingAvg_windowSize can be swept, every combination is replayed on all traces.
+ *
+ * Use "make" to compile. Usage:
+ *   ./replay [-t perfThres list] [-d probDelay list] [-w window list] [-l loopDelay] [-c curves] [-m machine] [-p 0|1] [-r records.csv] trace.out ...
+ * Lists are comma-separated, e.g. "-t p85,p90,p95 -d 5,15,30 -w 8,16".
+ * -l is the loop interval of the traces in milliseconds (default 200). A loop longer than that counts its own duration.
+ * -c gives the response curve of each GPU, comma-separated, the last one repeats (default compute):
+ *    "compute" (performance proportional to frequency), "memory" (saturates at 55% of the max frequency),
+ *    "knee:F" (saturates at F MHz), or a file with lines "freq perf power", where perf and power are relative to the max frequency.
+ * -m overrides the machine in the trace header ("MACHINE v100-maxq", "v100-300w" or "a100-insp").
+ * -p 0 disables the idle park of dvfs.c (on by default). The traces have no process list, so a GPU is idle when util and mem util are 0.
+ * -r writes the frequency, predicted power and relative performance of each GPU at each loop, and the frequency set for the next loop, to a csv file.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+#include "assure.h"
+
+#define MAXGPU 64
+#define MAXLIST 16
+#define MAXCURVE 256
+
+// The same constants as in dvfs.c. The machines are assureMachines[] of assure.c.
+static const int numProbRep = 2;
+static const double regErrThres = 100;
+static const double idleParkDelay = 10;
+
+enum curveKind {CURVE_COMPUTE = 0, CURVE_MEMORY, CURVE_KNEE, CURVE_TABLE};
+
+typedef struct responseCurve_st
+{
+    enum curveKind kind;
+    double knee;
+    int n;// points of a table, sorted by frequency.
+    double f[MAXCURVE], perf[MAXCURVE], power[MAXCURVE];
+} responseCurve;
+
+typedef struct trace_st
+{
+    const char* path;
+    char machine[32];
+    int numGpu;
+    long numTick;
+    float* util;// [tick*numGpu + gpu].
+    float* memUtil;
+    float* power;// in mW.
+    float* freq;
+    float* dt;// loop duration in seconds.
+} trace;
+
+typedef struct replayResult_st
+{
+    double time, energy, energyMax, work, workMax;
+    long ticks, probes, discarded, sets;
+} replayResult;
+
+static int parseList(const char* arg, double* values, bool thres) // comma-separated numbers, or thresholds as parseThres(). Return the count, or -1 if a threshold is invalid.
+{
+    char buf[512];
+    char* tok;
+    char* save = NULL;
+    int n = 0;
+    snprintf(buf, sizeof(buf), "%s", arg);
+    for (tok = strtok_r(buf, ",", &save); tok != NULL && n < MAXLIST; tok = strtok_r(NULL, ",", &save))
+    {
+        values[n] = thres ? parseThres(tok) : atof(tok);
+        if (thres && values[n] < 0)
+            return -1;
+        n += 1;
+    }
+    return n;
+}
+
+static int loadCurve(const char* spec, responseCurve* c) // parse one response curve. Return -1 if invalid.
+{
+    FILE* fp;
+    double f, perf, power;
+    char line[256];
+    memset(c, 0, sizeof(responseCurve));
+    if (strcmp(spec, "compute") == 0)
+        c->kind = CURVE_COMPUTE;
+    else if (strcmp(spec, "memory") == 0)
+        c->kind = CURVE_MEMORY;
+    else if (strncmp(spec, "knee:", 5) == 0)
+    {
+        c->kind = CURVE_KNEE;
+        c->knee = atof(spec + 5);
+        if (c->knee <= 0)
+            return -1;
+    }
+    else
+    {
+        c->kind = CURVE_TABLE;
+        fp = fopen(spec, "r");
+        if (fp == NULL)
+            return -1;
+        while (fgets(line, sizeof(line), fp) != NULL && c->n < MAXCURVE)
+        {
+            if (sscanf(line, "%lf %lf %lf", &f, &perf, &power) != 3 && sscanf(line, "%lf,%lf,%lf", &f, &perf, &power) != 3)
+                continue;// header or comment.
+            if (c->n > 0 && f <= c->f[c->n-1])
+            {
+                fclose(fp);
+                return -1;// must be sorted by frequency.
+            }
+            c->f[c->n] = f;
+            c->perf[c->n] = perf;
+            c->power[c->n] = power;
+            c->n += 1;
+        }
+        fclose(fp);
+        if (c->n < 2)
+            return -1;
+    }
+    return 0;
+}
+
+static double interpolate(const responseCurve* c, const double* y, double f) // piecewise linear, clamped at both ends.
+{
+    int j;
+    if (f <= c->f[0])
+        return y[0];
+    for (j = 1; j < c->n; j++)
+    {
+        if (f <= c->f[j])
+            return y[j-1] + (y[j]-y[j-1]) * (f-c->f[j-1]) / (c->f[j]-c->f[j-1]);
+    }
+    return y[c->n-1];
+}
+
+static double curvePerf(const responseCurve* c, double f, double maxFreq) // performance at f relative to maxFreq.
+{
+    double knee = maxFreq, slope = 0;
+    if (c->kind == CURVE_TABLE)
+        return interpolate(c, c->perf, f);
+    if (c->kind == CURVE_MEMORY)
+    {
+        knee = 0.55 * maxFreq;
+        slope = 0.05;
+    }
+    else if (c->kind == CURVE_KNEE)
+        knee = c->knee;
+    return (min(f, knee) + slope * max(f - knee, 0)) / (min(maxFreq, knee) + slope * max(maxFreq - knee, 0));
+}
+
+static double curvePower(const responseCurve* c, double f, double maxFreq) // power at f relative to maxFreq. Static part plus cubic.
+{
+    double fr = f / maxFreq;
+    if (c->kind == CURVE_TABLE)
+        return interpolate(c, c->power, f);
+    if (c->kind == CURVE_MEMORY)
+        return 0.5 + 0.5 * fr*fr*fr;
+    if (c->kind == CURVE_KNEE)
+        return 0.4 + 0.6 * fr*fr*fr;
+    return 0.3 + 0.7 * fr*fr*fr;
+}
+
+static int loadTrace(const char* path, double loopDelay, trace* tr) // read a dvfs_*.out file. Return -1 if failed.
+{
+    FILE* fp = fopen(path, "r");
+    char* line = NULL;
+    size_t cap = 0;
+    char* fields[5*MAXGPU+2];
+    char* p;
+    long capTick = 0;
+    int nf, g, numGpu;
+    double duration;
+    if (fp == NULL)
+        return -1;
+    memset(tr, 0, sizeof(trace));
+    tr->path = path;
+    while (getline(&line, &cap, fp) > 0)
+    {
+        if (strncmp(line, "MACHINE ", 8) == 0)
+        {
+            sscanf(line + 8, "%31s", tr->machine);
+            continue;
+        }
+        if (line[0] < '0' || line[0] > '9')
+            continue;// not a data line.
+        // fields are separated by ", ": date, then util, mem util, power, freq, setFreq of each GPU, then the loop duration.
+        nf = 0;
+        for (p = line; p != NULL && nf < 5*MAXGPU+2; nf++)
+        {
+            fields[nf] = p;
+            p = strstr(p, ", ");
+            if (p != NULL)
+            {
+                *p = '\0';
+                p += 2;
+            }
+        }
+        if (nf < 7 || (nf-2) % 5 != 0)
+            continue;
+        numGpu = (nf-2) / 5;
+        if (tr->numGpu == 0)
+            tr->numGpu = numGpu;
+        else if (numGpu != tr->numGpu)
+            continue;// a line broken by other output.
+        if (tr->numTick == capTick)
+        {
+            capTick = capTick > 0 ? capTick * 2 : 4096;
+            tr->util = (float*)realloc(tr->util, sizeof(float)*capTick*numGpu);
+            tr->memUtil = (float*)realloc(tr->memUtil, sizeof(float)*capTick*numGpu);
+            tr->power = (float*)realloc(tr->power, sizeof(float)*capTick*numGpu);
+            tr->freq = (float*)realloc(tr->freq, sizeof(float)*capTick*numGpu);
+            tr->dt = (float*)realloc(tr->dt, sizeof(float)*capTick);
+        }
+        for (g = 0; g < numGpu; g++)
+        {
+            tr->util[tr->numTick*numGpu+g] = atof(fields[1+5*g]);
+            tr->memUtil[tr->numTick*numGpu+g] = atof(fields[2+5*g]);
+            tr->power[tr->numTick*numGpu+g] = atof(fields[3+5*g]);
+            tr->freq[tr->numTick*numGpu+g] = atof(fields[4+5*g]);
+        }
+        duration = atof(fields[nf-1]) / 1e6;
+        tr->dt[tr->numTick] = max(duration, loopDelay / 1000);
+        tr->numTick += 1;
+    }
+    free(line);
+    fclose(fp);
+    return tr->numTick > 0 ? 0 : -1;
+}
+
+static void replayTrace(const trace* tr, const assureMachine* mp, const int* availableFreqs, const responseCurve* curves, int numCurves,
+    double perfThres, double probDelay, int windowSize, bool useIdlePark, int config, FILE* rec, replayResult* res) // replay the Assure policy on one trace.
+{
+    const int numGpu = tr->numGpu;
+    const int numProbFreq = mp->numProbFreq;
+    const int numProbRec = numProbFreq * numProbRep;
+    const double maxFreq = mp->maxFreq;
+    double* gmemUtils = (double*)malloc(sizeof(double)*numGpu*numProbRec);
+    double* gPowers = (double*)malloc(sizeof(double)*numGpu*numProbRec);
+    double* work = (double*)malloc(sizeof(double)*(6*numProbRec + 4*numProbFreq));
+    double* window = (double*)calloc(numGpu*windowSize, sizeof(double));
+    double movingAvg[MAXGPU], freqCap[MAXGPU], curFreq[MAXGPU], idleStart[MAXGPU], thisCap, sample;
+    int optimizedFreqs[MAXGPU];
+    bool gpuParked[MAXGPU], probeRequest = false;
+    int probPhase = numProbRec, lastprobPhase = 0, idxOldest = 0, g, iprob, reminder, iAvail, setFreq;
+    bool applyFreqSet;
+    double accumuTime = 0, sumGutil, freqBound, freqEff, freqOpt;
+    double u, m, p, f, fr, perfRec, busyTime, iterTime, perfMax, power, dt;
+    const responseCurve* c;
+    long k;
+
+    for (g = 0; g < numGpu; g++)
+    {
+        movingAvg[g] = 0;
+        freqCap[g] = maxFreq;
+        curFreq[g] = maxFreq;// the daemon starts from the default clocks.
+        optimizedFreqs[g] = mp->maxFreq;
+        idleStart[g] = -1;
+        gpuParked[g] = false;
+    }
+    for (k = 0; k < tr->numTick; k++)
+    {
+        dt = tr->dt[k];
+        for (g = 0; g < numGpu; g++)
+        {
+            // the recorded sample, moved from the recorded frequency to the frequency chosen in the replay.
+            c = &curves[g < numCurves ? g : numCurves-1];
+            u = tr->util[k*numGpu+g];
+            m = tr->memUtil[k*numGpu+g];
+            p = tr->power[k*numGpu+g];
+            fr = tr->freq[k*numGpu+g];
+            f = curFreq[g];
+            if (u > 0 && fr > 0)
+            {
+                // only the busy part (util) of the recorded time scales with the curve, the same assumption as utilFreqCap().
+                perfRec = max(curvePerf(c, fr, maxFreq), 1e-6);
+                busyTime = u / 100 * perfRec / max(curvePerf(c, f, maxFreq), 1e-6);
+                iterTime = 1 - u / 100 + busyTime;// time of the recorded work at f, relative to the recorded time.
+                perfMax = (1 - u / 100 + u / 100 * perfRec) / iterTime;// relative to the max frequency.
+                m = min(m / iterTime, 100);
+                u = min(100 * busyTime / iterTime, 100);
+                power = p * curvePower(c, f, maxFreq) / max(curvePower(c, fr, maxFreq), 1e-6);
+                res->energyMax += p * curvePower(c, maxFreq, maxFreq) / max(curvePower(c, fr, maxFreq), 1e-6) * dt / 1000;
+                res->work += perfMax * dt;
+                res->workMax += dt;
+            }
+            else
+            {
+                perfMax = 1;// an idle GPU loses nothing.
+                power = p;
+                res->energyMax += p * dt / 1000;
+            }
+            res->energy += power * dt / 1000;
+
+            // moving average of gpu util, as in dvfs.c.
+            movingAvg[g] += (u - window[g*windowSize+idxOldest]) / windowSize;
+            window[g*windowSize+idxOldest] = u;
+
+            if (lastprobPhase > 0)
+            {
+                gmemUtils[g*numProbRec+numProbRec-lastprobPhase] = m;
+                gPowers[g*numProbRec+numProbRec-lastprobPhase] = power / 1000;
+                thisCap = utilFreqCap(f, u, perfThres, maxFreq);
+                if (lastprobPhase == numProbRec || thisCap > freqCap[g])
+                    freqCap[g] = thisCap;
+            }
+
+            if (probPhase >= 0)
+            {
+                iprob = probPhase > 0 ? numProbRec - probPhase : numProbRec - 1;
+                reminder = iprob % (2*numProbFreq);
+                setFreq = reminder < numProbFreq ? mp->probFreqs[reminder] : mp->probFreqs[2*numProbFreq-1-reminder];
+            }
+            else
+                setFreq = optimizedFreqs[g];
+            applyFreqSet = probPhase >= -1;
+
+            // idle park, as in dvfs.c.
+            if (useIdlePark)
+            {
+                if (u > 0 || m > 0)
+                {
+                    idleStart[g] = -1;
+                    if (gpuParked[g])
+                    {
+                        gpuParked[g] = false;
+                        if (probPhase < -1)
+                        {
+                            optimizedFreqs[g] = mp->maxFreq;
+                            setFreq = mp->maxFreq;
+                        }
+                        applyFreqSet = true;
+                        probeRequest = true;
+                    }
+                }
+                else
+                {
+                    if (idleStart[g] < 0)
+                        idleStart[g] = res->time;
+                    if (gpuParked[g])
+                    {
+                        setFreq = availableFreqs[0];
+                        applyFreqSet = false;
+                    }
+                    else if (res->time - idleStart[g] >= idleParkDelay && probPhase < -1)
+                    {
+                        gpuParked[g] = true;
+                        setFreq = availableFreqs[0];
+                        applyFreqSet = true;
+                    }
+                }
+            }
+            if (applyFreqSet)
+                res->sets += 1;
+            if (rec != NULL)
+            {
+                sample = res->time + dt;
+                fprintf(rec, "%d,%s,%ld,%d,%.3f,%.0f,%.0f,%.4f,%d\n", config, tr->path, k, g, sample, f, power, perfMax, setFreq);
+            }
+            curFreq[g] = setFreq;
+        }
+        idxOldest = idxOldest < windowSize-1 ? idxOldest + 1 : 0;
+        res->time += dt;
+
+        if (probPhase == 0)
+        {
+            for (g = 0; g < numGpu; g++)
+            {
+                if (!assureModelFit(g, numProbFreq, numProbRep, (int*)mp->probFreqs, &gmemUtils[g*numProbRec], &gPowers[g*numProbRec], perfThres, mp->maxFreq, mp->freqAvgEff, true, regErrThres, false, work, &freqBound, &freqEff))
+                    res->discarded += 1;
+                res->probes += 1;
+                freqOpt = max(min(freqBound, freqCap[g]), freqEff);
+                freqOpt = min(max(freqOpt, (double)mp->minSetFreq), maxFreq);
+                for (iAvail = mp->numAvailableFreqs-1; iAvail >= 0; iAvail--)
+                {
+                    if (availableFreqs[iAvail] < freqOpt)
+                    {
+                        optimizedFreqs[g] = availableFreqs[iAvail < mp->numAvailableFreqs-1 ? iAvail+1 : iAvail];
+                        break;
+                    }
+                }
+            }
+        }
+
+        // probing schedule, as in dvfs.c.
+        lastprobPhase = probPhase;
+        if (probeRequest && probPhase < -1)
+        {
+            accumuTime = probDelay;// a GPU just woke up. Probe at once.
+            probeRequest = false;
+        }
+        if (accumuTime >= probDelay)
+        {
+            sumGutil = 0;
+            for (g = 0; g < numGpu; g++)
+                sumGutil += movingAvg[g];
+            probPhase = sumGutil >= 1 ? numProbRec : -2;
+            accumuTime = 0;
+        }
+        else
+        {
+            if (probPhase > -1)
+                accumuTime = 0;
+            else
+                accumuTime += dt;
+            if (probPhase > -99)
+                probPhase -= 1;
+        }
+    }
+    res->ticks += tr->numTick;
+    free(gmemUtils);
+    free(gPowers);
+    free(work);
+    free(window);
+}
+
+int main(int argc, char* argv[])
+{
+    double thresList[MAXLIST] = {0.9}, delayList[MAXLIST] = {15}, windowList[MAXLIST] = {16};
+    int numThres = 1, numDelay = 1, numWindow = 1, numCurves = 0, numTraces = 0;
+    double loopDelay = 200;
+    const char* curveSpec = "compute";
+    const char* machineName = NULL;
+    const char* recPath = NULL;
+    bool useIdlePark = true;
+    responseCurve* curves = (responseCurve*)malloc(sizeof(responseCurve)*MAXGPU);
+    trace* traces = (trace*)malloc(sizeof(trace)*argc);
+    const assureMachine** traceMachine = (const assureMachine**)malloc(sizeof(assureMachine*)*argc);
+    int** availableFreqs = (int**)malloc(sizeof(int*)*assureNumMachines);
+    char buf[1024];
+    char* tok;
+    char* save = NULL;
+    FILE* rec = NULL;
+    int i, it, id, iw, im, windowSize, config = 0;
+    long totalTicks = 0;
+    double elapsed;
+    struct timespec t0, t1;
+    replayResult res;
+
+    for (i = 1; i < argc; i++)
+    {
+        if (strcmp(argv[i], "-t") == 0 && i+1 < argc)
+        {
+            numThres = parseList(argv[++i], thresList, true);
+            if (numThres < 0)
+            {
+                printf("Error: invalid performance constraint in %s.\n", argv[i]);
+                return 1;
+            }
+        }
+        else if (strcmp(argv[i], "-d") == 0 && i+1 < argc)
+            numDelay = parseList(argv[++i], delayList, false);
+        else if (strcmp(argv[i], "-w") == 0 && i+1 < argc)
+            numWindow = parseList(argv[++i], windowList, false);
+        else if (strcmp(argv[i], "-l") == 0 && i+1 < argc)
+            loopDelay = atof(argv[++i]);
+        else if (strcmp(argv[i], "-c") == 0 && i+1 < argc)
+            curveSpec = argv[++i];
+        else if (strcmp(argv[i], "-m") == 0 && i+1 < argc)
+            machineName = argv[++i];
+        else if (strcmp(argv[i], "-p") == 0 && i+1 < argc)
+            useIdlePark = atoi(argv[++i]) != 0;
+        else if (strcmp(argv[i], "-r") == 0 && i+1 < argc)
+            recPath = argv[++i];
+        else if (argv[i][0] == '-')
+        {
+            printf("Unknown option %s.\n", argv[i]);
+            return 1;
+        }
+        else
+        {
+            if (loadTrace(argv[i], loopDelay, &traces[numTraces]) != 0)
+            {
+                printf("Error: cannot read trace %s.\n", argv[i]);
+                return 1;
+            }
+            numTraces += 1;
+        }
+    }
+    if (numTraces == 0 || numThres == 0 || numDelay == 0 || numWindow == 0)
+    {
+        printf("Usage: %s [-t perfThres list] [-d probDelay list] [-w window list] [-l loopDelay] [-c curves] [-m machine] [-p 0|1] [-r records.csv] trace.out ...\n", argv[0]);
+        return 1;
+    }
+    snprintf(buf, sizeof(buf), "%s", curveSpec);
+    for (tok = strtok_r(buf, ",", &save); tok != NULL && numCurves < MAXGPU; tok = strtok_r(NULL, ",", &save))
+    {
+        if (loadCurve(tok, &curves[numCurves]) != 0)
+        {
+            printf("Error: invalid response curve %s.\n", tok);
+            return 1;
+        }
+        numCurves += 1;
+    }
+    for (im = 0; im < assureNumMachines; im++)
+    {
+        availableFreqs[im] = (int*)malloc(sizeof(int)*assureMachines[im].numAvailableFreqs);
+        getAvailableFreqs(assureMachines[im].name, availableFreqs[im], assureMachines[im].numAvailableFreqs);
+    }
+    for (it = 0; it < numTraces; it++)
+    {
+        if (machineName == NULL && traces[it].machine[0] == '\0')
+            printf("Warning: no MACHINE line in %s, using v100-300w.\n", traces[it].path);
+        traceMachine[it] = assureFindMachine(machineName != NULL ? machineName : traces[it].machine);
+        if (traceMachine[it] == NULL)
+            traceMachine[it] = assureFindMachine("v100-300w");
+        totalTicks += traces[it].numTick;
+    }
+    if (recPath != NULL)
+    {
+        rec = fopen(recPath, "w");
+        if (rec == NULL)
+        {
+            printf("Error: cannot write %s.\n", recPath);
+            return 1;
+        }
+        fprintf(rec, "config,trace,tick,gpu,time,freq,power,perf,setfreq\n");
+    }
+
+    printf("Replaying %d trace(s), %ld loops per setting.\n", numTraces, totalTicks);
+    printf("config, perfThres, probDelay, window, time (s), energy (J), energy saving vs MaxFreq, perf loss vs MaxFreq, probes, discarded models, freq sets\n");
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    for (it = 0; it < numThres; it++)
+    for (id = 0; id < numDelay; id++)
+    for (iw = 0; iw < numWindow; iw++)
+    {
+        memset(&res, 0, sizeof(res));
+        windowSize = windowList[iw] >= 1 ? (int)windowList[iw] : 1;
+        for (i = 0; i < numTraces; i++)
+            replayTrace(&traces[i], traceMachine[i], availableFreqs[traceMachine[i] - assureMachines], curves, numCurves,
+                thresList[it], delayList[id], windowSize, useIdlePark, config, rec, &res);
+        printf("%d, %.3f, %.1f, %d, %.1f, %.1f, %.4f, %.4f, %ld, %ld, %ld\n", config, thresList[it], delayList[id], windowSize,
+            res.time, res.energy, res.energyMax > 0 ? 1 - res.energy / res.energyMax : 0, res.workMax > 0 ? 1 - res.work / res.workMax : 0,
+            res.probes, res.discarded, res.sets);
+        config += 1;
+    }
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+    elapsed = (t1.tv_sec - t0.tv_sec) * 1e3 + (t1.tv_nsec - t0.tv_nsec) / 1e6;
+    printf("Replayed %ld loops in %.1f ms (%.0f loops per ms).\n", totalTicks * config, elapsed, totalTicks * config / max(elapsed, 1e-3));
+    if (rec != NULL)
+        fclose(rec);
+    return 0;
+}
+// End of file replay.c
@@ -29,21 +29,48 @@ The dvfs.c and the benchmarks need to be compiled before running this code.
 Run this code using "sudo python3 runExp.py"
 Root privileges are necessary in applying frequency tuning.
 Results are saved to the ./output/ folder.
+
+With "--parallel", the benchmark instances run on all GPUs at once (see allAppsParallel()), e.g.
+"sudo python3 runExp.py --parallel --gpus 0,1,2,3". Each GPU writes its own result stream, allApps_..._gpu<N>.out,
+in the same format as the serial run, so it can be parsed by postprocessing.py with gpuList=[N].
+For a dry run without GPUs, point --benchdir to stub binaries in the same folder layout, --smi to a stub nvidia-smi,
+and add --no-dvfs.
 '''
+import argparse
 import time
 import subprocess
 import os
 import signal
+import threading
 
 def main():
     # policy can be one of: Assure, MaxFreq, EfficientFix, UtilizScale, NVboost.
     # iterations set the number of times each benchmark is launched.
     # suffix is a suffix to the output file name.
     # assurance variable is only effective when policy=='Assure'.
-    allApps(policy='Assure', iterations=2, suffix='_new', startdvfs=True, assurance=90)
+    parser = argparse.ArgumentParser(description='Run the cuda_samples benchmarks under a dvfs policy.')
+    parser.add_argument('--policy', default='Assure')
+    parser.add_argument('--iterations', type=int, default=2)
+    parser.add_argument('--suffix', default='_new')
+    parser.add_argument('--assurance', type=int, default=90)
+    parser.add_argument('--no-dvfs', action='store_true', help='do not start dvfs, e.g. when it is already running')
+    parser.add_argument('--parallel', action='store_true', help='run the benchmark instances on all GPUs concurrently')
+    parser.add_argument('--gpus', default='', help='comma-separated GPU indices for --parallel, default all GPUs')
+    parser.add_argument('--benchdir', default='./cuda_samples/benchmarks')
+    parser.add_argument('--smi', default='nvidia-smi', help='nvidia-smi command used for idle detection')
+    parser.add_argument('--idle-util', type=int, default=0, help='a GPU is idle at or below this utilization (%%)')
+    parser.add_argument('--idle-time', type=float, default=5, help='seconds a GPU must stay idle before the next benchmark')
+    parser.add_argument('--idle-timeout', type=float, default=60, help='max seconds to wait for a GPU to become idle')
+    parser.add_argument('--seed', type=int, default=None, help='seed of the random benchmark order')
+    args = parser.parse_args()
+    if args.parallel:
+        gpus = [int(g) for g in args.gpus.split(',')] if args.gpus else listGpus(args.smi)
+        allAppsParallel(policy=args.policy, iterations=args.iterations, suffix=args.suffix, startdvfs=not args.no_dvfs, assurance=args.assurance,
+            gpus=gpus, benchdir=args.benchdir, smi=args.smi, idleUtil=args.idle_util, idleTime=args.idle_time, idleTimeout=args.idle_timeout, seed=args.seed)
+    else:
+        allApps(policy=args.policy, iterations=args.iterations, suffix=args.suffix, startdvfs=not args.no_dvfs, assurance=args.assurance)
 
-def getAppCmd(app, gpu):
-    cudaSDKdir = './cuda_samples/benchmarks'
+def getAppCmd(app, gpu, cudaSDKdir='./cuda_samples/benchmarks'):
 
     if app=='cudaTensorCoreGemm':
         appcmd = './cudaTensorCoreGemm'
@@ -71,36 +98,50 @@ def getAppCmd(app, gpu):
         workdir = '%s/convolutionFFT2D' % cudaSDKdir
     return appcmd, workdir
 
-def allApps(policy, iterations, suffix, startdvfs, assurance):
-    import random
+apps = ['convolutionFFT2D','reductionMultiBlockCG','fastWalshTransform','BlackScholes','transpose','sortingNetworks','bandwidthTest','cudaTensorCoreGemm']
+
+def outputName(policy, iterations, suffix, assurance):
+    if policy == 'Assure':
+        return 'allApps_%s_p%d_%diter%s' % (policy, assurance, iterations, suffix)
+    return 'allApps_%s_%diter%s' % (policy, iterations, suffix)
+
+def startDvfs(policy, suffix, assurance):
     if policy == 'Assure':
-        outputfile = 'allApps_%s_p%d_%diter%s.out' % (policy, assurance, iterations, suffix)
+        ### dvfs.c version ###
+        dvfscmd = 'sudo DVFS_TRACE=output/dvfs_%s_p%d%s.dtr DVFS_ACCT=output/jobs_%s_p%d%s.jsonl ./dvfs mod %s p%d > output/dvfs_%s_p%d%s.out' % (
+            policy, assurance, suffix, policy, assurance, suffix, policy, assurance, policy, assurance, suffix)# the .dtr binary trace has the same samples, see dvfstrace.py.
+        ### dvfsPython.py version ### use the following line to launch dvfsPython.py ###
+        #dvfscmd = 'sudo python dvfsPython.py %s %d > output/dvfs_%s_p%d%s.out' % (policy, assurance, policy, assurance, suffix)
     else:
-        outputfile = 'allApps_%s_%diter%s.out' % (policy, iterations, suffix)
+        ### dvfs.c version ###
+        dvfscmd = 'sudo DVFS_TRACE=output/dvfs_%s%s.dtr DVFS_ACCT=output/jobs_%s%s.jsonl ./dvfs mod %s > output/dvfs_%s%s.out' % (policy, suffix,
+            policy, suffix, policy, policy, suffix)
+        ### dvfsPython.py version ### use the following line to launch dvfsPython.py ###
+        #dvfscmd = 'sudo python dvfsPython.py %s > output/dvfs_%s%s.out' % (policy, policy, suffix)
+    dvfs = subprocess.Popen(dvfscmd, stdout=subprocess.PIPE, stderr=subprocess.PIPE, shell=True, preexec_fn=os.setsid)# preexec_fn is necessary.
+    print('dvfs process started.')
+    return dvfs
 
-    apps = ['convolutionFFT2D','reductionMultiBlockCG','fastWalshTransform','BlackScholes','transpose','sortingNetworks','bandwidthTest','cudaTensorCoreGemm']
+def resultEnv(name, tag, env=None):
+    # environment of a benchmark run, so it appends its result record (helper_result.h) to output/<name>_results.jsonl.
+    return dict(os.environ if env is None else env, BENCH_RESULT_FILE=os.path.abspath('output/%s_results.jsonl' % name),
+        BENCH_RESULT_TAG=tag)
+
+def allApps(policy, iterations, suffix, startdvfs, assurance):
+    import random
+    name = outputName(policy, iterations, suffix, assurance)
+    outputfile = name + '.out'
 
     print('Starting..')
     outfile = open('output/%s' % outputfile,'w')
 
     if startdvfs:
-        if policy == 'Assure':
-            ### dvfs.c version ###
-            dvfscmd = 'sudo ./dvfs mod %s p%d > output/dvfs_%s_p%d%s.out' % (policy, assurance, policy, assurance, suffix)
-            ### dvfsPython.py version ### use the following line to launch dvfsPython.py ###
-            #dvfscmd = 'sudo python dvfsPython.py %s %d > output/dvfs_%s_p%d%s.out' % (policy, assurance, policy, assurance, suffix)
-        else:
-            ### dvfs.c version ###
-            dvfscmd = 'sudo ./dvfs mod %s > output/dvfs_%s%s.out' % (policy, policy, suffix)
-            ### dvfsPython.py version ### use the following line to launch dvfsPython.py ###
-            #dvfscmd = 'sudo python dvfsPython.py %s > output/dvfs_%s%s.out' % (policy, policy, suffix)
-        dvfs = subprocess.Popen(dvfscmd, stdout=subprocess.PIPE, stderr=subprocess.PIPE, shell=True, preexec_fn=os.setsid)# preexec_fn is necessary.
-        print('dvfs process started.')
+        dvfs = startDvfs(policy, suffix, assurance)
 
     # this one is a warm-up run. Should not be used in results.
     print('Start warm-up run.')
     appcmd, workdir = getAppCmd('cudaTensorCoreGemm', gpu=1)
-    apprun = subprocess.Popen(appcmd, stdout=outfile, stderr=outfile, shell=True, cwd=workdir)
+    apprun = subprocess.Popen(appcmd, stdout=outfile, stderr=outfile, shell=True, cwd=workdir, env=resultEnv(name, 'warmup'))
     apprun.wait()
     outfile.flush()
 
@@ -116,7 +157,8 @@ def allApps(policy, iterations, suffix, startdvfs, assurance):
             outfile.write('Application name: %s\n' % app)
             outfile.flush()
             appcmd, workdir = getAppCmd(app, gpu=1)
-            apprun = subprocess.Popen(appcmd, stdout=outfile, stderr=outfile, shell=True, cwd=workdir) # stderr needs to be added, otherwise the datetime is not included.
+            apprun = subprocess.Popen(appcmd, stdout=outfile, stderr=outfile, shell=True, cwd=workdir,
+                env=resultEnv(name, 'iteration %d' % iteration)) # stderr needs to be added, otherwise the datetime is not included.
             apprun.wait()
             outfile.flush()
 
@@ -128,5 +170,121 @@ def allApps(policy, iterations, suffix, startdvfs, assurance):
     outfile.close()
     print('Finished.')
 
+def listGpus(smi):
+    # indices of all GPUs.
+    out = subprocess.run('%s --query-gpu=index --format=csv,noheader,nounits' % smi, shell=True, stdout=subprocess.PIPE, universal_newlines=True).stdout
+    return [int(x) for x in out.split()]
+
+def gpuUtil(smi, gpu):
+    # utilization of one GPU in percent, -1 if it cannot be read.
+    out = subprocess.run('%s -i %d --query-gpu=utilization.gpu --format=csv,noheader,nounits' % (smi, gpu), shell=True,
+        stdout=subprocess.PIPE, stderr=subprocess.DEVNULL, universal_newlines=True).stdout
+    try:
+        return int(out.split()[0])
+    except (IndexError, ValueError):
+        return -1
+
+def waitIdle(smi, gpu, idleUtil, idleTime, idleTimeout):
+    '''
+    Wait until the GPU stays at or below idleUtil for idleTime seconds, instead of a fixed sleep.
+    Give up after idleTimeout seconds. Return the seconds waited.
+    '''
+    start = time.monotonic()
+    idleSince = None
+    while True:
+        now = time.monotonic()
+        util = gpuUtil(smi, gpu)
+        if 0 <= util <= idleUtil:
+            if idleSince is None:
+                idleSince = now
+            if now - idleSince >= idleTime:
+                break
+        else:
+            idleSince = None
+        if now - start >= idleTimeout:
+            print('GPU %d: not idle after %.f s, utilization %d%%. Starting anyway.' % (gpu, idleTimeout, util))
+            break
+        time.sleep(0.5)
+    return time.monotonic() - start
+
+def writeMarker(outfile, kind, gpu, iteration, app, monotonicNs, wallTime, returncode=None):
+    # precise start/end markers in the result stream. They match none of the lines parsed by postprocessing.py.
+    line = '%s marker: gpu %d, iteration %d, app %s, monotonic_ns %d, time %s' % (kind, gpu, iteration, app, monotonicNs,
+        time.strftime('%Y-%m-%d %H:%M:%S', time.localtime(wallTime)) + '.%03d' % (int(wallTime * 1000) % 1000))
+    if returncode is not None:
+        line += ', returncode %d' % returncode
+    outfile.write(line + '\n')
+    outfile.flush()
+
+def allAppsParallel(policy, iterations, suffix, startdvfs, assurance, gpus, benchdir, smi, idleUtil, idleTime, idleTimeout, seed):
+    '''
+    Run iterations x apps benchmark instances on all GPUs in gpus concurrently.
+    The instances are shuffled into one queue, and every GPU takes the next instance when it is idle, so each GPU runs
+    a random order and the wall time drops roughly in proportion to the number of GPUs. A benchmark is pinned to its GPU
+    by CUDA_VISIBLE_DEVICES, with CUDA_DEVICE_ORDER=PCI_BUS_ID so that the index is the one NVML and waitIdle() use. Before each instance, the GPU must be idle for idleTime seconds (see waitIdle()).
+    Each GPU writes output/<name>_gpu<N>.out, and all instances are listed in output/<name>_schedule.csv.
+    The result records of all instances go to output/<name>_results.jsonl.
+    '''
+    import random
+    name = outputName(policy, iterations, suffix, assurance)
+    rng = random.Random(seed)
+    queue = [(iteration, app) for iteration in range(iterations) for app in apps]
+    rng.shuffle(queue)
+    lock = threading.Lock()
+    schedule = open('output/%s_schedule.csv' % name, 'w')
+    schedule.write('gpu,iteration,app,start,end,start_monotonic_ns,end_monotonic_ns,exetime(s),idlewait(s),returncode\n')
+
+    print('Starting %d benchmark instances on GPUs %s..' % (len(queue), ','.join(str(g) for g in gpus)))
+    expStart = time.monotonic()
+    if startdvfs:
+        dvfs = startDvfs(policy, suffix, assurance)
+
+    def runGpu(gpu):
+        env = dict(os.environ, CUDA_DEVICE_ORDER='PCI_BUS_ID', CUDA_VISIBLE_DEVICES=str(gpu))# the same numbering as NVML and nvidia-smi.
+        outfile = open('output/%s_gpu%d.out' % (name, gpu), 'w')
+        # this one is a warm-up run. Should not be used in results.
+        appcmd, workdir = getAppCmd('cudaTensorCoreGemm', gpu=gpu, cudaSDKdir=benchdir)
+        apprun = subprocess.Popen(appcmd, stdout=outfile, stderr=outfile, shell=True, cwd=workdir, env=resultEnv(name, 'warmup', env))
+        apprun.wait()
+        outfile.flush()
+        while True:
+            with lock:
+                if len(queue) == 0:
+                    break
+                iteration, app = queue.pop()
+            idleWait = waitIdle(smi, gpu, idleUtil, idleTime, idleTimeout)
+            print('GPU %d: %s (iteration %d)' % (gpu, app, iteration))
+            outfile.write('=====================================\n')
+            outfile.write('Iteration %d:\n' % iteration)
+            outfile.write('Application name: %s\n' % app)
+            appcmd, workdir = getAppCmd(app, gpu=gpu, cudaSDKdir=benchdir)
+            startNs, startT = time.monotonic_ns(), time.time()
+            writeMarker(outfile, 'Start', gpu, iteration, app, startNs, startT)
+            apprun = subprocess.Popen(appcmd, stdout=outfile, stderr=outfile, shell=True, cwd=workdir,
+                env=resultEnv(name, 'iteration %d' % iteration, env))
+            returncode = apprun.wait()
+            endNs, endT = time.monotonic_ns(), time.time()
+            outfile.flush()
+            writeMarker(outfile, 'End', gpu, iteration, app, endNs, endT, returncode)
+            with lock:
+                schedule.write('%d,%d,%s,%.3f,%.3f,%d,%d,%.3f,%.1f,%d\n' % (gpu, iteration, app, startT, endT, startNs, endNs,
+                    (endNs - startNs) / 1e9, idleWait, returncode))
+                schedule.flush()
+        outfile.close()
+
+    threads = [threading.Thread(target=runGpu, args=(gpu,)) for gpu in gpus]
+    for thread in threads:
+        thread.start()
+    for thread in threads:
+        thread.join()
+
+    # experiment finished.
+    if startdvfs:
+        time.sleep(10)
+        os.killpg(os.getpgid(dvfs.pid), signal.SIGTERM)
+        print('dvfs process killed.')
+    schedule.close()
+    print('Finished in %.1f s.' % (time.monotonic() - expStart))
+
 if __name__ == '__main__':
     main()
@@ -0,0 +1,763 @@
+/* MIT License
+
+Copyright (c) 2023 Yijia Zhang
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+
+
+ * NVML simulator. Implements the NVML subset in sim/nvml.h on top of a simple GPU model, so that dvfs and measure_latency
+ * run without a GPU or root privileges. Build with "make sim" in the top folder, which produces sim/libnvidia-ml-sim.so and dvfs_sim.
+ * The library is also named libnvidia-ml.so.1, so a binary built against the real NVML runs on it with LD_LIBRARY_PATH=sim.
+ *
+ * GPU model (per device):
+ * - Performance vs SM clock f: perf(f) = min(f, knee) + slope*max(f - knee, 0), normalized to perf(maxClk).
+ *   "compute" has its knee at maxClk, "memory" saturates at 55% of maxClk, "knee" saturates at NVML_SIM_KNEE MHz.
+ *   "phase" alternates compute and memory every NVML_SIM_PHASE seconds, "bursty" runs compute for NVML_SIM_BURST_ON seconds
+ *   and idles for NVML_SIM_BURST_OFF seconds, and "idle" never runs.
+ * - Memory util is proportional to perf (this is what Assure models), plus uniform noise of +-NVML_SIM_NOISE percent.
+ * - Util and power are reported as averages over a sample period of NVML_SIM_SAMPLE_US, as NVML does, so a reading
+ *   mixes in the clock before a set until a full period has passed. nvmlDeviceGetSamples() returns the same samples.
+ * - Power: pStatic + pMem*memUtil + pDyn*activity*(f/maxClk)^3 when busy, pIdle when idle.
+ * - Set calls take NVML_SIM_SET_LATENCY_US, and the new clock is reached NVML_SIM_SETTLE_US later.
+ * - Temperature follows power with a first-order model. Above NVML_SIM_TLIMIT the clock is throttled down gradually.
+ *
+ * Environment variables (defaults in brackets):
+ * NVML_SIM_MACHINE [v100-300w]  clock and power preset: v100-maxq, v100-300w or a100-insp, as MACHINE in dvfs.c.
+ * NVML_SIM_WORKLOAD [compute]   comma-separated workload of each GPU, e.g. "compute,memory,knee:1100,phase,bursty,idle".
+ * NVML_SIM_GPUS                 number of GPUs. The last workload repeats. [number of workloads]
+ * NVML_SIM_KNEE [1200]          default knee of "knee" in MHz.
+ * NVML_SIM_PHASE [10]  NVML_SIM_BURST_ON [2]  NVML_SIM_BURST_OFF [3]  in seconds.
+ * NVML_SIM_NOISE [1]  NVML_SIM_SEED [1]
+ * NVML_SIM_SET_LATENCY_US [13000]  NVML_SIM_SETTLE_US [20000]  NVML_SIM_SAMPLE_US [166667]
+ * NVML_SIM_TAMB [35]  NVML_SIM_RTH [0.2] (C/W)  NVML_SIM_TAU [30] (s)  NVML_SIM_TLIMIT [83]  NVML_SIM_THROTTLE_RATE [150] (MHz/s)
+ * NVML_SIM_PSTATIC  NVML_SIM_PMEM  NVML_SIM_PDYN  NVML_SIM_PIDLE  in W, override the preset.
+ * NVML_SIM_NOPERM [0]           1 makes set calls fail with NVML_ERROR_NO_PERMISSION.
+ * NVML_SIM_DURATION [0]         if > 0, raise SIGINT in the calling process after this many seconds. The model and its
+ *                               statistics stop there, so the report covers exactly this duration.
+ * NVML_SIM_WINDOW [1]  NVML_SIM_THRES [0.9]  a busy window of NVML_SIM_WINDOW seconds whose performance relative to the
+ *                               max clock is below NVML_SIM_THRES counts as a violation of the performance constraint.
+ * NVML_SIM_REPORT               file for the per-GPU summary written at nvmlShutdown(), one "key=value" line per GPU.
+ *                               Without it, a readable summary is printed to stderr.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+#include <signal.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/time.h>
+#include "nvml.h"
+
+#define SIM_MAXGPU 64
+#define SIM_STEP 0.005// integration step in seconds.
+#define SIM_SAMPLES 120// util and power samples kept per device, as in the driver's buffer.
+
+enum simWorkload {SIM_IDLE = 0, SIM_COMPUTE, SIM_MEMORY, SIM_KNEE, SIM_PHASE, SIM_BURSTY};
+static const char* const workloadNames[] = {"idle", "compute", "memory", "knee", "phase", "bursty"};
+
+typedef struct simSample_st
+{
+    double t;// end of the sample period, in seconds since nvmlInit_v2().
+    double gpu, mem, power;// averages over the period.
+} simSample;
+
+typedef struct simGpu_st
+{
+    unsigned int index;
+    enum simWorkload workload;
+    double knee;// MHz, for SIM_KNEE.
+    unsigned int appClk;// 0 if not set.
+    unsigned int lockedClk;// 0 if not set.
+    double pendingClk;// clock requested by the settings, reached at settleAt.
+    double settleAt;
+    double clk;// clock before throttling.
+    double throttleCap;
+    double temp;
+    double lastTime;// time of the last update, in seconds since nvmlInit_v2().
+    unsigned int seed;
+    // state of the last update.
+    int busy;
+    enum simWorkload kind;
+    double perf;
+    double memUtil;
+    double power;// W.
+    // the sample being averaged, and the last SIM_SAMPLES samples. samples[sampleHead] is the next one written.
+    double sampleStart, sampleGpu, sampleMem, samplePower;
+    simSample samples[SIM_SAMPLES];
+    unsigned int sampleHead, sampleCount;
+    // statistics.
+    double energy;// J.
+    double work;
+    double maxWork;
+    double clkTime;// integral of the clock over time.
+    double throttledTime;
+    unsigned int sets;
+    double winStart, winWork, winBusy;// the current window.
+    unsigned int windows, violations;
+} simGpu;
+
+static pthread_mutex_t simLock = PTHREAD_MUTEX_INITIALIZER;
+static int simRefCount = 0;
+static int simRaised = 0;
+static double simStart;
+static unsigned int simCount;
+static simGpu simGpus[SIM_MAXGPU];
+
+// Parameters.
+static double maxClk, minClk, idleClk, memClk;
+static double pIdle, pStatic, pMem, pDyn;
+static double phaseTime, burstOn, burstOff, noise;
+static double setLatency, settleTime, samplePeriod;
+static unsigned long long simWallStart;// gettimeofday() at nvmlInit_v2() in microseconds, for sample timestamps.
+static double tAmb, rTh, tau, tLimit, throttleRate;
+static double duration;
+static double window, winThres;
+static int noPerm;
+
+static double envDouble(const char* name, double def)
+{
+    const char* s = getenv(name);
+    return (s != NULL && s[0] != '\0') ? atof(s) : def;
+}
+
+static double monoTime(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static unsigned int noiseRand(simGpu* g) // LCG, so that runs are repeatable.
+{
+    g->seed = g->seed * 1103515245u + 12345u;
+    return (g->seed >> 16) & 0x7fff;
+}
+
+static void pushSample(simGpu* g, double t) // close the sample period ending at t. The noise is drawn once per sample.
+{
+    simSample* smp = &g->samples[g->sampleHead];
+    double len = t - g->sampleStart;
+    smp->t = t;
+    smp->gpu = 100 * g->sampleGpu / len;
+    smp->mem = g->sampleMem / len;
+    if (smp->gpu > 0 && noise > 0)
+        smp->mem = fmin(fmax(smp->mem + noise * (2.0 * noiseRand(g) / 0x7fff - 1), 0), 100);
+    smp->power = g->samplePower / len;
+    g->sampleHead = (g->sampleHead + 1) % SIM_SAMPLES;
+    if (g->sampleCount < SIM_SAMPLES)
+        g->sampleCount += 1;
+    g->sampleStart = t;
+    g->sampleGpu = 0;
+    g->sampleMem = 0;
+    g->samplePower = 0;
+}
+
+static const simSample* lastSample(simGpu* g) // the newest sample, NULL before the first period ended.
+{
+    return g->sampleCount > 0 ? &g->samples[(g->sampleHead + SIM_SAMPLES - 1) % SIM_SAMPLES] : NULL;
+}
+
+static void currentKind(simGpu* g, double t, int* busy, enum simWorkload* kind) // the workload running at time t.
+{
+    double p;
+    *busy = 1;
+    *kind = g->workload;
+    if (g->workload == SIM_IDLE)
+        *busy = 0;
+    else if (g->workload == SIM_PHASE)
+        *kind = ((long)(t / phaseTime)) % 2 == 0 ? SIM_COMPUTE : SIM_MEMORY;
+    else if (g->workload == SIM_BURSTY)
+    {
+        p = fmod(t, burstOn + burstOff);
+        *kind = SIM_COMPUTE;
+        *busy = p < burstOn;
+    }
+}
+
+static double perfCurve(simGpu* g, enum simWorkload kind, double f) // perf(f) normalized to perf(maxClk).
+{
+    double knee = maxClk, slope = 0;
+    if (kind == SIM_MEMORY)
+    {
+        knee = 0.55 * maxClk;
+        slope = 0.05;
+    }
+    else if (kind == SIM_KNEE)
+        knee = g->knee;
+    return (fmin(f, knee) + slope * fmax(f - knee, 0)) / (fmin(maxClk, knee) + slope * fmax(maxClk - knee, 0));
+}
+
+static double desiredClk(simGpu* g, int busy) // the clock the driver would select with the current settings.
+{
+    if (g->lockedClk > 0)
+        return g->lockedClk;
+    if (!busy)
+        return idleClk;
+    if (g->appClk > 0)
+        return g->appClk;
+    return maxClk;// boost.
+}
+
+static void advance(simGpu* g, double now) // integrate the model up to now. Called with simLock held.
+{
+    static const double memPeak[] = {0, 25, 90, 60};// by kind: idle, compute, memory, knee.
+    static const double activity[] = {0, 1.0, 0.4, 0.7};
+    double t = g->lastTime, dt, f, want;
+    while (t < now)
+    {
+        dt = fmin(SIM_STEP, now - t);
+        t += dt;
+        currentKind(g, t, &g->busy, &g->kind);
+        want = desiredClk(g, g->busy);
+        if (want != g->pendingClk)
+        {
+            g->pendingClk = want;
+            g->settleAt = t + settleTime;
+        }
+        if (t >= g->settleAt)
+            g->clk = g->pendingClk;
+
+        // thermal throttling.
+        if (g->temp > tLimit)
+            g->throttleCap = fmax(g->throttleCap - throttleRate * dt, minClk);
+        else if (g->temp < tLimit - 2)
+            g->throttleCap = fmin(g->throttleCap + throttleRate * dt, maxClk);
+        f = fmin(g->clk, g->throttleCap);
+        if (f < g->clk)
+            g->throttledTime += dt;
+
+        if (g->busy)
+        {
+            g->perf = perfCurve(g, g->kind, f);
+            g->memUtil = memPeak[g->kind] * g->perf;
+            g->power = pStatic + pMem * g->memUtil / 100 + pDyn * activity[g->kind] * pow(f / maxClk, 3);
+            g->work += g->perf * dt;
+            g->maxWork += dt;
+        }
+        else
+        {
+            g->perf = 0;
+            g->memUtil = 0;
+            g->power = pIdle;
+        }
+        g->temp += (tAmb + rTh * g->power - g->temp) * (1 - exp(-dt / tau));
+        g->sampleGpu += g->busy * dt;
+        g->sampleMem += g->memUtil * dt;
+        g->samplePower += g->power * dt;
+        if (t - g->sampleStart >= samplePeriod - 1e-9)
+            pushSample(g, t);
+        g->energy += g->power * dt;
+        g->clkTime += f * dt;
+
+        // performance constraint, checked over windows that are mostly busy.
+        if (g->busy)
+        {
+            g->winWork += g->perf * dt;
+            g->winBusy += dt;
+        }
+        if (t - g->winStart >= window)
+        {
+            if (g->winBusy >= 0.5 * window)
+            {
+                g->windows += 1;
+                if (g->winWork < winThres * g->winBusy)
+                    g->violations += 1;
+            }
+            g->winStart = t;
+            g->winWork = 0;
+            g->winBusy = 0;
+        }
+    }
+    g->lastTime = now;
+}
+
+static simGpu* lockGpu(nvmlDevice_t device) // lock the simulator and bring the device up to date. NULL if invalid.
+{
+    simGpu* g = (simGpu*)device;
+    pthread_mutex_lock(&simLock);
+    if (simRefCount == 0 || g < simGpus || g >= simGpus + simCount)
+    {
+        pthread_mutex_unlock(&simLock);
+        return NULL;
+    }
+    advance(g, duration > 0 ? fmin(monoTime() - simStart, duration) : monoTime() - simStart);// the model stops at the end of the run.
+    return g;
+}
+
+static void unlockGpu(simGpu* g)
+{
+    int raiseNow = 0;
+    if (duration > 0 && !simRaised && g->lastTime >= duration)
+    {
+        simRaised = 1;
+        raiseNow = 1;
+    }
+    pthread_mutex_unlock(&simLock);
+    if (raiseNow)
+        raise(SIGINT);// end the run as if ctrl-c was pressed.
+}
+
+static void setPreset(void)
+{
+    const char* machine = getenv("NVML_SIM_MACHINE");
+    if (machine != NULL && strcmp(machine, "v100-maxq") == 0)
+    {
+        maxClk = 1440; memClk = 810; pIdle = 25; pStatic = 40; pMem = 25; pDyn = 95;
+    }
+    else if (machine != NULL && strcmp(machine, "a100-insp") == 0)
+    {
+        maxClk = 1410; memClk = 1593; pIdle = 55; pStatic = 90; pMem = 60; pDyn = 250;
+    }
+    else // v100-300w.
+    {
+        maxClk = 1530; memClk = 877; pIdle = 40; pStatic = 70; pMem = 40; pDyn = 200;
+    }
+    minClk = 135;
+    idleClk = 135;
+    pIdle = envDouble("NVML_SIM_PIDLE", pIdle);
+    pStatic = envDouble("NVML_SIM_PSTATIC", pStatic);
+    pMem = envDouble("NVML_SIM_PMEM", pMem);
+    pDyn = envDouble("NVML_SIM_PDYN", pDyn);
+}
+
+nvmlReturn_t nvmlInit_v2(void)
+{
+    const char* list;
+    char buf[1024];
+    char* tok;
+    char* save = NULL;
+    unsigned int i, numListed = 0;
+    int gpus;
+    enum simWorkload w;
+    simGpu* g;
+    struct timeval tv;
+
+    pthread_mutex_lock(&simLock);
+    if (simRefCount++ > 0)
+    {
+        pthread_mutex_unlock(&simLock);
+        return NVML_SUCCESS;
+    }
+    setPreset();
+    phaseTime = envDouble("NVML_SIM_PHASE", 10);
+    burstOn = envDouble("NVML_SIM_BURST_ON", 2);
+    burstOff = envDouble("NVML_SIM_BURST_OFF", 3);
+    noise = envDouble("NVML_SIM_NOISE", 1);
+    setLatency = envDouble("NVML_SIM_SET_LATENCY_US", 13000);
+    settleTime = envDouble("NVML_SIM_SETTLE_US", 20000) / 1e6;
+    samplePeriod = fmax(envDouble("NVML_SIM_SAMPLE_US", 166667) / 1e6, SIM_STEP);
+    tAmb = envDouble("NVML_SIM_TAMB", 35);
+    rTh = envDouble("NVML_SIM_RTH", 0.2);
+    tau = envDouble("NVML_SIM_TAU", 30);
+    tLimit = envDouble("NVML_SIM_TLIMIT", 83);
+    throttleRate = envDouble("NVML_SIM_THROTTLE_RATE", 150);
+    duration = envDouble("NVML_SIM_DURATION", 0);
+    window = envDouble("NVML_SIM_WINDOW", 1);
+    winThres = envDouble("NVML_SIM_THRES", 0.9);
+    noPerm = (int)envDouble("NVML_SIM_NOPERM", 0);
+
+    memset(simGpus, 0, sizeof(simGpus));
+    list = getenv("NVML_SIM_WORKLOAD");
+    snprintf(buf, sizeof(buf), "%s", (list != NULL && list[0] != '\0') ? list : "compute");
+    for (tok = strtok_r(buf, ",", &save); tok != NULL && numListed < SIM_MAXGPU; tok = strtok_r(NULL, ",", &save))
+    {
+        g = &simGpus[numListed];
+        g->knee = envDouble("NVML_SIM_KNEE", 1200);
+        for (w = SIM_IDLE; w <= SIM_BURSTY; w++)
+        {
+            if (strncmp(tok, workloadNames[w], strlen(workloadNames[w])) == 0)
+                break;
+        }
+        if (w > SIM_BURSTY)
+        {
+            fprintf(stderr, "NVML simulator: unknown workload %s.\n", tok);
+            simRefCount = 0;
+            pthread_mutex_unlock(&simLock);
+            return NVML_ERROR_INVALID_ARGUMENT;
+        }
+        g->workload = w;
+        if (w == SIM_KNEE && tok[4] == ':')
+            g->knee = atof(tok + 5);
+        numListed += 1;
+    }
+    gpus = (int)envDouble("NVML_SIM_GPUS", numListed);
+    simCount = gpus < 1 ? 1 : (gpus > SIM_MAXGPU ? SIM_MAXGPU : gpus);
+    for (i = 0; i < simCount; i++)
+    {
+        g = &simGpus[i];
+        if (i >= numListed)
+        {
+            g->workload = simGpus[numListed-1].workload;
+            g->knee = simGpus[numListed-1].knee;
+        }
+        g->index = i;
+        g->clk = g->pendingClk = g->workload == SIM_IDLE ? idleClk : maxClk;
+        g->throttleCap = maxClk;
+        g->temp = tAmb + rTh * pIdle;
+        g->seed = (unsigned int)envDouble("NVML_SIM_SEED", 1) + i;
+    }
+    simRaised = 0;
+    simStart = monoTime();
+    gettimeofday(&tv, NULL);
+    simWallStart = tv.tv_sec * 1000000ULL + tv.tv_usec;
+    pthread_mutex_unlock(&simLock);
+    return NVML_SUCCESS;
+}
+
+nvmlReturn_t nvmlInit(void)
+{
+    return nvmlInit_v2();
+}
+
+static void writeReport(void) // per-GPU summary of the run.
+{
+    const char* path = getenv("NVML_SIM_REPORT");
+    FILE* out = NULL;
+    unsigned int i;
+    simGpu* g;
+    if (path != NULL && path[0] != '\0')
+    {
+        out = fopen(path, "w");
+        if (out == NULL)
+            perror("NVML simulator report");
+    }
+    for (i = 0; i < simCount; i++)
+    {
+        g = &simGpus[i];
+        advance(g, duration > 0 ? fmin(monoTime() - simStart, duration) : monoTime() - simStart);
+        if (out != NULL)
+            fprintf(out, "gpu=%u workload=%s time=%.3f energy=%.3f work=%.4f maxwork=%.4f avgclk=%.1f sets=%u throttled=%.3f windows=%u violations=%u\n",
+                g->index, workloadNames[g->workload], g->lastTime, g->energy, g->work, g->maxWork,
+                g->lastTime > 0 ? g->clkTime / g->lastTime : 0, g->sets, g->throttledTime, g->windows, g->violations);
+        else
+            fprintf(stderr, "NVML simulator: GPU %u (%s): %.1f s, energy %.1f J, performance %.1f%% of max clock, avg clock %.0f MHz, %u frequency sets, throttled %.1f s, %u of %u windows below %.2f.\n",
+                g->index, workloadNames[g->workload], g->lastTime, g->energy, g->maxWork > 0 ? 100 * g->work / g->maxWork : 100,
+                g->lastTime > 0 ? g->clkTime / g->lastTime : 0, g->sets, g->throttledTime, g->violations, g->windows, winThres);
+    }
+    if (out != NULL)
+        fclose(out);
+}
+
+nvmlReturn_t nvmlShutdown(void)
+{
+    pthread_mutex_lock(&simLock);
+    if (simRefCount == 0)
+    {
+        pthread_mutex_unlock(&simLock);
+        return NVML_ERROR_UNINITIALIZED;
+    }
+    if (--simRefCount == 0)
+        writeReport();
+    pthread_mutex_unlock(&simLock);
+    return NVML_SUCCESS;
+}
+
+const char* nvmlErrorString(nvmlReturn_t result)
+{
+    switch (result)
+    {
+        case NVML_SUCCESS: return "Success";
+        case NVML_ERROR_UNINITIALIZED: return "Uninitialized";
+        case NVML_ERROR_INVALID_ARGUMENT: return "Invalid Argument";
+        case NVML_ERROR_NOT_SUPPORTED: return "Not Supported";
+        case NVML_ERROR_NO_PERMISSION: return "Insufficient Permissions";
+        case NVML_ERROR_NOT_FOUND: return "Not Found";
+        case NVML_ERROR_INSUFFICIENT_SIZE: return "Insufficient Size";
+        default: return "Unknown Error";
+    }
+}
+
+nvmlReturn_t nvmlDeviceGetCount(unsigned int* deviceCount)
+{
+    if (deviceCount == NULL)
+        return NVML_ERROR_INVALID_ARGUMENT;
+    if (simRefCount == 0)
+        return NVML_ERROR_UNINITIALIZED;
+    *deviceCount = simCount;
+    return NVML_SUCCESS;
+}
+
+nvmlReturn_t nvmlDeviceGetCount_v2(unsigned int* deviceCount)
+{
+    return nvmlDeviceGetCount(deviceCount);
+}
+
+nvmlReturn_t nvmlDeviceGetHandleByIndex(unsigned int index, nvmlDevice_t* device)
+{
+    if (simRefCount == 0)
+        return NVML_ERROR_UNINITIALIZED;
+    if (device == NULL || index >= simCount)
+        return NVML_ERROR_INVALID_ARGUMENT;
+    *device = (nvmlDevice_t)&simGpus[index];
+    return NVML_SUCCESS;
+}
+
+nvmlReturn_t nvmlDeviceGetHandleByIndex_v2(unsigned int index, nvmlDevice_t* device)
+{
+    return nvmlDeviceGetHandleByIndex(index, device);
+}
+
+nvmlReturn_t nvmlDeviceGetUtilizationRates(nvmlDevice_t device, nvmlUtilization_t* utilization)
+{
+    simGpu* g = lockGpu(device);
+    const simSample* smp;
+    if (g == NULL || utilization == NULL)
+    {
+        if (g != NULL)
+            unlockGpu(g);
+        return NVML_ERROR_INVALID_ARGUMENT;
+    }
+    smp = lastSample(g);
+    utilization->gpu = (unsigned int)((smp != NULL ? smp->gpu : 100 * g->busy) + 0.5);
+    utilization->memory = (unsigned int)((smp != NULL ? smp->mem : g->memUtil) + 0.5);
+    unlockGpu(g);
+    return NVML_SUCCESS;
+}
+
+nvmlReturn_t nvmlDeviceGetClockInfo(nvmlDevice_t device, nvmlClockType_t type, unsigned int* clock)
+{
+    simGpu* g = lockGpu(device);
+    if (g == NULL || clock == NULL)
+    {
+        if (g != NULL)
+            unlockGpu(g);
+        return NVML_ERROR_INVALID_ARGUMENT;
+    }
+    if (type == NVML_CLOCK_MEM)
+        *clock = (unsigned int)memClk;
+    else
+        *clock = (unsigned int)(fmin(g->clk, g->throttleCap) + 0.5);
+    unlockGpu(g);
+    return NVML_SUCCESS;
+}
+
+nvmlReturn_t nvmlDeviceGetPowerUsage(nvmlDevice_t device, unsigned int* power)
+{
+    simGpu* g = lockGpu(device);
+    const simSample* smp;
+    if (g == NULL || power == NULL)
+    {
+        if (g != NULL)
+            unlockGpu(g);
+        return NVML_ERROR_INVALID_ARGUMENT;
+    }
+    smp = lastSample(g);
+    *power = (unsigned int)((smp != NULL ? smp->power : g->power) * 1000);
+    unlockGpu(g);
+    return NVML_SUCCESS;
+}
+
+nvmlReturn_t nvmlDeviceGetTotalEnergyConsumption(nvmlDevice_t device, unsigned long long* energy)
+{
+    simGpu* g = lockGpu(device);
+    if (g == NULL || energy == NULL)
+    {
+        if (g != NULL)
+            unlockGpu(g);
+        return NVML_ERROR_INVALID_ARGUMENT;
+    }
+    *energy = (unsigned long long)(g->energy * 1000);
+    unlockGpu(g);
+    return NVML_SUCCESS;
+}
+
+nvmlReturn_t nvmlDeviceGetTemperature(nvmlDevice_t device, int sensorType, unsigned int* temp)
+{
+    simGpu* g = lockGpu(device);
+    (void)sensorType;
+    if (g == NULL || temp == NULL)
+    {
+        if (g != NULL)
+            unlockGpu(g);
+        return NVML_ERROR_INVALID_ARGUMENT;
+    }
+    *temp = (unsigned int)(g->temp + 0.5);
+    unlockGpu(g);
+    return NVML_SUCCESS;
+}
+
+nvmlReturn_t nvmlDeviceGetComputeRunningProcesses(nvmlDevice_t device, unsigned int* infoCount, nvmlProcessInfo_t* infos)
+{
+    simGpu* g = lockGpu(device);
+    unsigned int need;
+    nvmlReturn_t result = NVML_SUCCESS;
+    if (g == NULL || infoCount == NULL)
+    {
+        if (g != NULL)
+            unlockGpu(g);
+        return NVML_ERROR_INVALID_ARGUMENT;
+    }
+    // a bursty job keeps its process between bursts. The simulated process has a fixed pid per GPU.
+    need = g->workload != SIM_IDLE ? 1 : 0;
+    if (*infoCount < need)
+        result = NVML_ERROR_INSUFFICIENT_SIZE;
+    else if (need > 0 && infos != NULL)
+    {
+        infos[0].pid = 990000 + g->index;
+        infos[0].usedGpuMemory = 1ULL << 30;
+        infos[0].gpuInstanceId = 0xFFFFFFFF;
+        infos[0].computeInstanceId = 0xFFFFFFFF;
+    }
+    *infoCount = need;
+    unlockGpu(g);
+    return result;
+}
+
+nvmlReturn_t nvmlDeviceGetComputeRunningProcesses_v2(nvmlDevice_t device, unsigned int* infoCount, nvmlProcessInfo_t* infos)
+{
+    return nvmlDeviceGetComputeRunningProcesses(device, infoCount, infos);
+}
+
+nvmlReturn_t nvmlDeviceGetComputeRunningProcesses_v3(nvmlDevice_t device, unsigned int* infoCount, nvmlProcessInfo_t* infos)
+{
+    return nvmlDeviceGetComputeRunningProcesses(device, infoCount, infos);
+}
+
+nvmlReturn_t nvmlDeviceGetProcessUtilization(nvmlDevice_t device, nvmlProcessUtilizationSample_t* utilization, unsigned int* processSamplesCount, unsigned long long lastSeenTimeStamp)
+{
+    simGpu* g = lockGpu(device);
+    struct timeval tv;
+    unsigned long long now;
+    nvmlReturn_t result = NVML_SUCCESS;
+    if (g == NULL || processSamplesCount == NULL)
+    {
+        if (g != NULL)
+            unlockGpu(g);
+        return NVML_ERROR_INVALID_ARGUMENT;
+    }
+    gettimeofday(&tv, NULL);
+    now = tv.tv_sec * 1000000ULL + tv.tv_usec;
+    if (!g->busy || now <= lastSeenTimeStamp)
+    {
+        *processSamplesCount = 0;
+        result = NVML_ERROR_NOT_FOUND;
+    }
+    else if (*processSamplesCount < 1 || utilization == NULL)
+    {
+        *processSamplesCount = 1;
+        result = NVML_ERROR_INSUFFICIENT_SIZE;
+    }
+    else
+    {
+        utilization[0].pid = 990000 + g->index;
+        utilization[0].timeStamp = now;
+        utilization[0].smUtil = 100;
+        utilization[0].memUtil = (unsigned int)(g->memUtil + 0.5);
+        utilization[0].encUtil = 0;
+        utilization[0].decUtil = 0;
+        *processSamplesCount = 1;
+    }
+    unlockGpu(g);
+    return result;
+}
+
+nvmlReturn_t nvmlDeviceGetSamples(nvmlDevice_t device, nvmlSamplingType_t type, unsigned long long lastSeenTimeStamp, nvmlValueType_t* sampleValType, unsigned int* sampleCount, nvmlSample_t* samples)
+{
+    simGpu* g = lockGpu(device);
+    const simSample* smp;
+    unsigned int s, n = 0;
+    unsigned long long ts;
+    nvmlReturn_t result = NVML_SUCCESS;
+    if (g == NULL || sampleValType == NULL || sampleCount == NULL)
+    {
+        if (g != NULL)
+            unlockGpu(g);
+        return NVML_ERROR_INVALID_ARGUMENT;
+    }
+    if (type != NVML_TOTAL_POWER_SAMPLES && type != NVML_GPU_UTILIZATION_SAMPLES && type != NVML_MEMORY_UTILIZATION_SAMPLES)
+    {
+        unlockGpu(g);
+        return NVML_ERROR_NOT_SUPPORTED;
+    }
+    *sampleValType = NVML_VALUE_TYPE_UNSIGNED_INT;
+    if (samples == NULL)
+        *sampleCount = SIM_SAMPLES;// the buffer size to allocate.
+    else
+    {
+        for (s = 0; s < g->sampleCount; s++) // oldest first.
+        {
+            smp = &g->samples[(g->sampleHead + SIM_SAMPLES - g->sampleCount + s) % SIM_SAMPLES];
+            ts = simWallStart + (unsigned long long)(smp->t * 1e6);
+            if (ts <= lastSeenTimeStamp)
+                continue;
+            if (n >= *sampleCount)
+            {
+                result = NVML_ERROR_INSUFFICIENT_SIZE;
+                break;
+            }
+            samples[n].timeStamp = ts;
+            if (type == NVML_TOTAL_POWER_SAMPLES)
+                samples[n].sampleValue.uiVal = (unsigned int)(smp->power * 1000);// mW.
+            else
+                samples[n].sampleValue.uiVal = (unsigned int)((type == NVML_GPU_UTILIZATION_SAMPLES ? smp->gpu : smp->mem) + 0.5);
+            n += 1;
+        }
+        *sampleCount = n;
+        if (n == 0 && NVML_SUCCESS == result)
+            result = NVML_ERROR_NOT_FOUND;
+    }
+    unlockGpu(g);
+    return result;
+}
+
+static nvmlReturn_t setClock(nvmlDevice_t device, int locked, unsigned int clk) // common part of the set and reset calls. clk 0 resets.
+{
+    simGpu* g;
+    if (noPerm)
+        return NVML_ERROR_NO_PERMISSION;
+    usleep((useconds_t)setLatency);// the driver call is slow, the lock is not held meanwhile.
+    g = lockGpu(device);
+    if (g == NULL)
+        return NVML_ERROR_INVALID_ARGUMENT;
+    if (locked)
+        g->lockedClk = clk;
+    else
+        g->appClk = clk;
+    if (clk > 0)
+        g->sets += 1;
+    unlockGpu(g);
+    return NVML_SUCCESS;
+}
+
+nvmlReturn_t nvmlDeviceSetApplicationsClocks(nvmlDevice_t device, unsigned int memClockMHz, unsigned int graphicsClockMHz)
+{
+    if (memClockMHz != (unsigned int)memClk || graphicsClockMHz < minClk || graphicsClockMHz > maxClk)
+        return NVML_ERROR_INVALID_ARGUMENT;
+    return setClock(device, 0, graphicsClockMHz);
+}
+
+nvmlReturn_t nvmlDeviceSetGpuLockedClocks(nvmlDevice_t device, unsigned int minGpuClockMHz, unsigned int maxGpuClockMHz)
+{
+    if (minGpuClockMHz > maxGpuClockMHz || minGpuClockMHz < minClk || maxGpuClockMHz > maxClk)
+        return NVML_ERROR_INVALID_ARGUMENT;
+    return setClock(device, 1, maxGpuClockMHz);// the clock stays at the top of the range under load.
+}
+
+nvmlReturn_t nvmlDeviceResetApplicationsClocks(nvmlDevice_t device)
+{
+    return setClock(device, 0, 0);
+}
+
+nvmlReturn_t nvmlDeviceResetGpuLockedClocks(nvmlDevice_t device)
+{
+    return setClock(device, 1, 0);
+}
+// End of file nvml_sim.c